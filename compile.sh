@@ -1,8 +1,11 @@
 cd ./cmake-build-debug
-./cool
+# the other modes leave no exe behind, or run the program themselves
+run=1
+for arg in "$@"; do
+    case "$arg" in
+        -S|-emit-llvm|-c|--run|--interp|--vm|--tiered) run=0 ;;
+    esac
+done
+rm -f exe
+./cool "$@" && [ $run = 1 ] && ./exe
 cd ..
-llc -filetype obj ./cmake-build-debug/output.ll -o output.o
-gcc -c runtime/runtime.h runtime/runtime.c
-gcc -o exe output.o runtime.o
-rm runtime.o output.o
-./exe
@@ -6,6 +6,8 @@
 #define COOL_ADT_H
 
 #include <utility>
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 #include <stack>
 #include <string>
@@ -37,6 +39,9 @@ class ScopedTable {
     vector<int> stack;
     int next = 0;
     vector<T> val;
+    // ends[i] is the index following the last descendant of scope i, known
+    // once scope i is finished, -1 before
+    vector<int> ends;
 
     ScopedTable() {
         InitTraverse();
@@ -60,12 +65,14 @@ class ScopedTable {
     void NewScope() {
         stack.push_back(next++);
         val.emplace_back(T());
+        ends.emplace_back(-1);
     }
 
     void FinishScope() {
         if (stack.empty()) {
             throw runtime_error("no scope to finish");
         }
+        ends.at(stack.back()) = next;
         stack.pop_back();
     }
 
@@ -83,6 +90,23 @@ class ScopedTable {
         stack.pop_back();
     }
 
+    // make idx the next scope to enter, without entering or leaving any
+    void Seek(int idx) {
+        if (idx < 0 || idx > val.size()) {
+            throw runtime_error("no scope to seek to");
+        }
+        next = idx;
+    }
+
+    // skip the next scope and all scopes nested in it, as if they were
+    // entered and left
+    void SkipScope() {
+        if (next >= ends.size() || ends[next] < 0) {
+            throw runtime_error("no finished scope to skip");
+        }
+        next = ends[next];
+    }
+
     T& Current() {
         if (stack.empty()) {
             throw runtime_error("no scope to return, call NewScope or EnterScope first");
@@ -91,14 +115,22 @@ class ScopedTable {
     }
 };
 
+//======================================================================//
+//                        SymbolTable Class                             //
+//======================================================================//
+// One scope of the symbol table. It only records which identifiers the
+// scope declares, the IdAttrs themselves live in the enclosing
+// ScopedTableSpecializer<SymbolTable>.
 class SymbolTable {
   private:
-    using IdAttrMap = unordered_map<string, shared_ptr<attr::IdAttr>>;
+    template<typename T> friend class ScopedTableSpecializer;
 
-    int idx;
-    int numLocalId;
-    unordered_map<string, shared_ptr<attr::IdAttr>> ids;
-    repr::Class* cls;
+    int idx = 0;
+    int numLocalId = 0;
+    // (name, index of its IdAttr), scopes are small so a linear scan
+    // beats hashing here
+    vector<pair<Symbol, uint32_t>> ids;
+    repr::Class* cls = nullptr;
 
   public:
     SymbolTable() = default;
@@ -110,22 +142,10 @@ class SymbolTable {
 
     int NextLocalIdIdx() { return numLocalId; }
 
-    bool ContainsId(const string& name) {
-        return ids.find(name) != ids.end();
-    }
-
-    shared_ptr<attr::IdAttr> GetIdAttr(const string& name)  {
-        if (!ContainsId(name)) return nullptr;
-        return ids.at(name);
-    }
-
-    const IdAttrMap & GetIdAttrMap() {
-        return ids;
-    }
-
-    void Insert(attr::IdAttr attr) {
-        if (attr.storageClass == attr::IdAttr::Local) numLocalId++;
-        ids.insert({attr.name, make_shared<attr::IdAttr>(attr)});
+    bool ContainsId(Symbol name) const {
+        for (auto& id : ids)
+            if (id.first == name) return true;
+        return false;
     }
 
     repr::Class* GetClass() {
@@ -136,24 +156,107 @@ class SymbolTable {
 template<typename T>
 class ScopedTableSpecializer : ScopedTable<T> {};
 
+//======================================================================//
+//                 ScopedTableSpecializer<SymbolTable>                  //
+//======================================================================//
+// The scoped symbol table shared by semantic analysis and IR generation.
+// IdAttrs are stored by value in one vector and referred to by index.
+// What is visible in the currently open scopes is kept flat:
+//  - heads[sym.Id()] is the innermost binding of sym, -1 if none
+//  - bindings is a stack of (IdAttr index, shadowed binding), entering a
+//    scope pushes its declarations, leaving it truncates the stack back
+// so a lookup is one array access no matter how deep the scope is.
+// Symbol ids are dense, which is why heads is indexed directly instead
+// of hashed.
 template<>
 class ScopedTableSpecializer<SymbolTable> : public ScopedTable<SymbolTable> {
+  private:
+    struct Binding {
+        uint32_t attr;
+        int32_t prev;
+    };
+
+    vector<attr::IdAttr> attrs;
+    vector<int32_t> heads;
+    vector<Binding> bindings;
+    vector<size_t> marks; // bindings.size() when each open scope was entered
+
+    void bind(uint32_t attrIdx) {
+        uint32_t id = attrs.at(attrIdx).name.Id();
+        if (id >= heads.size())
+            heads.resize(max<size_t>(id + 1, heads.size() * 2), -1);
+        bindings.push_back({attrIdx, heads[id]});
+        heads[id] = bindings.size() - 1;
+    }
+
+    void open() {
+        marks.push_back(bindings.size());
+        for (auto& id : Current().ids) bind(id.second);
+    }
+
+    void close() {
+        if (marks.empty()) return;
+        while (bindings.size() > marks.back()) {
+            heads[attrs.at(bindings.back().attr).name.Id()] = bindings.back().prev;
+            bindings.pop_back();
+        }
+        marks.pop_back();
+    }
+
 public:
+    void InitTraverse() {
+        while (!marks.empty()) close();
+        ScopedTable<SymbolTable>::InitTraverse();
+    }
+
     void NewScope(repr::Class* cls) {
         val.emplace_back(SymbolTable(next, move(cls)));
+        ends.emplace_back(-1);
         stack.push_back(next++);
+        open();
     }
 
-    shared_ptr<attr::IdAttr> GetIdAttr(const string& name) {
-        for (int i = stack.size()-1; i>=0; i--) {
-            auto attr = val.at(stack.at(i)).GetIdAttr(name);
-            if (attr) return attr;
-        }
-        return nullptr;
+    void FinishScope() {
+        close();
+        ScopedTable<SymbolTable>::FinishScope();
+    }
+
+    void EnterScope() {
+        ScopedTable<SymbolTable>::EnterScope();
+        open();
     }
 
+    void LeaveScope() {
+        close();
+        ScopedTable<SymbolTable>::LeaveScope();
+    }
+
+    // index of the innermost visible IdAttr named name, -1 if none
+    int IndexOf(Symbol name) const {
+        if (name.Id() >= heads.size() || heads[name.Id()] < 0) return -1;
+        return bindings[heads[name.Id()]].attr;
+    }
+
+    // the returned pointer is invalidated by the next Insert
+    attr::IdAttr* GetIdAttr(Symbol name) {
+        int i = IndexOf(name);
+        return i < 0 ? nullptr : &attrs[i];
+    }
+
+    attr::IdAttr& IdAttrAt(uint32_t i) { return attrs.at(i); }
+
+    // total number of IdAttrs across all scopes
+    size_t NumIdAttr() const { return attrs.size(); }
+
+    // declare attr in the current scope, a name already declared in the
+    // same scope keeps its first declaration
     void Insert(attr::IdAttr attr) {
-        Current().Insert(attr);
+        auto& scope = Current();
+        if (scope.ContainsId(attr.name)) return;
+        if (attr.storageClass == attr::IdAttr::Local) scope.numLocalId++;
+        attrs.emplace_back(attr);
+        scope.ids.push_back({attr.name, uint32_t(attrs.size() - 1)});
+        bind(attrs.size() - 1);
     }
 
     repr::Class* GetClass() {
@@ -16,6 +16,7 @@
 #include "repr.h"
 #include "token.h"
 #include "constant.h"
+#include "cache.h"
 
 using namespace std;
 using namespace cool;
@@ -27,15 +28,15 @@ repr::Program* ana::InstallBuiltin::operator()(repr::Program* prog, pass::PassCo
 
     for (auto& cls : builtin::NewBuiltinClasses()) {
         if (!prog->AddClass(cls)) {
-            ctx.diag.EmitError(prog->GetClassPtr(cls->GetName().Value())->GetTextInfo(),
+            ctx.diag.EmitError(prog->GetClassPtr(cls->GetName().Sym())->GetTextInfo(),
                 "built-in class '" + cls->GetName().Value() + "' cannot be redefined");
-            prog->DeleteClass(cls->GetName().Value());
+            prog->DeleteClass(cls->GetName().Sym());
             assert(prog->AddClass(cls));
         }
     }
 
     for (auto& cls : prog->GetClasses()) {
-        if (cls->GetParent().Empty() && cls->GetName().Value() != CLS_OBJECT_NAME)
+        if (cls->GetParent().Empty() && cls->GetName().Sym() != SYM_OBJECT)
             cls->SetParent({CLS_OBJECT_NAME, cls->GetParent().TextInfo()});
     }
     return prog;
@@ -52,7 +53,7 @@ repr::Class* ana::CheckBuiltinInheritance::operator()(repr::Class* cls, pass::Pa
 }
 
 repr::Program* ana::BuildInheritanceTree::operator()(repr::Program* prog, pass::PassContext& ctx) {
-    type::TypeAdvisor typeAdvisor(prog->GetClassPtr(CLS_OBJECT_NAME));
+    type::TypeAdvisor typeAdvisor(prog->GetClassPtr(SYM_OBJECT));
 
     vector<repr::Class*> stack;
 
@@ -74,21 +75,21 @@ repr::Program* ana::BuildInheritanceTree::operator()(repr::Program* prog, pass::
     };
 
     for (auto cls : prog->GetClasses()) {
-        unordered_set<string> visiting;
+        unordered_set<Symbol> visiting;
         while (cls) {
-            if (typeAdvisor.Contains(cls->GetName().Value()))
+            if (typeAdvisor.Contains(cls->GetName().Sym()))
                 break;
             stack.emplace_back(cls);
-            if (visiting.find(cls->GetName().Value()) != visiting.end()) {
+            if (visiting.find(cls->GetName().Sym()) != visiting.end()) {
                 emitCycleError(stack, ctx.diag);
                 return prog;
             }
-            visiting.insert(cls->GetName().Value());
-            cls = prog->GetClassPtr(cls->GetParent().Value());
+            visiting.insert(cls->GetName().Sym());
+            cls = prog->GetClassPtr(cls->GetParent().Sym());
         }
         add(stack, typeAdvisor);
     }
-
+    typeAdvisor.BuildIndex();
 
     ctx.Set<type::TypeAdvisor>("type_advisor", typeAdvisor);
     return prog;
@@ -99,7 +100,7 @@ repr::Class* ana::CheckInheritedAttributes::operator()(repr::Class* cls, pass::P
 
     auto check = [&](repr::Class* ancestor) {
         for (auto& field : cls->GetFieldFeatures()) {
-            if (ancestor->GetFieldFeaturePtr(field->GetName().Value())) {
+            if (ancestor->GetFieldFeaturePtr(field->GetName().Sym())) {
                 ctx.diag.EmitError(field->GetTextInfo(),
                     "inherited attribute '" + field->GetName().Value() + "' cannot be redefined");
             }
@@ -107,7 +108,7 @@ repr::Class* ana::CheckInheritedAttributes::operator()(repr::Class* cls, pass::P
         return false;
     };
 
-    typeAdvisor.BottomUpVisit(cls->GetParent().Value(), check);
+    typeAdvisor.BottomUpVisit(cls->GetParent().Sym(), check);
     return cls;
 }
 
@@ -115,20 +116,23 @@ repr::Class* ana::AddInheritedAttributes::operator()(repr::Class* cls, pass::Pas
     using namespace repr;
     auto& typeAdvisor = *ctx.Get<type::TypeAdvisor>("type_advisor");
 
-    vector<FieldFeature*> feats = cls->GetFieldFeatures();
-    for (auto& feat : feats)
-        cls->DeleteFieldFeature(feat->GetName().Value());
+    // inherited fields go first, in the order of the ancestors they
+    // come from, so a class has the layout of its parent as a prefix
+    vector<FieldFeature*> feats = cls->GetOwnFieldFeatures();
+    vector<FieldFeature*> all = cls->GetFieldFeatures();
+    for (auto& feat : all)
+        cls->DeleteFieldFeature(feat->GetName().Sym());
 
     stack<Class*> stack;
-    Class* cur = typeAdvisor.GetTypeRepr(cls->GetParent().Value());
+    Class* cur = typeAdvisor.GetTypeRepr(cls->GetParent().Sym());
     while (cur) {
         stack.push(cur);
-        cur = typeAdvisor.GetTypeRepr(cur->GetParent().Value());
+        cur = typeAdvisor.GetTypeRepr(cur->GetParent().Sym());
     }
 
     while (!stack.empty()) {
         for (auto& field : stack.top()->GetFieldFeatures())
-            cls->AddFieldFeature(field->Clone());
+            cls->AddInheritedFieldFeature(field);
         stack.pop();
     }
 
@@ -141,12 +145,12 @@ repr::Class* ana::CheckInheritedMethods::operator()(repr::Class* cls, pass::Pass
     auto& typeAdvisor = *ctx.Get<type::TypeAdvisor>("type_advisor");
 
     auto valid = [](repr::FuncFeature& a, repr::FuncFeature& b) {
-        if (a.GetName().Value() != b.GetName().Value() ||
-            a.GetType().Value() != b.GetType().Value() ||
+        if (a.GetName().Sym() != b.GetName().Sym() ||
+            a.GetType().Sym() != b.GetType().Sym() ||
             a.GetArgs().size() != b.GetArgs().size())
             return false;
         for(int i = 0; i < a.GetArgs().size(); i++) {
-            if (a.GetArgs().at(i)->GetType().Value() != b.GetArgs().at(i)->GetType().Value())
+            if (a.GetArgs().at(i)->GetType().Sym() != b.GetArgs().at(i)->GetType().Sym())
                 return false;
         }
         return true;
@@ -155,8 +159,8 @@ repr::Class* ana::CheckInheritedMethods::operator()(repr::Class* cls, pass::Pass
     auto check = [&](repr::Class* ancestor) {
         for (auto& func : cls->GetFuncFeatures()) {
 
-            if (ancestor->GetFuncFeaturePtr(func->GetName().Value()) &&
-                !valid(*func, *(ancestor->GetFuncFeaturePtr(func->GetName().Value())))) {
+            if (ancestor->GetFuncFeaturePtr(func->GetName().Sym()) &&
+                !valid(*func, *(ancestor->GetFuncFeaturePtr(func->GetName().Sym())))) {
                 ctx.diag.EmitError(func->GetTextInfo(),
                     "invalid method overload: '" + func->GetName().Value() + "'");
             }
@@ -165,18 +169,18 @@ repr::Class* ana::CheckInheritedMethods::operator()(repr::Class* cls, pass::Pass
         return false;
     };
 
-    typeAdvisor.BottomUpVisit(cls->GetParent().Value(), check);
+    typeAdvisor.BottomUpVisit(cls->GetParent().Sym(), check);
     return cls;
 }
 
 repr::Class* ana::AddInheritedMethods::operator()(repr::Class* cls, pass::PassContext& ctx) {
     auto& typeAdvisor = *ctx.Get<type::TypeAdvisor>("type_advisor");
 
-    auto cur = typeAdvisor.GetTypeRepr(cls->GetParent().Value());
+    auto cur = typeAdvisor.GetTypeRepr(cls->GetParent().Sym());
     while (cur) {
         for (auto& func : cur->GetFuncFeatures())
-            cls->AddFuncFeature(func->Clone());
-        cur = typeAdvisor.GetTypeRepr(cur->GetParent().Value());
+            cls->AddInheritedFuncFeature(func);
+        cur = typeAdvisor.GetTypeRepr(cur->GetParent().Sym());
     }
 
     return cls;
@@ -202,9 +206,11 @@ repr::Program* ana::InitSymbolTable::operator()(repr::Program* prog, pass::PassC
             }, nullptr)
         }
 
+        // bodies are only visited in the class defining them, inherited
+        // fields are still declared since their indices are per class
         void Visit(repr::Class* cls) {
             NEW_SCOPE_GUARD(stable, {
-                for (auto &feat : cls->GetFuncFeatures()) Visit(*feat);
+                for (auto &feat : cls->GetOwnFuncFeatures()) Visit(*feat);
                 for (int i = 0; i < cls->GetFieldFeatures().size(); i++)
                     Visit(*cls->GetFieldFeatures().at(i), i);
             }, cls)
@@ -219,18 +225,18 @@ repr::Program* ana::InitSymbolTable::operator()(repr::Program* prog, pass::PassC
         }
 
         void Visit(repr::FieldFeature &feat, int idx) {
-            stable.Current().Insert(IdAttr{IdAttr::Field, idx, feat.GetName().Value(), feat.GetType().Value()});
-            if (feat.GetExpr())
+            stable.Insert(IdAttr{IdAttr::Field, idx, feat.GetName().Sym(), feat.GetType().Sym()});
+            if (feat.GetExpr() && !stable.GetClass()->IsInherited(&feat))
                 ExprVisitor::Visit(*feat.GetExpr());
         }
 
         void Visit(repr::Formal &form, int idx) {
-            stable.Current().Insert(IdAttr{IdAttr::Arg, idx, form.GetName().Value(), form.GetType().Value()});
+            stable.Insert(IdAttr{IdAttr::Arg, idx, form.GetName().Sym(), form.GetType().Sym()});
         }
 
         void Visit_(repr::LinkBuiltin& expr) {}
 
-        void Visit_(repr::Assign& expr) {}
+        void Visit_(repr::Assign& expr) { ExprVisitor::Visit(*expr.GetExpr()); }
 
         void Visit_(repr::Add& expr) { VisitBinary(expr); }
 
@@ -245,8 +251,8 @@ repr::Program* ana::InitSymbolTable::operator()(repr::Program* prog, pass::PassC
             ExprVisitor::Visit(*expr.GetExpr());
             for (auto& branch : expr.GetBranches()) {
                 NEW_SCOPE_GUARD(stable, {
-                    stable.Current().Insert(IdAttr{IdAttr::Local, stable.Current().NextLocalIdIdx(),
-                                                   branch->GetId().Value(), branch->GetType().Value()});
+                    stable.Insert(IdAttr{IdAttr::Local, stable.Current().NextLocalIdIdx(),
+                                                   branch->GetId().Sym(), branch->GetType().Sym()});
                     ExprVisitor::Visit(*branch->GetExpr());
                 }, stable.GetClass())
             }
@@ -291,8 +297,8 @@ repr::Program* ana::InitSymbolTable::operator()(repr::Program* prog, pass::PassC
             for (int i = 0; i < decls.size(); i++) {
                 stable.NewScope(stable.GetClass());
                 auto* decl = decls.at(i);
-                stable.Current().Insert(IdAttr{IdAttr::Local, stable.Current().NextLocalIdIdx(),
-                                               decl->GetName().Value(), decl->GetType().Value()});
+                stable.Insert(IdAttr{IdAttr::Local, stable.Current().NextLocalIdIdx(),
+                                               decl->GetName().Sym(), decl->GetType().Sym()});
                 if (decl->GetExpr())
                     ExprVisitor::Visit(*decl->GetExpr());
             }
@@ -345,23 +351,31 @@ repr::Program* ana::TypeChecking::operator()(repr::Program* prog, pass::PassCont
     using namespace builtin;
     using namespace tok;
 
-    using TypeName = string;
+    using TypeName = Symbol;
 
     class Visitor : public ProgramVisitor<void>, ClassVisitor<void>, FuncFeatureVisitor<void>,
         FieldFeatureVisitor<void>, FormalVisitor<void>, ExprVisitor<TypeName> {
       private:
         string invalidAssignmentMsg(const TypeName& assignType, const TypeName& toType) {
-            return string("cannot assign value of '" + assignType + "' to '" + toType +  "'");
+            return string("cannot assign value of '" + assignType.Str() + "' to '" + toType.Str() +  "'");
         }
 
         string idNotFound(const TypeName& id) {
-            return string("identifier '" + id + "' not found");
+            return string("identifier '" + id.Str() + "' not found");
+        }
+
+        // the type of expr, kept on it for code generation
+        TypeName Check(repr::Expr& expr) {
+            auto type = ExprVisitor<TypeName>::Visit(expr);
+            expr.SetStaticType(type);
+            return type;
         }
 
     public:
         pass::PassContext& ctx;
         ScopedTableSpecializer<SymbolTable>& stable;
         type::TypeAdvisor& typeAdvisor;
+        cache::CachedClasses* cached = nullptr;
 
         Visitor(pass::PassContext& _ctx, ScopedTableSpecializer<SymbolTable>& _stable, type::TypeAdvisor& _typeAdvisor)
         : ctx(_ctx), stable(_stable), typeAdvisor(_typeAdvisor) {
@@ -373,26 +387,33 @@ repr::Program* ana::TypeChecking::operator()(repr::Program* prog, pass::PassCont
         }
 
         void Visit(repr::Class &cls) {
+            // a cached class passed type checking when it was stored, and
+            // neither it nor any interface it can see has changed since
+            if (cached && cached->count(cls.GetName().Sym())) {
+                stable.SkipScope();
+                return;
+            }
+            // same order as InitSymbolTable, so scopes line up
             ENTER_SCOPE_GUARD(stable, {
-                for (auto& feat : cls.GetFieldFeatures())
+                for (auto& feat : cls.GetOwnFuncFeatures())
                     Visit(*feat);
-                for (auto& feat : cls.GetFuncFeatures())
+                for (auto& feat : cls.GetOwnFieldFeatures())
                     Visit(*feat);
             })
         }
 
         void Visit(repr::FieldFeature &feat) {
             if (!feat.GetExpr()) return;
-            TypeName exprType = ExprVisitor<TypeName>::Visit(*feat.GetExpr());
-            if (!typeAdvisor.Conforms(exprType, feat.GetType().Value(), stable.GetClass()->GetName().Value()))
-                ctx.diag.EmitError(feat.GetTextInfo(), invalidAssignmentMsg(exprType, feat.GetType().Value()));
+            TypeName exprType = Check(*feat.GetExpr());
+            if (!typeAdvisor.Conforms(exprType, feat.GetType().Sym(), stable.GetClass()->GetName().Sym()))
+                ctx.diag.EmitError(feat.GetTextInfo(), invalidAssignmentMsg(exprType, feat.GetType().Sym()));
         }
 
         void Visit(repr::FuncFeature &feat) {
             ENTER_SCOPE_GUARD(stable, {
-                TypeName exprType = ExprVisitor<TypeName>::Visit(*feat.GetExpr());
-                if (!typeAdvisor.Conforms(exprType, feat.GetType().Value(), stable.GetClass()->GetName().Value()))
-                    ctx.diag.EmitError(feat.GetTextInfo(), invalidAssignmentMsg(exprType, feat.GetType().Value()));
+                TypeName exprType = Check(*feat.GetExpr());
+                if (!typeAdvisor.Conforms(exprType, feat.GetType().Sym(), stable.GetClass()->GetName().Sym()))
+                    ctx.diag.EmitError(feat.GetTextInfo(), invalidAssignmentMsg(exprType, feat.GetType().Sym()));
             })
         }
 
@@ -401,56 +422,56 @@ repr::Program* ana::TypeChecking::operator()(repr::Program* prog, pass::PassCont
         TypeName Visit_(repr::LinkBuiltin& expr) { return expr.GetType(); }
 
         TypeName Visit_(repr::Assign& expr) {
-            auto exprType = ExprVisitor<TypeName>::Visit(*expr.GetExpr());
-            auto idAttr = stable.GetIdAttr(expr.GetId()->GetName().Value());
+            auto exprType = Check(*expr.GetExpr());
+            auto idAttr = stable.GetIdAttr(expr.GetId()->GetName().Sym());
             if (!idAttr)
                 ctx.diag.EmitError(expr.GetId()->GetTextInfo(), idNotFound(expr.GetId()->GetName().Value()));
-            else if (!typeAdvisor.Conforms(exprType, idAttr->type, stable.GetClass()->GetName().Value()))
+            else if (!typeAdvisor.Conforms(exprType, idAttr->type, stable.GetClass()->GetName().Sym()))
                 ctx.diag.EmitError(expr.GetExpr()->GetTextInfo(), invalidAssignmentMsg(exprType, idAttr->type));
             return exprType;
         }
 
         TypeName Visit_(repr::Add& expr) {
-            if (ExprVisitor<TypeName>::Visit(*expr.GetLeft()) != CLS_INT_NAME)
+            if (Check(*expr.GetLeft()) != SYM_INT)
                 ctx.diag.EmitError(expr.GetLeft()->GetTextInfo(), "operand for '+' must be 'Int'");
-            if (ExprVisitor<TypeName>::Visit(*expr.GetRight()) != CLS_INT_NAME)
+            if (Check(*expr.GetRight()) != SYM_INT)
                 ctx.diag.EmitError(expr.GetRight()->GetTextInfo(), "operand for '+' must be 'Int'");
-            return CLS_INT_NAME;
+            return SYM_INT;
         }
 
         TypeName Visit_(repr::Block& expr) {
             TypeName rType;
             ENTER_SCOPE_GUARD(stable, {
                 for (int i = 0; i < expr.GetExprs().size() - 1; i++)
-                    ExprVisitor<TypeName>::Visit(*expr.GetExprs().at(i));
-                rType = ExprVisitor<TypeName>::Visit(*expr.GetExprs().back());
+                    Check(*expr.GetExprs().at(i));
+                rType = Check(*expr.GetExprs().back());
             })
             return rType;;
         }
 
         TypeName Visit_(repr::Case& expr) {
-            unordered_set<TypeName> typeSet;
+            expr.SetExprType(Check(*expr.GetExpr()));
+            unordered_set<Symbol> branchTypes;
             vector<TypeName> types;
             for (auto& branch : expr.GetBranches()) {
                 ENTER_SCOPE_GUARD(stable, {
-                    auto type = ExprVisitor<TypeName>::Visit(*branch->GetExpr());
-                    if (typeSet.find(type) != typeSet.end())
+                    if (!branchTypes.insert(branch->GetType().Sym()).second)
                         ctx.diag.EmitError(branch->GetType().TextInfo(),
-                            "duplicate type '" + type + "' in case expression");
-                    typeSet.insert(type);
-                    types.emplace_back(type);
+                            "duplicate type '" + branch->GetType().Value() + "' in case expression");
+                    types.emplace_back(Check(*branch->GetExpr()));
                 })
             }
-            return typeAdvisor.LeastCommonAncestor(types);
+            expr.SetType(typeAdvisor.LeastCommonAncestor(types));
+            return expr.GetType();
         }
 
         TypeName Visit_(repr::Call& expr) {
             TypeName rType;
             ENTER_SCOPE_GUARD(stable,
-                auto funcPtr = CheckCall(stable.GetClass()->GetName().Value(), expr);
+                auto funcPtr = CheckCall(stable.GetClass()->GetName().Sym(), expr);
                 if (funcPtr) {
                     expr.SetLink(funcPtr);
-                    rType = funcPtr->GetType().Value();
+                    rType = funcPtr->GetType().Sym();
                 })
             return rType;
         }
@@ -459,11 +480,13 @@ repr::Program* ana::TypeChecking::operator()(repr::Program* prog, pass::PassCont
             TypeName rType;
             ENTER_SCOPE_GUARD(stable,
                 auto callExpr = static_cast<repr::Call*>(expr.GetRight());
-                expr.SetType(ExprVisitor<TypeName>::Visit(*expr.GetLeft()));
+                expr.SetType(Check(*expr.GetLeft()));
                 auto funcPtr = CheckCall(expr.GetType(), *callExpr);
                 if (funcPtr) {
                     callExpr->SetLink(funcPtr);
-                    rType = funcPtr->GetType().Value();
+                    rType = funcPtr->GetType().Sym();
+                    // the receiver's SELF_TYPE rather than self's
+                    if (rType == SYM_SELF_TYPE) rType = expr.GetType();
                 })
             return rType;
         }
@@ -471,10 +494,10 @@ repr::Program* ana::TypeChecking::operator()(repr::Program* prog, pass::PassCont
         repr::FuncFeature* CheckCall(TypeName type, repr::Call& expr) {
             auto cls = typeAdvisor.GetTypeRepr(type);
             if (!cls) {
-                ctx.diag.EmitError(expr.GetTextInfo(), "caller type '" + type + "' not found");
+                ctx.diag.EmitError(expr.GetTextInfo(), "caller type '" + type.Str() + "' not found");
                 return nullptr;
             }
-            auto funcPtr = cls->GetFuncFeaturePtr(expr.GetId()->GetName().Value());
+            auto funcPtr = cls->GetFuncFeaturePtr(expr.GetId()->GetName().Sym());
             if (!funcPtr) {
                 ctx.diag.EmitError(expr.GetTextInfo(), "method '" + expr.GetId()->GetName().Value() + "' not found");
                 return nullptr;
@@ -485,13 +508,13 @@ repr::Program* ana::TypeChecking::operator()(repr::Program* prog, pass::PassCont
                 return funcPtr;
             }
             for (int i = 0; i < expr.GetArgs().size(); i++) {
-                auto& arg = expr.GetArgs().at(i);
-                TypeName got = ExprVisitor<TypeName>::Visit(*arg);
-                TypeName expected = funcPtr->GetArgs().at(i)->GetType().Value();
+                auto arg = expr.GetArgs().at(i);
+                TypeName got = Check(*arg);
+                TypeName expected = funcPtr->GetArgs().at(i)->GetType().Sym();
                 if (!typeAdvisor.Conforms(got, expected, got)) {
                     ctx.diag.EmitError(expr.GetTextInfo(), "invalid argument '" +
-                    funcPtr->GetArgs().at(i)->GetName().Value() + "': expected '" + expected +
-                    "', got '" + got + "'");
+                    funcPtr->GetArgs().at(i)->GetName().Value() + "': expected '" + expected.Str() +
+                    "', got '" + got.Str() + "'");
                     return funcPtr;
                 }
             }
@@ -499,64 +522,69 @@ repr::Program* ana::TypeChecking::operator()(repr::Program* prog, pass::PassCont
         }
 
         TypeName Visit_(repr::Divide& expr) {
-            if (ExprVisitor<TypeName>::Visit(*expr.GetLeft()) != CLS_INT_NAME)
+            if (Check(*expr.GetLeft()) != SYM_INT)
                 ctx.diag.EmitError(expr.GetLeft()->GetTextInfo(), "operand for '/' must be 'Int'");
-            if (ExprVisitor<TypeName>::Visit(*expr.GetRight()) != CLS_INT_NAME)
+            if (Check(*expr.GetRight()) != SYM_INT)
                 ctx.diag.EmitError(expr.GetRight()->GetTextInfo(), "operand for '/' must be 'Int'");
-            return CLS_INT_NAME;
+            return SYM_INT;
         }
 
         TypeName Visit_(repr::Equal& expr) {
-            auto leftType = ExprVisitor<TypeName>::Visit(*expr.GetLeft());
-            auto rightType = ExprVisitor<TypeName>::Visit(*expr.GetRight());
-            if (((leftType == CLS_INT_NAME || leftType == CLS_STRING_NAME || leftType == CLS_BOOL_NAME) ||
-                (rightType == CLS_INT_NAME || rightType == CLS_STRING_NAME || rightType == CLS_BOOL_NAME)) &&
+            auto leftType = Check(*expr.GetLeft());
+            auto rightType = Check(*expr.GetRight());
+            if (((leftType == SYM_INT || leftType == SYM_STRING || leftType == SYM_BOOL) ||
+                (rightType == SYM_INT || rightType == SYM_STRING || rightType == SYM_BOOL)) &&
                 (leftType != rightType))
                 ctx.diag.EmitError(expr.GetRight()->GetTextInfo(), "'Int', 'String', 'Bool' can only be compared with the same type");
-            return CLS_BOOL_NAME;
+            return SYM_BOOL;
         }
 
-        TypeName Visit_(repr::False& expr) { return CLS_BOOL_NAME; }
+        TypeName Visit_(repr::False& expr) { return SYM_BOOL; }
 
         TypeName Visit_(repr::ID& expr) {
-            auto idAttr = stable.GetIdAttr(expr.GetName().Value());
+            auto idAttr = stable.GetIdAttr(expr.GetName().Sym());
             if (!idAttr) {
                 ctx.diag.EmitError(expr.GetTextInfo(), idNotFound(expr.GetName().Value()));
-                return "";
+                return Symbol();
             }
             return idAttr->type;
         }
 
         TypeName Visit_(repr::IsVoid& expr) {
-            ExprVisitor<TypeName>::Visit(*expr.GetExpr());
-            return CLS_BOOL_NAME;
+            Check(*expr.GetExpr());
+            return SYM_BOOL;
         }
 
-        TypeName Visit_(repr::Integer& expr) { return CLS_INT_NAME; }
+        TypeName Visit_(repr::Integer& expr) { return SYM_INT; }
 
         TypeName Visit_(repr::If& expr) {
-            if (ExprVisitor<TypeName>::Visit(*expr.GetIfExpr()) != CLS_BOOL_NAME)
-                ctx.diag.EmitError(expr.GetIfExpr()->GetTextInfo(), "predicate in if statement must be 'Bool'");
-            expr.SetType(typeAdvisor.LeastCommonAncestor(
-                ExprVisitor<TypeName>::Visit(*expr.GetThenExpr()),
-                ExprVisitor<TypeName>::Visit(*expr.GetElseExpr())));
+            // same scopes as InitSymbolTable
+            TypeName thenType;
+            TypeName elseType;
+            ENTER_SCOPE_GUARD(stable, {
+                if (Check(*expr.GetIfExpr()) != SYM_BOOL)
+                    ctx.diag.EmitError(expr.GetIfExpr()->GetTextInfo(), "predicate in if statement must be 'Bool'");
+                ENTER_SCOPE_GUARD(stable, thenType = Check(*expr.GetThenExpr()))
+                ENTER_SCOPE_GUARD(stable, elseType = Check(*expr.GetElseExpr()))
+                expr.SetType(typeAdvisor.LeastCommonAncestor(thenType, elseType));
+            })
             return expr.GetType();
         }
 
         TypeName Visit_(repr::LessThanOrEqual& expr) {
-            if (ExprVisitor<TypeName>::Visit(*expr.GetLeft()) != CLS_INT_NAME)
+            if (Check(*expr.GetLeft()) != SYM_INT)
                 ctx.diag.EmitError(expr.GetLeft()->GetTextInfo(), "operand for '<=' must be 'Int'");
-            if (ExprVisitor<TypeName>::Visit(*expr.GetRight()) != CLS_INT_NAME)
+            if (Check(*expr.GetRight()) != SYM_INT)
                 ctx.diag.EmitError(expr.GetRight()->GetTextInfo(), "operand for '<=' must be 'Int'");
-            return CLS_BOOL_NAME;
+            return SYM_BOOL;
         }
 
         TypeName Visit_(repr::LessThan& expr) {
-            if (ExprVisitor<TypeName>::Visit(*expr.GetLeft()) != CLS_INT_NAME)
+            if (Check(*expr.GetLeft()) != SYM_INT)
                 ctx.diag.EmitError(expr.GetLeft()->GetTextInfo(), "operand for '<' must be 'Int'");
-            if (ExprVisitor<TypeName>::Visit(*expr.GetRight()) != CLS_INT_NAME)
+            if (Check(*expr.GetRight()) != SYM_INT)
                 ctx.diag.EmitError(expr.GetRight()->GetTextInfo(), "operand for '<' must be 'Int'");
-            return CLS_BOOL_NAME;
+            return SYM_BOOL;
         }
 
         TypeName Visit_(repr::Let& expr) {
@@ -566,68 +594,127 @@ repr::Program* ana::TypeChecking::operator()(repr::Program* prog, pass::PassCont
                 stable.EnterScope();
                 auto* decl = decls.at(i);
                 if (decl->GetExpr()) {
-                    auto exprType = ExprVisitor<TypeName>::Visit(*decl->GetExpr());
-                    if (!typeAdvisor.Conforms(exprType, decl->GetType().Value(), stable.GetClass()->GetName().Value()))
+                    auto exprType = Check(*decl->GetExpr());
+                    if (!typeAdvisor.Conforms(exprType, decl->GetType().Sym(), stable.GetClass()->GetName().Sym()))
                         ctx.diag.EmitError(decl->GetExpr()->GetTextInfo(),
-                            invalidAssignmentMsg(exprType, decl->GetType().Value()));
+                            invalidAssignmentMsg(exprType, decl->GetType().Sym()));
                 }
             }
-            rType = ExprVisitor<TypeName>::Visit(*expr.GetExpr());
+            rType = Check(*expr.GetExpr());
             for (int i = 0; i < expr.GetDecls().size(); i++) stable.LeaveScope();
             return rType;
         }
 
         TypeName Visit_(repr::Multiply& expr) {
-            if (ExprVisitor<TypeName>::Visit(*expr.GetLeft()) != CLS_INT_NAME)
+            if (Check(*expr.GetLeft()) != SYM_INT)
                 ctx.diag.EmitError(expr.GetLeft()->GetTextInfo(), "operand for '*' must be 'Int'");
-            if (ExprVisitor<TypeName>::Visit(*expr.GetRight()) != CLS_INT_NAME)
+            if (Check(*expr.GetRight()) != SYM_INT)
                 ctx.diag.EmitError(expr.GetRight()->GetTextInfo(), "operand for '*' must be 'Int'");
-            return CLS_INT_NAME;
+            return SYM_INT;
         }
 
         TypeName Visit_(repr::Minus& expr) {
-            if (ExprVisitor<TypeName>::Visit(*expr.GetLeft()) != CLS_INT_NAME)
+            if (Check(*expr.GetLeft()) != SYM_INT)
                 ctx.diag.EmitError(expr.GetLeft()->GetTextInfo(), "operand for '-' must be 'Int'");
-            if (ExprVisitor<TypeName>::Visit(*expr.GetRight()) != CLS_INT_NAME)
+            if (Check(*expr.GetRight()) != SYM_INT)
                 ctx.diag.EmitError(expr.GetRight()->GetTextInfo(), "operand for '-' must be 'Int'");
-            return CLS_INT_NAME;
+            return SYM_INT;
         }
 
         TypeName Visit_(repr::Negate& expr) {
-            if (ExprVisitor<TypeName>::Visit(*expr.GetExpr()) != CLS_INT_NAME)
+            if (Check(*expr.GetExpr()) != SYM_INT)
                 ctx.diag.EmitError(expr.GetTextInfo(), "operand for '~' must be 'Int'");
-            return CLS_INT_NAME;
+            return SYM_INT;
         }
 
         TypeName Visit_(repr::New& expr) {
-            return expr.GetType().Value();
+            return expr.GetType().Sym();
         }
 
         TypeName Visit_(repr::Not& expr) {
-            if (ExprVisitor<TypeName>::Visit(*expr.GetExpr()) != CLS_BOOL_NAME)
+            if (Check(*expr.GetExpr()) != SYM_BOOL)
                 ctx.diag.EmitError(expr.GetTextInfo(), "operand for 'not' must be 'Int'");
-            return CLS_BOOL_NAME;
+            return SYM_BOOL;
         }
 
-        TypeName Visit_(repr::String& expr) { return CLS_STRING_NAME; }
+        TypeName Visit_(repr::String& expr) { return SYM_STRING; }
 
-        TypeName Visit_(repr::True& expr) { return CLS_BOOL_NAME; }
+        TypeName Visit_(repr::True& expr) { return SYM_BOOL; }
 
         TypeName Visit_(repr::While& expr) {
             ENTER_SCOPE_GUARD(stable, {
-                if (ExprVisitor<TypeName>::Visit(*expr.GetWhileExpr()) != CLS_BOOL_NAME)
+                if (Check(*expr.GetWhileExpr()) != SYM_BOOL)
                     ctx.diag.EmitError(expr.GetTextInfo(), "predicate in while expression must be 'Bool'");
-                ExprVisitor<TypeName>::Visit(*expr.GetLoopExpr());
+                Check(*expr.GetLoopExpr());
             })
-            return CLS_OBJECT_NAME;
+            return SYM_OBJECT;
         }
     };
 
     auto stable = ctx.Get<ScopedTableSpecializer<SymbolTable>>("symbol_table");
     auto typeAdvisor = ctx.Get<type::TypeAdvisor>("type_advisor");
 
-    Visitor vis(ctx, *stable, *typeAdvisor);
-    vis.Visit(*prog);
+    shared_ptr<cache::CachedClasses> cached;
+    if (ctx.Contains("cached_classes"))
+        cached = ctx.Get<cache::CachedClasses>("cached_classes");
+
+    if (!ctx.pool) {
+        Visitor vis(ctx, *stable, *typeAdvisor);
+        vis.cached = cached.get();
+        vis.Visit(*prog);
+        return prog;
+    }
+
+    // one task per method, plus one per class for its field initializers.
+    // Tasks find their scopes through ScopedTable::ends, and each worker
+    // walks a private copy of the symbol table.
+    struct Task {
+        repr::Class* cls;
+        repr::FuncFeature* func; // nullptr for the field initializers
+        int clsScope;
+        int scope;
+    };
+    vector<Task> tasks;
+    int clsScope = 1; // scope 0 is the program
+    for (auto& cls : prog->GetClasses()) {
+        if (!cached || !cached->count(cls->GetName().Sym())) {
+            int scope = clsScope + 1;
+            for (auto& func : cls->GetOwnFuncFeatures()) {
+                tasks.push_back({cls, func, clsScope, scope});
+                scope = stable->ends.at(scope);
+            }
+            tasks.push_back({cls, nullptr, clsScope, scope});
+        }
+        clsScope = stable->ends.at(clsScope);
+    }
+
+    // tasks are in the order the serial visitor goes, and so are their
+    // diagnoses once appended
+    vector<diag::Diagnosis> diags(tasks.size());
+    vector<diag::Diagnosis*> taskDiags;
+    for (auto& d : diags) taskDiags.emplace_back(&d);
+    vector<unique_ptr<ScopedTableSpecializer<SymbolTable>>> stables(ctx.pool->Size());
+    pass::ParallelFor(prog, ctx, taskDiags, [&](size_t i, size_t worker, pass::PassContext& local) {
+        if (!stables[worker])
+            stables[worker].reset(new ScopedTableSpecializer<SymbolTable>(*stable));
+        auto& wstable = *stables[worker];
+        auto& task = tasks[i];
+
+        Visitor vis(local, wstable, *typeAdvisor);
+        wstable.EnterScope();
+        wstable.Seek(task.clsScope);
+        ENTER_SCOPE_GUARD(wstable, {
+            wstable.Seek(task.scope);
+            if (task.func) {
+                vis.Visit(*task.func);
+            } else {
+                for (auto& feat : task.cls->GetOwnFieldFeatures())
+                    vis.Visit(*feat);
+            }
+        })
+        wstable.LeaveScope();
+    });
+    for (auto& d : diags) ctx.diag.Append(d);
     return prog;
 }
 
@@ -648,30 +735,30 @@ repr::Program* ana::EliminateSelfType::operator()(repr::Program* prog, pass::Pas
         }
 
         void Visit(repr::Class &cls) {
+            // same order as InitSymbolTable, so scopes line up
             ENTER_SCOPE_GUARD(stable, {
-                for (auto& feat : cls.GetFieldFeatures())
+                for (auto& feat : cls.GetOwnFuncFeatures())
                     Visit(*feat);
-                for (auto& feat : cls.GetFuncFeatures())
+                for (auto& feat : cls.GetOwnFieldFeatures())
                     Visit(*feat);
             })
         }
 
         void Visit(repr::FieldFeature &feat) {
-            if (feat.GetType().Value() == TYPE_SELF_TYPE)
+            if (feat.GetType().Sym() == SYM_SELF_TYPE)
                 feat.SetType({
-                    stable.GetClass()->GetName().Value(),
+                    stable.GetClass()->GetName().Sym(),
                     feat.GetType().TextInfo()
                 });
             if (feat.GetExpr())
                 Visit(*feat.GetExpr());
         }
 
+        // a method returning SELF_TYPE keeps it, the method is shared with
+        // the subclasses and returns theirs. Code generation resolves it
+        // per call.
         void Visit(repr::FuncFeature &feat) {
-            ENTER_SCOPE_GUARD(stable, {
-                if (feat.GetType().Value() == TYPE_SELF_TYPE)
-                    feat.SetType({stable.GetClass()->GetName().Value(), feat.GetType().TextInfo()});
-                Visit(*feat.GetExpr());
-            })
+            ENTER_SCOPE_GUARD(stable, Visit(*feat.GetExpr()))
         }
 
         void Visit(repr::Formal &form) {}
@@ -681,15 +768,15 @@ repr::Program* ana::EliminateSelfType::operator()(repr::Program* prog, pass::Pas
         }
 
         void Visit_(repr::LinkBuiltin& expr) {
-            if (expr.GetType() == TYPE_SELF_TYPE)
-                expr.SetType(stable.GetClass()->GetName().Value());
+            if (expr.GetType() == SYM_SELF_TYPE)
+                expr.SetType(stable.GetClass()->GetName().Sym());
         }
 
         void Visit_(repr::Assign& expr) { Visit(*expr.GetExpr()); }
 
         void Visit_(repr::Add& expr) {
             Visit(*expr.GetLeft());
-            Visit(*expr.GetLeft());
+            Visit(*expr.GetRight());
         }
 
         void Visit_(repr::Block& expr) {
@@ -740,11 +827,13 @@ repr::Program* ana::EliminateSelfType::operator()(repr::Program* prog, pass::Pas
         void Visit_(repr::Integer& expr) {}
 
         void Visit_(repr::If& expr) {
-            Visit(*expr.GetIfExpr());
-            Visit(*expr.GetThenExpr());
-            Visit(*expr.GetElseExpr());
-            if (expr.GetType() == TYPE_SELF_TYPE)
-                expr.SetType(stable.GetClass()->GetName().Value());
+            ENTER_SCOPE_GUARD(stable, {
+                Visit(*expr.GetIfExpr());
+                ENTER_SCOPE_GUARD(stable, Visit(*expr.GetThenExpr()))
+                ENTER_SCOPE_GUARD(stable, Visit(*expr.GetElseExpr()))
+            })
+            if (expr.GetType() == SYM_SELF_TYPE)
+                expr.SetType(stable.GetClass()->GetName().Sym());
         }
 
         void Visit_(repr::LessThanOrEqual& expr) {
@@ -784,8 +873,8 @@ repr::Program* ana::EliminateSelfType::operator()(repr::Program* prog, pass::Pas
         }
 
         void Visit_(repr::New& expr) {
-            if (expr.GetType().Value() == TYPE_SELF_TYPE)
-                expr.SetType({stable.GetClass()->GetName().Value(), expr.GetType().TextInfo()});
+            if (expr.GetType().Sym() == SYM_SELF_TYPE)
+                expr.SetType({stable.GetClass()->GetName().Sym(), expr.GetType().TextInfo()});
         }
 
         void Visit_(repr::Not& expr) { Visit(*expr.GetExpr()); }
@@ -806,4 +895,146 @@ repr::Program* ana::EliminateSelfType::operator()(repr::Program* prog, pass::Pas
     Visitor vis(*stable);
     vis.Visit(*prog);
     return prog;
-}
\ No newline at end of file
+}
+
+repr::Program* ana::Devirtualize::operator()(repr::Program* prog, pass::PassContext& ctx) {
+
+    class Visitor : public ExprVisitor<void> {
+      private:
+        type::TypeAdvisor& typeAdvisor;
+        // (type, method) -> whether a strict subclass of type overrides it
+        unordered_map<uint64_t, bool> overridden;
+
+        bool isOverridden(Symbol type, Symbol method) {
+            uint64_t key = uint64_t(type.Id()) << 32 | method.Id();
+            auto it = overridden.find(key);
+            if (it != overridden.end()) return it->second;
+            bool found = typeAdvisor.TopDownVisit(type, [&](repr::Class* cls) {
+                if (cls->GetName().Sym() == type) return false;
+                auto func = cls->GetFuncFeaturePtr(method);
+                return func && !cls->IsInherited(func);
+            });
+            overridden.insert({key, found});
+            return found;
+        }
+
+        void visitCall(Symbol type, repr::Call& call) {
+            for (auto& arg : call.GetArgs()) Visit(*arg);
+            // unresolved, e.g. in a class reused from the compile cache
+            if (!call.GetLink()) return;
+            stats.sites++;
+            if (type == SYM_SELF_TYPE) type = cls->GetName().Sym();
+            call.SetDirect(!isOverridden(type, call.GetLink()->GetName().Sym()));
+            if (call.GetDirect()) stats.devirtualized++;
+        }
+
+      public:
+        repr::Class* cls = nullptr;
+        DevirtualizeStats stats;
+
+        Visitor(type::TypeAdvisor& _typeAdvisor) : typeAdvisor(_typeAdvisor) {}
+
+        void Visit(repr::Expr& expr) { ExprVisitor<void>::Visit(expr); }
+
+        void Visit_(repr::LinkBuiltin& expr) {}
+
+        void Visit_(repr::Assign& expr) { Visit(*expr.GetExpr()); }
+
+        void Visit_(repr::Add& expr) {
+            Visit(*expr.GetLeft());
+            Visit(*expr.GetRight());
+        }
+
+        void Visit_(repr::Block& expr) {
+            for (auto& e : expr.GetExprs()) Visit(*e);
+        }
+
+        void Visit_(repr::Case& expr) {
+            Visit(*expr.GetExpr());
+            for (auto& branch : expr.GetBranches()) Visit(*branch->GetExpr());
+        }
+
+        void Visit_(repr::Call& expr) { visitCall(cls->GetName().Sym(), expr); }
+
+        void Visit_(repr::Divide& expr) {
+            Visit(*expr.GetLeft());
+            Visit(*expr.GetRight());
+        }
+
+        void Visit_(repr::Equal& expr) {
+            Visit(*expr.GetLeft());
+            Visit(*expr.GetRight());
+        }
+
+        void Visit_(repr::False& expr) {}
+
+        void Visit_(repr::ID& expr) {}
+
+        void Visit_(repr::IsVoid& expr) { Visit(*expr.GetExpr()); }
+
+        void Visit_(repr::Integer& expr) {}
+
+        void Visit_(repr::If& expr) {
+            Visit(*expr.GetIfExpr());
+            Visit(*expr.GetThenExpr());
+            Visit(*expr.GetElseExpr());
+        }
+
+        void Visit_(repr::LessThanOrEqual& expr) {
+            Visit(*expr.GetLeft());
+            Visit(*expr.GetRight());
+        }
+
+        void Visit_(repr::LessThan& expr) {
+            Visit(*expr.GetLeft());
+            Visit(*expr.GetRight());
+        }
+
+        void Visit_(repr::Let& expr) {
+            for (auto& decl : expr.GetDecls())
+                if (decl->GetExpr()) Visit(*decl->GetExpr());
+            Visit(*expr.GetExpr());
+        }
+
+        void Visit_(repr::MethodCall& expr) {
+            Visit(*expr.GetLeft());
+            visitCall(expr.GetType(), *static_cast<repr::Call*>(expr.GetRight()));
+        }
+
+        void Visit_(repr::Multiply& expr) {
+            Visit(*expr.GetLeft());
+            Visit(*expr.GetRight());
+        }
+
+        void Visit_(repr::Minus& expr) {
+            Visit(*expr.GetLeft());
+            Visit(*expr.GetRight());
+        }
+
+        void Visit_(repr::Negate& expr) { Visit(*expr.GetExpr()); }
+
+        void Visit_(repr::New& expr) {}
+
+        void Visit_(repr::Not& expr) { Visit(*expr.GetExpr()); }
+
+        void Visit_(repr::String& expr) {}
+
+        void Visit_(repr::True& expr) {}
+
+        void Visit_(repr::While& expr) {
+            Visit(*expr.GetWhileExpr());
+            Visit(*expr.GetLoopExpr());
+        }
+    };
+
+    Visitor vis(*ctx.Get<type::TypeAdvisor>("type_advisor"));
+    for (auto& cls : prog->GetClasses()) {
+        vis.cls = cls;
+        for (auto& func : cls->GetOwnFuncFeatures())
+            vis.Visit(*func->GetExpr());
+        for (auto& field : cls->GetOwnFieldFeatures())
+            if (field->GetExpr()) vis.Visit(*field->GetExpr());
+    }
+    ctx.Set<DevirtualizeStats>("devirtualize_stats", vis.stats);
+    return prog;
+}
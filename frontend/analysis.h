@@ -6,6 +6,7 @@
 #define COOL_ANALYSIS_H
 
 #include "pass.h"
+#include "cache.h"
 
 namespace cool {
 
@@ -28,6 +29,7 @@ class InstallBuiltin : public pass::ProgramPass {
 
 class CheckBuiltinInheritance : public pass::ClassPass {
   public:
+    Schedule GetSchedule() const final { return Independent; }
     repr::Class* operator()(repr::Class* cls, pass::PassContext& ctx) final;
 };
 
@@ -38,21 +40,25 @@ class BuildInheritanceTree : public pass::ProgramPass {
 
 class CheckInheritedAttributes : public pass::ClassPass {
   public:
+    Schedule GetSchedule() const final { return Independent; }
     repr::Class* operator()(repr::Class* cls, pass::PassContext& ctx) final;
 };
 
 class AddInheritedAttributes : public pass::ClassPass {
   public:
+    Schedule GetSchedule() const final { return TopDown; }
     repr::Class* operator()(repr::Class* cls, pass::PassContext& ctx) final;
 };
 
 class CheckInheritedMethods : public pass::ClassPass {
   public:
+    Schedule GetSchedule() const final { return Independent; }
     repr::Class* operator()(repr::Class* cls, pass::PassContext& ctx) final;
 };
 
 class AddInheritedMethods : public pass::ClassPass {
   public:
+    Schedule GetSchedule() const final { return TopDown; }
     repr::Class* operator()(repr::Class* cls, pass::PassContext& ctx) final;
 };
 
@@ -71,6 +77,21 @@ class EliminateSelfType : public pass::ProgramPass {
     repr::Program* operator()(repr::Program* prog, pass::PassContext& ctx) final;
 };
 
+// Class hierarchy analysis. A call whose receiver has static type T can
+// only reach the method T resolves to if no subclass of T overrides it, such
+// calls are marked direct (repr::Call::SetDirect) and generated without
+// going through the vtable. Run on a program that passed SemanticChecking.
+// Sets "devirtualize_stats" (DevirtualizeStats).
+struct DevirtualizeStats {
+    size_t sites = 0;         // call sites visited
+    size_t devirtualized = 0; // of which were marked direct
+};
+
+class Devirtualize : public pass::ProgramPass {
+  public:
+    repr::Program* operator()(repr::Program* prog, pass::PassContext& ctx) final;
+};
+
 class SemanticChecking : public pass::Sequential {
   public:
     SemanticChecking() : pass::Sequential({
@@ -81,6 +102,7 @@ class SemanticChecking : public pass::Sequential {
         make_shared<AddInheritedAttributes>(),
         make_shared<CheckInheritedMethods>(),
         make_shared<AddInheritedMethods>(),
+        make_shared<cache::FingerprintClasses>(),
         make_shared<InitSymbolTable>(),
         make_shared<TypeChecking>(),
         make_shared<EliminateSelfType>()
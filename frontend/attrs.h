@@ -10,6 +10,7 @@
 #include <memory>
 
 #include "repr.h"
+#include "symbol.h"
 
 using namespace std;
 
@@ -20,8 +21,8 @@ namespace attr {
 struct Attr {};
 
 struct FuncAttr {
-    string name;
-    string type;
+    Symbol name;
+    Symbol type;
 };
 
 struct IdAttr {
@@ -32,20 +33,20 @@ struct IdAttr {
     };
     StorageClass storageClass;
     int idx; // index in its storage class
-    string name;
-    string type;
+    Symbol name;
+    Symbol type;
 
-    IdAttr(StorageClass sc, int  _idx, const string& _name, const string& _type)
+    IdAttr(StorageClass sc, int  _idx, Symbol _name, Symbol _type)
     : storageClass(sc), idx(_idx), name(_name), type(_type) {}
 };
 
 struct TypeAttr {
-    string name;
-    string parent;
+    Symbol name;
+    Symbol parent;
     shared_ptr<repr::Class> cls;
-    inline string Name() { return cls->GetName().Value(); }
-    inline string Parent() { return cls->GetParent().Value(); }
-    inline bool Is(const string& type) { return cls->GetName().Value() == type; }
+    inline Symbol Name() { return cls->GetName().Sym(); }
+    inline Symbol Parent() { return cls->GetParent().Sym(); }
+    inline bool Is(Symbol type) { return cls->GetName().Sym() == type; }
 };
 
 } // attr
@@ -15,164 +15,199 @@ using namespace repr;
 using namespace constant;
 
 repr::FuncFeature* builtin::GetAbortFuncFeature() {
-    return new FuncFeature(
-        StringAttr("abort"),
+    return NewRepr<FuncFeature>(
+        StringAttr(FUNC_ABORT_NAME),
         StringAttr(CLS_OBJECT_NAME),
-        new LinkBuiltin()
+        NewRepr<LinkBuiltin>(
+            FUNC_ABORT_NAME,
+            CLS_OBJECT_NAME,
+            vector<Symbol>{}
+        ),
+        vector<Formal*>{}
     );
 }
 
 repr::FuncFeature* builtin::GetTypeNameFuncFeature() {
-    return new FuncFeature(
-        StringAttr("type_name"),
+    return NewRepr<FuncFeature>(
+        StringAttr(FUNC_TYPE_NAME_NAME),
         StringAttr(CLS_STRING_NAME),
-        new LinkBuiltin(),
-        {}
+        NewRepr<LinkBuiltin>(
+            FUNC_TYPE_NAME_NAME,
+            CLS_STRING_NAME,
+            vector<Symbol>{}
+        ),
+        vector<Formal*>{}
     );
 }
 
 repr::FuncFeature* builtin::GetCopyFuncFeature() {
-    return new FuncFeature(
-        StringAttr("copy"),
+    return NewRepr<FuncFeature>(
+        StringAttr(FUNC_COPY_NAME),
         StringAttr(TYPE_SELF_TYPE),
-        new LinkBuiltin(),
-        {}
+        NewRepr<LinkBuiltin>(
+            FUNC_COPY_NAME,
+            TYPE_SELF_TYPE,
+            vector<Symbol>{}
+        ),
+        vector<Formal*>{}
     );
 }
 
 repr::Class* builtin::GetObjectClass() {
-    return new Class(
+    return NewRepr<Class>(
         StringAttr(CLS_OBJECT_NAME),
         StringAttr(""),
-        {
-//        make_shared<FuncFeature>(Abort),
-//        make_shared<FuncFeature>(TypeName),
-//        make_shared<FuncFeature>(Copy),
+        vector<FuncFeature*>{
+            GetAbortFuncFeature(),
+            GetTypeNameFuncFeature(),
+            GetCopyFuncFeature(),
         },
-        {}
+        vector<FieldFeature*>{}
     );
 }
 
 repr::FuncFeature* builtin::GetOutStringFuncFeature() {
-    return new FuncFeature(
-        StringAttr("out_string"),
+    return NewRepr<FuncFeature>(
+        StringAttr(FUNC_OUT_STRING_NAME),
         StringAttr(TYPE_SELF_TYPE),
-        new LinkBuiltin(
-            "out_string",
+        NewRepr<LinkBuiltin>(
+            FUNC_OUT_STRING_NAME,
             TYPE_SELF_TYPE,
-            {"x"}
+            vector<Symbol>{"x"}
         ),
-        {
-            new Formal(StringAttr("x"), StringAttr("String"))
+        vector<Formal*>{
+            NewRepr<Formal>(StringAttr("x"), StringAttr(CLS_STRING_NAME)),
         }
     );
 }
 
 repr::FuncFeature* builtin::GetOutIntFuncFeature() {
-    return new FuncFeature(
-        StringAttr("out_int"),
+    return NewRepr<FuncFeature>(
+        StringAttr(FUNC_OUT_INT_NAME),
         StringAttr(TYPE_SELF_TYPE),
-        new LinkBuiltin(
-            "out_int",
+        NewRepr<LinkBuiltin>(
+            FUNC_OUT_INT_NAME,
             TYPE_SELF_TYPE,
-            {"x"}
+            vector<Symbol>{"x"}
         ),
-        {
-            new Formal(StringAttr("x"), StringAttr("Int"))
+        vector<Formal*>{
+            NewRepr<Formal>(StringAttr("x"), StringAttr(CLS_INT_NAME)),
         }
     );
 }
 
 repr::FuncFeature* builtin::GetInStringFuncFeature() {
-    return new FuncFeature(
-        StringAttr("in_string"),
+    return NewRepr<FuncFeature>(
+        StringAttr(FUNC_IN_STRING_NAME),
         StringAttr(CLS_STRING_NAME),
-        new LinkBuiltin(),
-        {}
+        NewRepr<LinkBuiltin>(
+            FUNC_IN_STRING_NAME,
+            CLS_STRING_NAME,
+            vector<Symbol>{}
+        ),
+        vector<Formal*>{}
     );
 }
 
 repr::FuncFeature* builtin::GetInIntFuncFeature() {
-    return new FuncFeature(
-        StringAttr("in_int"),
+    return NewRepr<FuncFeature>(
+        StringAttr(FUNC_IN_INT_NAME),
         StringAttr(CLS_INT_NAME),
-        new LinkBuiltin(),
-        {}
+        NewRepr<LinkBuiltin>(
+            FUNC_IN_INT_NAME,
+            CLS_INT_NAME,
+            vector<Symbol>{}
+        ),
+        vector<Formal*>{}
     );
 }
 
 repr::Class* builtin::GetIOClass() {
-    return new Class(
+    return NewRepr<Class>(
         StringAttr(CLS_IO_NAME),
         StringAttr(CLS_OBJECT_NAME),
-        {
+        vector<FuncFeature*>{
             GetOutStringFuncFeature(),
             GetOutIntFuncFeature(),
-//        make_shared<FuncFeature>(InString),
-//        make_shared<FuncFeature>(InInt),
+            GetInStringFuncFeature(),
+            GetInIntFuncFeature(),
         },
-        {}
+        vector<FieldFeature*>{}
     );
 }
 
 repr::Class* builtin::GetIntClass() {
-    return new Class(
+    return NewRepr<Class>(
         StringAttr(CLS_INT_NAME),
         StringAttr(CLS_OBJECT_NAME),
-        {},
-        {}
+        vector<FuncFeature*>{},
+        vector<FieldFeature*>{}
     );
 }
 
 repr::FuncFeature* builtin::GetLengthFuncFeature() {
-    return new FuncFeature(
-        StringAttr("length"),
+    return NewRepr<FuncFeature>(
+        StringAttr(FUNC_LENGTH_NAME),
         StringAttr(CLS_INT_NAME),
-        new LinkBuiltin(),
-        {}
+        NewRepr<LinkBuiltin>(
+            FUNC_LENGTH_NAME,
+            CLS_INT_NAME,
+            vector<Symbol>{}
+        ),
+        vector<Formal*>{}
     );
 }
 
 repr::FuncFeature* builtin::GetConcatFuncFeature() {
-    return new FuncFeature(
-        StringAttr(CLS_STRING_NAME),
+    return NewRepr<FuncFeature>(
+        StringAttr(FUNC_CONCAT_NAME),
         StringAttr(CLS_STRING_NAME),
-        new LinkBuiltin(),
-        {}
+        NewRepr<LinkBuiltin>(
+            FUNC_CONCAT_NAME,
+            CLS_STRING_NAME,
+            vector<Symbol>{"s"}
+        ),
+        vector<Formal*>{
+            NewRepr<Formal>(StringAttr("s"), StringAttr(CLS_STRING_NAME)),
+        }
     );
 }
 
 repr::FuncFeature* builtin::GetSubstrFuncFeature() {
-    return new FuncFeature(
-        StringAttr("substr"),
+    return NewRepr<FuncFeature>(
+        StringAttr(FUNC_SUBSTR_NAME),
         StringAttr(CLS_STRING_NAME),
-        new LinkBuiltin(),
-        {
-            new Formal(StringAttr("i"), StringAttr("Int")),
-            new Formal(StringAttr("l"), StringAttr("Int")),
+        NewRepr<LinkBuiltin>(
+            FUNC_SUBSTR_NAME,
+            CLS_STRING_NAME,
+            vector<Symbol>{"i", "l"}
+        ),
+        vector<Formal*>{
+            NewRepr<Formal>(StringAttr("i"), StringAttr(CLS_INT_NAME)),
+            NewRepr<Formal>(StringAttr("l"), StringAttr(CLS_INT_NAME)),
         }
     );
 }
 
 repr::Class* builtin::GetStringClass() {
-    return new Class(
+    return NewRepr<Class>(
         StringAttr(CLS_STRING_NAME),
         StringAttr(CLS_OBJECT_NAME),
-        {
-//        make_shared<FuncFeature>(Length),
-//        make_shared<FuncFeature>(Concat),
-//        make_shared<FuncFeature>(Substr),
+        vector<FuncFeature*>{
+            GetLengthFuncFeature(),
+            GetConcatFuncFeature(),
+            GetSubstrFuncFeature(),
         },
-        {}
+        vector<FieldFeature*>{}
     );
 }
 
 repr::Class* builtin::GetBoolClass() {
-    return new Class(
+    return NewRepr<Class>(
         StringAttr(CLS_BOOL_NAME),
         StringAttr(CLS_OBJECT_NAME),
-        {},
-        {}
+        vector<FuncFeature*>{},
+        vector<FieldFeature*>{}
     );
 }
 
@@ -0,0 +1,260 @@
+//
+// Created by 田地 on 2021/8/29.
+//
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "visitor.h"
+#include "profile.h"
+
+using namespace std;
+using namespace cool;
+using namespace cache;
+
+namespace {
+
+// bump when the hashed structure or the entry format changes
+const uint64_t formatVersion = 13;
+
+//======================================================================//
+//                        Structure Hashing                             //
+//======================================================================//
+class ExprHasher : public visitor::ExprVisitor<void> {
+  private:
+    Hasher& h;
+
+    void visit(repr::Expr* expr) {
+        // optional sub-expressions, e.g. let initializers, may be null
+        h.Mix(uint64_t(expr ? uint64_t(expr->GetKind()) : ~0ull));
+        if (expr) ExprVisitor<void>::Visit(*expr);
+    }
+
+    void visitUnary(repr::Unary& expr) { visit(expr.GetExpr()); }
+
+    void visitBinary(repr::Binary& expr) {
+        visit(expr.GetLeft());
+        visit(expr.GetRight());
+    }
+
+  public:
+    explicit ExprHasher(Hasher& _h) : h(_h) {}
+
+    void Hash(repr::Expr* expr) { visit(expr); }
+
+    void Visit_(repr::LinkBuiltin& expr) {
+        h.Mix(expr.GetName());
+        h.Mix(expr.GetType());
+        h.Mix(uint64_t(expr.GetParams().size()));
+        for (auto& param : expr.GetParams()) h.Mix(param);
+    }
+
+    void Visit_(repr::Assign& expr) {
+        h.Mix(expr.GetId()->GetName().Sym());
+        visit(expr.GetExpr());
+    }
+
+    void Visit_(repr::Block& expr) {
+        h.Mix(uint64_t(expr.GetExprs().size()));
+        for (auto& e : expr.GetExprs()) visit(e);
+    }
+
+    void Visit_(repr::Case& expr) {
+        visit(expr.GetExpr());
+        h.Mix(uint64_t(expr.GetBranches().size()));
+        for (auto& branch : expr.GetBranches()) {
+            h.Mix(branch->GetId().Sym());
+            h.Mix(branch->GetType().Sym());
+            visit(branch->GetExpr());
+        }
+    }
+
+    void Visit_(repr::Call& expr) {
+        h.Mix(expr.GetId()->GetName().Sym());
+        h.Mix(uint64_t(expr.GetArgs().size()));
+        for (auto& arg : expr.GetArgs()) visit(arg);
+    }
+
+    void Visit_(repr::ID& expr) { h.Mix(expr.GetName().Sym()); }
+
+    void Visit_(repr::Integer& expr) { h.Mix(uint64_t(expr.GetValue().Value())); }
+
+    void Visit_(repr::If& expr) {
+        visit(expr.GetIfExpr());
+        visit(expr.GetThenExpr());
+        visit(expr.GetElseExpr());
+    }
+
+    void Visit_(repr::Let& expr) {
+        h.Mix(uint64_t(expr.GetDecls().size()));
+        for (auto& decl : expr.GetDecls()) {
+            h.Mix(decl->GetName().Sym());
+            h.Mix(decl->GetType().Sym());
+            visit(decl->GetExpr());
+        }
+        visit(expr.GetExpr());
+    }
+
+    void Visit_(repr::New& expr) { h.Mix(expr.GetType().Sym()); }
+
+    void Visit_(repr::String& expr) { h.Mix(expr.GetValue().Sym()); }
+
+    void Visit_(repr::While& expr) {
+        visit(expr.GetWhileExpr());
+        visit(expr.GetLoopExpr());
+    }
+
+    void Visit_(repr::IsVoid& expr) { visitUnary(expr); }
+    void Visit_(repr::Negate& expr) { visitUnary(expr); }
+    void Visit_(repr::Not& expr) { visitUnary(expr); }
+
+    void Visit_(repr::Add& expr) { visitBinary(expr); }
+    void Visit_(repr::Divide& expr) { visitBinary(expr); }
+    void Visit_(repr::Equal& expr) { visitBinary(expr); }
+    void Visit_(repr::LessThanOrEqual& expr) { visitBinary(expr); }
+    void Visit_(repr::LessThan& expr) { visitBinary(expr); }
+    void Visit_(repr::MethodCall& expr) { visitBinary(expr); }
+    void Visit_(repr::Multiply& expr) { visitBinary(expr); }
+    void Visit_(repr::Minus& expr) { visitBinary(expr); }
+
+    void Visit_(repr::True& expr) {}
+    void Visit_(repr::False& expr) {}
+};
+
+void hashSignature(Hasher& h, repr::FuncFeature& feat) {
+    h.Mix(feat.GetName().Sym());
+    h.Mix(feat.GetType().Sym());
+    h.Mix(uint64_t(feat.GetArgs().size()));
+    for (auto& arg : feat.GetArgs()) {
+        h.Mix(arg->GetName().Sym());
+        h.Mix(arg->GetType().Sym());
+    }
+}
+
+void hashInterface(Hasher& h, repr::Class& cls) {
+    h.Mix(cls.GetName().Sym());
+    h.Mix(cls.GetParent().Sym());
+    h.Mix(uint64_t(cls.GetFieldFeatures().size()));
+    for (auto& field : cls.GetFieldFeatures()) {
+        h.Mix(field->GetName().Sym());
+        h.Mix(field->GetType().Sym());
+    }
+    h.Mix(uint64_t(cls.GetFuncFeatures().size()));
+    for (auto& func : cls.GetFuncFeatures())
+        hashSignature(h, *func);
+}
+
+} // namespace
+
+uint64_t cache::HashClass(repr::Class& cls) {
+    Hasher h;
+    ExprHasher exprHasher(h);
+    hashInterface(h, cls);
+    for (auto& field : cls.GetOwnFieldFeatures())
+        exprHasher.Hash(field->GetExpr());
+    for (auto& func : cls.GetOwnFuncFeatures())
+        exprHasher.Hash(func->GetExpr());
+    return h.Digest();
+}
+
+uint64_t cache::HashInterfaces(repr::Program& prog) {
+    // independent of the order classes are declared in
+    vector<uint64_t> hashes;
+    for (auto& cls : prog.GetClasses()) {
+        Hasher h;
+        hashInterface(h, *cls);
+        hashes.emplace_back(h.Digest());
+    }
+    sort(hashes.begin(), hashes.end());
+    Hasher h;
+    for (auto v : hashes) h.Mix(v);
+    return h.Digest();
+}
+
+//======================================================================//
+//                         CompileCache Class                           //
+//======================================================================//
+CompileCache::CompileCache(const string& _dir) : dir(_dir) {
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+        throw runtime_error("cannot create cache directory '" + dir + "': " + strerror(errno));
+}
+
+string CompileCache::path(uint64_t key) const {
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long) key);
+    return dir + "/" + name + ".bc";
+}
+
+bool CompileCache::Load(uint64_t key, string& blob) const {
+    ifstream in(path(key), ios::binary);
+    if (!in) return false;
+    stringstream ss;
+    ss<< in.rdbuf();
+    blob = ss.str();
+    return true;
+}
+
+void CompileCache::Store(uint64_t key, const string& blob) const {
+    // write aside then rename, so a concurrent or interrupted run never
+    // sees a partial entry
+    auto dest = path(key);
+    auto tmp = dest + "." + to_string(getpid()) + ".tmp";
+    {
+        ofstream out(tmp, ios::binary | ios::trunc);
+        out.write(blob.data(), blob.size());
+        if (!out) throw runtime_error("cannot write cache entry '" + tmp + "'");
+    }
+    if (rename(tmp.c_str(), dest.c_str()) != 0) {
+        remove(tmp.c_str());
+        throw runtime_error("cannot write cache entry '" + dest + "': " + strerror(errno));
+    }
+}
+
+uint64_t CompileCache::Key(uint64_t classHash, uint64_t interfaceHash) {
+    Hasher h;
+    h.Mix(formatVersion);
+    h.Mix(classHash);
+    h.Mix(interfaceHash);
+    return h.Digest();
+}
+
+//======================================================================//
+//                       FingerprintClasses Pass                        //
+//======================================================================//
+repr::Program* FingerprintClasses::operator()(repr::Program* prog, pass::PassContext& ctx) {
+    if (!ctx.Contains("compile_cache")) return prog;
+    auto compileCache = ctx.Get<CompileCache>("compile_cache");
+
+    Fingerprints fingerprints;
+    CachedClasses cached;
+    Hasher h;
+    h.Mix(HashInterfaces(*prog));
+    auto speculation = ctx.Contains("speculation") ?
+        *ctx.Get<profile::Speculation>("speculation") : profile::Speculation::Profile;
+    h.Mix(uint64_t(speculation));
+    if (speculation != profile::Speculation::None && ctx.Contains("receiver_profile"))
+        h.Mix(ctx.Get<profile::ReceiverProfile>("receiver_profile")->Hash());
+    auto interfaces = h.Digest();
+    for (auto& cls : prog->GetClasses()) {
+        auto key = CompileCache::Key(HashClass(*cls), interfaces);
+        fingerprints.insert({cls->GetName().Sym(), key});
+        string blob;
+        if (compileCache->Load(key, blob))
+            cached.insert({cls->GetName().Sym(), move(blob)});
+    }
+
+    ctx.Set<Fingerprints>("fingerprints", fingerprints);
+    ctx.Set<CachedClasses>("cached_classes", cached);
+    return prog;
+}
@@ -0,0 +1,114 @@
+//
+// Created by 田地 on 2021/8/29.
+//
+
+#ifndef COOL_CACHE_H
+#define COOL_CACHE_H
+
+#include <string>
+#include <cstdint>
+#include <unordered_map>
+
+#include "repr.h"
+#include "pass.h"
+#include "symbol.h"
+
+using namespace std;
+
+namespace cool {
+
+namespace cache {
+
+//======================================================================//
+//                           Hasher Class                               //
+//======================================================================//
+// 64-bit FNV-1a. Symbols are hashed by their text, never by id, since
+// ids depend on the order strings were interned in and differ between
+// runs.
+class Hasher {
+  private:
+    uint64_t h = 0xcbf29ce484222325ull;
+
+  public:
+    void Mix(const void* data, size_t size) {
+        auto p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            h ^= p[i];
+            h *= 0x100000001b3ull;
+        }
+    }
+
+    void Mix(uint64_t v) { Mix(&v, sizeof(v)); }
+
+    // length-prefixed so that ("ab", "c") and ("a", "bc") differ
+    void Mix(const string& str) {
+        Mix(uint64_t(str.size()));
+        Mix(str.data(), str.size());
+    }
+
+    void Mix(Symbol sym) { Mix(sym.Str()); }
+
+    uint64_t Digest() const { return h; }
+};
+
+// structural hash of everything in cls that code generation depends on:
+// its name, parent, fields and methods, and the bodies of the ones it
+// defines. Inherited bodies are generated with the ancestor. Run after
+// the inheritance passes so inherited members are part of it.
+uint64_t HashClass(repr::Class& cls);
+
+// hash of the interfaces of all classes in prog, i.e. names, parents,
+// field types and method signatures, but not method bodies
+uint64_t HashInterfaces(repr::Program& prog);
+
+using Fingerprints = unordered_map<Symbol, uint64_t>;
+
+// bitcode of the classes found in the cache
+using CachedClasses = unordered_map<Symbol, string>;
+
+//======================================================================//
+//                         CompileCache Class                           //
+//======================================================================//
+// An on-disk cache of per-class compilation results, one file per
+// fingerprint under dir. Only classes that passed semantic checking are
+// stored, a hit means the class can skip type checking and reuse its
+// bitcode.
+class CompileCache {
+  private:
+    string dir;
+
+    string path(uint64_t key) const;
+
+  public:
+    // create dir if not existed, throw runtime_error on failure
+    explicit CompileCache(const string& _dir);
+
+    // read the entry of key into blob, return false if not existed
+    bool Load(uint64_t key, string& blob) const;
+
+    // write the entry of key, replacing an existing one atomically
+    void Store(uint64_t key, const string& blob) const;
+
+    // the cache key of a class, also mixes in the cache format version
+    static uint64_t Key(uint64_t classHash, uint64_t interfaceHash);
+};
+
+//======================================================================//
+//                       FingerprintClasses Pass                        //
+//======================================================================//
+// Fingerprint every class and look it up in the CompileCache set in the
+// context as "compile_cache". The speculation mode and receiver profile
+// set in the context change the generated code, so they are part of every
+// fingerprint, see profile::SpeculateReceivers. Sets "fingerprints"
+// (Fingerprints) and "cached_classes" (CachedClasses). Does nothing if
+// there's no cache.
+class FingerprintClasses : public pass::ProgramPass {
+  public:
+    repr::Program* operator()(repr::Program* prog, pass::PassContext& ctx) final;
+};
+
+} // namespace cache
+
+} // namespace cool
+
+#endif //COOL_CACHE_H
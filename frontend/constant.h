@@ -7,6 +7,8 @@
 
 #include <string>
 
+#include "symbol.h"
+
 namespace cool {
 
 namespace constant {
@@ -24,9 +26,80 @@ const string CLS_MAIN_NAME = "Main";
 
 // Function
 const string FUNC_MAIN_NAME = "main";
+// methods of the builtin classes, see builtin.cpp
+const string FUNC_ABORT_NAME = "abort";
+const string FUNC_TYPE_NAME_NAME = "type_name";
+const string FUNC_COPY_NAME = "copy";
+const string FUNC_OUT_STRING_NAME = "out_string";
+const string FUNC_OUT_INT_NAME = "out_int";
+const string FUNC_IN_STRING_NAME = "in_string";
+const string FUNC_IN_INT_NAME = "in_int";
+const string FUNC_LENGTH_NAME = "length";
+const string FUNC_CONCAT_NAME = "concat";
+const string FUNC_SUBSTR_NAME = "substr";
 
 // Code Generation
 const string CG_FUNC_COOL_MAIN_NAME = "coolmain";
+// suffix of the field initializer of a class, not a valid method name
+const string CG_FUNC_INIT_SUFFIX = ".init";
+// suffix of the vtable global of a class
+const string CG_VTABLE_SUFFIX = ".vtable";
+// suffix of the global listing the pointer fields of a class, see runtime/gc.h
+const string CG_LAYOUT_SUFFIX = ".layout";
+// suffix of the String global holding the name of a class, for type_name
+const string CG_TYPE_NAME_SUFFIX = ".name";
+// the innermost frame of the shadow stack and the write barrier, see runtime/gc.h
+const string CG_GC_ROOTS_NAME = "cool_gc_roots";
+const string CG_WRITE_BARRIER_NAME = "cool_gc_write_barrier";
+// aborts a case no branch of matches, see runtime/runtime.h
+const string CG_CASE_ABORT_NAME = "cool_case_abort";
+// Object.abort, libc has an abort already
+const string CG_ABORT_NAME = "cool_abort";
+// Object.copy, see runtime/runtime.h
+const string CG_COPY_NAME = "cool_copy";
+// the free space of the current arena chunk, see runtime/arena.h
+const string CG_ARENA_TOP_NAME = "cool_arena_top";
+const string CG_ARENA_END_NAME = "cool_arena_end";
+
+// Linking
+#ifndef COOL_RUNTIME_ARCHIVE
+#define COOL_RUNTIME_ARCHIVE "libcoolrt.a"
+#endif
+// the precompiled runtime executables are linked with, see EmitExecutable
+const string RUNTIME_ARCHIVE = COOL_RUNTIME_ARCHIVE;
+#ifndef COOL_RUNTIME_ARENA_ARCHIVE
+#define COOL_RUNTIME_ARENA_ARCHIVE "libcoolrt_arena.a"
+#endif
+// the same with the arena in place of the collector, see runtime/arena.h
+const string RUNTIME_ARENA_ARCHIVE = COOL_RUNTIME_ARENA_ARCHIVE;
+const string OUTPUT_EXECUTABLE = "exe";
+
+// Speculative Devirtualization
+// suffix of the receiver profile of a source file
+const string PROFILE_SUFFIX = ".prof";
+
+// Incremental Compilation
+const string CACHE_DIR = ".coolcache";
+
+// Interned names, compare Symbols against these instead of the strings above
+const Symbol SYM_SELF_TYPE = TYPE_SELF_TYPE;
+const Symbol SYM_OBJECT = CLS_OBJECT_NAME;
+const Symbol SYM_IO = CLS_IO_NAME;
+const Symbol SYM_INT = CLS_INT_NAME;
+const Symbol SYM_BOOL = CLS_BOOL_NAME;
+const Symbol SYM_STRING = CLS_STRING_NAME;
+const Symbol SYM_MAIN = CLS_MAIN_NAME;
+const Symbol SYM_FUNC_MAIN = FUNC_MAIN_NAME;
+const Symbol SYM_FUNC_ABORT = FUNC_ABORT_NAME;
+const Symbol SYM_FUNC_TYPE_NAME = FUNC_TYPE_NAME_NAME;
+const Symbol SYM_FUNC_COPY = FUNC_COPY_NAME;
+const Symbol SYM_FUNC_OUT_STRING = FUNC_OUT_STRING_NAME;
+const Symbol SYM_FUNC_OUT_INT = FUNC_OUT_INT_NAME;
+const Symbol SYM_FUNC_IN_STRING = FUNC_IN_STRING_NAME;
+const Symbol SYM_FUNC_IN_INT = FUNC_IN_INT_NAME;
+const Symbol SYM_FUNC_LENGTH = FUNC_LENGTH_NAME;
+const Symbol SYM_FUNC_CONCAT = FUNC_CONCAT_NAME;
+const Symbol SYM_FUNC_SUBSTR = FUNC_SUBSTR_NAME;
 
 
 } // namespace cool
@@ -9,6 +9,8 @@
 #include <vector>
 #include <ostream>
 #include <unordered_map>
+#include <algorithm>
+#include <tuple>
 
 using namespace std;
 
@@ -103,7 +105,15 @@ class Diagnosis {
 
     bool Empty() {return rows.empty(); }
 
-    bool FatalOccurred() { for (auto& row : rows) if (row.level == FATAL) return true; }
+    bool FatalOccurred() {
+        for (auto& row : rows) if (row.level == FATAL) return true;
+        return false;
+    }
+
+    // append the rows of other in the order they were emitted
+    void Append(const Diagnosis& other) {
+        rows.insert(rows.end(), other.rows.begin(), other.rows.end());
+    }
 
     void Output(ostream& ostm) {
         for (auto& row : rows)
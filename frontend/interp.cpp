@@ -0,0 +1,504 @@
+//
+// Created by 田地 on 2021/9/2.
+//
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstdlib>
+
+#include "interp.h"
+#include "constant.h"
+
+using namespace std;
+using namespace cool;
+using namespace interp;
+using namespace constant;
+
+Interpreter::Interpreter(adt::ScopedTableSpecializer<adt::SymbolTable>& _stable,
+    ostream& _out, istream& _in)
+: stable(_stable), out(_out), in(_in) {}
+
+//======================================================================//
+//                            Resolution                                //
+//======================================================================//
+// walk the scopes in the order InitSymbolTable created them, like
+// LLVMGen does, turn every identifier into a slot and give every call a
+// site
+void Interpreter::resolve(repr::Program& prog) {
+
+    class Visitor : public visitor::ExprVisitor<void> {
+      private:
+        using Slot = repr::Slot;
+
+        Interpreter& interp;
+        adt::ScopedTableSpecializer<adt::SymbolTable>& stable;
+        // frame slots of the locals declared so far, by IdAttr index
+        vector<uint32_t> locals;
+
+        Slot lookup(Symbol name) {
+            int i = stable.IndexOf(name);
+            if (i < 0) {
+                if (name.Str() == "self") return Slot{Slot::Self, 0};
+                throw runtime_error("unresolved identifier '" + name.Str() + "'");
+            }
+            auto& idAttr = stable.IdAttrAt(i);
+            switch (idAttr.storageClass) {
+                case attr::IdAttr::Field:
+                    return Slot{Slot::Field, uint32_t(idAttr.idx)};
+                case attr::IdAttr::Arg:
+                    return Slot{Slot::Frame, uint32_t(idAttr.idx)};
+                case attr::IdAttr::Local:
+                    return Slot{Slot::Frame, locals[i]};
+            }
+            throw runtime_error("invalid storage class");
+        }
+
+        // the local name was just declared in the current scope
+        Slot declare(Symbol name) {
+            uint32_t i = stable.IndexOf(name);
+            if (i >= locals.size()) locals.resize(i + 1);
+            locals[i] = size;
+            return Slot{Slot::Frame, size++};
+        }
+
+        void visitBinary(repr::Binary& expr) {
+            Visit(*expr.GetLeft());
+            Visit(*expr.GetRight());
+        }
+
+        void visitArgs(repr::Call& expr) {
+            expr.SetSite(interp.sites.size());
+            interp.sites.emplace_back();
+            for (auto& arg : expr.GetArgs()) Visit(*arg);
+        }
+
+      public:
+        uint32_t size = 0; // of the frame being resolved
+
+        Visitor(Interpreter& _interp, adt::ScopedTableSpecializer<adt::SymbolTable>& _stable)
+        : interp(_interp), stable(_stable) {}
+
+        void Visit(repr::Expr& expr) { visitor::ExprVisitor<void>::Visit(expr); }
+
+        // the params of a builtin are the args of its method, in order,
+        // so they are the first slots of the frame
+        void Visit_(repr::LinkBuiltin& expr) {}
+
+        void Visit_(repr::Assign& expr) {
+            Visit(*expr.GetExpr());
+            Visit_(*expr.GetId());
+        }
+
+        void Visit_(repr::Block& expr) {
+            ENTER_SCOPE_GUARD(stable, {
+                for (auto& e : expr.GetExprs()) Visit(*e);
+            })
+        }
+
+        void Visit_(repr::Case& expr) {
+            Visit(*expr.GetExpr());
+            for (auto& branch : expr.GetBranches()) {
+                ENTER_SCOPE_GUARD(stable, {
+                    branch->SetSlot(declare(branch->GetId().Sym()));
+                    Visit(*branch->GetExpr());
+                })
+            }
+        }
+
+        void Visit_(repr::Call& expr) { ENTER_SCOPE_GUARD(stable, visitArgs(expr)) }
+
+        void Visit_(repr::ID& expr) { expr.SetSlot(lookup(expr.GetName().Sym())); }
+
+        void Visit_(repr::If& expr) {
+            ENTER_SCOPE_GUARD(stable, {
+                Visit(*expr.GetIfExpr());
+                ENTER_SCOPE_GUARD(stable, Visit(*expr.GetThenExpr()))
+                ENTER_SCOPE_GUARD(stable, Visit(*expr.GetElseExpr()))
+            })
+        }
+
+        void Visit_(repr::Let& expr) {
+            for (auto& decl : expr.GetDecls()) {
+                stable.EnterScope();
+                decl->SetSlot(declare(decl->GetName().Sym()));
+                if (decl->GetExpr()) Visit(*decl->GetExpr());
+            }
+            Visit(*expr.GetExpr());
+            for (int i = 0; i < expr.GetDecls().size(); i++)
+                stable.LeaveScope();
+        }
+
+        void Visit_(repr::MethodCall& expr) {
+            ENTER_SCOPE_GUARD(stable, {
+                Visit(*expr.GetLeft());
+                visitArgs(*static_cast<repr::Call*>(expr.GetRight()));
+            })
+        }
+
+        void Visit_(repr::While& expr) {
+            ENTER_SCOPE_GUARD(stable, {
+                Visit(*expr.GetWhileExpr());
+                Visit(*expr.GetLoopExpr());
+            })
+        }
+
+        void Visit_(repr::IsVoid& expr) { Visit(*expr.GetExpr()); }
+        void Visit_(repr::Negate& expr) { Visit(*expr.GetExpr()); }
+        void Visit_(repr::Not& expr) { Visit(*expr.GetExpr()); }
+
+        void Visit_(repr::Add& expr) { visitBinary(expr); }
+        void Visit_(repr::Divide& expr) { visitBinary(expr); }
+        void Visit_(repr::Equal& expr) { visitBinary(expr); }
+        void Visit_(repr::LessThanOrEqual& expr) { visitBinary(expr); }
+        void Visit_(repr::LessThan& expr) { visitBinary(expr); }
+        void Visit_(repr::Multiply& expr) { visitBinary(expr); }
+        void Visit_(repr::Minus& expr) { visitBinary(expr); }
+
+        void Visit_(repr::Integer& expr) {}
+        void Visit_(repr::New& expr) {}
+        void Visit_(repr::String& expr) {
+            auto id = expr.GetValue().Sym().Id();
+            if (id >= interp.literals.size()) interp.literals.resize(id + 1);
+        }
+        void Visit_(repr::True& expr) {}
+        void Visit_(repr::False& expr) {}
+    };
+
+    Visitor vis(*this, stable);
+    stable.InitTraverse();
+    ENTER_SCOPE_GUARD(stable, {
+        for (auto& cls : prog.GetClasses()) {
+            ENTER_SCOPE_GUARD(stable, {
+                for (auto& func : cls->GetOwnFuncFeatures()) {
+                    vis.size = func->GetArgs().size();
+                    ENTER_SCOPE_GUARD(stable, vis.Visit(*func->GetExpr()))
+                    func->SetFrameSize(vis.size);
+                }
+                // the initializers of a class share a frame
+                vis.size = 0;
+                for (auto& field : cls->GetOwnFieldFeatures())
+                    if (field->GetExpr()) vis.Visit(*field->GetExpr());
+                cls->SetFrameSize(vis.size);
+            })
+        }
+    })
+}
+
+//======================================================================//
+//                              Runtime                                 //
+//======================================================================//
+Object* Interpreter::alloc(repr::Class* cls) {
+    heap.emplace_back(new Object());
+    heap.back()->cls = cls;
+    return heap.back().get();
+}
+
+Value Interpreter::newString(const string& str) {
+    auto obj = alloc(stringCls);
+    obj->str = str;
+    return Value{Value::Kind::String, 0, obj};
+}
+
+Value Interpreter::defaultValue(Symbol type) {
+    if (type == SYM_INT) return Value{Value::Kind::Int, 0};
+    if (type == SYM_BOOL) return Value{Value::Kind::Bool, 0};
+    if (type == SYM_STRING) return newString("");
+    return Value();
+}
+
+Value Interpreter::boolValue(bool b) {
+    return Value{Value::Kind::Bool, b};
+}
+
+repr::Class* Interpreter::classOf(const Value& value) {
+    switch (value.kind) {
+        case Value::Kind::Int:
+            return intCls;
+        case Value::Kind::Bool:
+            return boolCls;
+        default:
+            return value.obj ? value.obj->cls : nullptr;
+    }
+}
+
+Value Interpreter::newObject(Symbol type) {
+    if (type == SYM_INT || type == SYM_BOOL || type == SYM_STRING)
+        return defaultValue(type);
+    auto cls = program->GetClassPtr(type);
+    auto obj = alloc(cls);
+    // every field holds its default before any initializer runs
+    for (auto& field : cls->GetFieldFeatures())
+        obj->fields.emplace_back(defaultValue(field->GetType().Sym()));
+    Value value{Value::Kind::Object, 0, obj};
+    initFields(cls, value);
+    return value;
+}
+
+void Interpreter::initFields(repr::Class* cls, Value obj) {
+    // the fields of the parent are initialized first
+    if (auto parent = program->GetClassPtr(cls->GetParent().Sym()))
+        initFields(parent, obj);
+    auto& fields = cls->GetFieldFeatures();
+    for (uint32_t i = 0; i < fields.size(); i++) {
+        if (!fields[i]->GetExpr() || cls->IsInherited(fields[i])) continue;
+        auto value = eval(*fields[i]->GetExpr(), obj, cls->GetFrameSize(), {});
+        obj.obj->fields[i] = value;
+    }
+}
+
+Value& Interpreter::load(const repr::Slot& slot) {
+    switch (slot.kind) {
+        case repr::Slot::Field:
+            return self.obj->fields[slot.idx];
+        case repr::Slot::Frame:
+            return stack[base + slot.idx];
+        default:
+            return self;
+    }
+}
+
+Value Interpreter::eval(repr::Expr& expr, Value receiver, uint32_t size, const vector<Value>& args) {
+    auto savedBase = base;
+    auto savedSelf = self;
+    base = stack.size();
+    stack.resize(base + max<size_t>(size, args.size()));
+    copy(args.begin(), args.end(), stack.begin() + base);
+    self = receiver;
+
+    auto value = Visit(expr);
+
+    stack.resize(base);
+    base = savedBase;
+    self = savedSelf;
+    return value;
+}
+
+Value Interpreter::call(Value receiver, repr::Call& call) {
+    vector<Value> args;
+    for (auto& arg : call.GetArgs()) args.emplace_back(Visit(*arg));
+    if (receiver.kind == Value::Kind::Void)
+        throw runtime_error(call.GetTextInfo().String() + ": dispatch to void");
+    auto cls = classOf(receiver);
+    auto& site = sites[call.GetSite()];
+    if (site.cls != cls) {
+        auto func = cls->GetFuncFeaturePtr(call.GetId()->GetName().Sym());
+        if (!func)
+            throw runtime_error(call.GetTextInfo().String() + ": '" + cls->GetName().Value()
+                + "' has no method '" + call.GetId()->GetName().Value() + "'");
+        site = Site{cls, func};
+    }
+    return eval(*site.func->GetExpr(), receiver, site.func->GetFrameSize(), args);
+}
+
+int32_t Interpreter::intOf(repr::Expr& expr) {
+    return Visit(expr).i;
+}
+
+bool Interpreter::boolOf(repr::Expr& expr) {
+    return Visit(expr).i != 0;
+}
+
+void Interpreter::Run(repr::Program& prog) {
+    program = &prog;
+    intCls = prog.GetClassPtr(SYM_INT);
+    boolCls = prog.GetClassPtr(SYM_BOOL);
+    stringCls = prog.GetClassPtr(SYM_STRING);
+    resolve(prog);
+    auto main = newObject(SYM_MAIN);
+    auto func = classOf(main)->GetFuncFeaturePtr(SYM_FUNC_MAIN);
+    if (!func) throw runtime_error("no method main in class Main");
+    eval(*func->GetExpr(), main, func->GetFrameSize(), {});
+    out.flush();
+}
+
+//======================================================================//
+//                            Expressions                               //
+//======================================================================//
+// the methods of the builtin classes, see builtin.cpp. The args are
+// the first values of the frame.
+Value Interpreter::Visit_(repr::LinkBuiltin& expr) {
+    auto args = stack.begin() + base;
+    auto name = expr.Sym();
+    if (name == SYM_FUNC_OUT_STRING) {
+        out<< args[0].obj->str<< '\n';
+        return self;
+    }
+    if (name == SYM_FUNC_OUT_INT) {
+        out<< args[0].i<< '\n';
+        return self;
+    }
+    if (name == SYM_FUNC_IN_STRING || name == SYM_FUNC_IN_INT) {
+        // a line without its newline, empty at the end of the input
+        string line;
+        getline(in, line);
+        if (name == SYM_FUNC_IN_STRING) return newString(line);
+        return Value{Value::Kind::Int, int32_t(strtol(line.c_str(), nullptr, 10))};
+    }
+    if (name == SYM_FUNC_LENGTH)
+        return Value{Value::Kind::Int, int32_t(self.obj->str.size())};
+    if (name == SYM_FUNC_CONCAT)
+        return newString(self.obj->str + args[0].obj->str);
+    if (name == SYM_FUNC_SUBSTR) {
+        auto& str = self.obj->str;
+        int64_t i = args[0].i;
+        int64_t l = args[1].i;
+        if (i < 0 || l < 0 || i + l > int64_t(str.size()))
+            throw runtime_error("substr(" + to_string(i) + ", " + to_string(l)
+                + ") out of range of a String of length " + to_string(str.size()));
+        return newString(str.substr(i, l));
+    }
+    if (name == SYM_FUNC_TYPE_NAME)
+        return newString(classOf(self)->GetName().Value());
+    if (name == SYM_FUNC_COPY) {
+        // Int, Bool and String values are immutable
+        if (self.kind != Value::Kind::Object) return self;
+        auto obj = alloc(self.obj->cls);
+        obj->fields = self.obj->fields;
+        return Value{Value::Kind::Object, 0, obj};
+    }
+    if (name == SYM_FUNC_ABORT)
+        throw runtime_error("abort called from class '" + classOf(self)->GetName().Value() + "'");
+    throw runtime_error("builtin '" + expr.GetName() + "' is not supported");
+}
+
+Value Interpreter::Visit_(repr::Assign& expr) {
+    auto value = Visit(*expr.GetExpr());
+    load(expr.GetId()->GetSlot()) = value;
+    return value;
+}
+
+Value Interpreter::Visit_(repr::Add& expr) {
+    uint32_t left = intOf(*expr.GetLeft());
+    return Value{Value::Kind::Int, int32_t(left + uint32_t(intOf(*expr.GetRight())))};
+}
+
+Value Interpreter::Visit_(repr::Block& expr) {
+    Value value;
+    for (auto& e : expr.GetExprs()) value = Visit(*e);
+    return value;
+}
+
+Value Interpreter::Visit_(repr::Case& expr) {
+    auto value = Visit(*expr.GetExpr());
+    if (value.kind == Value::Kind::Void)
+        throw runtime_error(expr.GetTextInfo().String() + ": case on void");
+    // the branch of the closest ancestor
+    for (auto cls = classOf(value); cls; cls = program->GetClassPtr(cls->GetParent().Sym())) {
+        for (auto& branch : expr.GetBranches()) {
+            if (branch->GetType().Sym() != cls->GetName().Sym()) continue;
+            load(branch->GetSlot()) = value;
+            return Visit(*branch->GetExpr());
+        }
+    }
+    throw runtime_error(expr.GetTextInfo().String() + ": no case branch matches '"
+        + classOf(value)->GetName().Value() + "'");
+}
+
+Value Interpreter::Visit_(repr::Call& expr) {
+    return call(self, expr);
+}
+
+Value Interpreter::Visit_(repr::Divide& expr) {
+    int32_t left = intOf(*expr.GetLeft());
+    int32_t right = intOf(*expr.GetRight());
+    if (right == 0)
+        throw runtime_error(expr.GetTextInfo().String() + ": division by zero");
+    // the only quotient that overflows, it wraps around
+    if (right == -1) return Value{Value::Kind::Int, int32_t(0u - uint32_t(left))};
+    return Value{Value::Kind::Int, left / right};
+}
+
+Value Interpreter::Visit_(repr::Equal& expr) {
+    auto left = Visit(*expr.GetLeft());
+    auto right = Visit(*expr.GetRight());
+    if (left.kind == Value::Kind::String && right.kind == Value::Kind::String)
+        return boolValue(left.obj->str == right.obj->str);
+    if (left.kind == Value::Kind::Int || left.kind == Value::Kind::Bool)
+        return boolValue(left.i == right.i);
+    return boolValue(left.obj == right.obj);
+}
+
+Value Interpreter::Visit_(repr::False& expr) {
+    return boolValue(false);
+}
+
+Value Interpreter::Visit_(repr::ID& expr) {
+    return load(expr.GetSlot());
+}
+
+Value Interpreter::Visit_(repr::IsVoid& expr) {
+    return boolValue(Visit(*expr.GetExpr()).kind == Value::Kind::Void);
+}
+
+Value Interpreter::Visit_(repr::Integer& expr) {
+    return Value{Value::Kind::Int, expr.GetValue().Value()};
+}
+
+Value Interpreter::Visit_(repr::If& expr) {
+    return boolOf(*expr.GetIfExpr()) ? Visit(*expr.GetThenExpr()) : Visit(*expr.GetElseExpr());
+}
+
+Value Interpreter::Visit_(repr::LessThanOrEqual& expr) {
+    int32_t left = intOf(*expr.GetLeft());
+    return boolValue(left <= intOf(*expr.GetRight()));
+}
+
+Value Interpreter::Visit_(repr::LessThan& expr) {
+    int32_t left = intOf(*expr.GetLeft());
+    return boolValue(left < intOf(*expr.GetRight()));
+}
+
+Value Interpreter::Visit_(repr::Let& expr) {
+    for (auto& decl : expr.GetDecls()) {
+        auto value = decl->GetExpr() ? Visit(*decl->GetExpr()) : defaultValue(decl->GetType().Sym());
+        load(decl->GetSlot()) = value;
+    }
+    return Visit(*expr.GetExpr());
+}
+
+Value Interpreter::Visit_(repr::MethodCall& expr) {
+    auto receiver = Visit(*expr.GetLeft());
+    return call(receiver, *static_cast<repr::Call*>(expr.GetRight()));
+}
+
+Value Interpreter::Visit_(repr::Multiply& expr) {
+    uint32_t left = intOf(*expr.GetLeft());
+    return Value{Value::Kind::Int, int32_t(left * uint32_t(intOf(*expr.GetRight())))};
+}
+
+Value Interpreter::Visit_(repr::Minus& expr) {
+    uint32_t left = intOf(*expr.GetLeft());
+    return Value{Value::Kind::Int, int32_t(left - uint32_t(intOf(*expr.GetRight())))};
+}
+
+Value Interpreter::Visit_(repr::Negate& expr) {
+    return Value{Value::Kind::Int, int32_t(0u - uint32_t(intOf(*expr.GetExpr())))};
+}
+
+Value Interpreter::Visit_(repr::New& expr) {
+    auto type = expr.GetType().Sym();
+    if (type == SYM_SELF_TYPE) type = classOf(self)->GetName().Sym();
+    return newObject(type);
+}
+
+Value Interpreter::Visit_(repr::Not& expr) {
+    return boolValue(!boolOf(*expr.GetExpr()));
+}
+
+// literals are immutable and allocated once
+Value Interpreter::Visit_(repr::String& expr) {
+    auto& obj = literals[expr.GetValue().Sym().Id()];
+    if (!obj) obj = newString(expr.GetValue().Value()).obj;
+    return Value{Value::Kind::String, 0, obj};
+}
+
+Value Interpreter::Visit_(repr::True& expr) {
+    return boolValue(true);
+}
+
+Value Interpreter::Visit_(repr::While& expr) {
+    while (boolOf(*expr.GetWhileExpr()))
+        Visit(*expr.GetLoopExpr());
+    return Value();
+}
@@ -0,0 +1,150 @@
+//
+// Created by 田地 on 2021/9/2.
+//
+
+#ifndef COOL_INTERP_H
+#define COOL_INTERP_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "visitor.h"
+#include "repr.h"
+#include "adt.h"
+#include "symbol.h"
+
+using namespace std;
+
+namespace cool {
+
+namespace interp {
+
+//======================================================================//
+//                           Value Struct                               //
+//======================================================================//
+struct Object;
+
+// Int and Bool are unboxed, String and other objects point into the heap
+// of the Interpreter, void is Kind::Void
+struct Value {
+    enum class Kind : uint8_t {
+        Void,
+        Int,
+        Bool,
+        String,
+        Object,
+    };
+    Kind kind = Kind::Void;
+    int32_t i = 0;
+    Object* obj = nullptr;
+};
+
+struct Object {
+    repr::Class* cls = nullptr;
+    vector<Value> fields;
+    string str; // content of a String
+    bool marked = false; // by the collector of vm::VM
+};
+
+//======================================================================//
+//                         Interpreter Class                            //
+//======================================================================//
+// Runs a program that passed SemanticChecking directly on its AST, with
+// no code generation, so the program starts right away. Identifiers are
+// resolved to slots once before running, from the IdAttrs InitSymbolTable
+// left in the symbol table, and the slots are kept on the nodes: a field
+// to its index in the object, an arg or a local to its index in the frame
+// of the method. Frames live on one value stack. Every call gets an inline
+// cache of the method its receiver's class last dispatched to. Objects
+// live as long as the interpreter.
+class Interpreter : visitor::ExprVisitor<Value> {
+  private:
+    // the inline cache of a call
+    struct Site {
+        repr::Class* cls = nullptr;
+        repr::FuncFeature* func = nullptr;
+    };
+
+    adt::ScopedTableSpecializer<adt::SymbolTable>& stable;
+    ostream& out;
+    istream& in;
+    repr::Program* program = nullptr;
+    repr::Class* intCls = nullptr;
+    repr::Class* boolCls = nullptr;
+    repr::Class* stringCls = nullptr;
+
+    // set by resolve
+    vector<Site> sites; // by Call::GetSite
+    vector<Object*> literals; // by the Symbol id of their value
+
+    vector<unique_ptr<Object>> heap;
+    vector<Value> stack;
+    size_t base = 0; // of the current frame
+    Value self;
+
+    void resolve(repr::Program& prog);
+
+    Object* alloc(repr::Class* cls);
+    Value newString(const string& str);
+    Value defaultValue(Symbol type);
+    repr::Class* classOf(const Value& value);
+    // a new object of type with its fields initialized
+    Value newObject(Symbol type);
+    void initFields(repr::Class* cls, Value obj);
+
+    Value& load(const repr::Slot& slot);
+    Value call(Value receiver, repr::Call& call);
+    // eval expr with a fresh frame of size above the current one
+    Value eval(repr::Expr& expr, Value receiver, uint32_t size, const vector<Value>& args);
+
+    int32_t intOf(repr::Expr& expr);
+    bool boolOf(repr::Expr& expr);
+    Value boolValue(bool b);
+
+  public:
+    // out_string and out_int write to _out, in_string and in_int read
+    // from _in
+    explicit Interpreter(adt::ScopedTableSpecializer<adt::SymbolTable>& _stable,
+        ostream& _out = cout, istream& _in = cin);
+    Interpreter(const Interpreter&) = delete;
+    Interpreter& operator=(const Interpreter&) = delete;
+
+    // run Main.main, throw runtime_error on an error at run time, e.g. a
+    // dispatch on void
+    void Run(repr::Program& prog);
+
+    Value Visit_(repr::LinkBuiltin& expr) final;
+    Value Visit_(repr::Assign& expr) final;
+    Value Visit_(repr::Add& expr) final;
+    Value Visit_(repr::Block& expr) final;
+    Value Visit_(repr::Case& expr) final;
+    Value Visit_(repr::Call& expr) final;
+    Value Visit_(repr::Divide& expr) final;
+    Value Visit_(repr::Equal& expr) final;
+    Value Visit_(repr::False& expr) final;
+    Value Visit_(repr::ID& expr) final;
+    Value Visit_(repr::IsVoid& expr) final;
+    Value Visit_(repr::Integer& expr) final;
+    Value Visit_(repr::If& expr) final;
+    Value Visit_(repr::LessThanOrEqual& expr) final;
+    Value Visit_(repr::LessThan& expr) final;
+    Value Visit_(repr::Let& expr) final;
+    Value Visit_(repr::MethodCall& expr) final;
+    Value Visit_(repr::Multiply& expr) final;
+    Value Visit_(repr::Minus& expr) final;
+    Value Visit_(repr::Negate& expr) final;
+    Value Visit_(repr::New& expr) final;
+    Value Visit_(repr::Not& expr) final;
+    Value Visit_(repr::String& expr) final;
+    Value Visit_(repr::True& expr) final;
+    Value Visit_(repr::While& expr) final;
+};
+
+} // namespace interp
+
+} // namespace cool
+
+#endif //COOL_INTERP_H
@@ -5,6 +5,9 @@
 #include <vector>
 #include <memory>
 #include <string>
+#include <unordered_set>
+#include <algorithm>
+#include <functional>
 
 #include <stdlib.h>
 
@@ -14,9 +17,16 @@
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/Program.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/PassInstrumentation.h"
+#include "llvm/IR/PassTimingInfo.h"
+#include "llvm/Passes/PassBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
@@ -27,7 +37,15 @@
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/Support/raw_os_ostream.h"
-
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include "../runtime/runtime.h"
+#include "../runtime/gc.h"
+#include "../runtime/arena.h"
 #include "builtin.h"
 #include "llvm_gen.h"
 #include "adt.h"
@@ -39,51 +57,61 @@ using namespace irgen;
 using namespace llvm;
 using namespace constant;
 
+namespace {
+
+// the builtins generated code implements, the others are only run by
+// interp::Interpreter and vm::VM
+bool IsNativeBuiltin(Symbol name) {
+    return name == SYM_FUNC_OUT_STRING || name == SYM_FUNC_OUT_INT || name == SYM_FUNC_IN_INT
+        || name == SYM_FUNC_LENGTH || name == SYM_FUNC_ABORT || name == SYM_FUNC_COPY
+        || name == SYM_FUNC_TYPE_NAME;
+}
+
+} // namespace
+
 //======================================================================//
 //                       SymbolTable Class                              //
 //======================================================================//
 LLVMGen::SymbolTable::SymbolTable(
     adt::ScopedTableSpecializer<adt::SymbolTable> &_stable)
-: stable(_stable) {
-    for (int i = 0; i < stable.Size(); i++) valueTable.insert({i, {}});
+: stable(_stable), values(_stable.NumIdAttr(), nullptr) {
     stable.InitTraverse();
 }
 
-llvm::Value* LLVMGen::SymbolTable::get(const string& name) {
-    auto& stack = stable.Stack();
-    for (auto it = stack.rbegin(); it != stack.rend(); it++) {
-        if (valueTable.at(*it).find(name) != valueTable.at(*it).end())
-            return valueTable.at(*it).at(name);
-    }
-    assert(false && "symbol not found");
-    return nullptr;
+llvm::Value* LLVMGen::SymbolTable::get(Symbol name) {
+    int i = stable.IndexOf(name);
+    assert(i >= 0 && values.at(i) && "symbol not found");
+    return values.at(i);
 }
 
-void LLVMGen::SymbolTable::insert(const string& name,
+void LLVMGen::SymbolTable::insert(Symbol name,
     llvm::Value* value) {
-    valueTable.at(stable.Idx()).insert({name, value});
+    int i = stable.IndexOf(name);
+    assert(i >= 0 && "symbol not declared");
+    values.at(i) = value;
 }
 
-void LLVMGen::SymbolTable::InsertLocalVar(const string& name,
+void LLVMGen::SymbolTable::InsertLocalVar(Symbol name,
     llvm::Value* value) {
     insert(name, value);
 }
 
 void LLVMGen::SymbolTable::InsertSelfVar(llvm::Value* value) {
-    insert("self", value);
+    self = value;
 }
 
-void LLVMGen::SymbolTable::InsertArg(const string& name,
+void LLVMGen::SymbolTable::InsertArg(Symbol name,
     llvm::Value* value) {
     insert(name, value);
 }
 
-llvm::Value * LLVMGen::SymbolTable::GetLocalVar(const string &name) {
+llvm::Value * LLVMGen::SymbolTable::GetLocalVar(Symbol name) {
     return get(name);
 }
 
 llvm::Value * LLVMGen::SymbolTable::GetSelfVar() {
-    return get("self");
+    assert(self && "self not set");
+    return self;
 }
 
 llvm::Value * LLVMGen::SymbolTable::GetSelfField(uint32_t i) {
@@ -91,7 +119,7 @@ llvm::Value * LLVMGen::SymbolTable::GetSelfField(uint32_t i) {
     return nullptr;
 }
 
-llvm::Value * LLVMGen::SymbolTable::GetArg(const string &name) {
+llvm::Value * LLVMGen::SymbolTable::GetArg(Symbol name) {
     return get(name);
 }
 
@@ -119,7 +147,9 @@ LLVMGen::LLVMGen(adt::ScopedTableSpecializer<adt::SymbolTable>& _stable)
     auto Features = "";
 
     TargetOptions opt;
-    auto RM = Optional<Reloc::Model>();
+    // position independent, so that EmitExecutable can link with the
+    // default, usually PIE, settings of the system linker
+    auto RM = Optional<Reloc::Model>(Reloc::PIC_);
     target = unique_ptr<TargetMachine>(
         Target->createTargetMachine(
             TargetTriple,
@@ -168,7 +198,10 @@ llvm::PointerType* LLVMGen::GetStringLLVMType() {
 //    if(st->isOpaque()) todo: this line cause Assersion failed, check the reason
         st->setBody({
             Type::getInt32Ty(*context),
-            PointerType::getInt8PtrTy(*context)
+            Type::getInt32Ty(*context),
+            GetVTablePointerType(),
+            Type::getInt32Ty(*context),
+            ArrayType::get(Type::getInt8Ty(*context), 0)
         });
     return PointerType::get(st, 0);
 }
@@ -179,7 +212,7 @@ llvm::Value* LLVMGen::AllocLLVMConstStringStruct(const string& str) {
         getStructLayout(cast<StructType>(
             GetStringLLVMType()->getPointerElementType())
         )->
-        getElementOffset(1);
+        getElementOffset(FieldIndex(1));
 
     // create data
     vector<Constant*> chars;
@@ -187,16 +220,16 @@ llvm::Value* LLVMGen::AllocLLVMConstStringStruct(const string& str) {
         chars.emplace_back(ConstInt8(c));
     chars.emplace_back(ConstInt8('\0'));
 
-    GetStringLLVMType();
-
+    uint32_t size = (chars.size() + dataOffset + 7) & ~7u;
     auto strPtr = CreateMallocCall(
-        chars.size() + dataOffset,
+        size,
         GetStringLLVMType());
+    CreateObjectHeader(strPtr, SYM_STRING, size);
 
     // set size pointer
     auto sizeFieldPtr = builder->CreateGEP(
         strPtr,
-        ConstInt32s({0, 0}));
+        ConstInt32s({0, FieldIndex(0)}));
     builder->CreateStore(
         ConstInt32(chars.size() - 1),
         sizeFieldPtr);
@@ -209,7 +242,7 @@ llvm::Value* LLVMGen::AllocLLVMConstStringStruct(const string& str) {
             chars);
     auto dataFieldPtr = builder->CreateGEP(
         strPtr,
-        ConstInt32s({0, 1}));
+        ConstInt32s({0, FieldIndex(1)}));
 
     auto dataMemAddr = builder->CreatePointerCast(
         dataFieldPtr,
@@ -224,14 +257,14 @@ llvm::Value* LLVMGen::AllocLLVMConstStringStruct(const string& str) {
     return strPtr;
 }
 
-Type* LLVMGen::GetLLVMType(const string& name) {
-    if (name == CLS_INT_NAME)
+Type* LLVMGen::GetLLVMType(Symbol name) {
+    if (name == SYM_INT)
         return Type::getInt32Ty(*context);
-    if (name == CLS_BOOL_NAME)
+    if (name == SYM_BOOL)
         return Type::getInt32Ty(*context);
-    if (name == CLS_STRING_NAME)
+    if (name == SYM_STRING)
         return GetStringLLVMType();
-    return CreateStructPointerTypeIfNx(name);
+    return CreateStructPointerTypeIfNx(name.Str());
 }
 
 llvm::Value* LLVMGen::GetPointedValueIfAPointer(llvm::Value* value) {
@@ -247,8 +280,8 @@ llvm::Value* LLVMGen::GetPointedValueIfAPointer(llvm::Value* value) {
     return builder->CreateLoad(value);
 }
 
-bool LLVMGen::IsMappedToLLVMStructPointerType(const string& type) {
-    return type != CLS_INT_NAME && type != CLS_BOOL_NAME;
+bool LLVMGen::IsMappedToLLVMStructPointerType(Symbol type) {
+    return type != SYM_INT && type != SYM_BOOL;
 }
 
 bool LLVMGen::IsStringLLVMType(llvm::Value* v) {
@@ -257,20 +290,26 @@ bool LLVMGen::IsStringLLVMType(llvm::Value* v) {
     == CLS_STRING_NAME;
 }
 
-string LLVMGen::FunctionName(const string& name, const string& selfType) {
-    return selfType + "_" + name;
+const string& LLVMGen::FunctionName(Symbol name, Symbol selfType) {
+    uint64_t key = uint64_t(selfType.Id()) << 32 | name.Id();
+    auto it = functionNames.find(key);
+    if (it == functionNames.end())
+        it = functionNames.insert({key, selfType.Str() + "_" + name.Str()}).first;
+    return it->second;
 }
 
-Function* LLVMGen::CreateFunctionDeclIfNx(const string& name,
-    const string& type, const string& selfType, vector<Formal*> args) {
+Function* LLVMGen::CreateFunctionDeclIfNx(Symbol name,
+    Symbol type, Symbol selfType, const ArenaArray<Formal*>& args) {
     auto funcName = FunctionName(name, selfType);
 
     auto function = module->getFunction(funcName);
     if (function) return function;
 
+    if (type == SYM_SELF_TYPE) type = selfType;
+
     vector<Type *> argTypes = {GetLLVMType(selfType)};
     for(auto& arg : args)
-        argTypes.emplace_back(GetLLVMType(arg->GetType().Value()));
+        argTypes.emplace_back(GetLLVMType(arg->GetType().Sym()));
 
     FunctionType* ft = FunctionType::get(GetLLVMType(type),
         argTypes, false);
@@ -328,6 +367,22 @@ void LLVMGen::CreateRuntimeFunctionDecls() {
     Function::Create(ft, Function::ExternalLinkage,
         "mallocool", module.get());
 
+    // runtime/gc.h: void cool_gc_write_barrier(void* obj, void* value);
+    args = {int8Ptr, int8Ptr};
+    ft = FunctionType::get(Type::getVoidTy(*context), args, false);
+    Function::Create(ft, Function::ExternalLinkage,
+        CG_WRITE_BARRIER_NAME, module.get());
+
+    // runtime/gc.h: CoolFrame* cool_gc_roots;
+    new GlobalVariable(*module, int8Ptr, false, GlobalValue::ExternalLinkage,
+        nullptr, CG_GC_ROOTS_NAME);
+
+    // runtime/arena.h: char* cool_arena_top, cool_arena_end;
+    new GlobalVariable(*module, int8Ptr, false, GlobalValue::ExternalLinkage,
+        nullptr, CG_ARENA_TOP_NAME);
+    new GlobalVariable(*module, int8Ptr, false, GlobalValue::ExternalLinkage,
+        nullptr, CG_ARENA_END_NAME);
+
     // runtime/runtime.h: void* out_int(int32_t i);
     args = {int32Type};
     ft = FunctionType::get(voidPointerType, args, false);
@@ -340,6 +395,28 @@ void LLVMGen::CreateRuntimeFunctionDecls() {
     Function::Create(ft, Function::ExternalLinkage,
         "out_string", module.get());
 
+    // runtime/runtime.h: int32_t in_int(void);
+    ft = FunctionType::get(int32Type, false);
+    Function::Create(ft, Function::ExternalLinkage,
+        "in_int", module.get());
+
+    // runtime/runtime.h: void cool_abort(void);
+    ft = FunctionType::get(Type::getVoidTy(*context), false);
+    Function::Create(ft, Function::ExternalLinkage,
+        CG_ABORT_NAME, module.get())->setDoesNotReturn();
+
+    // runtime/runtime.h: void* cool_copy(void* obj);
+    args = {int8Ptr};
+    ft = FunctionType::get(int8Ptr, args, false);
+    Function::Create(ft, Function::ExternalLinkage,
+        CG_COPY_NAME, module.get());
+
+    // runtime/runtime.h: void cool_case_abort(int64_t classId);
+    args = {int64Type};
+    ft = FunctionType::get(Type::getVoidTy(*context), args, false);
+    Function::Create(ft, Function::ExternalLinkage,
+        CG_CASE_ABORT_NAME, module.get())->setDoesNotReturn();
+
     // runtime/runtime.h: void print_ptr(void*);
     args = {voidPointerType};
     ft = FunctionType::get(voidPointerType, args, false);
@@ -347,18 +424,18 @@ void LLVMGen::CreateRuntimeFunctionDecls() {
         "print_ptr", module.get());
 }
 
-llvm::Value* LLVMGen::DefaultNewOperator(const string& type) {
-    if (type == CLS_INT_NAME) {
+llvm::Value* LLVMGen::DefaultNewOperator(Symbol type) {
+    if (type == SYM_INT) {
         return ConstInt32(0);
     }
-    if (type == CLS_BOOL_NAME) {
+    if (type == SYM_BOOL) {
         auto f = ConstantInt::getFalse(Type::getInt32Ty(*context));
         return builder->CreateIntCast(
             f,
             Type::getInt32Ty(*context),
             true);
     }
-    if (type == CLS_STRING_NAME) {
+    if (type == SYM_STRING) {
         return AllocLLVMConstStringStruct("");
     }
 //    if (type == CLS_OBJECT_NAME) {
@@ -367,19 +444,19 @@ llvm::Value* LLVMGen::DefaultNewOperator(const string& type) {
 //    if (type == CLS_IO_NAME) {
 //      todo
 //    }
-    return ConstantPointerNull::get(CreateStructPointerTypeIfNx(type));
+    return ConstantPointerNull::get(CreateStructPointerTypeIfNx(type.Str()));
 }
 
-llvm::Function* LLVMGen::CreateNewOperatorDeclIfNx(const string& type) {
-    assert(!type.empty() && isupper(type.at(0)));
-    auto function = module->getFunction(type);
+llvm::Function* LLVMGen::CreateNewOperatorDeclIfNx(Symbol type) {
+    assert(!type.Empty() && isupper(type.Str().at(0)));
+    auto function = module->getFunction(type.Str());
     if (!function) {
         FunctionType* ft = FunctionType::get(
             GetLLVMType(type),false);
         function = Function::Create(
             ft,
             Function::ExternalLinkage,
-            type,
+            type.Str(),
             module.get());
     }
     return function;
@@ -387,49 +464,333 @@ llvm::Function* LLVMGen::CreateNewOperatorDeclIfNx(const string& type) {
 
 
 llvm::Function* LLVMGen::CreateNewOperatorBody(Class &cls) {
-    auto function = CreateNewOperatorDeclIfNx(cls.GetName().Value());
+    auto function = CreateNewOperatorDeclIfNx(cls.GetName().Sym());
 
     BasicBlock* bb = BasicBlock::Create(*context, "entry", function);
     builder->SetInsertPoint(bb);
 
-    if (builtin::IsBuiltinClass(cls.GetName().Value())) {
-        builder->CreateRet(DefaultNewOperator(cls.GetName().Value()));
+    // Int, Bool and String are made from their values
+    if (!HasObjectHeader(cls.GetName().Sym()) || cls.GetName().Sym() == SYM_STRING) {
+        builder->CreateRet(DefaultNewOperator(cls.GetName().Sym()));
         return function;
     }
 
     // malloc
-    uint32_t size = cls.GetFieldFeatures().size() * 4;
+    auto structType = CreateOpaqueStructTypeIfNx(cls.GetName().Value());
+    uint32_t size = module->getDataLayout().getTypeAllocSize(structType);
     auto ptr = CreateMallocCall(
         size,
         CreateStructPointerTypeIfNx(cls.GetName().Value()));
+    // the default of a String field allocates
+    auto slot = CreateRootSlot(ptr->getType());
+    builder->CreateStore(ptr, slot);
 
-    // init fields
+    CreateObjectHeader(ptr, cls.GetName().Sym(), size);
+
+    // every field holds its default before any initializer runs
     uint32_t i = 0;
     for (auto& field : cls.GetFieldFeatures()) {
-        Value* value;
+        auto value = DefaultNewOperator(field->GetType().Sym());
+        ptr = builder->CreateLoad(slot);
         Value* fieldPtr = builder->CreateGEP(
             ptr,
-            ConstInt32s({0, i++}));
-        if (field->GetExpr())
-            value = Visit(*field->GetExpr());
-        else
-            value = DefaultNewOperator(field->GetType().Value());
-        builder->CreateStore(value, fieldPtr);
+            ConstInt32s({0, FieldIndex(i++)}));
+        CreateFieldStore(ptr, fieldPtr, value);
     }
+    if (!builtin::IsBuiltinClass(cls.GetName().Value()))
+        builder->CreateCall(CreateInitializerDeclIfNx(cls.GetName().Sym()), {builder->CreateLoad(slot)});
 
-    builder->CreateRet(ptr);
+    builder->CreateRet(builder->CreateLoad(slot));
+    CreateGCFrame(function);
     return function;
 }
 
-llvm::Value* LLVMGen::CreateNewOperatorCall(const string& type) {
-    CreateNewOperatorDeclIfNx(type);
-    return builder->CreateCall(module->getFunction(type), {});
+llvm::Function* LLVMGen::CreateInitializerDeclIfNx(Symbol type) {
+    auto name = type.Str() + CG_FUNC_INIT_SUFFIX;
+    auto function = module->getFunction(name);
+    if (!function) {
+        FunctionType* ft = FunctionType::get(
+            Type::getVoidTy(*context), {GetLLVMType(type)}, false);
+        function = Function::Create(
+            ft,
+            Function::ExternalLinkage,
+            name,
+            module.get());
+        function->args().begin()->setName("self");
+    }
+    return function;
+}
+
+llvm::Function* LLVMGen::CreateInitializerBody(Class& cls) {
+    auto function = CreateInitializerDeclIfNx(cls.GetName().Sym());
+
+    BasicBlock* bb = BasicBlock::Create(*context, "entry", function);
+    builder->SetInsertPoint(bb);
+    auto self = function->args().begin();
+    auto selfSlot = CreateRootSlot(self->getType());
+    builder->CreateStore(self, selfSlot);
+    llvmStable.InsertSelfVar(selfSlot);
+
+    // the parent's fields are a prefix of ours
+    auto parent = cls.GetParent().Sym();
+    if (!parent.Empty() && !builtin::IsBuiltinClass(parent.Str())) {
+        auto parentInit = CreateInitializerDeclIfNx(parent);
+        builder->CreateCall(parentInit, {builder->CreatePointerCast(
+            self, parentInit->getFunctionType()->getParamType(0))});
+    }
+
+    uint32_t i = 0;
+    for (auto& field : cls.GetFieldFeatures()) {
+        uint32_t idx = i++;
+        if (cls.IsInherited(field) || !field->GetExpr()) continue;
+        // the value first, evaluating it may move self
+        auto value = CreateBoxIfNeeded(GetPointedValueIfAPointer(Visit(*field->GetExpr())),
+            field->GetType().Sym(), field->GetExpr()->GetStaticType());
+        auto obj = CreateSelfLoad();
+        Value* fieldPtr = builder->CreateGEP(obj, ConstInt32s({0, FieldIndex(idx)}));
+        CreateFieldStore(obj, fieldPtr, value);
+    }
+
+    builder->CreateRetVoid();
+    CreateGCFrame(function);
+    return function;
+}
+
+llvm::Value* LLVMGen::CreateNewOperatorCall(Symbol type) {
+    return builder->CreateCall(CreateNewOperatorDeclIfNx(type), {});
 }
 
 llvm::Value* LLVMGen::CreateMallocCall(int size, llvm::Type* ptrType) {
     auto mallocFunc = module->getFunction("mallocool");
-    auto orgPtr = builder->CreateCall(mallocFunc, {ConstInt64(size)});
-    return builder->CreatePointerCast(orgPtr, ptrType);
+    size = (size + 7) & ~7;
+
+    // bump the arena if it has room, it has none unless in use, see
+    // runtime/arena.h
+    Function* function = builder->GetInsertBlock()->getParent();
+    BasicBlock* bumpBB = BasicBlock::Create(*context, "bump", function);
+    BasicBlock* callBB = BasicBlock::Create(*context, "malloc", function);
+    BasicBlock* mergeBB = BasicBlock::Create(*context, "allocated", function);
+    auto topVar = module->getNamedGlobal(CG_ARENA_TOP_NAME);
+    auto endVar = module->getNamedGlobal(CG_ARENA_END_NAME);
+    auto top = builder->CreateLoad(topVar);
+    auto end = builder->CreateLoad(endVar);
+    auto next = builder->CreateGEP(top, ConstInt64(size));
+    builder->CreateCondBr(builder->CreateICmpULE(next, end), bumpBB, callBB,
+        MDBuilder(*context).createBranchWeights(1000, 1));
+
+    builder->SetInsertPoint(bumpBB);
+    builder->CreateStore(next, topVar);
+    builder->CreateBr(mergeBB);
+
+    builder->SetInsertPoint(callBB);
+    auto orgPtr = builder->CreatePointerCast(
+        builder->CreateCall(mallocFunc, {ConstInt64(size)}),
+        top->getType());
+    builder->CreateBr(mergeBB);
+
+    builder->SetInsertPoint(mergeBB);
+    auto phi = builder->CreatePHI(top->getType(), 2);
+    phi->addIncoming(top, bumpBB);
+    phi->addIncoming(orgPtr, callBB);
+    return builder->CreatePointerCast(phi, ptrType);
+}
+
+llvm::AllocaInst* LLVMGen::CreateEntryAlloca(llvm::Type* type) {
+    auto& entry = builder->GetInsertBlock()->getParent()->getEntryBlock();
+    IRBuilder<> front(&entry, entry.begin());
+    return front.CreateAlloca(type);
+}
+
+llvm::AllocaInst* LLVMGen::CreateRootSlot(llvm::Type* type) {
+    auto slot = CreateEntryAlloca(type);
+    rootSlots.emplace_back(slot);
+    return slot;
+}
+
+llvm::Value* LLVMGen::CreateSelfLoad() {
+    auto self = llvmStable.GetSelfVar();
+    return builder->CreateLoad(self);
+}
+
+void LLVMGen::CreateGCFrame(llvm::Function* function, bool mayAllocate) {
+    auto slots = move(rootSlots);
+    rootSlots.clear();
+    // nothing can move while it runs
+    if (slots.empty() || !mayAllocate) return;
+
+    auto ptrType = Type::getInt8PtrTy(*context);
+    auto frameType = ArrayType::get(ptrType, slots.size() + 2);
+    auto head = module->getNamedGlobal(CG_GC_ROOTS_NAME);
+
+    // {prev, count, roots...} as CoolFrame, with the roots null until
+    // stored, a collection may come before
+    auto& entry = function->getEntryBlock();
+    IRBuilder<> push(&entry, entry.begin());
+    auto frame = push.CreateAlloca(frameType);
+    push.CreateStore(ConstantAggregateZero::get(frameType), frame);
+    auto prevPtr = push.CreateConstGEP2_32(frameType, frame, 0, 0);
+    push.CreateStore(push.CreateLoad(head), prevPtr);
+    push.CreateStore(
+        ConstantExpr::getIntToPtr(ConstInt64(slots.size()), ptrType),
+        push.CreateConstGEP2_32(frameType, frame, 0, 1));
+    push.CreateStore(push.CreatePointerCast(frame, ptrType), head);
+    for (uint32_t i = 0; i < slots.size(); i++) {
+        auto root = push.CreatePointerCast(
+            push.CreateConstGEP2_32(frameType, frame, 0, i + 2),
+            slots[i]->getType());
+        slots[i]->replaceAllUsesWith(root);
+        slots[i]->eraseFromParent();
+    }
+
+    for (auto& bb : *function) {
+        auto ret = dyn_cast_or_null<ReturnInst>(bb.getTerminator());
+        if (!ret) continue;
+        IRBuilder<> pop(ret);
+        pop.CreateStore(pop.CreateLoad(prevPtr), head);
+    }
+}
+
+void LLVMGen::CreateFieldStore(llvm::Value* obj, llvm::Value* fieldPtr, llvm::Value* value) {
+    value = CreateUpCast(value, fieldPtr->getType()->getPointerElementType());
+    builder->CreateStore(value, fieldPtr);
+    if (!value->getType()->isPointerTy() || isa<ConstantPointerNull>(value))
+        return;
+    auto int8Ptr = Type::getInt8PtrTy(*context);
+    builder->CreateCall(module->getFunction(CG_WRITE_BARRIER_NAME), {
+        builder->CreatePointerCast(obj, int8Ptr),
+        builder->CreatePointerCast(value, int8Ptr)});
+}
+
+llvm::Constant* LLVMGen::CreateLayoutIfNx(Class& cls) {
+    auto int32Ptr = PointerType::get(Type::getInt32Ty(*context), 0);
+    auto name = cls.GetName().Value() + CG_LAYOUT_SUFFIX;
+    if (auto layout = module->getNamedGlobal(name))
+        return ConstantExpr::getBitCast(layout, int32Ptr);
+
+    // {count, offsets...}
+    auto structType = CreateOpaqueStructTypeIfNx(cls.GetName().Value());
+    auto structLayout = module->getDataLayout().getStructLayout(structType);
+    vector<Constant*> offsets = {nullptr};
+    for (uint32_t i = 0; i < cls.GetFieldFeatures().size(); i++)
+        if (structType->getElementType(FieldIndex(i))->isPointerTy())
+            offsets.emplace_back(ConstInt32(structLayout->getElementOffset(FieldIndex(i))));
+    offsets[0] = ConstInt32(offsets.size() - 1);
+
+    auto arrayType = ArrayType::get(Type::getInt32Ty(*context), offsets.size());
+    auto layout = new GlobalVariable(*module, arrayType, true, GlobalValue::PrivateLinkage,
+        ConstantArray::get(arrayType, offsets), name);
+    return ConstantExpr::getBitCast(layout, int32Ptr);
+}
+
+bool LLVMGen::MayAllocate(FuncFeature& feat) {
+
+    // whether evaluating an expression may allocate, given what is known
+    // about the methods so far. With an owner, a call to a method of
+    // another class may allocate: a cached class is only keyed on its own
+    // bodies, see cache::HashClass, so its code must stay right whatever
+    // the others become.
+    class Visitor : public ExprVisitor<bool> {
+      private:
+        const unordered_map<const FuncFeature*, bool>& allocating;
+        const Class* owner;
+
+        bool visitBinary(Binary& expr) {
+            return Visit(*expr.GetLeft()) || Visit(*expr.GetRight());
+        }
+
+      public:
+        Visitor(const unordered_map<const FuncFeature*, bool>& _allocating, const Class* _owner)
+        : allocating(_allocating), owner(_owner) {}
+
+        // New, String, Case and whatever else is not listed
+        bool VisitDefault_() final { return true; }
+
+        // the ones without native code allocate nothing either, calls to
+        // them are rejected
+        bool Visit_(LinkBuiltin& expr) final { return expr.Sym() == SYM_FUNC_COPY; }
+        bool Visit_(Assign& expr) final { return Visit(*expr.GetExpr()); }
+        bool Visit_(Block& expr) final {
+            for (auto& e : expr.GetExprs())
+                if (Visit(*e)) return true;
+            return false;
+        }
+        // a dispatched call may land in any override
+        bool Visit_(Call& expr) final {
+            if (!expr.GetLink() || !expr.GetDirect()) return true;
+            if (owner && expr.GetLink()->GetOwner() != owner) return true;
+            for (auto& arg : expr.GetArgs())
+                if (Visit(*arg)) return true;
+            auto it = allocating.find(expr.GetLink());
+            return it == allocating.end() || it->second;
+        }
+        bool Visit_(MethodCall& expr) final {
+            return Visit(*expr.GetLeft()) || Visit(*expr.GetRight());
+        }
+        bool Visit_(If& expr) final {
+            return Visit(*expr.GetIfExpr()) || Visit(*expr.GetThenExpr()) || Visit(*expr.GetElseExpr());
+        }
+        bool Visit_(While& expr) final {
+            return Visit(*expr.GetWhileExpr()) || Visit(*expr.GetLoopExpr());
+        }
+        // a local without an initializer gets the default of its type
+        bool Visit_(Let& expr) final {
+            for (auto& decl : expr.GetDecls()) {
+                auto type = decl->GetType().Sym();
+                if (decl->GetExpr() ? Visit(*decl->GetExpr()) : type != SYM_INT && type != SYM_BOOL)
+                    return true;
+            }
+            return Visit(*expr.GetExpr());
+        }
+
+        bool Visit_(IsVoid& expr) final { return Visit(*expr.GetExpr()); }
+        bool Visit_(Negate& expr) final { return Visit(*expr.GetExpr()); }
+        bool Visit_(Not& expr) final { return Visit(*expr.GetExpr()); }
+
+        bool Visit_(Add& expr) final { return visitBinary(expr); }
+        bool Visit_(Divide& expr) final { return visitBinary(expr); }
+        bool Visit_(Equal& expr) final { return visitBinary(expr); }
+        bool Visit_(LessThanOrEqual& expr) final { return visitBinary(expr); }
+        bool Visit_(LessThan& expr) final { return visitBinary(expr); }
+        bool Visit_(Multiply& expr) final { return visitBinary(expr); }
+        bool Visit_(Minus& expr) final { return visitBinary(expr); }
+
+        bool Visit_(ID& expr) final { return false; }
+        bool Visit_(Integer& expr) final { return false; }
+        bool Visit_(True& expr) final { return false; }
+        bool Visit_(False& expr) final { return false; }
+    };
+
+    // from nothing allocating, until no more method is found to, so that
+    // recursion settles
+    if (allocating.empty()) {
+        vector<FuncFeature*> methods;
+        for (auto& cls : program->GetClasses())
+            for (auto& method : cls->GetOwnFuncFeatures()) {
+                methods.emplace_back(method);
+                allocating[method] = false;
+            }
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (auto method : methods) {
+                auto owner = compileCache ? method->GetOwner() : nullptr;
+                if (allocating[method] || !Visitor(allocating, owner).Visit(*method->GetExpr())) continue;
+                allocating[method] = true;
+                changed = true;
+            }
+        }
+    }
+    auto it = allocating.find(&feat);
+    return it == allocating.end() || it->second;
+}
+
+llvm::Value* LLVMGen::CreateUpCast(llvm::Value* value, llvm::Type* type) {
+    if (value->getType() == type || !value->getType()->isPointerTy() || !type->isPointerTy())
+        return value;
+    return builder->CreatePointerCast(value, type);
+}
+
+llvm::Value* LLVMGen::CreateUpCast(llvm::Value* value, Symbol type) {
+    return CreateUpCast(value, GetLLVMType(type));
 }
 
 llvm::Value* LLVMGen::CreateICmpAsCoolBool(
@@ -442,6 +803,262 @@ llvm::Value* LLVMGen::CreateICmpAsCoolBool(
         false);
 }
 
+StructType* LLVMGen::CreateClassStructType(Class& cls) {
+    // String has no fields in the AST, its layout is fixed instead
+    if (cls.GetName().Sym() == SYM_STRING)
+        return cast<StructType>(GetStringLLVMType()->getPointerElementType());
+    vector<Type *> Fields;
+    Fields.emplace_back(Type::getInt32Ty(*context));
+    Fields.emplace_back(Type::getInt32Ty(*context));
+    Fields.emplace_back(GetVTablePointerType());
+    // the box of an Int or a Bool holds its value
+    if (!HasObjectHeader(cls.GetName().Sym()))
+        Fields.emplace_back(GetLLVMType(cls.GetName().Sym()));
+    for (auto& feat : cls.GetFieldFeatures())
+        Fields.emplace_back(Visit(*feat));
+    StructType* ST = CreateOpaqueStructTypeIfNx(cls.GetName().Value());
+    ST->setBody(Fields, false);
+    return ST;
+}
+
+bool LLVMGen::HasObjectHeader(Symbol type) {
+    return type != SYM_INT && type != SYM_BOOL;
+}
+
+uint32_t LLVMGen::FieldIndex(uint32_t i) {
+    return i + HeaderFields;
+}
+
+void LLVMGen::CreateObjectHeader(llvm::Value* ptr, Symbol type, uint32_t size) {
+    Value* classIdPtr = builder->CreateGEP(ptr, ConstInt32s({0, ClassIdIndex}));
+    builder->CreateStore(ConstInt32(ClassIdRange(type).first), classIdPtr);
+    Value* sizePtr = builder->CreateGEP(ptr, ConstInt32s({0, SizeIndex}));
+    builder->CreateStore(ConstInt32(size), sizePtr);
+    Value* vptrPtr = builder->CreateGEP(ptr, ConstInt32s({0, VPtrIndex}));
+    builder->CreateStore(CreateVPtr(type), vptrPtr);
+}
+
+llvm::Value* LLVMGen::CreateBox(llvm::Value* value, Symbol type) {
+    auto structType = CreateOpaqueStructTypeIfNx(type.Str());
+    if (structType->isOpaque()) CreateClassStructType(*program->GetClassPtr(type));
+    uint32_t size = module->getDataLayout().getTypeAllocSize(structType);
+    auto box = CreateMallocCall(size, PointerType::getUnqual(structType));
+    CreateObjectHeader(box, type, size);
+    auto valuePtr = builder->CreateGEP(box, ConstInt32s({0, FieldIndex(0)}));
+    builder->CreateStore(value, valuePtr);
+    return box;
+}
+
+llvm::Value* LLVMGen::CreateBoxIfNeeded(llvm::Value* value, Symbol to, Symbol from) {
+    if (value->getType()->isPointerTy() || !IsMappedToLLVMStructPointerType(to))
+        return value;
+    if (from != SYM_INT && from != SYM_BOOL)
+        throw runtime_error("cannot box a value of type '" + from.Str() + "'");
+    return CreateBox(value, from);
+}
+
+llvm::Value* LLVMGen::CreateUnbox(llvm::Value* box, Symbol type) {
+    auto structType = CreateOpaqueStructTypeIfNx(type.Str());
+    if (structType->isOpaque()) CreateClassStructType(*program->GetClassPtr(type));
+    auto ptr = builder->CreatePointerCast(box, PointerType::getUnqual(structType));
+    auto valuePtr = builder->CreateGEP(ptr, ConstInt32s({0, FieldIndex(0)}));
+    return builder->CreateLoad(valuePtr);
+}
+
+const pair<uint32_t, uint32_t>& LLVMGen::ClassIdRange(Symbol type) {
+    if (classIds.empty()) {
+        unordered_map<Symbol, vector<Symbol>> children;
+        for (auto& cls : program->GetClasses()) {
+            auto parent = cls->GetParent().Sym();
+            if (!parent.Empty() && parent != cls->GetName().Sym())
+                children[parent].emplace_back(cls->GetName().Sym());
+        }
+        for (auto& entry : children)
+            std::sort(entry.second.begin(), entry.second.end(),
+                [](Symbol a, Symbol b) { return a.Str() < b.Str(); });
+
+        uint32_t next = 0;
+        function<void(Symbol)> number = [&](Symbol cls) {
+            auto first = next++;
+            for (auto child : children[cls]) number(child);
+            classIds[cls] = {first, next - 1};
+        };
+        number(SYM_OBJECT);
+    }
+    auto it = classIds.find(type);
+    if (it == classIds.end())
+        throw runtime_error("no class id of '" + type.Str() + "'");
+    return it->second;
+}
+
+const LLVMGen::VTable& LLVMGen::GetVTable(Symbol type) {
+    auto it = vtables.find(type);
+    if (it != vtables.end()) return it->second;
+
+    VTable vtable;
+    auto cls = program->GetClassPtr(type);
+    if (cls) {
+        auto parent = cls->GetParent().Sym();
+        if (!parent.Empty() && parent != type)
+            vtable = GetVTable(parent);
+        for (auto& func : cls->GetOwnFuncFeatures()) {
+            auto slot = vtable.index.find(func->GetName().Sym());
+            if (slot != vtable.index.end()) {
+                vtable.slots[slot->second] = func;
+            } else {
+                vtable.index.insert({func->GetName().Sym(), vtable.slots.size()});
+                vtable.slots.emplace_back(func);
+            }
+        }
+    }
+    return vtables.insert({type, move(vtable)}).first->second;
+}
+
+PointerType* LLVMGen::GetVTablePointerType() {
+    return PointerType::getUnqual(Type::getInt8PtrTy(*context));
+}
+
+GlobalVariable* LLVMGen::CreateVTableDeclIfNx(Symbol type) {
+    auto name = type.Str() + CG_VTABLE_SUFFIX;
+    auto vtable = module->getNamedGlobal(name);
+    if (!vtable) {
+        auto arrayType = ArrayType::get(Type::getInt8PtrTy(*context), GetVTable(type).slots.size() + MethodsIndex);
+        vtable = new GlobalVariable(*module, arrayType, true,
+            GlobalValue::ExternalLinkage, nullptr, name);
+        // a small vtable fits in one cache line
+        vtable->setAlignment(Align(64));
+    }
+    return vtable;
+}
+
+Constant* LLVMGen::CreateVPtr(Symbol type) {
+    auto vtable = CreateVTableDeclIfNx(type);
+    auto vptr = ConstantExpr::getInBoundsGetElementPtr(vtable->getValueType(), vtable,
+        ArrayRef<Constant*>({ConstInt32(0), ConstInt32(MethodsIndex)}));
+    return ConstantExpr::getBitCast(vptr, GetVTablePointerType());
+}
+
+Constant* LLVMGen::CreateTypeNameIfNx(Class& cls) {
+    auto int8Ptr = Type::getInt8PtrTy(*context);
+    auto globalName = cls.GetName().Value() + CG_TYPE_NAME_SUFFIX;
+    if (auto name = module->getNamedGlobal(globalName))
+        return ConstantExpr::getBitCast(name, int8Ptr);
+
+    // laid out as a String, whose chars are an array of the exact length
+    auto& value = cls.GetName().Value();
+    auto chars = ConstantDataArray::getString(*context, value);
+    auto dataOffset = module->getDataLayout().getStructLayout(cast<StructType>(
+        GetStringLLVMType()->getPointerElementType()))->getElementOffset(FieldIndex(1));
+    uint32_t size = (dataOffset + value.size() + 1 + 7) & ~7u;
+    auto structType = StructType::get(*context, {
+        Type::getInt32Ty(*context),
+        Type::getInt32Ty(*context),
+        GetVTablePointerType(),
+        Type::getInt32Ty(*context),
+        chars->getType()});
+    auto init = ConstantStruct::get(structType, {
+        ConstInt32(ClassIdRange(SYM_STRING).first),
+        ConstInt32(size),
+        CreateVPtr(SYM_STRING),
+        ConstInt32(value.size()),
+        chars});
+    auto name = new GlobalVariable(*module, structType, true, GlobalValue::PrivateLinkage,
+        init, globalName);
+    name->setAlignment(Align(8));
+    return ConstantExpr::getBitCast(name, int8Ptr);
+}
+
+GlobalVariable* LLVMGen::CreateVTableBody(Class& cls) {
+    auto vtable = CreateVTableDeclIfNx(cls.GetName().Sym());
+    vector<Constant*> slots = {
+        CreateTypeNameIfNx(cls),
+        ConstantExpr::getBitCast(CreateLayoutIfNx(cls), Type::getInt8PtrTy(*context))};
+    for (auto& func : GetVTable(cls.GetName().Sym()).slots) {
+        auto owner = func->GetOwner()->GetName().Sym();
+        Function* function;
+        if (owner == SYM_MAIN && func->GetName().Sym() == SYM_FUNC_MAIN)
+            function = CreateFunctionMain();
+        else
+            function = CreateFunctionDeclIfNx(func->GetName().Sym(),
+                func->GetType().Sym(), owner, func->GetArgs());
+        slots.emplace_back(ConstantExpr::getBitCast(function, Type::getInt8PtrTy(*context)));
+    }
+    vtable->setInitializer(ConstantArray::get(
+        cast<ArrayType>(vtable->getValueType()), slots));
+    return vtable;
+}
+
+void LLVMGen::DeclareClasses(Program& prog) {
+    for (auto& cls : prog.GetClasses()) {
+        CreateClassStructType(*cls);
+        CreateNewOperatorDeclIfNx(cls->GetName().Sym());
+    }
+    GetStringLLVMType();
+}
+
+void LLVMGen::LinkCachedClass(Class& cls, const string& blob) {
+    auto cached = parseBitcodeFile(
+        MemoryBufferRef(blob, cls.GetName().Value()), *context);
+    if (!cached)
+        throw runtime_error("corrupted cache entry of class '" + cls.GetName().Value()
+            + "': " + toString(cached.takeError()));
+    if (Linker::linkModules(*module, move(cached.get())))
+        throw runtime_error("link cached class '" + cls.GetName().Value() + "' failed");
+}
+
+void LLVMGen::StoreClass(Class& cls) {
+    auto name = cls.GetName().Sym();
+
+    // the functions generated for cls and its new operator
+    unordered_set<const GlobalValue*> owned;
+    for (auto& feat : cls.GetOwnFuncFeatures()) {
+        if (name == SYM_MAIN && feat->GetName().Sym() == SYM_FUNC_MAIN)
+            owned.insert(module->getFunction(CG_FUNC_COOL_MAIN_NAME));
+        else
+            owned.insert(module->getFunction(FunctionName(feat->GetName().Sym(), name)));
+    }
+    owned.insert(module->getFunction(name.Str()));
+    owned.insert(module->getFunction(name.Str() + CG_FUNC_INIT_SUFFIX));
+    owned.insert(module->getNamedGlobal(name.Str() + CG_VTABLE_SUFFIX));
+    owned.erase(nullptr);
+
+    // invalid IR can't be read back, leave such classes uncached
+    for (auto gv : owned)
+        if (isa<Function>(gv) && verifyFunction(*cast<Function>(gv))) return;
+
+    // module-local globals they refer to can't be left as declarations
+    vector<const User*> work(owned.begin(), owned.end());
+    unordered_set<const User*> seen(work.begin(), work.end());
+    while (!work.empty()) {
+        auto user = work.back();
+        work.pop_back();
+        vector<const Value*> operands;
+        if (auto function = dyn_cast<Function>(user)) {
+            for (auto& inst : instructions(function))
+                for (auto& op : inst.operands()) operands.emplace_back(op.get());
+        } else {
+            for (auto& op : user->operands()) operands.emplace_back(op.get());
+        }
+        for (auto op : operands) {
+            auto opUser = dyn_cast<Constant>(op);
+            if (!opUser || !seen.insert(opUser).second) continue;
+            if (auto gv = dyn_cast<GlobalVariable>(opUser))
+                if (gv->hasLocalLinkage()) owned.insert(gv);
+            work.emplace_back(opUser);
+        }
+    }
+
+    ValueToValueMapTy vmap;
+    auto clone = CloneModule(*module, vmap,
+        [&](const GlobalValue* gv) { return owned.count(gv) > 0; });
+
+    string blob;
+    raw_string_ostream out(blob);
+    WriteBitcodeToFile(*clone, out);
+    out.flush();
+    compileCache->Store(fingerprints->at(name), blob);
+}
+
 void LLVMGen::PrintPointer(llvm::Value* value) {
     builder->CreateCall(
         module->getFunction("print_ptr"),
@@ -450,6 +1067,68 @@ void LLVMGen::PrintPointer(llvm::Value* value) {
             Type::getInt32PtrTy(*context))});
 }
 
+void LLVMGen::UseCache(cache::CompileCache& _compileCache,
+    const cache::Fingerprints& _fingerprints,
+    const cache::CachedClasses& _cachedClasses) {
+    compileCache = &_compileCache;
+    fingerprints = &_fingerprints;
+    cachedClasses = &_cachedClasses;
+}
+
+void LLVMGen::Optimize(OptLevel level, bool timePasses) {
+    if (verifyModule(*module, &os))
+        throw runtime_error("can't optimize a broken module");
+
+    PassBuilder::OptimizationLevel passLevel = PassBuilder::OptimizationLevel::O0;
+    CodeGenOpt::Level codeGenLevel = CodeGenOpt::None;
+    switch (level) {
+        case OptLevel::O0:
+            break;
+        case OptLevel::O1:
+            passLevel = PassBuilder::OptimizationLevel::O1;
+            codeGenLevel = CodeGenOpt::Less;
+            break;
+        case OptLevel::O2:
+            passLevel = PassBuilder::OptimizationLevel::O2;
+            codeGenLevel = CodeGenOpt::Default;
+            break;
+        case OptLevel::O3:
+            passLevel = PassBuilder::OptimizationLevel::O3;
+            codeGenLevel = CodeGenOpt::Aggressive;
+            break;
+        case OptLevel::Os:
+            passLevel = PassBuilder::OptimizationLevel::Os;
+            codeGenLevel = CodeGenOpt::Default;
+            break;
+    }
+    target->setOptLevel(codeGenLevel);
+
+    PassInstrumentationCallbacks callbacks;
+    TimePassesHandler timer(timePasses);
+    timer.setOutStream(os);
+    timer.registerCallbacks(callbacks);
+
+    PassBuilder passBuilder(false, target.get(), PipelineTuningOptions(), None, &callbacks);
+    LoopAnalysisManager loopAnalyses;
+    FunctionAnalysisManager functionAnalyses;
+    CGSCCAnalysisManager cgsccAnalyses;
+    ModuleAnalysisManager moduleAnalyses;
+    passBuilder.registerModuleAnalyses(moduleAnalyses);
+    passBuilder.registerCGSCCAnalyses(cgsccAnalyses);
+    passBuilder.registerFunctionAnalyses(functionAnalyses);
+    passBuilder.registerLoopAnalyses(loopAnalyses);
+    passBuilder.crossRegisterProxies(loopAnalyses, functionAnalyses, cgsccAnalyses, moduleAnalyses);
+
+    // the default pipeline asserts on O0, which has a pipeline of its own
+    ModulePassManager passes = level == OptLevel::O0
+        ? passBuilder.buildO0DefaultPipeline(passLevel)
+        : passBuilder.buildPerModuleDefaultPipeline(passLevel);
+    passes.run(*module, moduleAnalyses);
+
+    timer.print();
+    os.flush();
+}
+
 void LLVMGen::DumpTextualIR(const string &filename) {
     std::error_code ec;
     raw_fd_ostream dest(filename, ec, sys::fs::OF_Text);
@@ -480,77 +1159,303 @@ void LLVMGen::EmitObjectFile(const string &filename) {
     dest.flush();
 }
 
-llvm::Value* LLVMGen::genCall(const string& selfType, llvm::Value* self, repr::Call& call) {
+void LLVMGen::EmitBitcodeFile(const string &filename) {
+    std::error_code ec;
+    raw_fd_ostream dest(filename, ec, sys::fs::OF_None);
+    if (ec)
+        throw runtime_error("create raw_fd_ostream error: " + ec.message());
+
+    WriteBitcodeToFile(*module, dest);
+    dest.close();
+
+    if (dest.has_error())
+        throw runtime_error("write bitcode error: " + dest.error().message());
+}
+
+void LLVMGen::EmitExecutable(const string &filename, const string &runtimeArchive) {
+    SmallString<128> objectFile;
+    if (auto ec = sys::fs::createTemporaryFile("cool", "o", objectFile))
+        throw runtime_error("create temporary file error: " + ec.message());
+    FileRemover objectRemover(objectFile);
+    EmitObjectFile(objectFile.str().str());
+
+    // the linker driver finds the C library and start files for us, the
+    // runtime archive provides main and marks with threads
+    auto linker = sys::findProgramByName("cc");
+    if (!linker)
+        throw runtime_error("linker not found: " + linker.getError().message());
+    vector<StringRef> args = {*linker, objectFile, runtimeArchive, "-pthread", "-o", filename};
+    string error;
+    if (sys::ExecuteAndWait(*linker, args, None, {}, 0, 0, &error) != 0)
+        throw runtime_error("link error: " + (error.empty() ? "linker failed" : error));
+}
+
+void LLVMGen::Run() {
+    auto jit = CreateJIT();
+    AddTo(*jit);
+    auto coolmain = reinterpret_cast<void (*)()>(Lookup(*jit, CG_FUNC_COOL_MAIN_NAME));
+    coolmain();
+    fflush(stdout);
+}
+
+unique_ptr<orc::LLJIT> LLVMGen::CreateJIT() {
+    auto jit = orc::LLJITBuilder().create();
+    if (!jit)
+        throw runtime_error("create jit error: " + toString(jit.takeError()));
+
+    // the runtime is linked into the compiler
+    orc::MangleAndInterner mangle((*jit)->getExecutionSession(), (*jit)->getDataLayout());
+    orc::SymbolMap runtimeSymbols = {
+        {mangle("mallocool"), JITEvaluatedSymbol::fromPointer(&mallocool)},
+        {mangle("out_int"), JITEvaluatedSymbol::fromPointer(&out_int)},
+        {mangle("out_string"), JITEvaluatedSymbol::fromPointer(&out_string)},
+        {mangle("in_int"), JITEvaluatedSymbol::fromPointer(&in_int)},
+        {mangle(CG_ABORT_NAME), JITEvaluatedSymbol::fromPointer(&cool_abort)},
+        {mangle(CG_COPY_NAME), JITEvaluatedSymbol::fromPointer(&cool_copy)},
+        {mangle("print_ptr"), JITEvaluatedSymbol::fromPointer(&print_ptr)},
+        {mangle(CG_CASE_ABORT_NAME), JITEvaluatedSymbol::fromPointer(&cool_case_abort)},
+        {mangle(CG_WRITE_BARRIER_NAME), JITEvaluatedSymbol::fromPointer(&cool_gc_write_barrier)},
+        {mangle(CG_GC_ROOTS_NAME), JITEvaluatedSymbol::fromPointer(&cool_gc_roots)},
+        {mangle(CG_ARENA_TOP_NAME), JITEvaluatedSymbol::fromPointer(&cool_arena_top)},
+        {mangle(CG_ARENA_END_NAME), JITEvaluatedSymbol::fromPointer(&cool_arena_end)},
+    };
+    if (auto err = (*jit)->getMainJITDylib().define(orc::absoluteSymbols(move(runtimeSymbols))))
+        throw runtime_error("define runtime symbols error: " + toString(move(err)));
+    return move(*jit);
+}
+
+void LLVMGen::AddTo(orc::LLJIT& jit) {
+    // the jit takes over the module and its context
+    builder.reset();
+    if (auto err = jit.addIRModule(orc::ThreadSafeModule(move(module), move(context))))
+        throw runtime_error("add module error: " + toString(move(err)));
+}
+
+void* LLVMGen::Lookup(orc::LLJIT& jit, const string& symbol) {
+    auto entry = jit.lookup(symbol);
+    if (!entry)
+        throw runtime_error("look up " + symbol + " error: " + toString(entry.takeError()));
+    return reinterpret_cast<void*>(entry->getAddress());
+}
+
+llvm::Value* LLVMGen::genCall(Symbol selfType, llvm::Value* self, repr::Call& call) {
+    auto link = call.GetLink();
+    if (link->GetExpr()->GetKind() == Repr::Kind::LinkBuiltin
+        && !IsNativeBuiltin(static_cast<LinkBuiltin*>(link->GetExpr())->Sym()))
+        throw runtime_error(call.GetTextInfo().String() + ": '" + link->GetName().Value()
+            + "' is not supported in native code, run with --vm or --interp");
+    // methods take self as an object, Object's can't be called on an
+    // unboxed Int or Bool
+    if (selfType == SYM_INT || selfType == SYM_BOOL)
+        throw runtime_error(call.GetTextInfo().String() + ": calling '" + link->GetName().Value()
+            + "' on " + selfType.Str() + " is not supported in native code, run with --vm or --interp");
+
+    // an inherited method is only generated for the class defining it
+    auto owner = call.GetLink()->GetOwner();
     auto function = CreateFunctionDeclIfNx(
-        call.GetLink()->GetName().Value(),
-        call.GetLink()->GetType().Value(),
-        selfType,
+        call.GetLink()->GetName().Sym(),
+        call.GetLink()->GetType().Sym(),
+        owner ? owner->GetName().Sym() : selfType,
         call.GetLink()->GetArgs()
         );
 
+    auto selfParamType = function->getFunctionType()->getParamType(0);
+    if (self->getType() != selfParamType && self->getType()->isPointerTy() && selfParamType->isPointerTy())
+        self = builder->CreatePointerCast(self, selfParamType);
+
     vector<Value*> args = {self};
+    vector<AllocaInst*> slots;
     for (auto& arg : call.GetArgs()) {
-        auto value = Visit(*arg);
-        if (dynamic_cast<ID*>(arg))
-            value = builder->CreateLoad(value);
-        args.emplace_back(value);
+        // self and the args so far have to survive the evaluation of arg
+        for (uint32_t i = slots.size(); i < args.size(); i++) {
+            slots.emplace_back(nullptr);
+            if (!args[i]->getType()->isPointerTy()) continue;
+            slots[i] = CreateRootSlot(args[i]->getType());
+            builder->CreateStore(args[i], slots[i]);
+        }
+        // an arg is passed in a register, a local or a field is loaded
+        auto value = CreateBoxIfNeeded(GetPointedValueIfAPointer(Visit(*arg)),
+            call.GetLink()->GetArgs().at(args.size() - 1)->GetType().Sym(), arg->GetStaticType());
+        args.emplace_back(CreateUpCast(value, function->getFunctionType()->getParamType(args.size())));
+    }
+    for (uint32_t i = 0; i < slots.size(); i++) {
+        auto slot = slots[i];
+        if (slot) args[i] = builder->CreateLoad(slot);
     }
 
-    return builder->CreateCall(function, args);
+    Value* ret;
+    auto& vtable = GetVTable(selfType);
+    auto slot = vtable.index.find(call.GetLink()->GetName().Sym());
+    if (!call.GetDirect() && HasObjectHeader(selfType) && slot != vtable.index.end()) {
+        // self is at least a selfType, so the method is in the same slot
+        // of its vtable
+        auto receiver = args[0];
+        auto vptrPtr = builder->CreateGEP(receiver, ConstInt32s({0, VPtrIndex}));
+        auto vptr = builder->CreateLoad(vptrPtr);
+        auto guess = call.GetSpeculation();
+        if (!guess.Empty() && HasObjectHeader(guess)) {
+            ret = CreateGuardedCall(guess, slot->second, vptr, function, args);
+        } else {
+            auto slotPtr = builder->CreateGEP(vptr, ConstInt32(slot->second));
+            auto slotValue = builder->CreateLoad(slotPtr);
+            auto callee = builder->CreatePointerCast(slotValue, function->getType());
+            ret = builder->CreateCall(function->getFunctionType(), callee, args);
+        }
+    } else {
+        // no override below selfType, or nothing to dispatch on
+        ret = builder->CreateCall(function, args);
+    }
+    // SELF_TYPE is the type of the receiver rather than of the owner
+    if (call.GetLink()->GetType().Sym() == SYM_SELF_TYPE && ret->getType()->isPointerTy()
+        && IsMappedToLLVMStructPointerType(selfType))
+        ret = builder->CreatePointerCast(ret, GetLLVMType(selfType));
+    return ret;
+}
+
+Value* LLVMGen::CreateGuardedCall(Symbol guess, uint32_t slot, Value* vptr, Function* function,
+    const vector<Value*>& args) {
+    // the method guess resolves to in the slot
+    auto target = GetVTable(guess).slots.at(slot);
+    auto targetFunction = CreateFunctionDeclIfNx(
+        target->GetName().Sym(),
+        target->GetType().Sym(),
+        target->GetOwner() ? target->GetOwner()->GetName().Sym() : guess,
+        target->GetArgs()
+        );
+
+    Function* parent = builder->GetInsertBlock()->getParent();
+    BasicBlock* hitBB = BasicBlock::Create(*context);
+    BasicBlock* missBB = BasicBlock::Create(*context);
+    BasicBlock* mergeBB = BasicBlock::Create(*context);
+
+    // the receiver is exactly a guess iff it points to guess' vtable
+    auto expected = CreateVPtr(guess);
+    builder->CreateCondBr(builder->CreateICmpEQ(vptr, expected), hitBB, missBB);
+
+    // a direct call LLVM can inline
+    parent->getBasicBlockList().push_back(hitBB);
+    builder->SetInsertPoint(hitBB);
+    vector<Value*> targetArgs = args;
+    targetArgs[0] = builder->CreatePointerCast(args[0], targetFunction->getFunctionType()->getParamType(0));
+    Value* hitValue = builder->CreateCall(targetFunction, targetArgs);
+    if (hitValue->getType() != function->getReturnType())
+        hitValue = builder->CreatePointerCast(hitValue, function->getReturnType());
+    hitBB = builder->GetInsertBlock();
+    builder->CreateBr(mergeBB);
+
+    // full dispatch
+    parent->getBasicBlockList().push_back(missBB);
+    builder->SetInsertPoint(missBB);
+    auto slotPtr = builder->CreateGEP(vptr, ConstInt32(slot));
+    auto slotValue = builder->CreateLoad(slotPtr);
+    auto callee = builder->CreatePointerCast(slotValue, function->getType());
+    Value* missValue = builder->CreateCall(function->getFunctionType(), callee, args);
+    missBB = builder->GetInsertBlock();
+    builder->CreateBr(mergeBB);
+
+    parent->getBasicBlockList().push_back(mergeBB);
+    builder->SetInsertPoint(mergeBB);
+    auto phi = builder->CreatePHI(function->getReturnType(), 2);
+    phi->addIncoming(hitValue, hitBB);
+    phi->addIncoming(missValue, missBB);
+    return phi;
 }
 
 Value * LLVMGen::Visit(Program &prog) {
+    program = &prog;
     ENTER_SCOPE_GUARD(stable, {
         CreateRuntimeFunctionDecls();
+        DeclareClasses(prog);
         for (auto& cls : prog.GetClasses()) Visit(*cls);
     })
     verifyModule(*module, &os);
+    return nullptr;
 }
 
-void LLVMGen::Visit(Class &cls) {
+void LLVMGen::VisitMethods(Program& prog, const unordered_set<const FuncFeature*>& methods) {
+    program = &prog;
+    stable.InitTraverse();
     ENTER_SCOPE_GUARD(stable, {
-        vector<Type *> Fields;
-        for (auto& feat : cls.GetFieldFeatures())
-            Fields.emplace_back(Visit(*feat));
-        StructType* ST = CreateOpaqueStructTypeIfNx(cls.GetName().Value());
-        ST->setBody(Fields, false);
+        CreateRuntimeFunctionDecls();
+        for (auto& cls : prog.GetClasses()) {
+            auto own = cls->GetOwnFuncFeatures();
+            if (none_of(own.begin(), own.end(), [&](FuncFeature* feat) { return methods.count(feat); })) {
+                stable.SkipScope();
+                continue;
+            }
+            // the scopes of the field initializers follow those of the
+            // methods
+            auto end = stable.ends.at(stable.next);
+            ENTER_SCOPE_GUARD(stable, {
+                for (auto& feat : own) {
+                    if (methods.count(feat)) Visit(*feat);
+                    else stable.SkipScope();
+                }
+            })
+            stable.Seek(end);
+        }
+    })
+    verifyModule(*module, &os);
+}
+
+void LLVMGen::Visit(Class &cls) {
+    CreateClassStructType(cls);
+
+    if (cachedClasses) {
+        auto it = cachedClasses->find(cls.GetName().Sym());
+        if (it != cachedClasses->end()) {
+            stable.SkipScope();
+            LinkCachedClass(cls, it->second);
+            return;
+        }
+    }
 
-        for (auto& feat : cls.GetFuncFeatures())
+    ENTER_SCOPE_GUARD(stable, {
+        for (auto& feat : cls.GetOwnFuncFeatures())
             Visit(*feat);
 
+        if (!builtin::IsBuiltinClass(cls.GetName().Value()))
+            CreateInitializerBody(cls);
+        // the boxes of Int and Bool point to theirs too
+        CreateVTableBody(cls);
         CreateNewOperatorBody(cls);
     })
+
+    if (compileCache) StoreClass(cls);
 }
 
 Value * LLVMGen::Visit(FuncFeature &feat) {
     Function* function;
     ENTER_SCOPE_GUARD(stable, {
 
-        if (stable.GetClass()->GetName().Value() == CLS_MAIN_NAME &&
-        feat.GetName().Value() == FUNC_MAIN_NAME) {
+        if (stable.GetClass()->GetName().Sym() == SYM_MAIN &&
+        feat.GetName().Sym() == SYM_FUNC_MAIN) {
 
             function =  CreateFunctionMain();
             BasicBlock* bb = BasicBlock::Create(*context, "entry", function);
             builder->SetInsertPoint(bb);
-            auto selfVar = CreateNewOperatorCall(CLS_MAIN_NAME);
-            llvmStable.InsertSelfVar(selfVar);
+            auto selfVar = CreateNewOperatorCall(SYM_MAIN);
+            auto selfSlot = CreateRootSlot(selfVar->getType());
+            builder->CreateStore(selfVar, selfSlot);
+            llvmStable.InsertSelfVar(selfSlot);
 //          note: don't do this! we have added llvm::Value*-s in Visit
 //          function call insert twice cause memory problem!!
 //            builder->Insert(Visit(*feat.GetExpr()));
             Visit(*feat.GetExpr());
             builder->CreateRetVoid();
+            CreateGCFrame(function);
 
         } else {
 
-            auto funcName = FunctionName(feat.GetName().Value(),
-                stable.GetClass()->GetName().Value());
+            auto& funcName = FunctionName(feat.GetName().Sym(),
+                stable.GetClass()->GetName().Sym());
             function = module->getFunction(funcName);
 
             if (!function)
                 function = CreateFunctionDeclIfNx(
-                    feat.GetName().Value(),
-                    feat.GetType().Value(),
-                    stable.GetClass()->GetName().Value(),
+                    feat.GetName().Sym(),
+                    feat.GetType().Sym(),
+                    stable.GetClass()->GetName().Sym(),
                     feat.GetArgs());
 
             if (!function)
@@ -559,14 +1464,22 @@ Value * LLVMGen::Visit(FuncFeature &feat) {
             BasicBlock* bb = BasicBlock::Create(*context, "entry", function);
             builder->SetInsertPoint(bb);
 
+            // self and the args of object type live in root slots, the
+            // others in plain slots, an arg can be assigned
             int i = 0;
             for (auto& arg : function->args()) {
-                if (i == 0) llvmStable.InsertSelfVar(function->args().begin());
-                else llvmStable.InsertArg(arg.getName().str(), &arg);
+                Value* var = arg.getType()->isPointerTy() ? CreateRootSlot(arg.getType())
+                    : CreateEntryAlloca(arg.getType());
+                builder->CreateStore(&arg, var);
+                if (i == 0) llvmStable.InsertSelfVar(var);
+                else llvmStable.InsertArg(feat.GetArgs().at(i-1)->GetName().Sym(), var);
                 i++;
             }
 
-            builder->CreateRet(Visit(*feat.GetExpr()));
+            auto value = CreateBoxIfNeeded(GetPointedValueIfAPointer(Visit(*feat.GetExpr())),
+                feat.GetType().Sym(), feat.GetExpr()->GetStaticType());
+            builder->CreateRet(CreateUpCast(value, function->getReturnType()));
+            CreateGCFrame(function, MayAllocate(feat));
         }
 
     })
@@ -574,11 +1487,11 @@ Value * LLVMGen::Visit(FuncFeature &feat) {
 }
 
 Type * LLVMGen::Visit(FieldFeature &feat) {
-    return GetLLVMType(feat.GetType().Value());
+    return GetLLVMType(feat.GetType().Sym());
 }
 
 Type* LLVMGen::Visit(Formal& formal) {
-    return GetLLVMType(formal.GetType().Value());
+    return GetLLVMType(formal.GetType().Sym());
 }
 
 Value* LLVMGen::Visit(repr::Expr& expr) {
@@ -586,32 +1499,68 @@ Value* LLVMGen::Visit(repr::Expr& expr) {
 }
 
 Value* LLVMGen::Visit_(repr::LinkBuiltin& expr) {
+    auto rType = GetLLVMType(expr.GetType());
+    // never called, genCall rejects the calls
+    if (!IsNativeBuiltin(expr.Sym()))
+        return Constant::getNullValue(rType);
+    if (expr.Sym() == SYM_FUNC_LENGTH) {
+        auto self = CreateSelfLoad();
+        auto lengthPtr = builder->CreateGEP(self, ConstInt32s({0, FieldIndex(0)}));
+        return builder->CreateLoad(lengthPtr);
+    }
+    if (expr.Sym() == SYM_FUNC_ABORT) {
+        builder->CreateCall(module->getFunction(CG_ABORT_NAME));
+        return builder->CreatePointerCast(CreateSelfLoad(), rType);
+    }
+    auto int8Ptr = Type::getInt8PtrTy(*context);
+    if (expr.Sym() == SYM_FUNC_COPY) {
+        auto self = builder->CreatePointerCast(CreateSelfLoad(), int8Ptr);
+        auto copy = builder->CreateCall(module->getFunction(CG_COPY_NAME), {self});
+        return builder->CreatePointerCast(copy, rType);
+    }
+    if (expr.Sym() == SYM_FUNC_TYPE_NAME) {
+        // the name the vtable holds, Strings are never changed
+        auto self = CreateSelfLoad();
+        auto vptrPtr = builder->CreateGEP(self, ConstInt32s({0, VPtrIndex}));
+        auto vptr = builder->CreateLoad(vptrPtr);
+        auto namePtr = builder->CreateGEP(vptr, ConstInt32(int32_t(TypeNameIndex) - int32_t(MethodsIndex)));
+        auto name = builder->CreateLoad(namePtr);
+        return builder->CreatePointerCast(name, rType);
+    }
     auto function = module->getFunction(expr.GetName());
     vector<Value*> args;
     for (auto& param : expr.GetParams()) {
-        auto arg = llvmStable.GetArg(param);
+        auto arg = GetPointedValueIfAPointer(llvmStable.GetArg(param));
         if (IsStringLLVMType(arg)) {
-            arg = builder->CreateGEP(arg, ConstInt32s({0, 1}));
+            arg = builder->CreateGEP(arg, ConstInt32s({0, FieldIndex(1)}));
             arg = builder->CreatePointerCast(arg, PointerType::getInt8PtrTy(*context));
         }
         args.emplace_back(arg);
     }
     auto ret = builder->CreateCall(function, args);
     // C runtime functions only return void pointer, cast it to the correct type.
-    auto rType = GetLLVMType(expr.GetType());
     if (rType->isPointerTy())
         return builder->CreatePointerCast(ret, rType);
     return ret;
 }
 
 Value* LLVMGen::Visit_(repr::Assign& expr) {
-    return builder->CreateStore(
-        GetPointedValueIfAPointer(Visit(*expr.GetExpr())),
-        Visit(*expr.GetId()));
+    // the value first, evaluating it may move self
+    auto value = CreateBoxIfNeeded(GetPointedValueIfAPointer(Visit(*expr.GetExpr())),
+        stable.GetIdAttr(expr.GetId()->GetName().Sym())->type, expr.GetExpr()->GetStaticType());
+    auto target = Visit(*expr.GetId());
+    value = CreateUpCast(value, target->getType()->getPointerElementType());
+    if (stable.GetIdAttr(expr.GetId()->GetName().Sym())->storageClass == attr::IdAttr::Field)
+        CreateFieldStore(CreateSelfLoad(), target, value);
+    else
+        builder->CreateStore(value, target);
+    return value;
 }
 
 Value* LLVMGen::Visit_(repr::Add& expr) {
-    return builder->CreateAdd(Visit(*expr.GetLeft()),Visit(*expr.GetRight()));
+    return builder->CreateAdd(
+        GetPointedValueIfAPointer(Visit(*expr.GetLeft())),
+        GetPointedValueIfAPointer(Visit(*expr.GetRight())));
 }
 
 Value* LLVMGen::Visit_(repr::Block& expr) {
@@ -624,25 +1573,117 @@ Value* LLVMGen::Visit_(repr::Block& expr) {
 }
 
 Value* LLVMGen::Visit_(repr::Case& expr) {
-    // todo
-    return nullptr;
+    auto selfType = stable.GetClass()->GetName().Sym();
+    auto exprType = expr.GetExprType() == SYM_SELF_TYPE ? selfType : expr.GetExprType();
+    auto typeName = expr.GetType() == SYM_SELF_TYPE ? selfType : expr.GetType();
+    auto type = GetLLVMType(typeName);
+    auto value = GetPointedValueIfAPointer(Visit(*expr.GetExpr()));
+    auto branches = expr.GetBranches();
+
+    // the branch every class id value may have takes, -1 if none. Ranges
+    // of classes either nest or are disjoint, so the most specific branch
+    // is the one whose range starts last.
+    auto range = ClassIdRange(exprType);
+    vector<int> owners(range.second - range.first + 1, -1);
+    for (int i = 0; i < branches.size(); i++) {
+        auto branchRange = ClassIdRange(branches[i]->GetType().Sym());
+        for (auto id = max(range.first, branchRange.first); id <= min(range.second, branchRange.second); id++) {
+            auto& owner = owners[id - range.first];
+            if (owner < 0 || ClassIdRange(branches[owner]->GetType().Sym()).first < branchRange.first)
+                owner = i;
+        }
+    }
+
+    Function* function = builder->GetInsertBlock()->getParent();
+    vector<BasicBlock*> branchBBs;
+    for (int i = 0; i < branches.size(); i++)
+        branchBBs.emplace_back(BasicBlock::Create(*context));
+    BasicBlock* mergeBB = BasicBlock::Create(*context);
+    auto createAbort = [&](Value* classId) {
+        auto abortBB = BasicBlock::Create(*context, "", function);
+        IRBuilder<> abort(abortBB);
+        abort.CreateCall(module->getFunction(CG_CASE_ABORT_NAME), {classId});
+        abort.CreateUnreachable();
+        return abortBB;
+    };
+
+    if (HasObjectHeader(exprType)) {
+        // one load of the class id and a switch over it, which LLVM lowers
+        // to a jump table or a binary search over the ranges of branches
+        BasicBlock* dispatchBB = BasicBlock::Create(*context);
+        builder->CreateCondBr(builder->CreateIsNull(value),
+            createAbort(ConstInt64(-1)), dispatchBB);
+        function->getBasicBlockList().push_back(dispatchBB);
+        builder->SetInsertPoint(dispatchBB);
+        // the class id is the first word of every object, the struct type
+        // of exprType may still be opaque
+        auto classIdPtr = builder->CreatePointerCast(value, PointerType::getUnqual(Type::getInt32Ty(*context)));
+        auto classId = builder->CreateLoad(classIdPtr);
+        auto noMatchBB = createAbort(builder->CreateZExt(classId, Type::getInt64Ty(*context)));
+        auto switchInst = builder->CreateSwitch(classId, noMatchBB, owners.size());
+        for (uint32_t i = 0; i < owners.size(); i++)
+            if (owners[i] >= 0) switchInst->addCase(ConstInt32(range.first + i), branchBBs[owners[i]]);
+    } else {
+        // Int and Bool have no header nor subclasses, the branch is known
+        // now
+        builder->CreateBr(owners[0] >= 0 ? branchBBs[owners[0]] : createAbort(ConstInt64(range.first)));
+    }
+
+    // an Int or a Bool bound to an object type is boxed, a box a branch
+    // of Int or Bool matched is unboxed
+    auto convert = [&](Value* v, Symbol from, Symbol to) {
+        if (v->getType()->isPointerTy() && !IsMappedToLLVMStructPointerType(to))
+            return CreateUnbox(v, to);
+        return CreateUpCast(CreateBoxIfNeeded(v, to, from), GetLLVMType(to));
+    };
+    vector<pair<Value*, BasicBlock*>> incoming;
+    for (int i = 0; i < branches.size(); i++) {
+        function->getBasicBlockList().push_back(branchBBs[i]);
+        builder->SetInsertPoint(branchBBs[i]);
+        Value* branchValue;
+        ENTER_SCOPE_GUARD(stable, {
+            auto idType = GetLLVMType(branches[i]->GetType().Sym());
+            auto slot = idType->isPointerTy() ? CreateRootSlot(idType) : CreateEntryAlloca(idType);
+            builder->CreateStore(convert(value, exprType, branches[i]->GetType().Sym()), slot);
+            llvmStable.InsertLocalVar(branches[i]->GetId().Sym(), slot);
+            branchValue = convert(GetPointedValueIfAPointer(Visit(*branches[i]->GetExpr())),
+                branches[i]->GetExpr()->GetStaticType(), typeName);
+        })
+        incoming.emplace_back(branchValue, builder->GetInsertBlock());
+        builder->CreateBr(mergeBB);
+    }
+
+    function->getBasicBlockList().push_back(mergeBB);
+    builder->SetInsertPoint(mergeBB);
+    auto phi = builder->CreatePHI(type, incoming.size());
+    for (auto& in : incoming)
+        phi->addIncoming(in.first, in.second);
+    return phi;
 }
 
 Value* LLVMGen::Visit_(repr::Call& expr) {
     Value* value;
     ENTER_SCOPE_GUARD(stable, {
-        value = genCall(stable.GetClass()->GetName().Value(), llvmStable.GetSelfVar(), expr);
+        value = genCall(stable.GetClass()->GetName().Sym(), CreateSelfLoad(), expr);
     })
     return value;
 }
 
 Value* LLVMGen::Visit_(repr::Divide& expr) {
-    return builder->CreateSDiv(Visit(*expr.GetLeft()), Visit(*expr.GetRight()));
+    return builder->CreateSDiv(
+        GetPointedValueIfAPointer(Visit(*expr.GetLeft())),
+        GetPointedValueIfAPointer(Visit(*expr.GetRight())));
 }
 
 Value* LLVMGen::Visit_(repr::Equal& expr) {
-    auto left = Visit(*expr.GetLeft());
-    auto right = Visit(*expr.GetRight());
+    auto left = GetPointedValueIfAPointer(Visit(*expr.GetLeft()));
+    AllocaInst* slot = nullptr;
+    if (left->getType()->isPointerTy()) {
+        slot = CreateRootSlot(left->getType());
+        builder->CreateStore(left, slot);
+    }
+    auto right = GetPointedValueIfAPointer(Visit(*expr.GetRight()));
+    if (slot) left = builder->CreateLoad(slot);
     if (IsStringLLVMType(left)) {
         if (!IsStringLLVMType(right)) throw runtime_error("");
         // todo: Create a built function to compare string content
@@ -661,11 +1702,11 @@ Value* LLVMGen::Visit_(repr::False& expr) {
 }
 
 Value* LLVMGen::Visit_(repr::ID& expr) {
-    auto idAttr = stable.GetIdAttr(expr.GetName().Value());
+    auto idAttr = stable.GetIdAttr(expr.GetName().Sym());
     switch (idAttr->storageClass) {
         case attr::IdAttr::Field: {
-            auto self = llvmStable.GetSelfVar();
-            return builder->CreateGEP(self, ConstInt32s({0, uint32_t (idAttr->idx)}));
+            auto self = CreateSelfLoad();
+            return builder->CreateGEP(self, ConstInt32s({0, FieldIndex(idAttr->idx)}));
         }
         case attr::IdAttr::Local:
             return llvmStable.GetLocalVar(idAttr->name);
@@ -677,9 +1718,9 @@ Value* LLVMGen::Visit_(repr::ID& expr) {
 }
 
 Value* LLVMGen::Visit_(repr::IsVoid& expr) {
-    auto value = Visit(*expr.GetExpr());
+    auto value = GetPointedValueIfAPointer(Visit(*expr.GetExpr()));
     if (value->getType()->isPointerTy() && !IsStringLLVMType(value))
-        return builder->CreateIsNull(value);     // todo: valid?
+        return builder->CreateIntCast(builder->CreateIsNull(value), Type::getInt32Ty(*context), false);
     return ConstantInt::getFalse(Type::getInt32Ty(*context));
 }
 
@@ -693,23 +1734,37 @@ Value* LLVMGen::Visit_(repr::If& expr) {
     BasicBlock* elseBB = BasicBlock::Create(*context);
     BasicBlock* mergeBB = BasicBlock::Create(*context);
 
-    // gen if predicate
-    Value* condValue = builder->CreateICmpSGE(
-        Visit(*expr.GetIfExpr()),
-        ConstInt32(1));
-    builder->CreateCondBr(condValue, thenBB, elseBB);
-
-    // gen then block
-    function->getBasicBlockList().push_back(thenBB);
-    builder->SetInsertPoint(thenBB);
-    auto thenValue = Visit(*expr.GetThenExpr());
-    builder->CreateBr(mergeBB);
-
-    // gen else block
-    function->getBasicBlockList().push_back(elseBB);
-    builder->SetInsertPoint(elseBB);
-    auto elseValue = Visit(*expr.GetElseExpr());
-    builder->CreateBr(mergeBB);
+    Value* thenValue;
+    Value* elseValue;
+    ENTER_SCOPE_GUARD(stable, {
+        // gen if predicate
+        Value* condValue = builder->CreateICmpSGE(
+            GetPointedValueIfAPointer(Visit(*expr.GetIfExpr())),
+            ConstInt32(1));
+        builder->CreateCondBr(condValue, thenBB, elseBB);
+
+        // gen then block, a branch may end in another block than it
+        // started in
+        auto type = GetLLVMType(expr.GetType());
+        function->getBasicBlockList().push_back(thenBB);
+        builder->SetInsertPoint(thenBB);
+        ENTER_SCOPE_GUARD(stable, thenValue = Visit(*expr.GetThenExpr()));
+        thenValue = CreateBoxIfNeeded(GetPointedValueIfAPointer(thenValue),
+            expr.GetType(), expr.GetThenExpr()->GetStaticType());
+        thenValue = CreateUpCast(thenValue, type);
+        thenBB = builder->GetInsertBlock();
+        builder->CreateBr(mergeBB);
+
+        // gen else block
+        function->getBasicBlockList().push_back(elseBB);
+        builder->SetInsertPoint(elseBB);
+        ENTER_SCOPE_GUARD(stable, elseValue = Visit(*expr.GetElseExpr()));
+        elseValue = CreateBoxIfNeeded(GetPointedValueIfAPointer(elseValue),
+            expr.GetType(), expr.GetElseExpr()->GetStaticType());
+        elseValue = CreateUpCast(elseValue, type);
+        elseBB = builder->GetInsertBlock();
+        builder->CreateBr(mergeBB);
+    })
 
     // gen merge block (return block)
     function->getBasicBlockList().push_back(mergeBB);
@@ -717,7 +1772,7 @@ Value* LLVMGen::Visit_(repr::If& expr) {
     auto phi = builder->CreatePHI(GetLLVMType(expr.GetType()), 2);
     phi->addIncoming(thenValue, thenBB);
     phi->addIncoming(elseValue, elseBB);
-    return nullptr;
+    return phi;
 }
 
 Value* LLVMGen::Visit_(repr::LessThanOrEqual& expr) {
@@ -740,20 +1795,21 @@ Value* LLVMGen::Visit_(repr::Let& expr) {
     auto visitFormal = [&](repr::Let::Decl& decl) {
         Value* value;
         // note: alloca is a pointer points to pointer of type 'formal.GetType().Value()'
-        auto type = GetLLVMType(decl.GetType().Value());
-        auto alloca = builder->CreateAlloca(type, nullptr);
+        auto type = GetLLVMType(decl.GetType().Sym());
+        auto alloca = type->isPointerTy() ? CreateRootSlot(type) : CreateEntryAlloca(type);
         if (decl.GetExpr())
-            value = Visit(*decl.GetExpr());
+            value = CreateBoxIfNeeded(GetPointedValueIfAPointer(Visit(*decl.GetExpr())),
+                decl.GetType().Sym(), decl.GetExpr()->GetStaticType());
         else
-            value = DefaultNewOperator(decl.GetType().Value());
-        builder->CreateStore(value, alloca);
+            value = DefaultNewOperator(decl.GetType().Sym());
+        builder->CreateStore(CreateUpCast(value, type), alloca);
         return alloca;
     };
     auto decls = expr.GetDecls();
     for (int i = 0; i < decls.size(); i++) {
         auto decl = decls.at(i);
         stable.EnterScope();
-        llvmStable.InsertLocalVar(decl->GetName().Value(), visitFormal(*decl));
+        llvmStable.InsertLocalVar(decl->GetName().Sym(), visitFormal(*decl));
     }
     auto value = Visit(*expr.GetExpr());
     for (int i = 0; i < decls.size(); i++)
@@ -764,29 +1820,35 @@ Value* LLVMGen::Visit_(repr::Let& expr) {
 Value* LLVMGen::Visit_(repr::MethodCall& expr) {
     Value* value;
     ENTER_SCOPE_GUARD(stable, {
-        value = genCall(expr.GetType(), Visit(*expr.GetLeft()), *static_cast<repr::Call*>(expr.GetRight()));
+        auto self = GetPointedValueIfAPointer(Visit(*expr.GetLeft()));
+        value = genCall(expr.GetType(), self, *static_cast<repr::Call*>(expr.GetRight()));
     })
     return value;
 }
 
 Value* LLVMGen::Visit_(repr::Multiply& expr) {
-    return builder->CreateMul(Visit(*expr.GetLeft()),Visit(*expr.GetRight()));
+    return builder->CreateMul(
+        GetPointedValueIfAPointer(Visit(*expr.GetLeft())),
+        GetPointedValueIfAPointer(Visit(*expr.GetRight())));
 }
 
 Value* LLVMGen::Visit_(repr::Minus& expr) {
-    return builder->CreateSub(Visit(*expr.GetLeft()),Visit(*expr.GetRight()));
+    return builder->CreateSub(
+        GetPointedValueIfAPointer(Visit(*expr.GetLeft())),
+        GetPointedValueIfAPointer(Visit(*expr.GetRight())));
 }
 
 Value* LLVMGen::Visit_(repr::Negate& expr) {
-    return builder->CreateNeg(Visit(*expr.GetExpr()));
+    return builder->CreateNeg(GetPointedValueIfAPointer(Visit(*expr.GetExpr())));
 }
 
 Value* LLVMGen::Visit_(repr::New& expr) {
-    return CreateNewOperatorCall(expr.GetType().Value());
+    return CreateNewOperatorCall(expr.GetType().Sym());
 }
 
 Value* LLVMGen::Visit_(repr::Not& expr) {
-    return builder->CreateNot(Visit(*expr.GetExpr()));
+    // a Bool is 0 or 1, flipping every bit would make true of both
+    return builder->CreateXor(GetPointedValueIfAPointer(Visit(*expr.GetExpr())), ConstInt32(1));
 }
 
 Value* LLVMGen::Visit_(repr::String& expr) {
@@ -798,6 +1860,29 @@ Value* LLVMGen::Visit_(repr::True& expr) {
 }
 
 Value* LLVMGen::Visit_(repr::While& expr) {
-    // todo
-    return nullptr;
+    Function* function = builder->GetInsertBlock()->getParent();
+    BasicBlock* condBB = BasicBlock::Create(*context);
+    BasicBlock* loopBB = BasicBlock::Create(*context);
+    BasicBlock* exitBB = BasicBlock::Create(*context);
+
+    ENTER_SCOPE_GUARD(stable, {
+        builder->CreateBr(condBB);
+        function->getBasicBlockList().push_back(condBB);
+        builder->SetInsertPoint(condBB);
+        Value* condValue = builder->CreateICmpSGE(
+            GetPointedValueIfAPointer(Visit(*expr.GetWhileExpr())),
+            ConstInt32(1));
+        builder->CreateCondBr(condValue, loopBB, exitBB);
+
+        // the body may end in another block than it started in
+        function->getBasicBlockList().push_back(loopBB);
+        builder->SetInsertPoint(loopBB);
+        Visit(*expr.GetLoopExpr());
+        builder->CreateBr(condBB);
+    })
+
+    function->getBasicBlockList().push_back(exitBB);
+    builder->SetInsertPoint(exitBB);
+    // a loop evaluates to void
+    return ConstantPointerNull::get(cast<PointerType>(GetLLVMType(SYM_OBJECT)));
 }
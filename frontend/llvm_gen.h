@@ -6,6 +6,8 @@
 #define COOL_LLVM_H
 
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/STLExtras.h"
@@ -24,6 +26,14 @@
 #include "visitor.h"
 #include "repr.h"
 #include "adt.h"
+#include "symbol.h"
+#include "cache.h"
+
+namespace llvm {
+namespace orc {
+class LLJIT;
+} // namespace orc
+} // namespace llvm
 
 namespace cool {
 
@@ -51,29 +61,87 @@ class LLVMGen : public ProgramVisitor<llvm::Value*>, ClassVisitor<void>,
     //==================================================================//
     //                       SymbolTable Class                          //
     //==================================================================//
+    // llvm values of the identifiers visible in stable, indexed by the
+    // IdAttr index stable resolves them to
     class SymbolTable {
       private:
         adt::ScopedTableSpecializer<adt::SymbolTable>& stable;
-        unordered_map<uint32_t, unordered_map<string, llvm::Value*>> valueTable;
+        vector<llvm::Value*> values;
+        llvm::Value* self = nullptr;
 
-        llvm::Value* get(const string& name);
-        void insert(const string& name, llvm::Value* value);
+        llvm::Value* get(Symbol name);
+        void insert(Symbol name, llvm::Value* value);
 
     public:
         SymbolTable(adt::ScopedTableSpecializer<adt::SymbolTable>& _stable);
 
-        void InsertLocalVar(const string& name, llvm::Value* value);
+        void InsertLocalVar(Symbol name, llvm::Value* value);
         void InsertSelfVar(llvm::Value* value);
-        void InsertArg(const string& name, llvm::Value* value);
+        void InsertArg(Symbol name, llvm::Value* value);
 
-        llvm::Value* GetLocalVar(const string& name);
+        llvm::Value* GetLocalVar(Symbol name);
         llvm::Value* GetSelfVar();
         llvm::Value* GetSelfField(uint32_t i);
-        llvm::Value* GetArg(const string& name);
+        llvm::Value* GetArg(Symbol name);
     };
 
     SymbolTable llvmStable;
 
+    //==================================================================//
+    //                            GC Roots                              //
+    //==================================================================//
+    // an allocation may move any object, see runtime/gc.h. A pointer that
+    // has to survive one is kept in a root slot of the frame its function
+    // pushes on the shadow stack, and loaded from there after it. Self and
+    // the args and locals of object type live in root slots throughout.
+    vector<llvm::AllocaInst*> rootSlots; // of the function being generated
+
+    // a new slot in the entry block of the function being generated, so
+    // that a loop doesn't grow the stack and mem2reg can promote it
+    llvm::AllocaInst* CreateEntryAlloca(llvm::Type* type);
+    // a new root slot of the function being generated, null until stored
+    llvm::AllocaInst* CreateRootSlot(llvm::Type* type);
+    llvm::Value* CreateSelfLoad();
+    // whether a call to feat may allocate, conservatively. Methods that
+    // never do need no frame. With compileCache, calls into other classes
+    // are taken to allocate.
+    unordered_map<const FuncFeature*, bool> allocating;
+    bool MayAllocate(FuncFeature& feat);
+    // push a frame holding the root slots of function on entry and pop it
+    // before every return, once the body of function is complete. Without
+    // mayAllocate the slots are left plain allocas.
+    void CreateGCFrame(llvm::Function* function, bool mayAllocate = true);
+    // store value into the field at fieldPtr of obj, with the write barrier
+    // if value is a pointer
+    void CreateFieldStore(llvm::Value* obj, llvm::Value* fieldPtr, llvm::Value* value);
+    // get the global listing the pointer fields of the objects of cls if
+    // existed, otherwise create one
+    llvm::Constant* CreateLayoutIfNx(Class& cls);
+
+    //==================================================================//
+    //                          VTable Struct                           //
+    //==================================================================//
+    // method slots of a class. A class starts with the slots of its
+    // parent, an overriding method takes over the slot of the method it
+    // overrides and new methods are appended, so the index of a method is
+    // the same in all subclasses
+    struct VTable {
+        vector<FuncFeature*> slots;
+        unordered_map<Symbol, uint32_t> index;
+    };
+
+    // set by Visit(Program)
+    Program* program = nullptr;
+    unordered_map<Symbol, VTable> vtables;
+
+    // mangled function names, keyed by (class, method) symbol ids
+    unordered_map<uint64_t, string> functionNames;
+
+    // set by UseCache, nullptr if compiling without a cache
+    cache::CompileCache* compileCache = nullptr;
+    const cache::Fingerprints* fingerprints = nullptr;
+    const cache::CachedClasses* cachedClasses = nullptr;
+
     llvm::ConstantInt* ConstInt8(uint8_t v);
     llvm::ConstantInt* ConstInt32(uint32_t v);
     llvm::ConstantInt* ConstInt64(uint64_t v);
@@ -91,28 +159,103 @@ class LLVMGen : public ProgramVisitor<llvm::Value*>, ClassVisitor<void>,
     // this will create an opaque struct type if not existed
     llvm::PointerType* GetStringLLVMType();
     llvm::Value* AllocLLVMConstStringStruct(const string& str);
-    llvm::Type* GetLLVMType(const string& type);
+    llvm::Type* GetLLVMType(Symbol type);
     llvm::Value* GetPointedValueIfAPointer(llvm::Value*);
-    bool IsMappedToLLVMStructPointerType(const string& type);
+    bool IsMappedToLLVMStructPointerType(Symbol type);
     bool IsStringLLVMType(llvm::Value* v);
 
-    // C is the class name
-    string FunctionName(const string& name, const string& C);
     // get the Function if existed, otherwise create one
-    llvm::Function* CreateFunctionDeclIfNx(const string& name,
-        const string& type, const string& selfType, vector<Formal*> args);
+    llvm::Function* CreateFunctionDeclIfNx(Symbol name,
+        Symbol type, Symbol selfType, const ArenaArray<Formal*>& args);
 
     llvm::Function* CreateFunctionMain();
     void CreateRuntimeFunctionDecls();
 
     // constructor
-    llvm::Value* DefaultNewOperator(const string& type);
-    llvm::Function* CreateNewOperatorDeclIfNx(const string& type);
+    llvm::Value* DefaultNewOperator(Symbol type);
+    llvm::Function* CreateNewOperatorDeclIfNx(Symbol type);
     llvm::Function* CreateNewOperatorBody(Class& cls);
-    llvm::Value* CreateNewOperatorCall(const string& type);
+    llvm::Value* CreateNewOperatorCall(Symbol type);
+
+    // initializer of the fields a class defines, it runs the one of the
+    // parent first. Builtin classes have none.
+    llvm::Function* CreateInitializerDeclIfNx(Symbol type);
+    llvm::Function* CreateInitializerBody(Class& cls);
 
+    // size bytes for an object, its header included
     llvm::Value* CreateMallocCall(int size, llvm::Type* ptrType);
 
+    // set the body of the struct type of cls, creating it if not existed.
+    // Objects with a header start with it, their fields follow it.
+    llvm::StructType* CreateClassStructType(Class& cls);
+    // Int and Bool are values and have no header. Bound to an object type
+    // they are boxed, the struct type of Int and Bool is that of the box.
+    bool HasObjectHeader(Symbol type);
+    // struct indexes of the header, laid out as CoolObjectHeader in
+    // runtime.h
+    enum HeaderIndex : uint32_t {
+        ClassIdIndex,
+        SizeIndex,
+        VPtrIndex,
+        HeaderFields,
+    };
+    // struct index of the i-th field of an object. A String has its
+    // length as field 0 and its chars, NUL terminated, as field 1, a box
+    // its value as field 0.
+    uint32_t FieldIndex(uint32_t i);
+    // store the header of an object of type and size bytes to ptr
+    void CreateObjectHeader(llvm::Value* ptr, Symbol type, uint32_t size);
+    // value of type Int or Bool in a new box
+    llvm::Value* CreateBox(llvm::Value* value, Symbol type);
+    // value of static type from bound to an object of type to, boxed if
+    // needed. Boxing allocates, so it comes before loading anything that
+    // has to survive it.
+    llvm::Value* CreateBoxIfNeeded(llvm::Value* value, Symbol to, Symbol from);
+    // the value in box, which points to an object of type
+    llvm::Value* CreateUnbox(llvm::Value* box, Symbol type);
+
+    // of ClassIdRange
+    unordered_map<Symbol, pair<uint32_t, uint32_t>> classIds;
+
+    // the layout of the vtable of a class, built from the parent's
+    const VTable& GetVTable(Symbol type);
+    llvm::PointerType* GetVTablePointerType();
+    // get the vtable global of type if existed, otherwise declare one. It
+    // holds the name of type and the layout of its objects, then their
+    // method slots.
+    llvm::GlobalVariable* CreateVTableDeclIfNx(Symbol type);
+    // indexes of the vtable global
+    enum VTableIndex : uint32_t {
+        TypeNameIndex,
+        LayoutIndex,
+        MethodsIndex,
+    };
+    // the vtable pointer of the objects of type, to the method slots. The
+    // collector finds the layout at index -1, see runtime/gc.h.
+    llvm::Constant* CreateVPtr(Symbol type);
+    llvm::GlobalVariable* CreateVTableBody(Class& cls);
+    // the name of cls as a String outside the heap, what type_name returns
+    llvm::Constant* CreateTypeNameIfNx(Class& cls);
+    // call the method in slot, directly if the receiver with vptr is
+    // exactly a guess and through the vtable otherwise
+    llvm::Value* CreateGuardedCall(Symbol guess, uint32_t slot, llvm::Value* vptr,
+        llvm::Function* function, const vector<llvm::Value*>& args);
+    // declare the types and new operators of all classes upfront, so that
+    // a receiver of a class not visited yet can be dispatched on, stored
+    // bitcode never has a class type left opaque, and linking cached
+    // bitcode maps its types onto them by name rather than onto whichever
+    // type happens to have the same layout
+    void DeclareClasses(Program& prog);
+    // link the bitcode cls was stored as into module
+    void LinkCachedClass(Class& cls, const string& blob);
+    // store the definitions generated for cls into compileCache
+    void StoreClass(Class& cls);
+
+    // an object of a subclass as one of type, the layouts of classes are
+    // prefixes of their subclasses'
+    llvm::Value* CreateUpCast(llvm::Value* value, llvm::Type* type);
+    llvm::Value* CreateUpCast(llvm::Value* value, Symbol type);
+
     llvm::Value* CreateICmpAsCoolBool(
         llvm::CmpInst::Predicate, llvm::Value* left, llvm::Value* right);
 
@@ -120,17 +263,68 @@ class LLVMGen : public ProgramVisitor<llvm::Value*>, ClassVisitor<void>,
     void PrintPointer(llvm::Value* value);
 
 public:
+    enum class OptLevel { O0, O1, O2, O3, Os };
+
     LLVMGen(adt::ScopedTableSpecializer<adt::SymbolTable>& stable);
     LLVMGen(const LLVMGen& llvmGen) = delete;
     LLVMGen(const LLVMGen&& llvmGen) = delete;
 
+    // reuse the bitcode of cachedClasses instead of generating it, and
+    // store every class generated into compileCache. The classes must
+    // also have been skipped by type checking, see cache::FingerprintClasses
+    void UseCache(cache::CompileCache& _compileCache,
+        const cache::Fingerprints& _fingerprints,
+        const cache::CachedClasses& _cachedClasses);
+
+    // run the default new pass manager pipeline of level over the module
+    // and set the code generation level of EmitObjectFile to match.
+    // Called after Visit(Program) and before emitting, throw runtime_error
+    // if the module is broken. Report the time every pass took if
+    // timePasses.
+    void Optimize(OptLevel level, bool timePasses = false);
+
     void DumpTextualIR(const string& filename);
+    void EmitBitcodeFile(const string& filename);
     void EmitObjectFile(const string& filename);
-
-    llvm::Value* genCall(const string& selfType,
+    // emit the module as an object file and link it with runtimeArchive
+    // into the executable filename, throw runtime_error on failure
+    void EmitExecutable(const string& filename, const string& runtimeArchive);
+    // compile the module in memory with ORC and run its coolmain against
+    // the runtime linked into the compiler. The module is handed over to
+    // the JIT, nothing else can be done with the generator afterwards.
+    void Run();
+
+    // a JIT resolving the runtime linked into the compiler, for modules
+    // added with AddTo
+    static unique_ptr<llvm::orc::LLJIT> CreateJIT();
+    // hand the module over to jit, which compiles it on the first lookup
+    // of one of its symbols. Symbols the module only declares resolve to
+    // modules added before. Nothing else can be done with the generator
+    // afterwards.
+    void AddTo(llvm::orc::LLJIT& jit);
+    // the address of the function symbol in jit, throw runtime_error if
+    // there is none
+    static void* Lookup(llvm::orc::LLJIT& jit, const string& symbol);
+
+    // the symbol of method name of class C
+    const string& FunctionName(Symbol name, Symbol C);
+
+    // class ids, numbered in pre-order over the inheritance tree from
+    // Object, children by name, so that a class and its subclasses take
+    // the ids [first, last]. Only the hierarchy decides them, which every
+    // cache entry is keyed on, see cache::HashInterfaces. Called after
+    // Visit(Program).
+    const pair<uint32_t, uint32_t>& ClassIdRange(Symbol type);
+
+    // call through the vtable of self, whose static type is selfType,
+    // or directly if selfType has no vtable
+    llvm::Value* genCall(Symbol selfType,
         llvm::Value* self, repr::Call& call);
 
     llvm::Value* Visit(Program& prog);
+    // generate only methods, calls to any other method are left as
+    // declarations, and no class is generated
+    void VisitMethods(Program& prog, const unordered_set<const FuncFeature*>& methods);
     void Visit(Class&);
     llvm::Value* Visit(FuncFeature& );
     llvm::Type*  Visit(FieldFeature&);
@@ -0,0 +1,73 @@
+//
+// Created by 田地 on 2021/8/30.
+//
+
+#include <algorithm>
+
+#include "parallel.h"
+
+using namespace std;
+using namespace cool;
+using namespace parallel;
+
+ThreadPool::ThreadPool(size_t size) : next(0) {
+    if (size == 0) size = max(1u, thread::hardware_concurrency());
+    for (size_t i = 1; i < size; i++)
+        threads.emplace_back(&ThreadPool::run, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(mu);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& t : threads) t.join();
+}
+
+void ThreadPool::run(size_t worker) {
+    uint64_t seen = 0;
+    unique_lock<mutex> lock(mu);
+    while (true) {
+        wake.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping) return;
+        seen = generation;
+        lock.unlock();
+        work(worker);
+        lock.lock();
+        if (--active == 0) done.notify_one();
+    }
+}
+
+void ThreadPool::work(size_t worker) {
+    size_t i;
+    while ((i = next.fetch_add(1)) < total) {
+        try {
+            (*job)(i, worker);
+        } catch (...) {
+            lock_guard<mutex> lock(mu);
+            if (!error) error = current_exception();
+            next.store(total);
+        }
+    }
+}
+
+void ThreadPool::ParallelFor(size_t n, const function<void(size_t, size_t)>& fn) {
+    if (n == 0) return;
+    {
+        lock_guard<mutex> lock(mu);
+        job = &fn;
+        total = n;
+        next.store(0);
+        error = nullptr;
+        active = threads.size();
+        generation++;
+    }
+    wake.notify_all();
+    work(0);
+
+    unique_lock<mutex> lock(mu);
+    done.wait(lock, [&] { return active == 0; });
+    job = nullptr;
+    if (error) rethrow_exception(error);
+}
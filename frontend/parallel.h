@@ -0,0 +1,69 @@
+//
+// Created by 田地 on 2021/8/30.
+//
+
+#ifndef COOL_PARALLEL_H
+#define COOL_PARALLEL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <functional>
+
+using namespace std;
+
+namespace cool {
+
+namespace parallel {
+
+//======================================================================//
+//                          ThreadPool Class                            //
+//======================================================================//
+// A fixed set of worker threads running one ParallelFor at a time. The
+// calling thread takes part as worker 0, so a pool of size 1 runs
+// everything inline.
+class ThreadPool {
+  private:
+    vector<thread> threads;
+
+    mutex mu;
+    condition_variable wake;
+    condition_variable done;
+    bool stopping = false;
+    uint64_t generation = 0; // bumped for every ParallelFor
+    size_t active = 0;       // threads still working on the current one
+
+    const function<void(size_t, size_t)>* job = nullptr;
+    size_t total = 0;
+    atomic<size_t> next;
+    exception_ptr error;
+
+    void run(size_t worker);
+    void work(size_t worker);
+
+  public:
+    // size is the number of workers including the caller, 0 means one per
+    // hardware thread
+    explicit ThreadPool(size_t size = 0);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    size_t Size() const { return threads.size() + 1; }
+
+    // call fn(i, worker) for every i in [0, n) and wait for all of them.
+    // worker is in [0, Size()) and no two calls with the same worker run
+    // at the same time. The first exception thrown by fn is rethrown here,
+    // remaining indices are skipped. Not reentrant, fn must not call
+    // ParallelFor on the same pool.
+    void ParallelFor(size_t n, const function<void(size_t i, size_t worker)>& fn);
+};
+
+} // namespace parallel
+
+} // namespace cool
+
+#endif //COOL_PARALLEL_H
@@ -126,7 +126,7 @@ bool ParsingResultChecker::Visit_(repr::True& expr) { return true; }
 bool ParsingResultChecker::Visit_(repr::While& expr) { return Visit(expr.GetWhileExpr()) && Visit(expr.GetLoopExpr()); }
 
 Parser::Parser(diag::Diagnosis& _diag, vector<Token> _toks)
-: diag(_diag), toks(std::move(_toks)), pos(0) {
+: diag(_diag), toks(std::move(_toks)), pos(0), arena(make_shared<repr::AstArena>()) {
     scopeEnds.push(toks.size());
 }
 
@@ -181,7 +181,9 @@ void Parser::PushScopeEnd(int scopeEnd) {
 
 int Parser::PopScopeEnd() {
     if (scopeEnds.size() == 1) throw runtime_error("no scope end to pop");
+    int scopeEnd = scopeEnds.top();
     scopeEnds.pop();
+    return scopeEnd;
 }
 
 int Parser::ReturnNextPos(Token::Type type) {
@@ -243,7 +245,7 @@ diag::TextInfo Parser::GetTextInfo() {
 //  i.e., they only need to check valid nodes. for this reason, the checker need only checks expr,
 //  for any grammer that contains expr, the grammer parser itseld should filter out invalid exprs.
 Program* Parser::ParseProgram() {
-    auto prog = new Program(Peek().textInfo, {});
+    auto prog = new Program(arena, Peek().textInfo, {});
 
     while (!Empty()) {
 
@@ -252,7 +254,7 @@ Program* Parser::ParseProgram() {
             if (checker.Visit(*cls) && !prog->AddClass(cls)) {
                 diag.EmitError(cls->GetTextInfo(), "class '" + cls->GetName().Value() +
                 "' redefined, previous defined at: " +
-                prog->GetClassPtr(cls->GetName().Value())->GetTextInfo().String());
+                prog->GetClassPtr(cls->GetName().Sym())->GetTextInfo().String());
             }
         } else {
             diag.EmitError(GetTextInfo(), "expected 'class' in class declaration");
@@ -267,7 +269,7 @@ Program* Parser::ParseProgram() {
 Class* Parser::ParseClass() {
     assert(ConsumeIfMatch(Token::kClass) && "unexpected call to ParseClass");
 
-    auto cls = new Class();
+    auto cls = arena->New<Class>();
 
     PARSER_STAT_IF_FALSE_EMIT_DIAG_RETURN(Match(Token::TypeID), cls->SetName(StringAttr(ConsumeReturn())),
         "expected type identifier(start with capital letter)", nullptr)
@@ -292,14 +294,14 @@ Class* Parser::ParseClass() {
             if (checker.Visit(*feat) && !cls->AddFuncFeature(feat)) {
                 diag.EmitError(feat->GetTextInfo(),"method '" + feat->GetName().Value() +
                 "' redefined, previous declared at: " +
-                cls->GetFuncFeaturePtr(feat->GetName().Value())->GetTextInfo().String());
+                cls->GetFuncFeaturePtr(feat->GetName().Sym())->GetTextInfo().String());
             }
         } else if (Match(Token::ID)) {
             auto feat = ParseFieldFeature();
             if (checker.Visit(*feat) && !cls->AddFieldFeature(feat)) {
                     diag.EmitError(feat->GetTextInfo(),"attribute '" + feat->GetName().Value() +
                     "' redefined, previous declared at: " +
-                    cls->GetFieldFeaturePtr(feat->GetName().Value())->GetTextInfo().String());
+                    cls->GetFieldFeaturePtr(feat->GetName().Sym())->GetTextInfo().String());
             }
         } else {
             diag.EmitError(GetTextInfo(), "expected identifier in class feature declaration");
@@ -316,7 +318,7 @@ Class* Parser::ParseClass() {
 }
 
 FuncFeature* Parser::ParseFuncFeature() {
-    auto feat = new FuncFeature();
+    auto feat = arena->New<FuncFeature>();
 
     assert(MatchMultiple({Token::ID, Token::kOpenParen}) && "unexpected call to ParseFuncFeature");
     feat->SetName(StringAttr(ConsumeReturn()));
@@ -341,7 +343,7 @@ FuncFeature* Parser::ParseFuncFeature() {
             args.emplace_back(arg);
         else break;
     }
-    feat->SetArgs(args);
+    feat->SetArgs({*arena, args});
     PopScopeEnd();
     MoveTo(closeParenPos+1);
 
@@ -378,7 +380,7 @@ FuncFeature* Parser::ParseFuncFeature() {
 }
 
 FieldFeature* Parser::ParseFieldFeature() {
-    auto feat = new FieldFeature();
+    auto feat = arena->New<FieldFeature>();
 
     assert(Match(Token::ID) &&"unexpected call to ParseFieldFeature");
     feat->SetName(StringAttr(ConsumeReturn()));
@@ -402,7 +404,7 @@ FieldFeature* Parser::ParseFieldFeature() {
 }
 
 Formal* Parser::ParseFormal() {
-    auto formal = new Formal();
+    auto formal = arena->New<Formal>();
 
     PARSER_STAT_IF_FALSE_EMIT_DIAG_RETURN(Match(Token::ID),
         formal->SetName(StringAttr(ConsumeReturn())),
@@ -461,27 +463,27 @@ Expr* Parser::OperatorExprFactory(Token::Type type, repr::Expr* left, repr::Expr
 
     switch (type) {
         case Token::kAdd:
-            return new Add(left, right);
+            return arena->New<Add>(left, right);
         case Token::kMinus:
-            return new Minus(left, right);
+            return arena->New<Minus>(left, right);
         case Token::kMultiply:
-            return new Multiply(left, right);
+            return arena->New<Multiply>(left, right);
         case Token::kDivide:
-            return new Divide(left, right);
+            return arena->New<Divide>(left, right);
         case Token::kLessThan:
-            return new LessThan(left, right);
+            return arena->New<LessThan>(left, right);
         case Token::kLessThanOrEqual:
-            return new LessThanOrEqual(left, right);
+            return arena->New<LessThanOrEqual>(left, right);
         case Token::kDot:
-            return new MethodCall(left, right);
+            return arena->New<MethodCall>(left, right);
         case Token::kEqual:
-            return new Equal(left, right);
+            return arena->New<Equal>(left, right);
         case Token::kNegate:
-            return new Negate(left);
+            return arena->New<Negate>(left);
         case Token::kNot:
-            return new Not(left);
+            return arena->New<Not>(left);
         case Token::kIsvoid:
-            return new IsVoid(left);
+            return arena->New<IsVoid>(left);
         default:
             assert(false);
     }
@@ -558,7 +560,10 @@ Expr* Parser::ParseExpr() {
             auto functor = GetParseExprFunctor(Peek().type);
             if (!functor)
                 break;
-            exprs.emplace_back(Peek(), functor(*this));
+            // read the token before functor consumes it, the evaluation
+            // order of arguments is unspecified
+            auto token = Peek();
+            exprs.emplace_back(token, functor(*this));
 
         } else { // parse operator, we need to handle precedence
 
@@ -616,7 +621,7 @@ Expr* Parser::ParseExpr() {
 }
 
 If* Parser::ParseIf() {
-    auto anIf = new If();
+    auto anIf = arena->New<If>();
 
     assert(ConsumeIfMatch(Token::kIf) &&"unexpected call to ParseIf");
     auto expr = ParseExpr();
@@ -636,7 +641,7 @@ If* Parser::ParseIf() {
 
 Block* Parser::ParseBlock() {
     auto parse = [this]() {
-        auto blk = new Block(GetTextInfo());
+        auto blk = arena->New<Block>(GetTextInfo());
         vector<Expr*> exprs;
 
         while (!Empty()) {
@@ -650,7 +655,7 @@ Block* Parser::ParseBlock() {
 
         PARSER_IF_FALSE_EMIT_DIAG_RETURN(!exprs.empty(), "expected expression", blk);
 
-        blk->SetExprs(exprs);
+        blk->SetExprs({*arena, exprs});
         return blk;
     };
 
@@ -685,7 +690,7 @@ Expr* Parser::ParseParen() {
 }
 
 While* Parser::ParseWhile() {
-    auto aWhile = new While();
+    auto aWhile = arena->New<While>();
 
     assert(ConsumeIfMatch(Token::kWhile) && "unexpected call to ParseWhile");
     auto expr = ParseExpr();
@@ -700,12 +705,12 @@ While* Parser::ParseWhile() {
 }
 
 Let* Parser::ParseLet() {
-    auto let = new Let();
+    auto let = arena->New<Let>();
 
     assert(ConsumeIfMatch(Token::kLet) &&"unexpected call to ParseLet");
 
     auto parseDecl = [&](){
-        auto decl = new Let::Decl();
+        auto decl = arena->New<Let::Decl>();
 
         PARSER_IF_FALSE_EMIT_DIAG_RETURN(Match(Token::ID), "expected identifier", decl);
         decl->SetName(StringAttr(ConsumeReturn()));
@@ -731,7 +736,7 @@ Let* Parser::ParseLet() {
         else return let;
 
     } while (ConsumeIfMatch(Token::kComma));
-    let->SetDecls(decls);
+    let->SetDecls({*arena, decls});
 
     PARSER_IF_FALSE_EMIT_DIAG_RETURN(ConsumeIfMatch(Token::kIn), "expected 'in' in let expression", let);
 
@@ -741,7 +746,7 @@ Let* Parser::ParseLet() {
 }
 
 Case* Parser::ParseCase() {
-    auto aCase = new Case();
+    auto aCase = arena->New<Case>();
 
     assert(ConsumeIfMatch(Token::kCase) && "expected keyword 'case'");
     auto expr = ParseExpr();
@@ -750,7 +755,7 @@ Case* Parser::ParseCase() {
     PARSER_IF_FALSE_EMIT_DIAG_RETURN(ConsumeIfMatch(Token::kOf), "expected 'of' in case expression", aCase);
 
     auto parseBranch = [&](){
-        auto branch = new Case::Branch();
+        auto branch = arena->New<Case::Branch>();
 
         PARSER_STAT_IF_FALSE_EMIT_DIAG_RETURN(Match(Token::ID),
             branch->SetId(StringAttr(ConsumeReturn())),
@@ -784,13 +789,13 @@ Case* Parser::ParseCase() {
             return aCase;
     } while (!ConsumeIfMatch(Token::kEsac));
 
-    aCase->SetBranches(branches);
+    aCase->SetBranches({*arena, branches});
 
     return aCase;
 }
 
 ID* Parser::ParseID() {
-    auto id = new ID();
+    auto id = arena->New<ID>();
     PARSER_STAT_IF_FALSE_EMIT_DIAG_RETURN(Match(Token::ID),
         id->SetName(StringAttr(ConsumeReturn())),
         "expected identifier", id);
@@ -798,7 +803,7 @@ ID* Parser::ParseID() {
 }
 
 Assign* Parser::ParseAssign() {
-    auto assign = new Assign();
+    auto assign = arena->New<Assign>();
 
     auto id = ParseID();
     PARSER_CHECK_STAT_IF_FALSE_RETURN(id, assign->SetId(id), assign)
@@ -812,7 +817,7 @@ Assign* Parser::ParseAssign() {
 }
 
 Call* Parser::ParseCall() {
-    auto call = new Call();
+    auto call = arena->New<Call>();
     PARSER_STAT_IF_FALSE_EMIT_DIAG_RETURN(Match(Token::ID),
         call->SetId(ParseID()),
         "expected identifier in call", call);
@@ -835,14 +840,14 @@ Call* Parser::ParseCall() {
             args.emplace_back(expr);
         else break;
     }
-    call->SetArgs(args);
+    call->SetArgs({*arena, args});
     PopScopeEnd();
     MoveTo(end+1);
     return call;
 }
 
 New* Parser::ParseNew() {
-    auto aNew = new New();
+    auto aNew = arena->New<New>();
     assert(ConsumeIfMatch(Token::kNew) &&"unexpected call to ParseNew");
 
     // one common programing mistake is use ID instead of TypeID
@@ -857,20 +862,20 @@ New* Parser::ParseNew() {
 
 repr::Integer* Parser::ParseInteger() {
     assert(Match(Token::Integer) &&"unexpected call to ParseInteger");
-    return new Integer(ConsumeReturn());
+    return arena->New<Integer>(ConsumeReturn());
 }
 
 repr::String* Parser::ParseString() {
     assert(Match(Token::String) &&"unexpected call to ParseString");
-    return new String(ConsumeReturn());
+    return arena->New<String>(ConsumeReturn());
 }
 
 repr::True* Parser::ParseTrue() {
     assert(Match(Token::kTrue) && "unexpected call to ParseTrue");
-    return new True(ConsumeReturn().textInfo);
+    return arena->New<True>(ConsumeReturn().textInfo);
 }
 
 repr::False* Parser::ParseFalse() {
     assert(Match(Token::kFalse) &&"unexpected call to ParseFalse");
-    return new False(ConsumeReturn().textInfo);
+    return arena->New<False>(ConsumeReturn().textInfo);
 }
\ No newline at end of file
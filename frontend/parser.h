@@ -95,6 +95,8 @@ class Parser {
     vector<Token> toks;
     stack<int> scopeEnds;
     int pos;
+    // every node parsed is allocated here, the parsed Program keeps it alive
+    shared_ptr<repr::AstArena> arena;
 
   public:
     Parser(diag::Diagnosis& _diag, vector<Token> _toks);
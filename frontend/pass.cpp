@@ -6,6 +6,8 @@
 #include <unordered_map>
 #include <stack>
 #include <iostream>
+#include <vector>
+#include <functional>
 
 #include "pass.h"
 
@@ -21,12 +23,77 @@ void PassManager::Run(repr::Program* prog, PassContext& ctx) {
         pm.topsort();
     }
 
+    // nodes created by passes, e.g. clones, belong to the program
+    repr::AstArena::Scope scope(prog->GetArena());
+
     for (int i = 0; i < pm.passes.size() ; i++) {
         if (ctx.diag.FatalOccurred()) return;
         (*pm.passes.at(pm.sorted[i]))(prog, ctx);
     }
 }
 
+void cool::pass::ParallelFor(cool::repr::Program* prog, PassContext& ctx, const vector<diag::Diagnosis*>& diags,
+    const function<void(size_t, size_t, PassContext&)>& fn) {
+    auto& pool = *ctx.pool;
+    vector<repr::AstArena*> arenas(pool.Size(), nullptr);
+
+    pool.ParallelFor(diags.size(), [&](size_t i, size_t worker) {
+        if (!arenas[worker])
+            arenas[worker] = &prog->GetArena().Fork(worker);
+        PassContext local(*diags[i]);
+        local.map = ctx.map;
+        repr::AstArena::Scope scope(*arenas[worker]);
+        fn(i, worker, local);
+    });
+}
+
+cool::repr::Program* ClassPass::operator()(cool::repr::Program* prog, PassContext& ctx) {
+    auto classes = prog->GetClasses();
+    if (!ctx.pool || GetSchedule() == Serial) {
+        for (auto& cls : classes)
+            operator()(cls, ctx);
+        return prog;
+    }
+
+    // group classes into waves by their depth in the inheritance tree, a
+    // wave starts after every shallower one is done
+    vector<vector<repr::Class*>> waves(1);
+    if (GetSchedule() == Independent) {
+        waves[0] = classes;
+    } else {
+        unordered_map<repr::Class*, int> depths;
+        function<int(repr::Class*)> depth = [&](repr::Class* cls) {
+            auto it = depths.find(cls);
+            if (it != depths.end()) return it->second;
+            depths[cls] = 0; // guard against cycles, which are reported elsewhere
+            auto parent = prog->GetClassPtr(cls->GetParent().Sym());
+            int d = parent && parent != cls ? depth(parent) + 1 : 0;
+            depths[cls] = d;
+            return d;
+        };
+        for (auto& cls : classes) {
+            int d = depth(cls);
+            if (d >= waves.size()) waves.resize(d + 1);
+            waves[d].emplace_back(cls);
+        }
+    }
+
+    // every class reports to its own Diagnosis, appended in program order
+    vector<diag::Diagnosis> diags(classes.size());
+    unordered_map<repr::Class*, diag::Diagnosis*> diagOf;
+    for (size_t i = 0; i < classes.size(); i++)
+        diagOf[classes[i]] = &diags[i];
+    for (auto& wave : waves) {
+        vector<diag::Diagnosis*> waveDiags;
+        for (auto cls : wave) waveDiags.emplace_back(diagOf.at(cls));
+        ParallelFor(prog, ctx, waveDiags, [&](size_t i, size_t, PassContext& local) {
+            operator()(wave[i], local);
+        });
+    }
+    for (auto& d : diags) ctx.diag.Append(d);
+    return prog;
+}
+
 void PassManager::Refresh() {
     GetPassManager().passes.clear();
     GetPassManager().dependency.clear();
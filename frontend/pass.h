@@ -9,9 +9,11 @@
 #include <memory>
 #include <unordered_map>
 #include <iostream>
+#include <functional>
 
 #include "repr.h"
 #include "diag.h"
+#include "parallel.h"
 
 #define PassID(PassClass) std::type_index(typeid(PassClass))
 
@@ -29,11 +31,24 @@ class PassContext {
 
     unordered_map<string, pair<type_index, shared_ptr<void>>> map;
 
+    // passes that support it spread their work over pool, see ParallelFor.
+    // nullptr runs everything serially.
+    shared_ptr<parallel::ThreadPool> pool;
+
+    // jobs is the number of threads, 0 for one per hardware thread
+    void EnableParallel(size_t jobs = 0) {
+        pool = make_shared<parallel::ThreadPool>(jobs);
+    }
+
     template<class T>
     void Set(string name, T& val) {
         map.insert({move(name), make_pair(type_index(typeid(T)), make_shared<T>(val))});
     }
 
+    bool Contains(const string& name) const {
+        return map.find(name) != map.end();
+    }
+
     template<class T>
     shared_ptr<T> Get(string name) {
         if (map.find(name) == map.end()) throw runtime_error("object '" + name + "' not found");
@@ -59,13 +74,28 @@ class ProgramPass : public Pass {
     };
 };
 
+// Run fn(i, worker, ctx) for every i in [0, diags.size()) on the pool of
+// ctx. Task i gets its own PassContext, sharing the objects of ctx but
+// reporting to diags[i], and the fork of the program's arena of its
+// worker. Callers append diags to ctx.diag in the order a serial run would
+// have emitted them, so the output doesn't depend on scheduling.
+void ParallelFor(repr::Program* prog, PassContext& ctx, const vector<diag::Diagnosis*>& diags,
+    const function<void(size_t i, size_t worker, PassContext& ctx)>& fn);
+
 class ClassPass : public Pass {
   public:
-    repr::Program* operator()(repr::Program* prog, PassContext& ctx) final {
-        for (auto& cls : prog->GetClasses())
-            operator()(cls, ctx);
-        return prog;
-    }
+    // how the classes of a program may be run when ctx has a pool
+    enum Schedule {
+        Serial,      // one at a time, in program order
+        Independent, // all at once, a class only writes to itself
+        TopDown,     // as Independent, but all ancestors of a class are
+                     // finished before it starts
+    };
+
+    virtual Schedule GetSchedule() const { return Serial; }
+
+    repr::Program* operator()(repr::Program* prog, PassContext& ctx) final;
+
     virtual repr::Class* operator()(repr::Class* cls, PassContext& ctx) {
         return cls;
     }
@@ -0,0 +1,285 @@
+//
+// Created by 田地 on 2021/9/1.
+//
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include "profile.h"
+#include "visitor.h"
+#include "typead.h"
+#include "constant.h"
+#include "cache.h"
+
+using namespace std;
+using namespace cool;
+using namespace profile;
+using namespace constant;
+
+//======================================================================//
+//                        ReceiverProfile Class                         //
+//======================================================================//
+ReceiverProfile ReceiverProfile::Read(istream& in) {
+    ReceiverProfile prof;
+    string line;
+    for (int lineno = 1; getline(in, line); lineno++) {
+        istringstream entry(line);
+        string site, cls;
+        if (!(entry>> site) || site[0] == '#') continue;
+        int siteLine, sitePos;
+        uint64_t count;
+        char colon, rest;
+        istringstream siteStream(site);
+        if (!(siteStream>> siteLine>> colon>> sitePos) || colon != ':' || siteStream>> rest
+            || !(entry>> cls>> count) || entry>> rest)
+            throw runtime_error("malformed receiver profile entry at line " + to_string(lineno));
+        prof.Add(siteLine, sitePos, cls, count);
+    }
+    return prof;
+}
+
+void ReceiverProfile::Add(int line, int pos, Symbol cls, uint64_t count) {
+    sites[key(line, pos)][cls] += count;
+}
+
+uint64_t ReceiverProfile::Hash() const {
+    vector<uint64_t> hashes;
+    for (auto& site : sites) {
+        for (auto& entry : site.second) {
+            cache::Hasher h;
+            h.Mix(site.first);
+            h.Mix(entry.first);
+            h.Mix(entry.second);
+            hashes.emplace_back(h.Digest());
+        }
+    }
+    sort(hashes.begin(), hashes.end());
+    cache::Hasher h;
+    for (auto v : hashes) h.Mix(v);
+    return h.Digest();
+}
+
+Symbol ReceiverProfile::Dominant(const diag::TextInfo& site, const function<bool(Symbol)>& accept) const {
+    auto it = sites.find(key(site.line, site.pos));
+    if (it == sites.end()) return Symbol();
+    Symbol best;
+    uint64_t bestCount = 0;
+    for (auto& entry : it->second) {
+        if (!accept(entry.first)) continue;
+        if (entry.second > bestCount || (entry.second == bestCount && entry.first < best)) {
+            best = entry.first;
+            bestCount = entry.second;
+        }
+    }
+    return best;
+}
+
+//======================================================================//
+//                      SpeculateReceivers Pass                         //
+//======================================================================//
+repr::Program* SpeculateReceivers::operator()(repr::Program* prog, pass::PassContext& ctx) {
+    auto mode = ctx.Contains("speculation") ? *ctx.Get<Speculation>("speculation") : Speculation::Profile;
+    if (mode == Speculation::None) {
+        SpeculationStats stats;
+        ctx.Set<SpeculationStats>("speculation_stats", stats);
+        return prog;
+    }
+
+    struct Site {
+        repr::Class* cls;
+        repr::Call* call;
+        Symbol type;  // static type of the receiver, SELF_TYPE resolved
+        Symbol guess; // inferred from the method alone, may be empty
+    };
+
+    // collect the calls to speculate on and the New expressions they may
+    // receive
+    class Visitor : public visitor::ExprVisitor<void> {
+      private:
+        // New classes bound to a name in the current method
+        unordered_map<Symbol, unordered_map<Symbol, uint64_t>> bindings;
+        // calls of the current method whose receiver is a local
+        vector<pair<size_t, Symbol>> locals;
+
+        void bind(Symbol name, repr::Expr* expr) {
+            if (expr && expr->GetKind() == repr::Expr::Kind::New)
+                bindings[name][static_cast<repr::New*>(expr)->GetType().Sym()]++;
+        }
+
+        void visitUnary(repr::Unary& expr) { Visit(*expr.GetExpr()); }
+
+        void visitBinary(repr::Binary& expr) {
+            Visit(*expr.GetLeft());
+            Visit(*expr.GetRight());
+        }
+
+        void visitCall(Symbol type, repr::Expr* receiver, repr::Call& call) {
+            for (auto& arg : call.GetArgs()) Visit(*arg);
+            if (!call.GetLink() || call.GetDirect()) return;
+            if (type == SYM_SELF_TYPE) type = cls->GetName().Sym();
+            Site site = {cls, &call, type, Symbol()};
+            // an implicit self receiver is neither
+            if (receiver && receiver->GetKind() == repr::Expr::Kind::New)
+                site.guess = static_cast<repr::New*>(receiver)->GetType().Sym();
+            else if (receiver && receiver->GetKind() == repr::Expr::Kind::ID)
+                locals.emplace_back(sites.size(), static_cast<repr::ID*>(receiver)->GetName().Sym());
+            sites.emplace_back(site);
+        }
+
+      public:
+        repr::Class* cls = nullptr;
+        vector<Site> sites;
+        unordered_map<Symbol, uint64_t> allocations; // New sites per class
+
+        void Visit(repr::Expr& expr) { ExprVisitor<void>::Visit(expr); }
+
+        // guess the receivers that are locals once the method is done,
+        // the last binding may follow the call in a loop
+        void Finish() {
+            for (auto& local : locals) {
+                auto it = bindings.find(local.second);
+                if (it == bindings.end()) continue;
+                uint64_t bestCount = 0;
+                for (auto& entry : it->second) {
+                    auto& guess = sites[local.first].guess;
+                    if (entry.second > bestCount || (entry.second == bestCount && entry.first < guess)) {
+                        guess = entry.first;
+                        bestCount = entry.second;
+                    }
+                }
+            }
+            bindings.clear();
+            locals.clear();
+        }
+
+        void Visit_(repr::LinkBuiltin& expr) {}
+
+        void Visit_(repr::Assign& expr) {
+            Visit(*expr.GetExpr());
+            bind(expr.GetId()->GetName().Sym(), expr.GetExpr());
+        }
+
+        void Visit_(repr::Block& expr) {
+            for (auto& e : expr.GetExprs()) Visit(*e);
+        }
+
+        void Visit_(repr::Case& expr) {
+            Visit(*expr.GetExpr());
+            for (auto& branch : expr.GetBranches()) Visit(*branch->GetExpr());
+        }
+
+        void Visit_(repr::Call& expr) { visitCall(cls->GetName().Sym(), nullptr, expr); }
+
+        void Visit_(repr::ID& expr) {}
+
+        void Visit_(repr::Integer& expr) {}
+
+        void Visit_(repr::If& expr) {
+            Visit(*expr.GetIfExpr());
+            Visit(*expr.GetThenExpr());
+            Visit(*expr.GetElseExpr());
+        }
+
+        void Visit_(repr::Let& expr) {
+            for (auto& decl : expr.GetDecls()) {
+                if (!decl->GetExpr()) continue;
+                Visit(*decl->GetExpr());
+                bind(decl->GetName().Sym(), decl->GetExpr());
+            }
+            Visit(*expr.GetExpr());
+        }
+
+        void Visit_(repr::MethodCall& expr) {
+            Visit(*expr.GetLeft());
+            visitCall(expr.GetType(), expr.GetLeft(), *static_cast<repr::Call*>(expr.GetRight()));
+        }
+
+        void Visit_(repr::New& expr) { allocations[expr.GetType().Sym()]++; }
+
+        void Visit_(repr::String& expr) {}
+
+        void Visit_(repr::While& expr) {
+            Visit(*expr.GetWhileExpr());
+            Visit(*expr.GetLoopExpr());
+        }
+
+        void Visit_(repr::IsVoid& expr) { visitUnary(expr); }
+        void Visit_(repr::Negate& expr) { visitUnary(expr); }
+        void Visit_(repr::Not& expr) { visitUnary(expr); }
+
+        void Visit_(repr::Add& expr) { visitBinary(expr); }
+        void Visit_(repr::Divide& expr) { visitBinary(expr); }
+        void Visit_(repr::Equal& expr) { visitBinary(expr); }
+        void Visit_(repr::LessThanOrEqual& expr) { visitBinary(expr); }
+        void Visit_(repr::LessThan& expr) { visitBinary(expr); }
+        void Visit_(repr::Multiply& expr) { visitBinary(expr); }
+        void Visit_(repr::Minus& expr) { visitBinary(expr); }
+
+        void Visit_(repr::True& expr) {}
+        void Visit_(repr::False& expr) {}
+    };
+
+    Visitor vis;
+    for (auto& cls : prog->GetClasses()) {
+        vis.cls = cls;
+        for (auto& func : cls->GetOwnFuncFeatures()) {
+            vis.Visit(*func->GetExpr());
+            vis.Finish();
+        }
+        for (auto& field : cls->GetOwnFieldFeatures()) {
+            if (field->GetExpr()) vis.Visit(*field->GetExpr());
+            vis.Finish();
+        }
+    }
+
+    auto& typeAdvisor = *ctx.Get<type::TypeAdvisor>("type_advisor");
+    shared_ptr<ReceiverProfile> receiverProfile;
+    if (ctx.Contains("receiver_profile"))
+        receiverProfile = ctx.Get<ReceiverProfile>("receiver_profile");
+
+    // the most allocated class conforming to type, first in pre-order on
+    // ties
+    unordered_map<Symbol, Symbol> mostAllocated;
+    auto getMostAllocated = [&](Symbol type) {
+        auto it = mostAllocated.find(type);
+        if (it != mostAllocated.end()) return it->second;
+        Symbol best;
+        uint64_t bestCount = 0;
+        typeAdvisor.TopDownVisit(type, [&](repr::Class* cls) {
+            auto count = vis.allocations.find(cls->GetName().Sym());
+            if (count != vis.allocations.end() && count->second > bestCount) {
+                best = cls->GetName().Sym();
+                bestCount = count->second;
+            }
+            return false;
+        });
+        mostAllocated.insert({type, best});
+        return best;
+    };
+
+    SpeculationStats stats;
+    for (auto& site : vis.sites) {
+        // values have no vtable to check against
+        auto accept = [&](Symbol guess) {
+            return !guess.Empty() && guess != SYM_INT && guess != SYM_BOOL && guess != SYM_STRING
+                && typeAdvisor.Contains(guess)
+                && typeAdvisor.Conforms(guess, site.type, site.cls->GetName().Sym());
+        };
+        Symbol guess;
+        if (receiverProfile) guess = receiverProfile->Dominant(site.call->GetTextInfo(), accept);
+        if (!guess.Empty()) {
+            stats.profiled++;
+        } else {
+            if (mode != Speculation::Guess) continue;
+            guess = accept(site.guess) ? site.guess : getMostAllocated(site.type);
+            if (!accept(guess)) continue;
+        }
+        site.call->SetSpeculation(guess);
+        stats.speculated++;
+    }
+    ctx.Set<SpeculationStats>("speculation_stats", stats);
+    return prog;
+}
@@ -0,0 +1,90 @@
+//
+// Created by 田地 on 2021/9/1.
+//
+
+#ifndef COOL_PROFILE_H
+#define COOL_PROFILE_H
+
+#include <istream>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+#include "repr.h"
+#include "pass.h"
+#include "diag.h"
+#include "symbol.h"
+
+using namespace std;
+
+namespace cool {
+
+namespace profile {
+
+//======================================================================//
+//                        ReceiverProfile Class                         //
+//======================================================================//
+// Counts of the receiver classes seen at call sites, a site is the
+// position of the method name of a call. The file format has one entry
+// per line,
+//     <line>:<pos> <class> <count>
+// entries of the same site and class add up, blank lines and lines
+// starting with '#' are skipped.
+class ReceiverProfile {
+  private:
+    unordered_map<uint64_t, unordered_map<Symbol, uint64_t>> sites;
+
+    static uint64_t key(int line, int pos) { return uint64_t(uint32_t(line)) << 32 | uint32_t(pos); }
+
+  public:
+    // throw runtime_error on a malformed entry
+    static ReceiverProfile Read(istream& in);
+
+    void Add(int line, int pos, Symbol cls, uint64_t count);
+
+    // the most frequent class at site that accept returns true for, ties
+    // go to the first interned one. Return an empty Symbol if none.
+    Symbol Dominant(const diag::TextInfo& site, const function<bool(Symbol)>& accept) const;
+
+    bool Empty() const { return sites.empty(); }
+
+    // independent of the order entries were read in
+    uint64_t Hash() const;
+};
+
+//======================================================================//
+//                      SpeculateReceivers Pass                         //
+//======================================================================//
+// Guess the likeliest receiver class of calls that still dispatch through
+// the vtable after ana::Devirtualize, LLVMGen then checks the receiver
+// against it and calls its method directly on a hit (see
+// repr::Call::SetSpeculation). The guess comes from the ReceiverProfile
+// set in the context as "receiver_profile" if it has the site. With
+// Speculation::Guess the other sites are inferred from New expressions: a
+// receiver that is a New, or a local last bound to a New in the same
+// method, is taken as that class, and anything else as the most allocated
+// class conforming to its static type. A wrong guess costs a compare,
+// never correctness.
+// The mode is the Speculation set in the context as "speculation",
+// Profile if there is none. Sets "speculation_stats" (SpeculationStats).
+enum class Speculation : uint8_t {
+    None,    // every polymorphic call dispatches through the vtable
+    Profile, // only the sites the profile has
+    Guess,   // those, and the others from New expressions
+};
+
+struct SpeculationStats {
+    size_t speculated = 0; // call sites given a guess
+    size_t profiled = 0;   // of which came from the profile
+};
+
+class SpeculateReceivers : public pass::ProgramPass {
+  public:
+    repr::Program* operator()(repr::Program* prog, pass::PassContext& ctx) final;
+};
+
+} // namespace profile
+
+} // namespace cool
+
+#endif //COOL_PROFILE_H
@@ -9,6 +9,51 @@
 using namespace cool;
 using namespace repr;
 
+//======================================================================//
+//                          AstArena  Class                             //
+//======================================================================//
+constexpr size_t repr::AstArena::chunkSize;
+
+thread_local AstArena* repr::AstArena::current = nullptr;
+
+void repr::AstArena::grow(size_t size) {
+    size_t payload = max(size, chunkSize);
+    auto chunk = static_cast<Chunk*>(::operator new(sizeof(Chunk) + payload));
+    chunk->next = chunks;
+    chunk->size = payload;
+    chunks = chunk;
+    cur = reinterpret_cast<char*>(chunk + 1);
+    end = cur + payload;
+}
+
+void repr::AstArena::Release() {
+    for (auto fin = finalizers; fin; fin = fin->next)
+        fin->destroy(fin->obj);
+    finalizers = nullptr;
+    while (chunks) {
+        auto next = chunks->next;
+        ::operator delete(chunks);
+        chunks = next;
+    }
+    cur = end = nullptr;
+    allocated = 0;
+    forks.clear();
+}
+
+AstArena& repr::AstArena::Fork(size_t slot) {
+    lock_guard<mutex> lock(forkMu);
+    if (slot >= forks.size()) forks.resize(slot + 1);
+    if (!forks[slot]) forks[slot].reset(new AstArena());
+    return *forks[slot];
+}
+
+AstArena& repr::AstArena::Current() {
+    // nodes created outside any compilation, e.g. by tests, live as long
+    // as the process does
+    static AstArena global;
+    return current ? *current : global;
+}
+
 //======================================================================//
 //                               Case Class                             //
 //======================================================================//
@@ -16,7 +61,7 @@ repr::Case* repr::Case::Clone() {
     vector<Branch*> _branches(branches.size());
     for (int i = 0; i < branches.size(); i++)
         _branches[i] = branches.at(i)->Clone();
-    return new Case(expr->Clone(), _branches);
+    return NewRepr<Case>(expr->Clone(), _branches);
 }
 
 //======================================================================//
@@ -26,7 +71,7 @@ repr::FuncFeature* repr::FuncFeature::Clone() {
     vector<Formal*> _args;
     for (auto& arg : args)
         _args.emplace_back(arg->Clone());
-    return new FuncFeature(name, type, expr->Clone(), _args);
+    return NewRepr<FuncFeature>(name, type, expr->Clone(), _args);
 }
 
 //======================================================================//
@@ -35,44 +80,63 @@ repr::FuncFeature* repr::FuncFeature::Clone() {
 
 repr::Class::Class(const StringAttr& _name, const StringAttr& _parent,
     vector<FuncFeature*> _funcs, vector<FieldFeature*> _fields)
-    : name(_name), parent(_parent), funcs(move(_funcs)),
+    : Repr(Kind::Class), name(_name), parent(_parent), funcs(move(_funcs)),
     fields(move(_fields)) {
-    for (auto& func : funcs)
+    for (auto& func : funcs) {
         funcMap.insert({func->GetName().Value(), func});
-    for (auto& field : fields)
+        func->SetOwner(this);
+    }
+    for (auto& field : fields) {
         fieldMap.insert({field->GetName().Value(), field});
+        field->SetOwner(this);
+    }
 }
 
 ::Class* repr::Class::Clone() {
+    // inherited features belong to the ancestors, the clone gets them
+    // when the inheritance passes run on it
+    vector<FuncFeature*> _funcs;
+    for (auto& func : GetOwnFuncFeatures())
+        _funcs.emplace_back(func->Clone());
 
-    vector<FuncFeature*> _funcs(funcs.size());
-    for(int i = 0; i < funcs.size(); i++)
-        _funcs[i] = funcs.at(i)->Clone();
+    vector<FieldFeature*> _fields;
+    for (auto& field : GetOwnFieldFeatures())
+        _fields.emplace_back(field->Clone());
 
-    vector<FieldFeature*> _fields(fields.size());
-    for(int i = 0; i < fields.size(); i++)
-        _fields[i] = fields.at(i)->Clone();
+    return NewRepr<Class>(name, parent, _funcs, _fields);
+}
+
+vector<repr::FuncFeature*> repr::Class::GetOwnFuncFeatures() {
+    vector<FuncFeature*> own;
+    for (auto& func : funcs)
+        if (!IsInherited(func)) own.emplace_back(func);
+    return own;
+}
 
-    return new Class(name, parent, _funcs, _fields);
+vector<repr::FieldFeature*> repr::Class::GetOwnFieldFeatures() {
+    vector<FieldFeature*> own;
+    for (auto& field : fields)
+        if (!IsInherited(field)) own.emplace_back(field);
+    return own;
 }
 
-void repr::Class::DeleteFuncFeature(const string& featName) {
+void repr::Class::DeleteFuncFeature(Symbol featName) {
     if (!GetFuncFeaturePtr(featName))
         return;
     funcMap.erase(featName);
     auto pred = [&featName](FuncFeature* feat) {
-        return feat->GetName().Value() == featName;
+        return feat->GetName().Sym() == featName;
     };
     auto it = find_if(funcs.begin(), funcs.end(), pred);
     funcs.erase(it);
 }
 
-void repr::Class::DeleteFieldFeature(const string& featName) {
+void repr::Class::DeleteFieldFeature(Symbol featName) {
     if (!GetFieldFeaturePtr(featName))
         return;
     fieldMap.erase(featName);
     auto pred = [&featName](FieldFeature* feat) {
-        return feat->GetName().Value() == featName;
+        return feat->GetName().Sym() == featName;
     };
     auto it = find_if(fields.begin(), fields.end(), pred);
     fields.erase(it);
@@ -84,24 +148,33 @@ void repr::Class::DeleteFieldFeature(const string& featName) {
 
 repr::Program::Program(const diag::TextInfo& _textInfo,
     const vector<Class*>& _classVec)
-    : textInfo(_textInfo), classVec(_classVec) {
+    : Repr(Kind::Program), textInfo(_textInfo), classVec(_classVec) {
+    for (auto& cls : classVec)
+        classMap.insert({cls->GetName().Sym(), cls});
+}
+
+repr::Program::Program(shared_ptr<AstArena> _arena,
+    const diag::TextInfo& _textInfo, const vector<Class*>& _classVec)
+    : Repr(Kind::Program), arena(move(_arena)), textInfo(_textInfo), classVec(_classVec) {
     for (auto& cls : classVec)
-        classMap.insert({cls->GetName().Value(), cls});
+        classMap.insert({cls->GetName().Sym(), cls});
 }
 
 repr::Program* repr::Program::Clone() {
+    // the clone shares the arena, which stays alive until both are gone
+    AstArena::Scope scope(*arena);
     vector<Class*> _classVec(classVec.size());
     for (int i = 0; i < classVec.size(); i++)
         _classVec[i] = classVec.at(i)->Clone();
-    return new Program(textInfo, _classVec);
+    return new Program(arena, textInfo, _classVec);
 }
 
-void repr::Program::DeleteClass(const string& name) {
+void repr::Program::DeleteClass(Symbol name) {
     if (!GetClassPtr(name))
         return;
     classMap.erase(name);
     auto pred = [&name](Class* cls) {
-        return cls->GetName().Value() == name;
+        return cls->GetName().Sym() == name;
     };
     auto it = find_if(classVec.begin(), classVec.end(), pred);
     classVec.erase(it);
@@ -10,9 +10,17 @@
 #include <vector>
 #include <memory>
 #include <iostream>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <mutex>
+#include <initializer_list>
+#include <stdexcept>
 
 #include "token.h"
 #include "diag.h"
+#include "symbol.h"
 
 using namespace std;
 
@@ -39,6 +47,166 @@ namespace repr {
 // covariant.                                                           //
 //======================================================================//
 
+//======================================================================//
+//                          AstArena  Class                             //
+//======================================================================//
+// Bump allocator that owns every node of one compilation. Nodes are
+// carved out of large chunks and are never freed one by one, dropping
+// the arena releases the whole tree at once. Nodes keep their lists in
+// the arena too (see ArenaArray) and are trivially destructible, only
+// those still owning heap memory (Class with its feature maps) are
+// recorded so that their destructors run when the arena goes away.
+//
+// Clone() allocates from the current arena, see AstArena::Scope.
+class AstArena {
+  private:
+    struct Chunk {
+        Chunk* next;
+        size_t size;
+    };
+
+    struct Finalizer {
+        void (*destroy)(void*);
+        void* obj;
+        Finalizer* next;
+    };
+
+    static constexpr size_t chunkSize = 64 * 1024;
+
+    char* cur;
+    char* end;
+    Chunk* chunks;
+    Finalizer* finalizers;
+    size_t allocated;
+
+    mutex forkMu;
+    vector<unique_ptr<AstArena>> forks;
+
+    void grow(size_t size);
+
+    static thread_local AstArena* current;
+
+  public:
+    AstArena() : cur(nullptr), end(nullptr), chunks(nullptr), finalizers(nullptr), allocated(0) {}
+
+    AstArena(const AstArena&) = delete;
+    AstArena& operator=(const AstArena&) = delete;
+
+    ~AstArena() { Release(); }
+
+    void* Allocate(size_t size, size_t align = alignof(max_align_t)) {
+        auto p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(cur) + align - 1) & ~(align - 1));
+        if (!cur || p + size > end) {
+            grow(size + align);
+            p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(cur) + align - 1) & ~(align - 1));
+        }
+        cur = p + size;
+        allocated += size;
+        return p;
+    }
+
+    template<class T, class... Args>
+    T* New(Args&&... args) {
+        // the lists a node is built with are copied into its arena
+        Scope scope(*this);
+        auto obj = new (Allocate(sizeof(T), alignof(T))) T(forward<Args>(args)...);
+        if (!is_trivially_destructible<T>::value) {
+            auto fin = new (Allocate(sizeof(Finalizer), alignof(Finalizer))) Finalizer{
+                [](void* p) { static_cast<T*>(p)->~T(); }, obj, finalizers};
+            finalizers = fin;
+        }
+        return obj;
+    }
+
+    // finalize all nodes and give every chunk back
+    void Release();
+
+    // bytes handed out so far, not counting forks
+    size_t Allocated() const { return allocated; }
+
+    // an arena released along with this one, created on first use of
+    // slot. An arena must only be used by one thread at a time, threads
+    // building nodes concurrently each take the fork of a different slot.
+    // Thread-safe.
+    AstArena& Fork(size_t slot);
+
+    // the arena Clone() allocates from, a process wide arena is used
+    // when no Scope is active
+    static AstArena& Current();
+
+    // make an arena current for the lifetime of the scope
+    class Scope {
+      private:
+        AstArena* prev;
+
+      public:
+        explicit Scope(AstArena& arena) : prev(current) { current = &arena; }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        ~Scope() { current = prev; }
+    };
+};
+
+// allocate a node from the current arena
+template<class T, class... Args>
+T* NewRepr(Args&&... args) {
+    return AstArena::Current().New<T>(forward<Args>(args)...);
+}
+
+//======================================================================//
+//                         ArenaArray  Class                            //
+//======================================================================//
+// Fixed-length list whose elements live in an AstArena, the child lists
+// of nodes are kept in it so that nodes need no destructor. It reads
+// like a const vector. Copies share the elements, which can't be changed
+// in place, set a new list on the node instead.
+template<class T>
+class ArenaArray {
+    static_assert(is_trivially_destructible<T>::value,
+        "elements are never destroyed");
+
+  private:
+    const T* elems = nullptr;
+    uint32_t count = 0;
+
+  public:
+    ArenaArray() = default;
+
+    ArenaArray(AstArena& arena, const T* first, size_t n) : count(n) {
+        if (!n) return;
+        auto p = static_cast<T*>(arena.Allocate(sizeof(T) * n, alignof(T)));
+        uninitialized_copy(first, first + n, p);
+        elems = p;
+    }
+
+    ArenaArray(AstArena& arena, const vector<T>& vec)
+    : ArenaArray(arena, vec.data(), vec.size()) {}
+
+    // copy into the current arena
+    ArenaArray(const vector<T>& vec) : ArenaArray(AstArena::Current(), vec) {}
+
+    ArenaArray(initializer_list<T> list)
+    : ArenaArray(AstArena::Current(), list.begin(), list.size()) {}
+
+    const T* begin() const { return elems; }
+    const T* end() const { return elems + count; }
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    const T& operator[](size_t i) const { return elems[i]; }
+
+    const T& at(size_t i) const {
+        if (i >= count) throw out_of_range("ArenaArray::at");
+        return elems[i];
+    }
+
+    const T& front() const { return elems[0]; }
+    const T& back() const { return elems[count - 1]; }
+};
+
 //======================================================================//
 //                             Attr  Class                              //
 //======================================================================//
@@ -62,7 +230,7 @@ class Attr {
 //======================================================================//
 class StringAttr : public Attr {
   private:
-    string val;
+    Symbol val;
 
   public:
     StringAttr() = default;
@@ -77,11 +245,16 @@ class StringAttr : public Attr {
     StringAttr(const string& _val, const diag::TextInfo& _textInfo)
     : val(_val), Attr(_textInfo) {}
 
-    string Value() { return val; }
+    StringAttr(Symbol _val, const diag::TextInfo& _textInfo)
+    : val(_val), Attr(_textInfo) {}
+
+    const string& Value() const { return val.Str(); }
+
+    Symbol Sym() const { return val; }
 
-    void SetValue(const string& _val) { val = _val; }
+    void SetValue(Symbol _val) { val = _val; }
 
-    bool Empty() const { return val.empty(); }
+    bool Empty() const { return val.Empty(); }
 };
 
 //======================================================================//
@@ -89,7 +262,7 @@ class StringAttr : public Attr {
 //======================================================================//
 class IntAttr : public Attr {
   private:
-    int val;
+    int val = 0;
 
   public:
     IntAttr() = default;
@@ -117,10 +290,16 @@ class IntAttr : public Attr {
 
 #define COOL_REPR_SETTER_GETTER_POINTER(Type, Name, Field)\
     Type* Get##Name() { return Field; }\
+    const Type* Get##Name() const { return Field; }\
     void Set##Name(Type* _##Field) { Field = _##Field; }
 
-#define COOL_REPR_BASE_CONSTRUCTOR(Type)\
-    Type() = default;\
+#define COOL_REPR_BASE_CONSTRUCTOR(Type, Base)\
+    Type() : Base(Kind::Type) {}\
+    Type(const Type&) = delete;\
+    Type& operator=(const Type&) = delete;\
+
+#define COOL_REPR_ABSTRACT_CONSTRUCTOR(Type, Base)\
+    explicit Type(Kind _kind) : Base(_kind) {}\
     Type(const Type&) = delete;\
     Type& operator=(const Type&) = delete;\
 
@@ -145,9 +324,59 @@ class IntAttr : public Attr {
 // todo: attach original token with repr
 class Repr {
   public:
-    virtual ~Repr() = default;
+    // concrete node kinds, expression kinds are kept contiguous
+    enum class Kind : uint8_t {
+        Program,
+        Class,
+        FuncFeature,
+        FieldFeature,
+        Formal,
+        Decl,
+        Branch,
+        ExprST,
+        LinkBuiltin,
+        Assign,
+        Add,
+        Block,
+        Case,
+        Call,
+        Divide,
+        Equal,
+        False,
+        ID,
+        IsVoid,
+        Integer,
+        If,
+        LessThanOrEqual,
+        LessThan,
+        Let,
+        MethodCall,
+        Multiply,
+        Minus,
+        Negate,
+        New,
+        Not,
+        String,
+        True,
+        While,
+        ExprEND,
+    };
+
+  private:
+    Kind kind;
+
+  public:
+    explicit Repr(Kind _kind) : kind(_kind) {}
+
+    Kind GetKind() const { return kind; }
+
     virtual diag::TextInfo GetTextInfo() const = 0;
     virtual Repr* Clone() = 0;
+
+  protected:
+    // nodes are never deleted through a base pointer, the arena drops
+    // them without running destructors
+    ~Repr() = default;
 };
 
 
@@ -155,9 +384,14 @@ class Repr {
 //                           Expr  Class                                //
 //======================================================================//
 class Expr : public Repr {
+  private:
+    Symbol staticType; // set by TypeChecking
+
   public:
-    virtual ~Expr() = default;
+    explicit Expr(Kind _kind) : Repr(_kind) {}
     virtual Expr* Clone() = 0;
+
+    COOL_REPR_SETTER_GETTER(Symbol, StaticType, staticType)
 };
 
 //======================================================================//
@@ -169,12 +403,12 @@ class Formal : public Repr {
     StringAttr type;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(Formal)
+    COOL_REPR_BASE_CONSTRUCTOR(Formal, Repr)
 
     Formal(const StringAttr& _name, const StringAttr& _type)
-    : name(_name), type(_type) {}
+    : Repr(Kind::Formal), name(_name), type(_type) {}
 
-    Formal* Clone() final { return new Formal(name, type); }
+    Formal* Clone() final { return NewRepr<Formal>(name, type); }
 
     diag::TextInfo GetTextInfo() const final { return name.TextInfo(); }
 
@@ -187,28 +421,44 @@ class Formal : public Repr {
 //======================================================================//
 class LinkBuiltin : public Expr {
   private:
-    string name;
-    string type;
-    vector<string> params;
+    Symbol name;
+    Symbol type;
+    ArenaArray<Symbol> params;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(LinkBuiltin)
+    COOL_REPR_BASE_CONSTRUCTOR(LinkBuiltin, Expr)
 
-    LinkBuiltin(const string& _name, const string& _type,
-        const vector<string>& _params)
-    : name(_name), type(_type), params(move(_params)) {}
+    LinkBuiltin(Symbol _name, Symbol _type, ArenaArray<Symbol> _params)
+    : Expr(Kind::LinkBuiltin), name(_name), type(_type), params(_params) {}
 
     LinkBuiltin* Clone() final {
-        return new LinkBuiltin(name, type, params);
+        return NewRepr<LinkBuiltin>(name, type, params);
     }
 
     diag::TextInfo GetTextInfo() const final {
         return diag::TextInfo{};
     }
 
-    COOL_REPR_SETTER_GETTER(string, Name, name)
-    COOL_REPR_SETTER_GETTER(string, Type, type)
-    COOL_REPR_SETTER_GETTER(vector<string>, Params, params)
+    const string& GetName() const { return name.Str(); }
+    Symbol Sym() const { return name; }
+    void SetName(Symbol _name) { name = _name; }
+    COOL_REPR_SETTER_GETTER(Symbol, Type, type)
+    COOL_REPR_SETTER_GETTER(ArenaArray<Symbol>, Params, params)
+};
+
+//======================================================================//
+//                             Slot Struct                              //
+//======================================================================//
+// where the value a name is bound to lives, see interp::Interpreter
+struct Slot {
+    enum Kind : uint8_t {
+        Unresolved,
+        Field, // idx-th field of self
+        Frame, // idx-th value of the frame
+        Self,
+    };
+    Kind kind = Unresolved;
+    uint32_t idx = 0;
 };
 
 //======================================================================//
@@ -217,14 +467,15 @@ class LinkBuiltin : public Expr {
 class ID : public Expr {
   private:
     StringAttr name;
+    Slot slot;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(ID)
+    COOL_REPR_BASE_CONSTRUCTOR(ID, Expr)
 
-    ID(const StringAttr& _name) : name(_name) {}
+    ID(const StringAttr& _name) : Expr(Kind::ID), name(_name) {}
 
     ID* Clone() final {
-        return new ID(name);
+        return NewRepr<ID>(name);
     }
 
     diag::TextInfo GetTextInfo() const final {
@@ -232,6 +483,7 @@ class ID : public Expr {
     }
 
     COOL_REPR_SETTER_GETTER(StringAttr, Name, name)
+    COOL_REPR_SETTER_GETTER(Slot, Slot, slot)
 };
 
 //======================================================================//
@@ -239,16 +491,16 @@ class ID : public Expr {
 //======================================================================//
 class Assign : public Expr {
   private:
-    ID* id;
-    Expr* expr;
+    ID* id = nullptr;
+    Expr* expr = nullptr;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(Assign)
+    COOL_REPR_BASE_CONSTRUCTOR(Assign, Expr)
 
-    Assign(ID* _id, Expr* _expr) : id(_id), expr(_expr) {}
+    Assign(ID* _id, Expr* _expr) : Expr(Kind::Assign), id(_id), expr(_expr) {}
 
     Assign* Clone() final {
-        return new Assign(id->Clone(), expr->Clone());
+        return NewRepr<Assign>(id->Clone(), expr->Clone());
     }
 
     diag::TextInfo GetTextInfo() const final { return id->GetTextInfo(); }
@@ -261,25 +513,42 @@ class Assign : public Expr {
 //                           Call  Class                                //
 //======================================================================//
 class FuncFeature;
+class Class;
 class Call : public Expr {
   private:
-    ID* id;
-    vector<Expr*> args;
-    FuncFeature* link;
+    ID* id = nullptr;
+    ArenaArray<Expr*> args;
+    FuncFeature* link = nullptr;
+    bool direct = false;
+    Symbol speculation;
+    uint32_t site = 0;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(Call)
+    COOL_REPR_BASE_CONSTRUCTOR(Call, Expr)
 
-    Call(ID* _id, const vector<Expr*>& _args, FuncFeature* _link)
-    : id(_id), args(_args), link(_link) {}
+    Call(ID* _id, ArenaArray<Expr*> _args, FuncFeature* _link)
+    : Expr(Kind::Call), id(_id), args(_args), link(_link) {}
 
-    Call* Clone() final { return new Call(id, args, link);  }
+    Call* Clone() final {
+        auto clone = NewRepr<Call>(id, args, link);
+        clone->SetDirect(direct);
+        clone->SetSpeculation(speculation);
+        return clone;
+    }
 
     diag::TextInfo GetTextInfo() const final { return id->GetTextInfo(); }
 
     COOL_REPR_SETTER_GETTER_POINTER(ID, Id, id)
-    COOL_REPR_SETTER_GETTER(vector<Expr*>, Args, args)
+    COOL_REPR_SETTER_GETTER(ArenaArray<Expr*>, Args, args)
     COOL_REPR_SETTER_GETTER_POINTER(FuncFeature, Link, link)
+    // whether link is the only method the call can reach, so that it
+    // needs no dispatch, see ana::Devirtualize
+    COOL_REPR_SETTER_GETTER(bool, Direct, direct)
+    // the class the receiver most likely is, empty if no guess, see
+    // profile::SpeculateReceivers
+    COOL_REPR_SETTER_GETTER(Symbol, Speculation, speculation)
+    // index of the inline cache of the call in an interp::Interpreter
+    COOL_REPR_SETTER_GETTER(uint32_t, Site, site)
 };
 
 //======================================================================//
@@ -287,19 +556,19 @@ class Call : public Expr {
 //======================================================================//
 class If : public Expr {
   private:
-    Expr* ifExpr;
-    Expr* thenExpr;
-    Expr* elseExpr;
-    string type;
+    Expr* ifExpr = nullptr;
+    Expr* thenExpr = nullptr;
+    Expr* elseExpr = nullptr;
+    Symbol type;
 
 public:
-    COOL_REPR_BASE_CONSTRUCTOR(If)
+    COOL_REPR_BASE_CONSTRUCTOR(If, Expr)
 
     If(Expr* _ifExpr, Expr* _thenExpr, Expr* _elseExpr)
-    : ifExpr(_ifExpr), thenExpr(_thenExpr), elseExpr(_elseExpr) {}
+    : Expr(Kind::If), ifExpr(_ifExpr), thenExpr(_thenExpr), elseExpr(_elseExpr) {}
 
     If* Clone() final {
-        return new If(
+        return NewRepr<If>(
             ifExpr->Clone(),
             thenExpr->Clone(),
             elseExpr->Clone());
@@ -312,7 +581,7 @@ public:
     COOL_REPR_SETTER_GETTER_POINTER(Expr, IfExpr, ifExpr)
     COOL_REPR_SETTER_GETTER_POINTER(Expr, ThenExpr, thenExpr)
     COOL_REPR_SETTER_GETTER_POINTER(Expr, ElseExpr, elseExpr)
-    COOL_REPR_SETTER_GETTER(string, Type, type)
+    COOL_REPR_SETTER_GETTER(Symbol, Type, type)
 };
 
 //======================================================================//
@@ -320,22 +589,22 @@ public:
 //======================================================================//
 class Block : public Expr {
   private:
-    diag::TextInfo textInfo;
-    vector<Expr*> exprs;
+    diag::TextInfo textInfo{};
+    ArenaArray<Expr*> exprs;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(Block)
+    COOL_REPR_BASE_CONSTRUCTOR(Block, Expr)
 
-    Block(diag::TextInfo _textInfo, const vector<Expr*>& _exprs = {})
-    : textInfo(_textInfo), exprs(_exprs) {}
+    Block(diag::TextInfo _textInfo, ArenaArray<Expr*> _exprs = {})
+    : Expr(Kind::Block), textInfo(_textInfo), exprs(_exprs) {}
 
     Block* Clone() final {
-        return new Block(textInfo, exprs);
+        return NewRepr<Block>(textInfo, exprs);
     }
 
     diag::TextInfo GetTextInfo() const final { return textInfo; }
 
-    COOL_REPR_SETTER_GETTER(vector<Expr*>, Exprs, exprs)
+    COOL_REPR_SETTER_GETTER(ArenaArray<Expr*>, Exprs, exprs)
 };
 
 //======================================================================//
@@ -343,17 +612,17 @@ class Block : public Expr {
 //======================================================================//
 class While : public Expr {
   private:
-    Expr* whileExpr;
-    Expr* loopExpr;
+    Expr* whileExpr = nullptr;
+    Expr* loopExpr = nullptr;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(While)
+    COOL_REPR_BASE_CONSTRUCTOR(While, Expr)
 
     While(Expr* _whileExpr, Expr* _loopExpr)
-    : whileExpr(_whileExpr), loopExpr(_loopExpr) {}
+    : Expr(Kind::While), whileExpr(_whileExpr), loopExpr(_loopExpr) {}
 
     While* Clone() final {
-        new While(whileExpr->Clone(),
+        return NewRepr<While>(whileExpr->Clone(),
             loopExpr->Clone());
     }
 
@@ -374,17 +643,18 @@ class Let : public Expr {
       private:
         StringAttr name;
         StringAttr type;
-        Expr* expr;
+        Expr* expr = nullptr;
+        Slot slot;
 
       public:
-        COOL_REPR_BASE_CONSTRUCTOR(Decl)
+        COOL_REPR_BASE_CONSTRUCTOR(Decl, Repr)
 
         Decl(const StringAttr& _name, const StringAttr& _type,
             Expr* _expr)
-            : name(_name), type(_type), expr(_expr) {}
+            : Repr(Kind::Decl), name(_name), type(_type), expr(_expr) {}
 
         Decl* Clone() final {
-            return new Decl(name, type, expr->Clone());
+            return NewRepr<Decl>(name, type, expr->Clone());
         }
 
         diag::TextInfo GetTextInfo() const final {
@@ -394,27 +664,28 @@ class Let : public Expr {
         COOL_REPR_SETTER_GETTER(StringAttr, Name, name)
         COOL_REPR_SETTER_GETTER(StringAttr, Type, type)
         COOL_REPR_SETTER_GETTER_POINTER(Expr, Expr, expr)
+        COOL_REPR_SETTER_GETTER(Slot, Slot, slot)
     };
 
   private:
-    vector<Let::Decl*> decls;
-    Expr* expr;
+    ArenaArray<Let::Decl*> decls;
+    Expr* expr = nullptr;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(Let)
+    COOL_REPR_BASE_CONSTRUCTOR(Let, Expr)
 
-    Let(const vector<Let::Decl*>& _decls, Expr* _expr)
-    : decls(_decls), expr(_expr) {}
+    Let(ArenaArray<Let::Decl*> _decls, Expr* _expr)
+    : Expr(Kind::Let), decls(_decls), expr(_expr) {}
 
     Let* Clone() final {
-        return new Let(decls, expr->Clone());
+        return NewRepr<Let>(decls, expr->Clone());
     }
 
     diag::TextInfo GetTextInfo() const final {
         return expr->GetTextInfo();
     }
 
-    COOL_REPR_SETTER_GETTER(vector<Let::Decl*>, Decls, decls)
+    COOL_REPR_SETTER_GETTER(ArenaArray<Let::Decl*>, Decls, decls)
     COOL_REPR_SETTER_GETTER_POINTER(Expr, Expr, expr)
 };
 
@@ -427,17 +698,18 @@ class Case : public Expr {
       private:
         StringAttr id;
         StringAttr type;
-        Expr* expr;
+        Expr* expr = nullptr;
+        Slot slot;
 
       public:
-        COOL_REPR_BASE_CONSTRUCTOR(Branch)
+        COOL_REPR_BASE_CONSTRUCTOR(Branch, Repr)
 
         Branch(const StringAttr& _id, const StringAttr& _type,
             Expr* _expr)
-        : id(_id), type(_type), expr(_expr) {}
+        : Repr(Kind::Branch), id(_id), type(_type), expr(_expr) {}
 
         Branch* Clone() final {
-            return new Branch(id, type, expr->Clone());
+            return NewRepr<Branch>(id, type, expr->Clone());
         }
 
         diag::TextInfo GetTextInfo() const final {
@@ -447,17 +719,20 @@ class Case : public Expr {
         COOL_REPR_SETTER_GETTER(StringAttr, Id, id)
         COOL_REPR_SETTER_GETTER(StringAttr, Type, type)
         COOL_REPR_SETTER_GETTER_POINTER(Expr, Expr, expr)
+        COOL_REPR_SETTER_GETTER(Slot, Slot, slot)
     };
 
   private:
-    Expr* expr;
-    vector<Branch*> branches;
+    Expr* expr = nullptr;
+    ArenaArray<Branch*> branches;
+    Symbol exprType; // of expr
+    Symbol type;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(Case)
+    COOL_REPR_BASE_CONSTRUCTOR(Case, Expr)
 
-    Case(Expr* _expr, const vector<Branch*>& _branches)
-    : expr(_expr), branches(_branches) {}
+    Case(Expr* _expr, ArenaArray<Branch*> _branches)
+    : Expr(Kind::Case), expr(_expr), branches(_branches) {}
 
     Case* Clone() final;
 
@@ -466,7 +741,9 @@ class Case : public Expr {
     }
 
     COOL_REPR_SETTER_GETTER_POINTER(Expr, Expr, expr)
-    COOL_REPR_SETTER_GETTER(vector<Branch*>, Branches, branches)
+    COOL_REPR_SETTER_GETTER(ArenaArray<Branch*>, Branches, branches)
+    COOL_REPR_SETTER_GETTER(Symbol, ExprType, exprType)
+    COOL_REPR_SETTER_GETTER(Symbol, Type, type)
 };
 
 //======================================================================//
@@ -477,11 +754,11 @@ class New : public Expr {
     StringAttr type;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(New)
+    COOL_REPR_BASE_CONSTRUCTOR(New, Expr)
 
-    New(const StringAttr& _type) : type(_type) {}
+    New(const StringAttr& _type) : Expr(Kind::New), type(_type) {}
 
-    New* Clone() final { return new New(type); }
+    New* Clone() final { return NewRepr<New>(type); }
 
     diag::TextInfo GetTextInfo() const final { return type.TextInfo(); }
 
@@ -493,12 +770,12 @@ class New : public Expr {
 //======================================================================//
 class Unary : public Expr {
   protected:
-    Expr* expr;
+    Expr* expr = nullptr;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(Unary)
+    COOL_REPR_ABSTRACT_CONSTRUCTOR(Unary, Expr)
 
-    Unary(Expr* _expr) : expr(_expr) {}
+    Unary(Kind _kind, Expr* _expr) : Expr(_kind), expr(_expr) {}
 
     diag::TextInfo GetTextInfo() const final {
         return expr->GetTextInfo();
@@ -512,11 +789,11 @@ class Unary : public Expr {
 //======================================================================//
 class IsVoid : public Unary {
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(IsVoid)
+    COOL_REPR_BASE_CONSTRUCTOR(IsVoid, Unary)
 
-    IsVoid(Expr* _expr) : Unary(_expr) {}
+    IsVoid(Expr* _expr) : Unary(Kind::IsVoid, _expr) {}
 
-    IsVoid* Clone() final { return new IsVoid(expr->Clone()); }
+    IsVoid* Clone() final { return NewRepr<IsVoid>(expr->Clone()); }
 };
 
 //======================================================================//
@@ -524,11 +801,11 @@ class IsVoid : public Unary {
 //======================================================================//
 class Negate : public Unary {
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(Negate)
+    COOL_REPR_BASE_CONSTRUCTOR(Negate, Unary)
 
-    Negate(Expr* _expr) : Unary(_expr) {}
+    Negate(Expr* _expr) : Unary(Kind::Negate, _expr) {}
 
-    Negate* Clone() final { return new Negate(expr->Clone()); }
+    Negate* Clone() final { return NewRepr<Negate>(expr->Clone()); }
 };
 
 //======================================================================//
@@ -536,11 +813,11 @@ class Negate : public Unary {
 //======================================================================//
 struct Not : public Unary {
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(Not)
+    COOL_REPR_BASE_CONSTRUCTOR(Not, Unary)
 
-    Not(Expr* _expr) : Unary(_expr) {}
+    Not(Expr* _expr) : Unary(Kind::Not, _expr) {}
 
-    Not* Clone() final { return new Not(expr->Clone()); }
+    Not* Clone() final { return NewRepr<Not>(expr->Clone()); }
 };
 
 //======================================================================//
@@ -548,13 +825,13 @@ struct Not : public Unary {
 //======================================================================//
 class Binary : public Expr {
   protected:
-    Expr* left;
-    Expr* right;
+    Expr* left = nullptr;
+    Expr* right = nullptr;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(Binary)
+    COOL_REPR_ABSTRACT_CONSTRUCTOR(Binary, Expr)
 
-    Binary(Expr* _left, Expr* _right) : left(_left), right(_right) {}
+    Binary(Kind _kind, Expr* _left, Expr* _right) : Expr(_kind), left(_left), right(_right) {}
 
     diag::TextInfo GetTextInfo() const final {
         return left->GetTextInfo();
@@ -569,12 +846,12 @@ class Binary : public Expr {
 //======================================================================//
 class Add : public Binary {
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(Add)
+    COOL_REPR_BASE_CONSTRUCTOR(Add, Binary)
 
-    Add(Expr* _left, Expr* _right) : Binary(_left, _right) {}
+    Add(Expr* _left, Expr* _right) : Binary(Kind::Add, _left, _right) {}
 
     Add* Clone() final {
-        return new Add(left->Clone(), right->Clone());
+        return NewRepr<Add>(left->Clone(), right->Clone());
     }
 };
 
@@ -583,12 +860,12 @@ class Add : public Binary {
 //======================================================================//
 class Minus : public Binary {
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(Minus)
+    COOL_REPR_BASE_CONSTRUCTOR(Minus, Binary)
 
-    Minus(Expr* _left, Expr* _right) : Binary(_left, _right) {}
+    Minus(Expr* _left, Expr* _right) : Binary(Kind::Minus, _left, _right) {}
 
     Minus* Clone() final {
-        return new Minus(left->Clone(), right->Clone());
+        return NewRepr<Minus>(left->Clone(), right->Clone());
     }
 };
 
@@ -597,12 +874,12 @@ class Minus : public Binary {
 //======================================================================//
 class Multiply : public Binary {
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(Multiply)
+    COOL_REPR_BASE_CONSTRUCTOR(Multiply, Binary)
 
-    Multiply(Expr* _left, Expr* _right) : Binary(_left, _right) {}
+    Multiply(Expr* _left, Expr* _right) : Binary(Kind::Multiply, _left, _right) {}
 
     Multiply* Clone() final {
-        return new Multiply(left->Clone(), right->Clone());
+        return NewRepr<Multiply>(left->Clone(), right->Clone());
     }
 };
 
@@ -611,12 +888,12 @@ class Multiply : public Binary {
 //======================================================================//
 class Divide : public Binary {
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(Divide)
+    COOL_REPR_BASE_CONSTRUCTOR(Divide, Binary)
 
-    Divide(Expr* _left, Expr* _right) : Binary(_left, _right) {}
+    Divide(Expr* _left, Expr* _right) : Binary(Kind::Divide, _left, _right) {}
 
     Divide* Clone() final {
-        return new Divide(left->Clone(), right->Clone());
+        return NewRepr<Divide>(left->Clone(), right->Clone());
     }
 };
 
@@ -625,12 +902,12 @@ class Divide : public Binary {
 //======================================================================//
 class LessThan : public Binary {
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(LessThan)
+    COOL_REPR_BASE_CONSTRUCTOR(LessThan, Binary)
 
-    LessThan(Expr* _left, Expr* _right) : Binary(_left, _right) {}
+    LessThan(Expr* _left, Expr* _right) : Binary(Kind::LessThan, _left, _right) {}
 
     LessThan* Clone() final {
-        return new LessThan(left->Clone(), right->Clone());
+        return NewRepr<LessThan>(left->Clone(), right->Clone());
     }
 };
 
@@ -639,12 +916,12 @@ class LessThan : public Binary {
 //======================================================================//
 class LessThanOrEqual : public Binary {
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(LessThanOrEqual)
+    COOL_REPR_BASE_CONSTRUCTOR(LessThanOrEqual, Binary)
 
-    LessThanOrEqual(Expr* _left, Expr* _right) : Binary(_left, _right) {}
+    LessThanOrEqual(Expr* _left, Expr* _right) : Binary(Kind::LessThanOrEqual, _left, _right) {}
 
     LessThanOrEqual* Clone() final {
-        return new LessThanOrEqual(
+        return NewRepr<LessThanOrEqual>(
             left->Clone(), right->Clone());
     }
 };
@@ -654,12 +931,12 @@ class LessThanOrEqual : public Binary {
 //======================================================================//
 class Equal : public Binary {
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(Equal)
+    COOL_REPR_BASE_CONSTRUCTOR(Equal, Binary)
 
-    Equal(Expr* _left, Expr* _right) : Binary(_left, _right) {}
+    Equal(Expr* _left, Expr* _right) : Binary(Kind::Equal, _left, _right) {}
 
     Equal* Clone() final {
-        return new Equal(left->Clone(), right->Clone());
+        return NewRepr<Equal>(left->Clone(), right->Clone());
     }
 };
 
@@ -668,18 +945,18 @@ class Equal : public Binary {
 //======================================================================//
 class MethodCall : public Binary {
   private:
-    string type;
+    Symbol type;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(MethodCall)
+    COOL_REPR_BASE_CONSTRUCTOR(MethodCall, Binary)
 
-    MethodCall(Expr* _left, Expr* _right) : Binary(_left, _right) {}
+    MethodCall(Expr* _left, Expr* _right) : Binary(Kind::MethodCall, _left, _right) {}
 
     MethodCall* Clone() final {
-        return new MethodCall(left->Clone(), right->Clone());
+        return NewRepr<MethodCall>(left->Clone(), right->Clone());
     }
 
-    COOL_REPR_SETTER_GETTER(string, Type, type)
+    COOL_REPR_SETTER_GETTER(Symbol, Type, type)
 };
 
 //======================================================================//
@@ -690,11 +967,11 @@ class Integer : public Expr {
     IntAttr val;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(Integer)
+    COOL_REPR_BASE_CONSTRUCTOR(Integer, Expr)
 
-    Integer(const IntAttr& _val) : val(_val) {}
+    Integer(const IntAttr& _val) : Expr(Kind::Integer), val(_val) {}
 
-    Integer* Clone() final { return new Integer(val); }
+    Integer* Clone() final { return NewRepr<Integer>(val); }
 
     IntAttr Value() { return val; }
 
@@ -711,11 +988,11 @@ class String : public Expr {
     StringAttr val;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(String)
+    COOL_REPR_BASE_CONSTRUCTOR(String, Expr)
 
-    String(const StringAttr& _val) : val(_val) {}
+    String(const StringAttr& _val) : Expr(Kind::String), val(_val) {}
 
-    String* Clone() final { return new String(val); }
+    String* Clone() final { return NewRepr<String>(val); }
 
     StringAttr Value() { return val; }
 
@@ -729,14 +1006,14 @@ class String : public Expr {
 //======================================================================//
 class True : public Expr {
   private:
-    diag::TextInfo textInfo;
+    diag::TextInfo textInfo{};
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(True)
+    COOL_REPR_BASE_CONSTRUCTOR(True, Expr)
 
-    True(const diag::TextInfo& _textInfo) : textInfo(_textInfo) {}
+    True(const diag::TextInfo& _textInfo) : Expr(Kind::True), textInfo(_textInfo) {}
 
-    True* Clone() { return new True(textInfo); }
+    True* Clone() { return NewRepr<True>(textInfo); }
 
     diag::TextInfo GetTextInfo() const final { return textInfo; }
 };
@@ -746,14 +1023,14 @@ class True : public Expr {
 //======================================================================//
 class False : public Expr {
   private:
-    diag::TextInfo textInfo;
+    diag::TextInfo textInfo{};
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(False)
+    COOL_REPR_BASE_CONSTRUCTOR(False, Expr)
 
-    False(const diag::TextInfo& _textInfo) : textInfo(_textInfo) {}
+    False(const diag::TextInfo& _textInfo) : Expr(Kind::False), textInfo(_textInfo) {}
 
-    False* Clone() final { return new False(textInfo); }
+    False* Clone() final { return NewRepr<False>(textInfo); }
 
     diag::TextInfo GetTextInfo() const final { return textInfo; }
 };
@@ -765,15 +1042,17 @@ class FuncFeature : public Repr {
   private:
     StringAttr name;
     StringAttr type;
-    Expr* expr;
-    vector<Formal*> args;
+    Expr* expr = nullptr;
+    ArenaArray<Formal*> args;
+    Class* owner = nullptr;
+    uint32_t frameSize = 0;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(FuncFeature)
+    COOL_REPR_BASE_CONSTRUCTOR(FuncFeature, Repr)
 
     FuncFeature(const StringAttr& _name, const StringAttr& _type,
-        Expr* _expr, vector<Formal*> _args = {})
-    : name(_name), type(_type), expr(_expr), args(_args) {}
+        Expr* _expr, ArenaArray<Formal*> _args = {})
+    : Repr(Kind::FuncFeature), name(_name), type(_type), expr(_expr), args(_args) {}
 
     FuncFeature* Clone() final;
 
@@ -782,7 +1061,11 @@ class FuncFeature : public Repr {
     COOL_REPR_SETTER_GETTER(StringAttr, Name, name)
     COOL_REPR_SETTER_GETTER(StringAttr, Type, type)
     COOL_REPR_SETTER_GETTER_POINTER(Expr, Expr, expr)
-    COOL_REPR_SETTER_GETTER(vector<Formal*>, Args, args)
+    COOL_REPR_SETTER_GETTER(ArenaArray<Formal*>, Args, args)
+    // the class defining it, set when added to one
+    COOL_REPR_SETTER_GETTER_POINTER(Class, Owner, owner)
+    // values a frame of the method holds, see interp::Interpreter
+    COOL_REPR_SETTER_GETTER(uint32_t, FrameSize, frameSize)
 };
 
 //======================================================================//
@@ -792,17 +1075,18 @@ class FieldFeature : public Repr {
   private:
     StringAttr name;
     StringAttr type;
-    Expr* expr;
+    Expr* expr = nullptr;
+    Class* owner = nullptr;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(FieldFeature)
+    COOL_REPR_BASE_CONSTRUCTOR(FieldFeature, Repr)
 
     FieldFeature(const StringAttr& _name,
         const StringAttr& _type, Expr* _expr)
-    : name(_name), type(_type), expr(_expr) {}
+    : Repr(Kind::FieldFeature), name(_name), type(_type), expr(_expr) {}
 
     FieldFeature* Clone() final {
-        return new FieldFeature(name, type, expr);
+        return NewRepr<FieldFeature>(name, type, expr);
     }
 
     diag::TextInfo GetTextInfo() const final { return name.TextInfo(); }
@@ -810,6 +1094,8 @@ class FieldFeature : public Repr {
     COOL_REPR_SETTER_GETTER(StringAttr, Name, name)
     COOL_REPR_SETTER_GETTER(StringAttr, Type, type)
     COOL_REPR_SETTER_GETTER_POINTER(Expr, Expr, expr)
+    // the class defining it, set when added to one
+    COOL_REPR_SETTER_GETTER_POINTER(Class, Owner, owner)
 };
 
 //======================================================================//
@@ -821,11 +1107,12 @@ class Class : public Repr {
     StringAttr parent;
     vector<FuncFeature*> funcs;
     vector<FieldFeature*> fields;
-    unordered_map<string, FuncFeature*> funcMap;
-    unordered_map<string, FieldFeature*> fieldMap;
+    unordered_map<Symbol, FuncFeature*> funcMap;
+    unordered_map<Symbol, FieldFeature*> fieldMap;
+    uint32_t frameSize = 0;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(Class)
+    COOL_REPR_BASE_CONSTRUCTOR(Class, Repr)
     Class(const StringAttr&, const StringAttr&,
         vector<FuncFeature*>, vector<FieldFeature*>);
 
@@ -833,62 +1120,96 @@ class Class : public Repr {
 
     diag::TextInfo GetTextInfo() const final { return name.TextInfo(); }
 
-    FuncFeature* GetFuncFeaturePtr(const string& name) {
+    FuncFeature* GetFuncFeaturePtr(Symbol name) {
         return funcMap.find(name) == funcMap.end() ?
         nullptr : funcMap.at(name);
     }
 
     vector<FuncFeature*>& GetFuncFeatures() { return funcs; }
 
-    FieldFeature* GetFieldFeaturePtr(const string& name) {
+    FieldFeature* GetFieldFeaturePtr(Symbol name) {
         return fieldMap.find(name) == fieldMap.end() ?
         nullptr : fieldMap.at(name);
     }
 
     vector<FieldFeature*>& GetFieldFeatures() { return fields; }
 
+    // features of cls itself, without the inherited ones
+    vector<FuncFeature*> GetOwnFuncFeatures();
+    vector<FieldFeature*> GetOwnFieldFeatures();
+
+    // add a feature defined by this class, which becomes its owner
     bool AddFuncFeature(FuncFeature* feat) {
-        if (funcMap.find(feat->GetName().Value()) != funcMap.end())
+        if (!AddInheritedFuncFeature(feat))
             return false;
-        funcs.emplace_back(feat);
-        funcMap.insert({feat->GetName().Value(), feat});
+        feat->SetOwner(this);
         return true;
     }
 
     bool AddFieldFeature(FieldFeature* feat) {
-        if (fieldMap.find(feat->GetName().Value()) != fieldMap.end())
+        if (!AddInheritedFieldFeature(feat))
+            return false;
+        feat->SetOwner(this);
+        return true;
+    }
+
+    // add a feature of an ancestor. It's shared rather than copied, so
+    // there's one body per defining class however deep the hierarchy is,
+    // passes working on bodies should only visit the own features
+    bool AddInheritedFuncFeature(FuncFeature* feat) {
+        if (funcMap.find(feat->GetName().Sym()) != funcMap.end())
+            return false;
+        funcs.emplace_back(feat);
+        funcMap.insert({feat->GetName().Sym(), feat});
+        return true;
+    }
+
+    bool AddInheritedFieldFeature(FieldFeature* feat) {
+        if (fieldMap.find(feat->GetName().Sym()) != fieldMap.end())
             return false;
         fields.emplace_back(feat);
-        fieldMap.insert({feat->GetName().Value(), feat});
+        fieldMap.insert({feat->GetName().Sym(), feat});
         return true;
     }
 
-    void DeleteFuncFeature(const string&);
-    void DeleteFieldFeature(const string& name);
+    bool IsInherited(FuncFeature* feat) const { return feat->GetOwner() != this; }
+    bool IsInherited(FieldFeature* feat) const { return feat->GetOwner() != this; }
+
+    void DeleteFuncFeature(Symbol);
+    void DeleteFieldFeature(Symbol name);
 
     COOL_REPR_SETTER_GETTER(StringAttr, Name, name);
     COOL_REPR_SETTER_GETTER(StringAttr, Parent, parent);
+    // values the frame the field initializers share holds, see
+    // interp::Interpreter
+    COOL_REPR_SETTER_GETTER(uint32_t, FrameSize, frameSize)
 };
 
 //======================================================================//
 //                         Program Class                                //
 //======================================================================//
-class Program : public Repr {
+class Program final : public Repr {
   private:
-    diag::TextInfo textInfo;
+    // declared first so that it outlives the class lists below
+    shared_ptr<AstArena> arena = make_shared<AstArena>();
+    diag::TextInfo textInfo{};
     vector<Class*> classVec;
-    unordered_map<string, Class*> classMap;
+    unordered_map<Symbol, Class*> classMap;
 
   public:
-    COOL_REPR_BASE_CONSTRUCTOR(Program)
+    COOL_REPR_BASE_CONSTRUCTOR(Program, Repr)
 
     Program(const diag::TextInfo&, const vector<Class*>&);
 
+    Program(shared_ptr<AstArena>, const diag::TextInfo&, const vector<Class*>&);
+
     Program* Clone() final;
 
+    AstArena& GetArena() { return *arena; }
+
     diag::TextInfo GetTextInfo() const final { return textInfo; }
 
-    Class* GetClassPtr(const string& name) {
+    Class* GetClassPtr(Symbol name) {
         return classMap.find(name) != classMap.end() ?
         classMap.at(name) : nullptr;
     }
@@ -896,14 +1217,14 @@ class Program : public Repr {
     vector<Class*> GetClasses() { return classVec; }
 
     bool AddClass(Class* cls) {
-        if (GetClassPtr(cls->GetName().Value()))
+        if (GetClassPtr(cls->GetName().Sym()))
             return false;
         classVec.emplace_back(cls);
-        classMap.insert({cls->GetName().Value(), cls});
+        classMap.insert({cls->GetName().Sym(), cls});
         return true;
     }
 
-    void DeleteClass(const string&);
+    void DeleteClass(Symbol);
 };
 
 } // expr
@@ -0,0 +1,263 @@
+//
+// Created by 田地 on 2021/8/23.
+//
+
+#include <cstdint>
+#include <initializer_list>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define COOL_SCAN_X86
+#include <immintrin.h>
+#endif
+
+#include "scan.h"
+
+using namespace cool;
+using namespace tok;
+using namespace scan;
+
+namespace {
+
+//======================================================================//
+//                        Scalar Kernels                                //
+//======================================================================//
+inline bool isSpace(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+inline bool isIdent(unsigned char c) {
+    return (unsigned char) ((c | 0x20) - 'a') <= 'z' - 'a'
+        || (unsigned char) (c - '0') <= 9
+        || c == '_';
+}
+
+const char* skipSpaceScalar(const char* p, const char* end) {
+    while (p < end && isSpace(*p)) p++;
+    return p;
+}
+
+const char* skipIdentScalar(const char* p, const char* end) {
+    while (p < end && isIdent(*p)) p++;
+    return p;
+}
+
+const char* findByteScalar(const char* p, const char* end, char c) {
+    while (p < end && *p != c) p++;
+    return p;
+}
+
+size_t countByteScalar(const char* p, const char* end, char c) {
+    size_t n = 0;
+    for (; p < end; p++) n += *p == c;
+    return n;
+}
+
+#ifdef COOL_SCAN_X86
+
+//======================================================================//
+//                        SSE2 Kernels                                  //
+//======================================================================//
+// unsigned lo <= x <= hi, computed as min(x - lo, hi - lo) == x - lo
+inline __m128i inRange16(__m128i x, char lo, char hi) {
+    __m128i d = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(char(hi - lo))), d);
+}
+
+inline __m128i spaceMask16(__m128i x) {
+    return _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), inRange16(x, '\t', '\r'));
+}
+
+inline __m128i identMask16(__m128i x) {
+    __m128i alpha = inRange16(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 'z');
+    __m128i digit = inRange16(x, '0', '9');
+    __m128i under = _mm_cmpeq_epi8(x, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(alpha, digit), under);
+}
+
+const char* skipSpaceSSE2(const char* p, const char* end) {
+    for (; end - p >= 16; p += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned miss = ~_mm_movemask_epi8(spaceMask16(x)) & 0xffff;
+        if (miss) return p + __builtin_ctz(miss);
+    }
+    return skipSpaceScalar(p, end);
+}
+
+const char* skipIdentSSE2(const char* p, const char* end) {
+    for (; end - p >= 16; p += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned miss = ~_mm_movemask_epi8(identMask16(x)) & 0xffff;
+        if (miss) return p + __builtin_ctz(miss);
+    }
+    return skipIdentScalar(p, end);
+}
+
+const char* findByteSSE2(const char* p, const char* end, char c) {
+    __m128i target = _mm_set1_epi8(c);
+    for (; end - p >= 16; p += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned hit = _mm_movemask_epi8(_mm_cmpeq_epi8(x, target));
+        if (hit) return p + __builtin_ctz(hit);
+    }
+    return findByteScalar(p, end, c);
+}
+
+size_t countByteSSE2(const char* p, const char* end, char c) {
+    __m128i target = _mm_set1_epi8(c);
+    size_t n = 0;
+    for (; end - p >= 16; p += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        n += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(x, target)));
+    }
+    return n + countByteScalar(p, end, c);
+}
+
+//======================================================================//
+//                        AVX2 Kernels                                  //
+//======================================================================//
+#define COOL_AVX2 __attribute__((target("avx2")))
+
+COOL_AVX2 inline __m256i inRange32(__m256i x, char lo, char hi) {
+    __m256i d = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(char(hi - lo))), d);
+}
+
+COOL_AVX2 inline __m256i spaceMask32(__m256i x) {
+    return _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), inRange32(x, '\t', '\r'));
+}
+
+COOL_AVX2 inline __m256i identMask32(__m256i x) {
+    __m256i alpha = inRange32(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), 'a', 'z');
+    __m256i digit = inRange32(x, '0', '9');
+    __m256i under = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_'));
+    return _mm256_or_si256(_mm256_or_si256(alpha, digit), under);
+}
+
+COOL_AVX2 const char* skipSpaceAVX2(const char* p, const char* end) {
+    for (; end - p >= 32; p += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        uint32_t miss = ~uint32_t(_mm256_movemask_epi8(spaceMask32(x)));
+        if (miss) return p + __builtin_ctz(miss);
+    }
+    return skipSpaceSSE2(p, end);
+}
+
+COOL_AVX2 const char* skipIdentAVX2(const char* p, const char* end) {
+    for (; end - p >= 32; p += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        uint32_t miss = ~uint32_t(_mm256_movemask_epi8(identMask32(x)));
+        if (miss) return p + __builtin_ctz(miss);
+    }
+    return skipIdentSSE2(p, end);
+}
+
+COOL_AVX2 const char* findByteAVX2(const char* p, const char* end, char c) {
+    __m256i target = _mm256_set1_epi8(c);
+    for (; end - p >= 32; p += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        uint32_t hit = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, target));
+        if (hit) return p + __builtin_ctz(hit);
+    }
+    return findByteSSE2(p, end, c);
+}
+
+COOL_AVX2 size_t countByteAVX2(const char* p, const char* end, char c) {
+    __m256i target = _mm256_set1_epi8(c);
+    size_t n = 0;
+    for (; end - p >= 32; p += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        n += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, target)));
+    }
+    return n + countByteSSE2(p, end, c);
+}
+
+#undef COOL_AVX2
+
+#endif // COOL_SCAN_X86
+
+//======================================================================//
+//                        Kernel Selection                              //
+//======================================================================//
+struct Kernels {
+    Kernel kind;
+    const char* (*skipSpace)(const char*, const char*);
+    const char* (*skipIdent)(const char*, const char*);
+    const char* (*findByte)(const char*, const char*, char);
+    size_t (*countByte)(const char*, const char*, char);
+};
+
+const Kernels scalarKernels = {
+    Kernel::Scalar, skipSpaceScalar, skipIdentScalar, findByteScalar, countByteScalar
+};
+
+#ifdef COOL_SCAN_X86
+const Kernels sse2Kernels = {
+    Kernel::SSE2, skipSpaceSSE2, skipIdentSSE2, findByteSSE2, countByteSSE2
+};
+
+const Kernels avx2Kernels = {
+    Kernel::AVX2, skipSpaceAVX2, skipIdentAVX2, findByteAVX2, countByteAVX2
+};
+#endif
+
+bool supported(Kernel k) {
+    switch (k) {
+        case Kernel::Scalar:
+            return true;
+#ifdef COOL_SCAN_X86
+        case Kernel::SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+        case Kernel::AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+const Kernels* kernelsOf(Kernel k) {
+#ifdef COOL_SCAN_X86
+    if (k == Kernel::AVX2) return &avx2Kernels;
+    if (k == Kernel::SSE2) return &sse2Kernels;
+#endif
+    return &scalarKernels;
+}
+
+const Kernels* detect() {
+    for (auto k : {Kernel::AVX2, Kernel::SSE2}) {
+        if (supported(k)) return kernelsOf(k);
+    }
+    return &scalarKernels;
+}
+
+const Kernels* active = detect();
+
+} // namespace
+
+const char* scan::SkipSpace(const char* p, const char* end) {
+    return active->skipSpace(p, end);
+}
+
+const char* scan::SkipIdent(const char* p, const char* end) {
+    return active->skipIdent(p, end);
+}
+
+const char* scan::FindByte(const char* p, const char* end, char c) {
+    return active->findByte(p, end, c);
+}
+
+size_t scan::CountByte(const char* p, const char* end, char c) {
+    return active->countByte(p, end, c);
+}
+
+Kernel scan::Active() {
+    return active->kind;
+}
+
+bool scan::Use(Kernel k) {
+    if (!supported(k)) return false;
+    active = kernelsOf(k);
+    return true;
+}
@@ -0,0 +1,55 @@
+//
+// Created by 田地 on 2021/8/23.
+//
+
+#ifndef COOL_SCAN_H
+#define COOL_SCAN_H
+
+#include <cstddef>
+
+namespace cool {
+
+namespace tok {
+
+namespace scan {
+
+//======================================================================//
+//                        Scanning Kernels                              //
+//======================================================================//
+// Byte classification kernels used by the tokenizer to skip over runs of
+// input. The SSE2/AVX2 versions classify 16/32 bytes at a time and are
+// picked at startup based on what the CPU supports, the scalar version
+// is used everywhere else. Kernels never read outside [p, end).
+
+enum class Kernel {
+    Scalar,
+    SSE2,
+    AVX2,
+};
+
+// return the first byte in [p, end) that is not a space
+const char* SkipSpace(const char* p, const char* end);
+
+// return the first byte in [p, end) that is not [0-9A-Za-z_]
+const char* SkipIdent(const char* p, const char* end);
+
+// return the first occurrence of c in [p, end), end if not found
+const char* FindByte(const char* p, const char* end, char c);
+
+// return the number of occurrences of c in [p, end)
+size_t CountByte(const char* p, const char* end, char c);
+
+// the kernel currently in use
+Kernel Active();
+
+// switch to kernel k, return false and keep the current one if the CPU
+// does not support it
+bool Use(Kernel k);
+
+} // namespace scan
+
+} // namespace tok
+
+} // namespace cool
+
+#endif //COOL_SCAN_H
@@ -0,0 +1,57 @@
+//
+// Created by 田地 on 2021/8/21.
+//
+
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "source.h"
+
+using namespace cool;
+using namespace tok;
+
+unique_ptr<SourceBuffer> SourceBuffer::Open(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw runtime_error("open source file '" + path + "' failed");
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        throw runtime_error("stat source file '" + path + "' failed");
+    }
+
+    unique_ptr<SourceBuffer> buf(new SourceBuffer());
+    // mmap rejects zero-length mappings, an empty file is just an empty buffer
+    if (st.st_size > 0) {
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            close(fd);
+            throw runtime_error("mmap source file '" + path + "' failed");
+        }
+        madvise(addr, st.st_size, MADV_SEQUENTIAL);
+        buf->mapped = addr;
+        buf->mappedSize = st.st_size;
+        buf->data = static_cast<const char*>(addr);
+        buf->size = st.st_size;
+    } else {
+        buf->data = buf->owned.data();
+    }
+    close(fd);
+    return buf;
+}
+
+SourceBuffer::SourceBuffer(string content)
+: mapped(nullptr), mappedSize(0), owned(move(content)) {
+    data = owned.data();
+    size = owned.size();
+}
+
+SourceBuffer::~SourceBuffer() {
+    if (mapped) munmap(mapped, mappedSize);
+}
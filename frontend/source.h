@@ -0,0 +1,60 @@
+//
+// Created by 田地 on 2021/8/21.
+//
+
+#ifndef COOL_SOURCE_H
+#define COOL_SOURCE_H
+
+#include <string>
+#include <memory>
+#include <cstdint>
+
+using namespace std;
+
+namespace cool {
+
+namespace tok {
+
+//======================================================================//
+//                        SourceBuffer Class                            //
+//======================================================================//
+// A read-only, contiguous view of a whole source file. Files are mapped
+// into memory with mmap so the tokenizer can scan them without going
+// through istream; other inputs (e.g. a stringstream) are copied once.
+class SourceBuffer {
+  private:
+    const char* data;
+    size_t size;
+    void* mapped;
+    size_t mappedSize;
+    string owned;
+
+    SourceBuffer() : data(nullptr), size(0), mapped(nullptr), mappedSize(0) {}
+
+  public:
+    // map the file at path into memory, throw runtime_error on failure
+    static unique_ptr<SourceBuffer> Open(const string& path);
+
+    explicit SourceBuffer(string content);
+
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+    ~SourceBuffer();
+
+    const char* Begin() const { return data; }
+
+    const char* End() const { return data + size; }
+
+    size_t Size() const { return size; }
+
+    string Slice(uint32_t offset, uint32_t length) const {
+        return string(data + offset, length);
+    }
+};
+
+} // namespace tok
+
+} // namespace cool
+
+#endif //COOL_SOURCE_H
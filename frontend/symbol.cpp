@@ -0,0 +1,90 @@
+//
+// Created by 田地 on 2021/8/27.
+//
+
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <stdexcept>
+
+#include "symbol.h"
+
+using namespace std;
+using namespace cool;
+
+namespace {
+
+//======================================================================//
+//                          Symbol Pool                                 //
+//======================================================================//
+// Strings are owned by the map (its nodes never move), the id -> string
+// direction is a two-level table of fixed-size chunks. Chunks are only
+// ever appended and published with release stores, so readers can index
+// into them without taking the lock.
+class Pool {
+  private:
+    static constexpr size_t chunkBits = 12;
+    static constexpr size_t chunkSize = 1 << chunkBits;
+    static constexpr size_t maxChunks = 4096;
+
+    mutex mu;
+    unordered_map<string, uint32_t> ids;
+    atomic<const string**> chunks[maxChunks];
+    atomic<uint32_t> size;
+
+  public:
+    Pool() : size(0) {
+        for (auto& c : chunks) c.store(nullptr, memory_order_relaxed);
+        Intern("");
+    }
+
+    ~Pool() {
+        for (auto& c : chunks) delete[] c.load(memory_order_relaxed);
+    }
+
+    uint32_t Intern(const string& str) {
+        lock_guard<mutex> lock(mu);
+        auto it = ids.find(str);
+        if (it != ids.end()) return it->second;
+
+        uint32_t id = size.load(memory_order_relaxed);
+        if ((id >> chunkBits) >= maxChunks)
+            throw runtime_error("symbol pool exhausted");
+        auto& chunk = chunks[id >> chunkBits];
+        if (!chunk.load(memory_order_relaxed))
+            chunk.store(new const string*[chunkSize], memory_order_release);
+
+        it = ids.insert({str, id}).first;
+        chunk.load(memory_order_relaxed)[id & (chunkSize - 1)] = &it->first;
+        size.store(id + 1, memory_order_release);
+        return id;
+    }
+
+    const string& Str(uint32_t id) {
+        return *chunks[id >> chunkBits].load(memory_order_acquire)[id & (chunkSize - 1)];
+    }
+
+    size_t Size() { return size.load(memory_order_acquire); }
+};
+
+// constructed on first use so that symbols can be created during static
+// initialization, e.g. the constants in constant.h
+Pool& pool() {
+    static Pool p;
+    return p;
+}
+
+} // namespace
+
+uint32_t Symbol::Intern(const string& str) {
+    return pool().Intern(str);
+}
+
+size_t Symbol::PoolSize() {
+    return pool().Size();
+}
+
+const string& Symbol::Str() const {
+    return pool().Str(id);
+}
@@ -0,0 +1,70 @@
+//
+// Created by 田地 on 2021/8/27.
+//
+
+#ifndef COOL_SYMBOL_H
+#define COOL_SYMBOL_H
+
+#include <string>
+#include <cstdint>
+#include <functional>
+
+using namespace std;
+
+namespace cool {
+
+//======================================================================//
+//                          Symbol Class                                //
+//======================================================================//
+// An interned identifier or type name. Every distinct string is stored
+// once in a process-wide pool and referred to by a 32-bit id, so copying,
+// hashing and comparing symbols are integer operations. Id 0 is always
+// the empty string. Interning takes a lock, Str() does not.
+class Symbol {
+  private:
+    uint32_t id;
+
+  public:
+    Symbol() : id(0) {}
+
+    Symbol(const string& str) : id(Intern(str)) {}
+
+    Symbol(const char* str) : id(Intern(str)) {}
+
+    // return the id of str, adding it to the pool if not existed
+    static uint32_t Intern(const string& str);
+
+    // number of distinct strings in the pool, including ""
+    static size_t PoolSize();
+
+    uint32_t Id() const { return id; }
+
+    const string& Str() const;
+
+    bool Empty() const { return id == 0; }
+
+    friend bool operator==(Symbol a, Symbol b) { return a.id == b.id; }
+    friend bool operator!=(Symbol a, Symbol b) { return a.id != b.id; }
+    // orders by id (i.e. first interned first), not lexicographically
+    friend bool operator<(Symbol a, Symbol b) { return a.id < b.id; }
+};
+
+// comparing against a raw string would intern it on every call,
+// compare against an interned Symbol (see constant.h) instead
+bool operator==(Symbol, const string&) = delete;
+bool operator!=(Symbol, const string&) = delete;
+bool operator==(const string&, Symbol) = delete;
+bool operator!=(const string&, Symbol) = delete;
+
+} // namespace cool
+
+namespace std {
+
+template<>
+struct hash<cool::Symbol> {
+    size_t operator()(cool::Symbol sym) const { return sym.Id(); }
+};
+
+} // namespace std
+
+#endif //COOL_SYMBOL_H
@@ -0,0 +1,218 @@
+//
+// Created by 田地 on 2021/9/4.
+//
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+
+#include "tier.h"
+#include "llvm_gen.h"
+#include "visitor.h"
+#include "constant.h"
+
+using namespace std;
+using namespace cool;
+using namespace tier;
+using namespace constant;
+
+TieredEngine::TieredEngine(adt::ScopedTableSpecializer<adt::SymbolTable>& _stable, ostream& _out,
+    uint32_t _threshold, bool _background)
+: stable(_stable), machine(_stable, _out), threshold(_threshold), compiled(0), background(_background) {}
+
+TieredEngine::~TieredEngine() {
+    {
+        lock_guard<mutex> lock(mu);
+        stopping = true;
+    }
+    wake.notify_one();
+    if (worker.joinable()) worker.join();
+}
+
+//======================================================================//
+//                             Eligibility                              //
+//======================================================================//
+bool TieredEngine::collect(repr::FuncFeature& func, unordered_set<const repr::FuncFeature*>& batch) {
+
+    // whether an expression only takes what native code can do on its own
+    class Checker : public visitor::ExprVisitor<bool> {
+      private:
+        TieredEngine& engine;
+        repr::FuncFeature& func;
+        unordered_set<const repr::FuncFeature*>& batch;
+
+        // the locals of the lets around the expression, innermost last
+        vector<Symbol> locals;
+
+        bool visitBinary(repr::Binary& expr) {
+            return Visit(*expr.GetLeft()) && Visit(*expr.GetRight());
+        }
+
+      public:
+        Checker(TieredEngine& _engine, repr::FuncFeature& _func, unordered_set<const repr::FuncFeature*>& _batch)
+        : engine(_engine), func(_func), batch(_batch) {}
+
+        static bool Scalar(Symbol type) { return type == SYM_INT || type == SYM_BOOL; }
+
+        bool VisitDefault_() final { return false; }
+
+        // the args and the locals are all Int or Bool, self and fields are
+        // out of reach
+        bool Visit_(repr::ID& expr) final {
+            auto name = expr.GetName().Sym();
+            if (find(locals.begin(), locals.end(), name) != locals.end()) return true;
+            for (auto& arg : func.GetArgs())
+                if (arg->GetName().Sym() == name) return true;
+            return false;
+        }
+
+        bool Visit_(repr::Assign& expr) final {
+            return Visit(*expr.GetId()) && Visit(*expr.GetExpr());
+        }
+
+        bool Visit_(repr::Let& expr) final {
+            auto depth = locals.size();
+            bool ok = true;
+            for (auto& decl : expr.GetDecls()) {
+                ok = Scalar(decl->GetType().Sym()) && (!decl->GetExpr() || Visit(*decl->GetExpr()));
+                if (!ok) break;
+                locals.push_back(decl->GetName().Sym());
+            }
+            ok = ok && Visit(*expr.GetExpr());
+            locals.resize(depth);
+            return ok;
+        }
+
+        // the void a loop evaluates to is only ever dropped by a block,
+        // the type checker keeps it from anywhere else a scalar goes
+        bool Visit_(repr::While& expr) final {
+            return Visit(*expr.GetWhileExpr()) && Visit(*expr.GetLoopExpr());
+        }
+
+        bool Visit_(repr::Block& expr) final {
+            auto exprs = expr.GetExprs();
+            for (auto& e : exprs)
+                if (!Visit(*e)) return false;
+            return !exprs.empty();
+        }
+
+        // an if joining a loop with a scalar would box the scalar
+        bool Visit_(repr::If& expr) final {
+            return Scalar(expr.GetType()) && Visit(*expr.GetIfExpr()) && Visit(*expr.GetThenExpr())
+                && Visit(*expr.GetElseExpr());
+        }
+
+        // native code gets a null self, so the callee must not dispatch on it
+        bool Visit_(repr::Call& expr) final {
+            if (!expr.GetLink() || !expr.GetDirect() || !expr.GetSpeculation().Empty()) return false;
+            for (auto& arg : expr.GetArgs())
+                if (!Visit(*arg)) return false;
+            return engine.collect(*expr.GetLink(), batch);
+        }
+
+        bool Visit_(repr::Negate& expr) final { return Visit(*expr.GetExpr()); }
+
+        bool Visit_(repr::Add& expr) final { return visitBinary(expr); }
+        bool Visit_(repr::Equal& expr) final { return visitBinary(expr); }
+        bool Visit_(repr::LessThanOrEqual& expr) final { return visitBinary(expr); }
+        bool Visit_(repr::LessThan& expr) final { return visitBinary(expr); }
+        bool Visit_(repr::Multiply& expr) final { return visitBinary(expr); }
+        bool Visit_(repr::Minus& expr) final { return visitBinary(expr); }
+
+        bool Visit_(repr::Integer& expr) final { return true; }
+        bool Visit_(repr::True& expr) final { return true; }
+        bool Visit_(repr::False& expr) final { return true; }
+    };
+
+    auto state = states[&func];
+    if (state == State::Compiled) return true;
+    if (state == State::Rejected) return false;
+    // a recursive call, checked by the caller
+    if (!batch.insert(&func).second) return true;
+
+    bool ok = Checker::Scalar(func.GetType().Sym()) && func.GetArgs().size() <= vm::VM::MaxNativeArgs;
+    for (auto& arg : func.GetArgs())
+        ok = ok && Checker::Scalar(arg->GetType().Sym());
+    // calling a method that does not qualify disqualifies the caller too
+    ok = ok && Checker(*this, func, batch).Visit(*func.GetExpr());
+    if (!ok) states[&func] = State::Rejected;
+    return ok;
+}
+
+//======================================================================//
+//                             Compilation                              //
+//======================================================================//
+void TieredEngine::compile(repr::FuncFeature& func) {
+    unordered_set<const repr::FuncFeature*> batch;
+    if (!collect(func, batch)) return;
+    if (batch.empty()) return; // compiled along with a caller before
+
+    // the generator registers the target the jit needs
+    irgen::LLVMGen gen(stable);
+    if (!jit) jit = irgen::LLVMGen::CreateJIT();
+    gen.VisitMethods(*program, batch);
+    gen.Optimize(irgen::LLVMGen::OptLevel::O2);
+    vector<pair<const repr::FuncFeature*, string>> symbols;
+    for (auto method : batch)
+        symbols.emplace_back(method, gen.FunctionName(method->GetName().Sym(), method->GetOwner()->GetName().Sym()));
+    gen.AddTo(*jit);
+
+    for (auto& symbol : symbols) {
+        machine.Install(*symbol.first, irgen::LLVMGen::Lookup(*jit, symbol.second));
+        states[symbol.first] = State::Compiled;
+        compiled++;
+    }
+}
+
+void TieredEngine::work() {
+    for (;;) {
+        repr::FuncFeature* func;
+        {
+            unique_lock<mutex> lock(mu);
+            wake.wait(lock, [&]() { return stopping || !queue.empty(); });
+            if (stopping) return;
+            func = queue.front();
+            queue.pop_front();
+        }
+        tryCompile(*func);
+    }
+}
+
+void TieredEngine::tryCompile(repr::FuncFeature& func) {
+    try {
+        compile(func);
+    } catch (const runtime_error& e) {
+        // the method keeps running on the bytecode
+        states[&func] = State::Rejected;
+    }
+}
+
+void TieredEngine::Run(repr::Program& prog) {
+    program = &prog;
+    machine.TierUp(threshold, [&](repr::FuncFeature& func) {
+        if (!background) {
+            tryCompile(func);
+            return;
+        }
+        {
+            lock_guard<mutex> lock(mu);
+            queue.push_back(&func);
+        }
+        wake.notify_one();
+    });
+    if (!background) {
+        machine.Run(prog);
+        return;
+    }
+    worker = thread([&]() { work(); });
+    machine.Run(prog);
+    {
+        lock_guard<mutex> lock(mu);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
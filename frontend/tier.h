@@ -0,0 +1,107 @@
+//
+// Created by 田地 on 2021/9/4.
+//
+
+#ifndef COOL_TIER_H
+#define COOL_TIER_H
+
+#include <iostream>
+#include <memory>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "repr.h"
+#include "adt.h"
+#include "vm.h"
+
+namespace llvm {
+namespace orc {
+class LLJIT;
+} // namespace orc
+} // namespace llvm
+
+using namespace std;
+
+namespace cool {
+
+namespace tier {
+
+//======================================================================//
+//                        TieredEngine Class                            //
+//======================================================================//
+// Runs a program that passed SemanticChecking and Devirtualize on the
+// vm::VM first, and compiles the methods that get hot with LLVMGen on a
+// background thread, into one ORC JIT for the whole run. Calls to a method
+// go to its native code once it is compiled, a running invocation stays
+// on the bytecode. A program that ends before anything is hot never
+// touches LLVM.
+// Only methods native code can run without the VM's heap qualify: their
+// args and their result are Int or Bool, and their body is made of Int and
+// Bool literals, args, lets of Int and Bool locals, assignments to those
+// and to the args, arithmetic other than division, comparisons, blocks,
+// ifs, loops and direct calls to such methods on self. Others stay on the
+// bytecode.
+class TieredEngine {
+  private:
+    enum class State : uint8_t {
+        Bytecode,
+        Compiled,
+        Rejected,
+    };
+
+    adt::ScopedTableSpecializer<adt::SymbolTable>& stable;
+    vm::VM machine;
+    const uint32_t threshold;
+    repr::Program* program = nullptr;
+
+    // owned by the worker
+    unordered_map<const repr::FuncFeature*, State> states;
+    unique_ptr<llvm::orc::LLJIT> jit; // created with the first compilation
+    atomic<size_t> compiled;
+
+    const bool background;
+    thread worker;
+    mutex mu;
+    condition_variable wake;
+    deque<repr::FuncFeature*> queue;
+    bool stopping = false;
+
+    void work();
+    // compile func, leaving it on the bytecode if that fails
+    void tryCompile(repr::FuncFeature& func);
+    // compile func and the methods it calls that have no native code yet
+    void compile(repr::FuncFeature& func);
+    // add func and the methods it calls that have no native code yet to
+    // batch, return false if one of them does not qualify
+    bool collect(repr::FuncFeature& func, unordered_set<const repr::FuncFeature*>& batch);
+
+  public:
+    // calls and loop back-edges a method takes before it is compiled
+    static const uint32_t DefaultThreshold = 1000;
+
+    // output of out_string and out_int goes to _out. Without _background
+    // a hot method is compiled right away on the thread running the
+    // program, so that its next call runs native code for sure
+    explicit TieredEngine(adt::ScopedTableSpecializer<adt::SymbolTable>& _stable, ostream& _out = cout,
+        uint32_t _threshold = DefaultThreshold, bool _background = true);
+    TieredEngine(const TieredEngine&) = delete;
+    TieredEngine& operator=(const TieredEngine&) = delete;
+    ~TieredEngine();
+
+    // run Main.main, throw runtime_error on an error at run time. Methods
+    // still waiting to be compiled when it returns are dropped.
+    void Run(repr::Program& prog);
+    // number of methods compiled to native code so far
+    size_t Compiled() const { return compiled; }
+};
+
+} // namespace tier
+
+} // namespace cool
+
+#endif //COOL_TIER_H
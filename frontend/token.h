@@ -8,6 +8,7 @@
 #include <string>
 #include <utility>
 #include <unordered_map>
+#include <cstdint>
 
 #include "diag.h"
 
@@ -134,6 +135,19 @@ struct Token {
     bool Skip();
 };
 
+// A token that refers back to the source buffer it was scanned from
+// instead of owning a copy of its lexeme. For String tokens the range
+// covers the raw text between the quotes, escapes are resolved only when
+// the view is materialized into a Token.
+struct TokenView {
+    Token::Type type;
+    uint32_t offset;
+    uint32_t length;
+    diag::TextInfo textInfo;
+
+    bool Skip() const { return type == Token::SKIP; }
+};
+
 } // namespace tok
 
 } // namespace cool
@@ -4,56 +4,145 @@
 
 #include <algorithm>
 #include <sstream>
+#include <iterator>
+#include <stdexcept>
 #include <unordered_map>
 
-#include "cctype"
-
 #include "token.h"
 #include "tokenizer.h"
+#include "scan.h"
 
 using namespace std;
 using namespace cool;
 using namespace tok;
 using namespace diag;
 
-unordered_map<string, Token::Type> tok::keywordMap = {
-    {"class", Token::kClass},
-    {"if", Token::kIf},
-    {"then", Token::kThen},
-    {"else", Token::kElse},
-    {"fi", Token::kFi},
-    {"in", Token::kIn},
-    {"inherits", Token::kInheirits},
-    {"isvoid", Token::kIsvoid},
-    {"let", Token::kLet},
-    {"loop", Token::kLoop},
-    {"pool", Token::kPool},
-    {"while", Token::kWhile},
-    {"case", Token::kCase},
-    {"esac", Token::kEsac},
-    {"new", Token::kNew},
-    {"of", Token::kOf},
-    {"not", Token::kNot},
-    {"true", Token::kTrue},
-    {"false", Token::kFalse},
+namespace {
+
+//======================================================================//
+//                        Character Classes                             //
+//======================================================================//
+enum CharFlag : uint8_t {
+    cDigit = 1 << 0,
+    cAlpha = 1 << 1, // letters and '_'
+    cUpper = 1 << 2,
+    cSpace = 1 << 3,
+};
+
+struct CharTable {
+    uint8_t flags[256];
+    Token::Type special[256]; // single character tokens, SKIP if invalid
+};
+
+constexpr CharTable makeCharTable() {
+    CharTable t{};
+    for (int c = 0; c < 256; c++) {
+        t.flags[c] = 0;
+        t.special[c] = Token::SKIP;
+    }
+    for (int c = '0'; c <= '9'; c++) t.flags[c] = cDigit;
+    for (int c = 'a'; c <= 'z'; c++) t.flags[c] = cAlpha;
+    for (int c = 'A'; c <= 'Z'; c++) t.flags[c] = cAlpha | cUpper;
+    t.flags['_'] = cAlpha;
+    for (char c : {' ', '\t', '\n', '\v', '\f', '\r'}) t.flags[(unsigned char) c] = cSpace;
+
+    t.special[':'] = Token::kColon;
+    t.special[';'] = Token::kSemiColon;
+    t.special[','] = Token::kComma;
+    t.special['.'] = Token::kDot;
+    t.special['~'] = Token::kNegate;
+    t.special['*'] = Token::kMultiply;
+    t.special['+'] = Token::kAdd;
+    t.special['-'] = Token::kMinus;
+    t.special['/'] = Token::kDivide;
+    t.special['('] = Token::kOpenParen;
+    t.special[')'] = Token::kCloseParen;
+    t.special['{'] = Token::kOpenBrace;
+    t.special['}'] = Token::kCloseBrace;
+    return t;
+}
+
+constexpr CharTable charTable = makeCharTable();
+
+inline bool is(int c, uint8_t flags) {
+    return c != EOF && (charTable.flags[c] & flags);
+}
+
+//======================================================================//
+//                        Keyword Perfect Hash                          //
+//======================================================================//
+// Keywords are hashed by their first and last characters, which happens
+// to be collision free for Cool. Matching is case-insensitive ('|0x20'
+// folds ASCII letters to lowercase) and never allocates.
+struct Keyword {
+    const char* word;
+    size_t len;
+    Token::Type type;
 };
 
-unordered_map<char, Token::Type> tok::tokenMap = {
-    {':', Token::kColon},
-    {';', Token::kSemiColon},
-    {',', Token::kComma},
-    {'.', Token::kDot},
-    {'~', Token::kNegate},
-    {'*', Token::kMultiply},
-    {'+', Token::kAdd},
-    {'-', Token::kMinus},
-    {'/', Token::kDivide},
-    {'(', Token::kOpenParen},
-    {')', Token::kCloseParen},
-    {'{', Token::kOpenBrace},
-    {'}', Token::kCloseBrace},
+constexpr Keyword keywords[] = {
+    {"class", 5, Token::kClass},
+    {"if", 2, Token::kIf},
+    {"then", 4, Token::kThen},
+    {"else", 4, Token::kElse},
+    {"fi", 2, Token::kFi},
+    {"in", 2, Token::kIn},
+    {"inherits", 8, Token::kInheirits},
+    {"isvoid", 6, Token::kIsvoid},
+    {"let", 3, Token::kLet},
+    {"loop", 4, Token::kLoop},
+    {"pool", 4, Token::kPool},
+    {"while", 5, Token::kWhile},
+    {"case", 4, Token::kCase},
+    {"esac", 4, Token::kEsac},
+    {"new", 3, Token::kNew},
+    {"of", 2, Token::kOf},
+    {"not", 3, Token::kNot},
+    {"true", 4, Token::kTrue},
+    {"false", 5, Token::kFalse},
 };
 
+constexpr size_t minKeywordLen = 2;
+constexpr size_t maxKeywordLen = 8;
+constexpr unsigned keywordSlots = 64;
+
+constexpr unsigned keywordHash(char first, char last) {
+    return ((unsigned char) (first | 0x20) + 2 * (unsigned char) (last | 0x20)) & (keywordSlots - 1);
+}
+
+struct KeywordTable {
+    Keyword slots[keywordSlots];
+};
+
+constexpr KeywordTable makeKeywordTable() {
+    KeywordTable t{};
+    for (auto& k : keywords) {
+        auto& slot = t.slots[keywordHash(k.word[0], k.word[k.len - 1])];
+        // a collision makes this non-constant and breaks the build
+        if (slot.word) throw logic_error("keyword hash collision");
+        slot = k;
+    }
+    return t;
+}
+
+constexpr KeywordTable keywordTable = makeKeywordTable();
+
+} // namespace
+
+Token::Type tok::LookupKeyword(const char* st, size_t len) {
+    if (len < minKeywordLen || len > maxKeywordLen) return Token::END;
+    auto& k = keywordTable.slots[keywordHash(st[0], st[len - 1])];
+    if (k.len != len) return Token::END;
+    for (size_t i = 0; i < len; i++) {
+        if ((st[i] | 0x20) != k.word[i]) return Token::END;
+    }
+    return k.type;
+}
+
+Token::Type tok::LookupSpecial(char c) {
+    return charTable.special[(unsigned char) c];
+}
+
 unordered_map<Token::Type, string> tok::tokenStr = {
     {Token::ID, "identifier"},
     {Token::TypeID, "type identifier"},
@@ -96,172 +185,289 @@ unordered_map<Token::Type, string> tok::tokenStr = {
     {Token::kEqual, "="},
 };
 
-Tokenizer::Tokenizer(diag::Diagnosis& _diag) : diag(_diag), line(1), pos(1) {}
+Tokenizer::Tokenizer(diag::Diagnosis& _diag)
+: diag(_diag), line(1), pos(1), base(nullptr), cur(nullptr), end(nullptr) {}
 
-Token Tokenizer::TokDigit(istream& in) {
-    assert(isdigit(in.peek()));
-    int stPos = pos;
-    string str;
-    while (isdigit(in.peek())) {
-        str += char(in.get());
-        pos++;
+TokenView Tokenizer::view(Token::Type type, const char* st, const char* ed, int _line, int _pos) {
+    return TokenView{type, uint32_t(st - base), uint32_t(ed - st), diag::TextInfo{_line, _pos, fileno}};
+}
+
+void Tokenizer::advance(const char* ed) {
+    size_t newlines = scan::CountByte(cur, ed, '\n');
+    if (newlines) {
+        line += newlines;
+        const char* lastNewline = ed - 1;
+        while (*lastNewline != '\n') lastNewline--;
+        pos = ed - lastNewline;
+    } else {
+        pos += ed - cur;
     }
-    return Token(Token::Integer, str, str, line, stPos, fileno);
+    cur = ed;
 }
 
-Token Tokenizer::TokAlpha(istream& in) {
-    assert(isalpha(in.peek()) || in.peek() == '_');
+void Tokenizer::reset(const SourceBuffer& buf) {
+    base = buf.Begin();
+    cur = buf.Begin();
+    end = buf.End();
+}
+
+TokenView Tokenizer::ScanDigit() {
+    assert(is(peek(), cDigit));
     int stPos = pos;
-    string str = {};
-    while (isalpha(in.peek()) || isdigit(in.peek()) || in.peek() == '_') {
-        str += char(in.get());
+    const char* st = cur;
+    while (is(peek(), cDigit)) {
+        cur++;
         pos++;
     }
-    string lowerStr(str.begin(), str.end());
-    bool capitalFirst = isupper(lowerStr.at(0));
-    transform(lowerStr.begin(), lowerStr.end(), lowerStr.begin(), ::tolower);
-    if (keywordMap.find(lowerStr) != keywordMap.end()) {
-        return Token(keywordMap.at(lowerStr), "", "", line, stPos, fileno);
+    return view(Token::Integer, st, cur, line, stPos);
+}
+
+TokenView Tokenizer::ScanAlpha() {
+    assert(is(peek(), cAlpha));
+    int stPos = pos;
+    const char* st = cur;
+    cur = scan::SkipIdent(cur, end);
+    pos += cur - st;
+    auto keyword = LookupKeyword(st, cur - st);
+    if (keyword != Token::END) {
+        return view(keyword, st, cur, line, stPos);
     }
-    if (capitalFirst) return Token(Token::TypeID, str, str, line, stPos, fileno);
-    return Token(Token::ID, str, str, line, stPos, fileno);
+    if (is((unsigned char) *st, cUpper)) return view(Token::TypeID, st, cur, line, stPos);
+    return view(Token::ID, st, cur, line, stPos);
 }
 
-Token Tokenizer::TokString(istream& in) {
-    assert(in.peek() == '"');
+TokenView Tokenizer::ScanString() {
+    assert(peek() == '"');
     int stPos = pos;
-    in.ignore(1);
+    cur++;
     pos++;
-    string str;
-    bool easc = false;
-    while (in.good()) {
-        if (easc) {
-            str += char(in.get());
-            easc = false;
-            continue;
-        }
-        if (in.peek() == '\\') {
-            in.ignore(1);
-            easc = true;
-        } else if (in.peek() == '"') {
-            in.ignore(1);
+    const char* st = cur;
+    const char* ed = end;
+    while (cur < end) {
+        if (*cur == '\\') {
+            // the escaped character is resolved in Materialize
+            cur = min(cur + 2, end);
+        } else if (*cur == '"') {
+            ed = cur++;
             break;
         } else {
-            str += char(in.get());
+            cur++;
         }
         pos++;
     }
-    return Token(Token::String, str, str, line, stPos, fileno);
+    return view(Token::String, st, ed, line, stPos);
 }
 
-Token Tokenizer::TokSpecial(istream& in) {
+TokenView Tokenizer::ScanSpecial() {
     int stPos = pos;
-    char c = in.get();
+    const char* st = cur;
+    char c = *cur++;
     pos++;
     switch (c) {
         case '<':
-            if (in.peek() == '-') {
-                in.ignore(1);
+            if (peek() == '-') {
+                cur++;
                 pos++;
-                return Token(Token::kAssignment, "", "", line, stPos, fileno);
+                return view(Token::kAssignment, st, cur, line, stPos);
             }
-            if (in.peek() == '=') {
-                in.ignore(1);
+            if (peek() == '=') {
+                cur++;
                 pos++;
-                return Token(Token::kLessThanOrEqual, "", "", line, stPos, fileno);
+                return view(Token::kLessThanOrEqual, st, cur, line, stPos);
             }
-            return Token(Token::kLessThan, "", "", line, stPos, fileno);
+            return view(Token::kLessThan, st, cur, line, stPos);
         case '=':
-            if (in.peek() == '>') {
-                in.ignore(1);
+            if (peek() == '>') {
+                cur++;
                 pos++;
-                return Token(Token::kEval, "", "", line, stPos, fileno);
+                return view(Token::kEval, st, cur, line, stPos);
             }
-            return Token(Token::kEqual, "", "", line, stPos, fileno);
+            return view(Token::kEqual, st, cur, line, stPos);
         default:
-            if (tokenMap.find(c) == tokenMap.end()) {
+            auto type = LookupSpecial(c);
+            if (type == Token::SKIP) {
                 diag.EmitError(line, 0, string("invalid character: ") += c);
-                return Token(Token::SKIP, "", "", line, stPos, fileno);
+                return view(Token::SKIP, st, st, line, stPos);
             }
-            return Token(tokenMap.at(c), "", "", line, stPos, fileno);
+            return view(type, st, cur, line, stPos);
     }
 }
 
-Token Tokenizer::TokComment(istream& in) {
-    char c = in.get();
+TokenView Tokenizer::ScanComment() {
+    char c = *cur++;
     pos++;
 
-    auto ReadUntil = [this, &in](char target) {
-        stringstream buf;
-        while (in.good()) {
-            char next = in.get();
-            pos++;
-            if (next == target || in.eof())
-                break;
-            buf << next;
-        }
-        return buf.str();
+    // consume up to and including target, the view excludes target
+    auto readUntil = [this](char target) {
+        const char* st = cur;
+        const char* ed = scan::FindByte(cur, end, target);
+        advance(ed < end ? ed + 1 : end);
+        return make_pair(st, ed);
     };
 
     if (c == '-') {
 
-        if (!in.good())
-            throw runtime_error("read from istream failed: ");
-
-        if (in.get() != '-' && ++pos) {
+        if (peek() != '-') {
+            if (peek() != EOF && peek() != '\n') {
+                cur++;
+                pos++;
+            }
             diag.EmitError(line, pos, "use '--' for comment");
-            return Token(Token::SKIP, "", "",
-                line, pos, fileno);
+            return view(Token::SKIP, cur, cur, line, pos);
         }
+        cur++;
+        pos++;
 
-        return Token(Token::Comment, ReadUntil('\n'),
-            "", line, pos, fileno);
+        auto text = readUntil('\n');
+        return view(Token::Comment, text.first, text.second, line, pos);
 
     } else if (c == '*') {
 
-        return Token(Token::Comment, ReadUntil('*'),
-                     "", line, pos, fileno);
+        auto text = readUntil('*');
+        return view(Token::Comment, text.first, text.second, line, pos);
     } else {
-        assert(false && "unexpected call to TokComment");
+        assert(false && "unexpected call to ScanComment");
     }
 }
 
-vector<Token> Tokenizer::Tokenize(const string& file, istream& in) {
+vector<TokenView> Tokenizer::Scan(const string& file, const SourceBuffer& buf) {
     fileno = FileMapper::GetFileNo(file);
-    vector<Token> toks;
+    reset(buf);
+    vector<TokenView> toks;
 
-    while (in.good()) {
-        char c = in.peek();
-        if (c == EOF)
-            break;
+    while (cur < end) {
+        unsigned char c = *cur;
 
-        if (isdigit(c)) {
-            toks.emplace_back(TokDigit(in));
-        } else if (isalpha(c) || c == '_') {
-            toks.emplace_back(TokAlpha(in));
+        if (is(c, cDigit)) {
+            toks.emplace_back(ScanDigit());
+        } else if (is(c, cAlpha)) {
+            toks.emplace_back(ScanAlpha());
         } else if (c == '"') {
-            toks.emplace_back(TokString(in));
+            toks.emplace_back(ScanString());
         } else if (c == '-' || c == '*') {
             // To utilize our current parser implementation, skip
             // comment tokens now, we may need to associate comment
             // with program, classes or functions in the future.
-            TokComment(in);
-        } else if (isspace(c)) {
-            if (c == '\n') {
-                line++;
-                pos = 1;
-            } else pos++;
-            in.ignore(1);
+            ScanComment();
+        } else if (is(c, cSpace)) {
+            advance(scan::SkipSpace(cur, end));
         } else {
-            auto tok = TokSpecial(in);
+            auto tok = ScanSpecial();
             if (!tok.Skip())
                 toks.emplace_back(tok);
         }
 
     }
 
-    // todo: check and report in.bad()
+    return toks;
+}
 
+vector<Token> Tokenizer::Tokenize(const string& file, const SourceBuffer& buf) {
+    auto views = Scan(file, buf);
+    vector<Token> toks;
+    toks.reserve(views.size());
+    for (auto& v : views)
+        toks.emplace_back(Materialize(buf, v));
     return toks;
 }
 
+vector<Token> Tokenizer::Tokenize(const string& file, istream& in) {
+    // todo: check and report in.bad()
+    SourceBuffer buf{string(istreambuf_iterator<char>(in), istreambuf_iterator<char>())};
+    return Tokenize(file, buf);
+}
+
+Token Tokenizer::tokOne(string text, TokenView (Tokenizer::*scan)()) {
+    SourceBuffer buf{move(text)};
+    reset(buf);
+    auto v = (this->*scan)();
+    assert(cur == end && "read more than the token");
+    return Materialize(buf, v);
+}
+
+// The adapters read a token the way its scanner consumes it and leave the
+// stream right after it, like the istream tokenizer did, rather than
+// copying the rest of the stream for every token.
+namespace {
+
+// the characters of a class in starts with
+string readClass(istream& in, uint8_t flags) {
+    string text;
+    while (is(in.peek(), flags)) text += char(in.get());
+    return text;
+}
+
+// up to and including target, or the rest of in
+string readThrough(istream& in, char target) {
+    string text;
+    getline(in, text, target);
+    if (!in.eof()) text += target;
+    in.clear();
+    return text;
+}
+
+} // namespace
+
+Token Tokenizer::TokDigit(istream& in) { return tokOne(readClass(in, cDigit), &Tokenizer::ScanDigit); }
+
+Token Tokenizer::TokAlpha(istream& in) { return tokOne(readClass(in, cAlpha | cDigit), &Tokenizer::ScanAlpha); }
+
+Token Tokenizer::TokString(istream& in) {
+    string text(1, char(in.get()));
+    for (int c = in.get(); c != EOF; c = in.get()) {
+        text += char(c);
+        if (c == '"') break;
+        if (c == '\\' && in.peek() != EOF) text += char(in.get());
+    }
+    in.clear();
+    return tokOne(move(text), &Tokenizer::ScanString);
+}
+
+Token Tokenizer::TokSpecial(istream& in) {
+    string text(1, char(in.get()));
+    int next = in.peek();
+    if ((text[0] == '<' && (next == '-' || next == '=')) || (text[0] == '=' && next == '>'))
+        text += char(in.get());
+    return tokOne(move(text), &Tokenizer::ScanSpecial);
+}
+
+Token Tokenizer::TokComment(istream& in) {
+    string text(1, char(in.get()));
+    if (text[0] == '*') {
+        text += readThrough(in, '*');
+    } else if (in.peek() == '-') {
+        text += readThrough(in, '\n');
+    } else if (in.peek() != EOF && in.peek() != '\n') {
+        // the character after a single '-' goes with the error
+        text += char(in.get());
+    }
+    return tokOne(move(text), &Tokenizer::ScanComment);
+}
+
+Token tok::Materialize(const SourceBuffer& buf, const TokenView& view) {
+    auto& info = view.textInfo;
+    switch (view.type) {
+        case Token::ID:
+        case Token::TypeID:
+        case Token::Integer: {
+            auto str = buf.Slice(view.offset, view.length);
+            return Token(view.type, str, str, info.line, info.pos, info.fileno);
+        }
+        case Token::String: {
+            string str;
+            str.reserve(view.length);
+            const char* p = buf.Begin() + view.offset;
+            const char* ed = p + view.length;
+            for (; p < ed; p++) {
+                if (*p == '\\' && p + 1 < ed) p++;
+                str += *p;
+            }
+            return Token(Token::String, str, str, info.line, info.pos, info.fileno);
+        }
+        case Token::Comment:
+            return Token(Token::Comment, buf.Slice(view.offset, view.length), "",
+                info.line, info.pos, info.fileno);
+        default:
+            return Token(view.type, "", "", info.line, info.pos, info.fileno);
+    }
+}
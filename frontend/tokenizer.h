@@ -12,6 +12,7 @@
 #include <istream>
 
 #include "token.h"
+#include "source.h"
 #include "diag.h"
 
 using namespace std;
@@ -20,10 +21,17 @@ namespace cool {
 
 namespace tok {
 
-extern unordered_map<string, Token::Type> keywordMap;
-extern unordered_map<char, Token::Type> tokenMap;
 extern unordered_map<Token::Type, string> tokenStr;
 
+// case-insensitive keyword lookup, return END if [st, st+len) is not a keyword
+Token::Type LookupKeyword(const char* st, size_t len);
+
+// single character token lookup, return SKIP if c is not a token
+Token::Type LookupSpecial(char c);
+
+// convert a scanned view into an owning Token
+Token Materialize(const SourceBuffer& buf, const TokenView& view);
+
 class Tokenizer {
   private:
     int line;
@@ -31,11 +39,41 @@ class Tokenizer {
     int fileno;
     diag::Diagnosis& diag;
 
+    // scanning state over a contiguous source buffer
+    const char* base;
+    const char* cur;
+    const char* end;
+
+    int peek() const { return cur < end ? (unsigned char) *cur : EOF; }
+
+    TokenView view(Token::Type type, const char* st, const char* ed, int _line, int _pos);
+
+    // move cur to ed, keeping line and pos in sync
+    void advance(const char* ed);
+
+    void reset(const SourceBuffer& buf);
+
+    // scan the text of a single token, read off an istream up to where
+    // the scanner stops
+    Token tokOne(string text, TokenView (Tokenizer::*scan)());
+
   public:
     Tokenizer(diag::Diagnosis& _diag);
 
+    // zero-copy scanning, the returned views refer to buf
+    vector<TokenView> Scan(const string& file, const SourceBuffer& buf);
+
+    vector<Token> Tokenize(const string& file, const SourceBuffer& buf);
+
+    // thin adapters over Scan, kept for the istream based callers
     vector<Token> Tokenize(const string& file, istream& in);
 
+    TokenView ScanDigit();
+    TokenView ScanAlpha();
+    TokenView ScanString();
+    TokenView ScanSpecial();
+    TokenView ScanComment();
+
     // todo: support comments
     Token TokDigit(istream& in);
     Token TokAlpha(istream& in);
@@ -3,24 +3,27 @@
 //
 
 #include <iostream>
+#include <utility>
 
 #include "typead.h"
+#include "constant.h"
 
 using namespace cool;
 using namespace type;
+using namespace constant;
 
-shared_ptr<TypeAdvisor::Node> TypeAdvisor::get(const string& type) {
-    if (map.find(type) == map.end()) return nullptr;
-    return map.at(type);
+shared_ptr<TypeAdvisor::Node> TypeAdvisor::get(Symbol type) {
+    auto it = map.find(type);
+    return it == map.end() ? nullptr : it->second;
 }
 
 TypeAdvisor::TypeAdvisor(repr::Class* rootClass) {
-    root = make_shared<Node>(Node{rootClass->GetName().Value(), rootClass, nullptr, {}});
-    map.insert({rootClass->GetName().Value(), root});
+    root = make_shared<Node>(Node{rootClass->GetName().Sym(), rootClass, nullptr, {}});
+    map.insert({rootClass->GetName().Sym(), root});
 }
 
-bool TypeAdvisor::Contains(const string& type) {
-    return (map.find(type) != map.end()) && map.at(type);
+bool TypeAdvisor::Contains(Symbol type) {
+    return get(type) != nullptr;
 }
 
 void TypeAdvisor::AddType(repr::Class* cls) {
@@ -31,55 +34,94 @@ void TypeAdvisor::AddType(repr::Class* cls) {
         throw runtime_error("type name cannot be ''");
     if (parent.Empty())
         throw runtime_error("parent type cannot be ''");
-    if (Contains(type.Value()))
+    if (Contains(type.Sym()))
         throw runtime_error("type already existed");
 
     auto parentNode = root;
     if (!parent.Empty()) {
-        parentNode = get(parent.Value());
+        parentNode = get(parent.Sym());
         if (!parentNode)
             throw runtime_error("parent type '" + parent.Value() + "' not found");
     }
-    auto node = make_shared<Node>(Node{type.Value(), cls, parentNode});
+    auto node = make_shared<Node>(Node{type.Sym(), cls, parentNode});
     parentNode->children.emplace_back(node);
-    map.insert({type.Value(), node});
+    map.insert({type.Sym(), node});
+    indexed = false;
 }
 
-repr::Class* TypeAdvisor::GetTypeRepr(const string& type) {
-    if (!Contains(type))
-        return nullptr;
-    return get(type)->cls;
+void TypeAdvisor::BuildIndex() {
+    euler.clear();
+    euler.reserve(2 * map.size());
+
+    // iterative so that deep hierarchies don't overflow the stack
+    int counter = 0;
+    vector<pair<Node*, size_t>> stack = {{root.get(), 0}};
+    root->depth = 0;
+    root->pre = counter++;
+    root->first = 0;
+    euler.emplace_back(root.get());
+    while (!stack.empty()) {
+        auto& top = stack.back();
+        Node* node = top.first;
+        if (top.second < node->children.size()) {
+            Node* child = node->children.at(top.second++).get();
+            child->depth = node->depth + 1;
+            child->pre = counter++;
+            child->first = euler.size();
+            euler.emplace_back(child);
+            stack.push_back({child, 0});
+        } else {
+            node->post = counter++;
+            stack.pop_back();
+            if (!stack.empty()) euler.emplace_back(stack.back().first);
+        }
+    }
+
+    auto shallower = [](Node* a, Node* b) { return a->depth <= b->depth ? a : b; };
+    sparse.assign(1, euler);
+    for (size_t k = 1; (size_t(1) << k) <= euler.size(); k++) {
+        auto& prev = sparse.at(k - 1);
+        size_t half = size_t(1) << (k - 1);
+        vector<Node*> level(euler.size() - (size_t(1) << k) + 1);
+        for (size_t i = 0; i < level.size(); i++)
+            level[i] = shallower(prev[i], prev[i + half]);
+        sparse.emplace_back(move(level));
+    }
+    indexed = true;
+}
+
+TypeAdvisor::Node* TypeAdvisor::lca(Node* a, Node* b) {
+    size_t l = min(a->first, b->first), r = max(a->first, b->first);
+    size_t k = 63 - __builtin_clzll(r - l + 1);
+    Node* x = sparse.at(k)[l];
+    Node* y = sparse.at(k)[r + 1 - (size_t(1) << k)];
+    return x->depth <= y->depth ? x : y;
+}
+
+repr::Class* TypeAdvisor::GetTypeRepr(Symbol type) {
+    auto node = get(type);
+    return node ? node->cls : nullptr;
 }
 
 // define the '<=' rule
-bool TypeAdvisor::Conforms(const string& left, const string& right, const string& C) {
-    if (right == "SELF_TYPE") return left == "SELF_TYPE";
-    if (left == "SELF_TYPE") return Conforms(C, right, C);
-    auto node = get(left);
-    while (node) {
-        if (node->type == right) return true;
-        node = node->parent;
-    }
-    return false;
+bool TypeAdvisor::Conforms(Symbol left, Symbol right, Symbol C) {
+    if (right == SYM_SELF_TYPE) return left == SYM_SELF_TYPE;
+    if (left == SYM_SELF_TYPE) return Conforms(C, right, C);
+    auto l = get(left), r = get(right);
+    if (!l || !r) return false;
+    if (!indexed) BuildIndex();
+    return r->pre <= l->pre && l->post <= r->post;
 }
 
-string TypeAdvisor::LeastCommonAncestor(const string& typea, const string& typeb) {
+Symbol TypeAdvisor::LeastCommonAncestor(Symbol typea, Symbol typeb) {
     if (typea == typeb) return typea;
-    auto node = get(typea);
-    unordered_set<string> acs;
-    while (node) {
-        acs.insert(node->type);
-        node = node->parent;
-    }
-    node = get(typeb);
-    while (node) {
-        if (acs.find(node->type) != acs.end()) return node->type;
-        node = node->parent;
-    }
-    return "";
+    auto a = get(typea), b = get(typeb);
+    if (!a || !b) return Symbol();
+    if (!indexed) BuildIndex();
+    return lca(a.get(), b.get())->type;
 }
 
-string TypeAdvisor::LeastCommonAncestor(vector<string>& types) {
+Symbol TypeAdvisor::LeastCommonAncestor(vector<Symbol>& types) {
     auto lca = types.front();
     for (auto& t : types) {
         lca = LeastCommonAncestor(lca, t);
@@ -87,12 +129,26 @@ string TypeAdvisor::LeastCommonAncestor(vector<string>& types) {
     return lca;
 }
 
-void TypeAdvisor::BottomUpVisit(const string& type, function<bool(repr::Class*)> f) {
+void TypeAdvisor::BottomUpVisit(Symbol type, function<bool(repr::Class*)> f) {
     auto node = get(type);
     while (node) {
-        if (!node->cls) std::cout<< node->type << " has null cls ptr" <<endl;
+        if (!node->cls) std::cout<< node->type.Str() << " has null cls ptr" <<endl;
         bool stop = f(node->cls);
         if (stop) return;
         node = node->parent;
     }
-}
\ No newline at end of file
+}
+
+bool TypeAdvisor::TopDownVisit(Symbol type, function<bool(repr::Class*)> f) {
+    auto node = get(type);
+    if (!node) return false;
+    vector<Node*> stack = {node.get()};
+    while (!stack.empty()) {
+        Node* top = stack.back();
+        stack.pop_back();
+        if (f(top->cls)) return true;
+        for (auto it = top->children.rbegin(); it != top->children.rend(); it++)
+            stack.emplace_back(it->get());
+    }
+    return false;
+}
@@ -12,6 +12,7 @@
 #include <memory>
 
 #include "repr.h"
+#include "symbol.h"
 
 using namespace std;
 
@@ -19,35 +20,65 @@ namespace cool {
 
 namespace type {
 
+//======================================================================//
+//                        TypeAdvisor Class                             //
+//======================================================================//
+// The inheritance tree. Queries are answered from an index built over
+// the tree once all types are added (see BuildIndex):
+//  - DFS pre/post numbers: A <= B iff B's [pre, post] interval contains A's
+//  - an Euler tour with a sparse table of the shallowest node in every
+//    2^k window: LCA(A, B) is the shallowest node between their first
+//    occurrences in the tour
+// Both are O(1) per query. Adding a type invalidates the index, it is
+// rebuilt by the next query.
 class TypeAdvisor {
   private:
     struct Node {
-        string type;
+        Symbol type;
         repr::Class* cls;
         shared_ptr<Node> parent;
         vector<shared_ptr<Node>> children;
+        int pre = -1;
+        int post = -1;
+        int depth = 0;
+        int first = -1; // first occurrence in the euler tour
     };
     shared_ptr<Node> root;
-    unordered_map<string, shared_ptr<Node>> map;
+    unordered_map<Symbol, shared_ptr<Node>> map;
 
-    shared_ptr<Node> get(const string& type);
+    bool indexed = false;
+    vector<Node*> euler;
+    vector<vector<Node*>> sparse; // sparse[k][i]: shallowest in euler[i, i+2^k)
+
+    shared_ptr<Node> get(Symbol type);
+
+    Node* lca(Node* a, Node* b);
 
   public:
     TypeAdvisor(repr::Class* rootClass);
 
-    bool Contains(const string& type);
+    bool Contains(Symbol type);
 
     void AddType(repr::Class* cls);
 
-    repr::Class* GetTypeRepr(const string& type);
+    // number the tree and build the LCA table, called once the
+    // inheritance tree is complete
+    void BuildIndex();
+
+    repr::Class* GetTypeRepr(Symbol type);
+
+    bool Conforms(Symbol left, Symbol right, Symbol C);
 
-    bool Conforms(const string& left, const string& right, const string& C);
+    Symbol LeastCommonAncestor(Symbol typea, Symbol typeb);
 
-    string LeastCommonAncestor(const string& typea, const string& typeb);
+    Symbol LeastCommonAncestor(vector<Symbol>& types);
 
-    string LeastCommonAncestor(vector<string>& types);
+    // call f on type and its ancestors, nearest first, until f returns true
+    void BottomUpVisit(Symbol type, function<bool(repr::Class*)> f);
 
-    void BottomUpVisit(const string& type, function<bool(repr::Class*)> f);
+    // call f on type and all its descendants, parents before children,
+    // until f returns true. Return whether f did.
+    bool TopDownVisit(Symbol type, function<bool(repr::Class*)> f);
 };
 
 } // namespace type
@@ -6,10 +6,12 @@
 #define COOL_VISITOR_H
 
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <typeinfo>
 
 #include "repr.h"
 #include "adt.h"
-#include "vtable.h"
 
 using namespace std;
 
@@ -54,16 +56,46 @@ class FormalVisitor {
 
 template<typename R, typename... Args>
 class ExprVisitor {
-  private:
-    using Self = ExprVisitor;
-    using VTable = VirtualTable<R, repr::Expr, Self&, Args...>;
-
   public:
+    #define EXPR_VISITOR_DISPATCH(Class)\
+        case repr::Repr::Kind::Class:\
+            return Visit_(static_cast<repr::Class&>(expr), args...);
+
+    // dispatch on the node kind, the switch compiles to a jump table
     R Visit(repr::Expr& expr, Args... args) {
-        VTable vtable = GetVTable();
-        return vtable(expr, *this, args...);
+        switch (expr.GetKind()) {
+            EXPR_VISITOR_DISPATCH(LinkBuiltin)
+            EXPR_VISITOR_DISPATCH(Assign)
+            EXPR_VISITOR_DISPATCH(Add)
+            EXPR_VISITOR_DISPATCH(Block)
+            EXPR_VISITOR_DISPATCH(Case)
+            EXPR_VISITOR_DISPATCH(Call)
+            EXPR_VISITOR_DISPATCH(Divide)
+            EXPR_VISITOR_DISPATCH(Equal)
+            EXPR_VISITOR_DISPATCH(False)
+            EXPR_VISITOR_DISPATCH(ID)
+            EXPR_VISITOR_DISPATCH(IsVoid)
+            EXPR_VISITOR_DISPATCH(Integer)
+            EXPR_VISITOR_DISPATCH(If)
+            EXPR_VISITOR_DISPATCH(LessThanOrEqual)
+            EXPR_VISITOR_DISPATCH(LessThan)
+            EXPR_VISITOR_DISPATCH(Let)
+            EXPR_VISITOR_DISPATCH(MethodCall)
+            EXPR_VISITOR_DISPATCH(Multiply)
+            EXPR_VISITOR_DISPATCH(Minus)
+            EXPR_VISITOR_DISPATCH(Negate)
+            EXPR_VISITOR_DISPATCH(New)
+            EXPR_VISITOR_DISPATCH(Not)
+            EXPR_VISITOR_DISPATCH(String)
+            EXPR_VISITOR_DISPATCH(True)
+            EXPR_VISITOR_DISPATCH(While)
+            default:
+                throw runtime_error(string("no available dispatch for type: ") + typeid(expr).name());
+        }
     }
 
+    #undef EXPR_VISITOR_DISPATCH
+
     #define EXPR_VISITOR_DEFAULT { VisitDefault_(); }
     virtual R Visit_(repr::LinkBuiltin& expr, Args... args) EXPR_VISITOR_DEFAULT;
     virtual R Visit_(repr::Assign& expr, Args... args) EXPR_VISITOR_DEFAULT;
@@ -94,42 +126,6 @@ class ExprVisitor {
         cerr<< "default not found" <<endl;
         throw;
     }
-
-  private:
-    #define EXPR_VISITOR_DISPATCH(Class)\
-        vtable.template SetDispatch<Class>([](repr::Expr& expr, Self& self, Args... args){\
-            return self.Visit_(static_cast<Class&>(expr));\
-        })\
-
-    static VTable GetVTable() {
-        static VTable vtable;
-        EXPR_VISITOR_DISPATCH(repr::LinkBuiltin);
-        EXPR_VISITOR_DISPATCH(repr::Assign);
-        EXPR_VISITOR_DISPATCH(repr::Add);
-        EXPR_VISITOR_DISPATCH(repr::Block);
-        EXPR_VISITOR_DISPATCH(repr::Case);
-        EXPR_VISITOR_DISPATCH(repr::Call);
-        EXPR_VISITOR_DISPATCH(repr::Divide);
-        EXPR_VISITOR_DISPATCH(repr::Equal);
-        EXPR_VISITOR_DISPATCH(repr::False);
-        EXPR_VISITOR_DISPATCH(repr::ID);
-        EXPR_VISITOR_DISPATCH(repr::IsVoid);
-        EXPR_VISITOR_DISPATCH(repr::Integer);
-        EXPR_VISITOR_DISPATCH(repr::If);
-        EXPR_VISITOR_DISPATCH(repr::LessThanOrEqual);
-        EXPR_VISITOR_DISPATCH(repr::LessThan);
-        EXPR_VISITOR_DISPATCH(repr::Let);
-        EXPR_VISITOR_DISPATCH(repr::MethodCall);
-        EXPR_VISITOR_DISPATCH(repr::Multiply);
-        EXPR_VISITOR_DISPATCH(repr::Minus);
-        EXPR_VISITOR_DISPATCH(repr::Negate);
-        EXPR_VISITOR_DISPATCH(repr::New);
-        EXPR_VISITOR_DISPATCH(repr::Not);
-        EXPR_VISITOR_DISPATCH(repr::String);
-        EXPR_VISITOR_DISPATCH(repr::True);
-        EXPR_VISITOR_DISPATCH(repr::While);
-        return vtable;
-    }
 };
 
 } // visitor
@@ -0,0 +1,760 @@
+//
+// Created by 田地 on 2021/9/3.
+//
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+
+#include "vm.h"
+#include "visitor.h"
+#include "constant.h"
+
+// labels as values, the dispatch loop jumps straight from one handler to
+// the next instead of going back to a switch
+#if defined(__GNUC__)
+#define COOL_VM_THREADED
+#endif
+
+using namespace std;
+using namespace cool;
+using namespace vm;
+using namespace constant;
+
+const size_t VM::MinHeap;
+
+VM::VM(adt::ScopedTableSpecializer<adt::SymbolTable>& _stable,
+    ostream& _out, istream& _in)
+: stable(_stable), out(_out), in(_in) {}
+
+//======================================================================//
+//                              Lowering                                //
+//======================================================================//
+// walk the scopes in the order InitSymbolTable created them, like
+// LLVMGen and interp::Interpreter do, and emit the code of every method
+// and of the field initializers of every class
+void VM::compile(repr::Program& prog) {
+
+    class Compiler : public visitor::ExprVisitor<void> {
+      private:
+        struct Ref {
+            bool field;
+            uint32_t idx; // of the field or the register
+        };
+
+        VM& vm;
+        adt::ScopedTableSpecializer<adt::SymbolTable>& stable;
+        Function* fn = nullptr;
+        // registers of the locals declared so far, by IdAttr index
+        unordered_map<uint32_t, uint32_t> locals;
+        vector<uint32_t> bases; // top when each open scope was entered
+        uint32_t top = 0;       // first free register
+        uint32_t dst = 0;       // where the visited expression goes
+
+        uint32_t pc() { return fn->code.size(); }
+
+        size_t emit(Op op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, repr::Expr* origin = nullptr) {
+            fn->code.push_back(Instr{op, a, b, c});
+            fn->origins.push_back(origin);
+            return fn->code.size() - 1;
+        }
+
+        uint32_t temp() {
+            fn->size = max(fn->size, top + 1);
+            return top++;
+        }
+
+        void enter() {
+            stable.EnterScope();
+            bases.push_back(top);
+            top += stable.Current().NumLocalId();
+            fn->size = max(fn->size, top);
+        }
+
+        void leave() {
+            top = bases.back();
+            bases.pop_back();
+            stable.LeaveScope();
+        }
+
+        // the local name was just declared in the innermost scope
+        uint32_t declare(Symbol name) {
+            int i = stable.IndexOf(name);
+            return locals[i] = bases.back() + stable.IdAttrAt(i).idx;
+        }
+
+        Ref lookup(Symbol name) {
+            int i = stable.IndexOf(name);
+            if (i < 0) {
+                if (name.Str() == "self") return Ref{false, 0};
+                throw runtime_error("unresolved identifier '" + name.Str() + "'");
+            }
+            auto& idAttr = stable.IdAttrAt(i);
+            switch (idAttr.storageClass) {
+                case attr::IdAttr::Field:
+                    return Ref{true, uint32_t(idAttr.idx)};
+                case attr::IdAttr::Arg:
+                    return Ref{false, uint32_t(idAttr.idx) + 1};
+                case attr::IdAttr::Local:
+                    return Ref{false, locals.at(i)};
+            }
+            throw runtime_error("invalid storage class");
+        }
+
+        // emit expr with its value going to reg, the temporaries it takes
+        // are free again afterwards
+        void into(repr::Expr& expr, uint32_t reg) {
+            auto savedDst = dst, savedTop = top;
+            dst = reg;
+            Visit(expr);
+            dst = savedDst;
+            top = savedTop;
+        }
+
+        uint32_t evaluate(repr::Expr& expr) {
+            auto reg = temp();
+            into(expr, reg);
+            return reg;
+        }
+
+        // the register holding the value of expr, a local or an arg is
+        // read where it is
+        uint32_t operand(repr::Expr& expr) {
+            if (auto id = dynamic_cast<repr::ID*>(&expr)) {
+                auto ref = lookup(id->GetName().Sym());
+                if (!ref.field) return ref.idx;
+            }
+            return evaluate(expr);
+        }
+
+        // whether evaluating expr cannot assign a local
+        static bool pure(repr::Expr& expr) {
+            switch (expr.GetKind()) {
+                case repr::Expr::Kind::ID:
+                case repr::Expr::Kind::Integer:
+                case repr::Expr::Kind::String:
+                case repr::Expr::Kind::True:
+                case repr::Expr::Kind::False:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        void loadDefault(Symbol type, uint32_t reg) {
+            if (type == SYM_INT) emit(Op::LoadInt, reg, 0);
+            else if (type == SYM_BOOL) emit(Op::LoadBool, reg, 0);
+            else if (type == SYM_STRING) emit(Op::LoadConst, reg, 0);
+            else emit(Op::LoadVoid, reg);
+        }
+
+        void visitUnary(Op op, repr::Unary& expr) {
+            emit(op, dst, operand(*expr.GetExpr()));
+        }
+
+        void visitBinary(Op op, repr::Binary& expr) {
+            // the left operand is read in place only if the right one
+            // cannot assign it before it is used
+            auto left = pure(*expr.GetRight()) ? operand(*expr.GetLeft()) : evaluate(*expr.GetLeft());
+            auto right = operand(*expr.GetRight());
+            emit(op, dst, left, right, &expr);
+        }
+
+        // the receiver is in recv, the args follow it
+        void visitSend(uint32_t recv, repr::Call& call) {
+            for (auto& arg : call.GetArgs()) {
+                auto reg = temp();
+                into(*arg, reg);
+            }
+            vm.sites.emplace_back();
+            vm.sites.back().name = call.GetId()->GetName().Sym();
+            emit(Op::Send, dst, recv, vm.sites.size() - 1, &call);
+        }
+
+      public:
+        Compiler(VM& _vm, adt::ScopedTableSpecializer<adt::SymbolTable>& _stable)
+        : vm(_vm), stable(_stable) {}
+
+        void Visit(repr::Expr& expr) { visitor::ExprVisitor<void>::Visit(expr); }
+
+        // compile func in the scope of its class
+        void CompileMethod(Function& function, repr::FuncFeature& func) {
+            fn = &function;
+            top = func.GetArgs().size() + 1;
+            fn->size = top;
+            stable.EnterScope();
+            auto ret = evaluate(*func.GetExpr());
+            stable.LeaveScope();
+            emit(Op::Return, ret);
+        }
+
+        // compile the initializers of the own fields of cls, return false
+        // if there is none
+        bool CompileInitializers(Function& function, repr::Class& cls) {
+            fn = &function;
+            top = 1;
+            fn->size = top;
+            auto& fields = cls.GetFieldFeatures();
+            for (uint32_t i = 0; i < fields.size(); i++) {
+                if (!fields[i]->GetExpr() || cls.IsInherited(fields[i])) continue;
+                emit(Op::SetField, i, evaluate(*fields[i]->GetExpr()));
+                top = 1;
+            }
+            emit(Op::Return, 0);
+            return fn->code.size() > 1;
+        }
+
+        void Visit_(repr::LinkBuiltin& expr) {
+            auto arg = [&](size_t i) { return lookup(expr.GetParams().at(i)).idx; };
+            auto name = expr.Sym();
+            if (name == SYM_FUNC_OUT_STRING || name == SYM_FUNC_OUT_INT) {
+                emit(name == SYM_FUNC_OUT_STRING ? Op::OutString : Op::OutInt, arg(0));
+                emit(Op::Move, dst, 0);
+            }
+            else if (name == SYM_FUNC_IN_STRING) emit(Op::InString, dst);
+            else if (name == SYM_FUNC_IN_INT) emit(Op::InInt, dst);
+            else if (name == SYM_FUNC_LENGTH) emit(Op::Length, dst, 0);
+            else if (name == SYM_FUNC_CONCAT) emit(Op::Concat, dst, 0, arg(0));
+            // the two args are in consecutive registers
+            else if (name == SYM_FUNC_SUBSTR) emit(Op::Substr, dst, 0, arg(0));
+            else if (name == SYM_FUNC_TYPE_NAME) emit(Op::TypeName, dst, 0);
+            else if (name == SYM_FUNC_COPY) emit(Op::Copy, dst, 0);
+            else if (name == SYM_FUNC_ABORT) emit(Op::Abort, 0);
+            else emit(Op::Trap, 0, 0, 0, &expr);
+        }
+
+        void Visit_(repr::Assign& expr) {
+            auto ref = lookup(expr.GetId()->GetName().Sym());
+            if (ref.field) {
+                into(*expr.GetExpr(), dst);
+                emit(Op::SetField, ref.idx, dst);
+                return;
+            }
+            into(*expr.GetExpr(), ref.idx);
+            if (dst != ref.idx) emit(Op::Move, dst, ref.idx);
+        }
+
+        void Visit_(repr::Block& expr) {
+            enter();
+            auto exprs = expr.GetExprs();
+            // only the last value is kept, the others must not clobber dst
+            // while it may still be read
+            auto scratch = exprs.size() > 1 ? temp() : dst;
+            for (size_t i = 0; i < exprs.size(); i++)
+                into(*exprs[i], i + 1 == exprs.size() ? dst : scratch);
+            if (exprs.empty()) emit(Op::LoadVoid, dst);
+            leave();
+        }
+
+        void Visit_(repr::Case& expr) {
+            auto value = evaluate(*expr.GetExpr());
+            uint32_t table = vm.cases.size();
+            vm.cases.emplace_back();
+            emit(Op::Case, value, table, 0, &expr);
+            vector<size_t> exits;
+            for (auto& branch : expr.GetBranches()) {
+                enter();
+                auto reg = declare(branch->GetId().Sym());
+                vm.cases[table].branches.emplace_back(vm.program->GetClassPtr(branch->GetType().Sym()), pc());
+                emit(Op::Move, reg, value);
+                into(*branch->GetExpr(), dst);
+                leave();
+                exits.push_back(emit(Op::Jump));
+            }
+            for (auto exit : exits) fn->code[exit].a = pc();
+        }
+
+        void Visit_(repr::Call& expr) {
+            enter();
+            auto recv = temp();
+            emit(Op::Move, recv, 0);
+            visitSend(recv, expr);
+            leave();
+        }
+
+        void Visit_(repr::ID& expr) {
+            auto ref = lookup(expr.GetName().Sym());
+            if (ref.field) emit(Op::GetField, dst, ref.idx);
+            else if (ref.idx != dst) emit(Op::Move, dst, ref.idx);
+        }
+
+        void Visit_(repr::If& expr) {
+            enter();
+            auto cond = operand(*expr.GetIfExpr());
+            auto toElse = emit(Op::JumpIfFalse, cond);
+            enter();
+            into(*expr.GetThenExpr(), dst);
+            leave();
+            auto toEnd = emit(Op::Jump);
+            fn->code[toElse].b = pc();
+            enter();
+            into(*expr.GetElseExpr(), dst);
+            leave();
+            fn->code[toEnd].a = pc();
+            leave();
+        }
+
+        void Visit_(repr::Integer& expr) { emit(Op::LoadInt, dst, uint32_t(expr.GetValue().Value())); }
+
+        void Visit_(repr::Let& expr) {
+            for (auto& decl : expr.GetDecls()) {
+                enter();
+                auto reg = declare(decl->GetName().Sym());
+                if (decl->GetExpr()) into(*decl->GetExpr(), reg);
+                else loadDefault(decl->GetType().Sym(), reg);
+            }
+            into(*expr.GetExpr(), dst);
+            for (int i = 0; i < expr.GetDecls().size(); i++)
+                leave();
+        }
+
+        void Visit_(repr::MethodCall& expr) {
+            enter();
+            auto recv = evaluate(*expr.GetLeft());
+            visitSend(recv, *static_cast<repr::Call*>(expr.GetRight()));
+            leave();
+        }
+
+        void Visit_(repr::New& expr) {
+            auto type = expr.GetType().Sym();
+            if (type == SYM_SELF_TYPE) emit(Op::NewSelf, dst);
+            else if (type == SYM_INT || type == SYM_BOOL || type == SYM_STRING) loadDefault(type, dst);
+            else emit(Op::New, dst, vm.classIndex.at(vm.program->GetClassPtr(type)));
+        }
+
+        // literals are immutable and allocated once
+        void Visit_(repr::String& expr) {
+            vm.constants.emplace_back(vm.newString(expr.GetValue().Value()));
+            emit(Op::LoadConst, dst, vm.constants.size() - 1);
+        }
+
+        void Visit_(repr::While& expr) {
+            enter();
+            auto loop = pc();
+            auto cond = operand(*expr.GetWhileExpr());
+            auto toEnd = emit(Op::JumpIfFalse, cond);
+            evaluate(*expr.GetLoopExpr());
+            emit(Op::Loop, loop);
+            fn->code[toEnd].b = pc();
+            emit(Op::LoadVoid, dst);
+            leave();
+        }
+
+        void Visit_(repr::IsVoid& expr) { visitUnary(Op::IsVoid, expr); }
+        void Visit_(repr::Negate& expr) { visitUnary(Op::Neg, expr); }
+        void Visit_(repr::Not& expr) { visitUnary(Op::Not, expr); }
+
+        void Visit_(repr::Add& expr) { visitBinary(Op::Add, expr); }
+        void Visit_(repr::Divide& expr) { visitBinary(Op::Div, expr); }
+        void Visit_(repr::Equal& expr) { visitBinary(Op::Eq, expr); }
+        void Visit_(repr::LessThanOrEqual& expr) { visitBinary(Op::Le, expr); }
+        void Visit_(repr::LessThan& expr) { visitBinary(Op::Lt, expr); }
+        void Visit_(repr::Multiply& expr) { visitBinary(Op::Mul, expr); }
+        void Visit_(repr::Minus& expr) { visitBinary(Op::Sub, expr); }
+
+        void Visit_(repr::True& expr) { emit(Op::LoadBool, dst, 1); }
+        void Visit_(repr::False& expr) { emit(Op::LoadBool, dst, 0); }
+    };
+
+    // the functions are all made before any is compiled, a call site
+    // refers to its callee by index
+    constants.emplace_back(newString("")); // the default of String
+    vector<uint32_t> initializers;
+    for (auto& cls : prog.GetClasses()) {
+        classIndex[cls] = classes.size();
+        classes.emplace_back();
+        classes.back().cls = cls;
+        for (auto& field : cls->GetFieldFeatures())
+            classes.back().defaults.emplace_back(defaultValue(field->GetType().Sym()));
+        for (auto& func : cls->GetOwnFuncFeatures()) {
+            methods[func] = functions.size();
+            functions.emplace_back();
+            functions.back().method = func;
+        }
+        initializers.emplace_back(functions.size());
+        functions.emplace_back();
+    }
+
+    Compiler compiler(*this, stable);
+    vector<bool> hasInitializers;
+    stable.InitTraverse();
+    ENTER_SCOPE_GUARD(stable, {
+        for (auto& cls : prog.GetClasses()) {
+            ENTER_SCOPE_GUARD(stable, {
+                for (auto& func : cls->GetOwnFuncFeatures())
+                    compiler.CompileMethod(functions[methods.at(func)], *func);
+                // the initializers of a class share a frame
+                auto init = initializers[hasInitializers.size()];
+                hasInitializers.push_back(compiler.CompileInitializers(functions[init], *cls));
+            })
+        }
+    })
+
+    // the initializers to run on a new object, those of the parent first
+    for (auto& info : classes) {
+        for (auto cls = info.cls; cls; cls = prog.GetClassPtr(cls->GetParent().Sym())) {
+            auto i = classIndex.at(cls);
+            if (hasInitializers[i]) info.inits.push_back(initializers[i]);
+        }
+        reverse(info.inits.begin(), info.inits.end());
+    }
+    natives = vector<atomic<void*>>(functions.size());
+}
+
+//======================================================================//
+//                              Runtime                                 //
+//======================================================================//
+Object* VM::alloc(repr::Class* cls) {
+    if (heap.size() >= collectAt) {
+        collect();
+        collectAt = max(MinHeap, 2 * heap.size());
+    }
+    heap.emplace_back(new Object());
+    heap.back()->cls = cls;
+    return heap.back().get();
+}
+
+// the object being allocated isn't made yet, the one whose initializers
+// run is in the frame of them
+void VM::collect() {
+    vector<Object*> work;
+    auto mark = [&](const Value& value) {
+        if (!value.obj || value.obj->marked) return;
+        value.obj->marked = true;
+        work.push_back(value.obj);
+    };
+    for (auto& value : constants) mark(value);
+    for (auto& info : classes)
+        for (auto& value : info.defaults) mark(value);
+    for (size_t i = 0; i < top; i++) mark(stack[i]);
+    while (!work.empty()) {
+        auto obj = work.back();
+        work.pop_back();
+        for (auto& field : obj->fields) mark(field);
+    }
+
+    heap.erase(remove_if(heap.begin(), heap.end(),
+        [](const unique_ptr<Object>& obj) { return !obj->marked; }), heap.end());
+    for (auto& obj : heap) obj->marked = false;
+}
+
+Value VM::newString(const string& str) {
+    auto obj = alloc(program->GetClassPtr(SYM_STRING));
+    obj->str = str;
+    return Value{Value::Kind::String, 0, obj};
+}
+
+// strings are immutable, so every String field starts as the same one
+Value VM::defaultValue(Symbol type) {
+    if (type == SYM_INT) return Value{Value::Kind::Int, 0};
+    if (type == SYM_BOOL) return Value{Value::Kind::Bool, 0};
+    if (type == SYM_STRING) return constants.at(0);
+    return Value();
+}
+
+repr::Class* VM::classOf(const Value& value) {
+    switch (value.kind) {
+        case Value::Kind::Int:
+            return program->GetClassPtr(SYM_INT);
+        case Value::Kind::Bool:
+            return program->GetClassPtr(SYM_BOOL);
+        default:
+            return value.obj ? value.obj->cls : nullptr;
+    }
+}
+
+Value VM::newObject(uint32_t cls) {
+    auto& info = classes[cls];
+    auto type = info.cls->GetName().Sym();
+    if (type == SYM_INT || type == SYM_BOOL || type == SYM_STRING)
+        return defaultValue(type);
+    auto obj = alloc(info.cls);
+    obj->fields = info.defaults;
+    Value value{Value::Kind::Object, 0, obj};
+    // the initializers run in a frame above the current one
+    for (auto init : info.inits) {
+        if (stack.size() <= top) stack.resize(2 * top + 1);
+        stack[top] = value;
+        execute(init, top);
+    }
+    return value;
+}
+
+void VM::heat(Function& fn) {
+    if (fn.method && ++fn.hotness == threshold) hot(*fn.method);
+}
+
+int32_t VM::callNative(void* entry, const Value* args, uint32_t n) {
+    switch (n) {
+        case 0:
+            return reinterpret_cast<int32_t (*)(void*)>(entry)(nullptr);
+        case 1:
+            return reinterpret_cast<int32_t (*)(void*, int32_t)>(entry)(nullptr, args[0].i);
+        case 2:
+            return reinterpret_cast<int32_t (*)(void*, int32_t, int32_t)>(entry)(nullptr, args[0].i, args[1].i);
+        case 3:
+            return reinterpret_cast<int32_t (*)(void*, int32_t, int32_t, int32_t)>(entry)(
+                nullptr, args[0].i, args[1].i, args[2].i);
+        case 4:
+            return reinterpret_cast<int32_t (*)(void*, int32_t, int32_t, int32_t, int32_t)>(entry)(
+                nullptr, args[0].i, args[1].i, args[2].i, args[3].i);
+    }
+    throw runtime_error("native code takes at most " + to_string(MaxNativeArgs) + " args");
+}
+
+Value VM::execute(uint32_t function, size_t base) {
+    auto& fn = functions[function];
+    if (hot) heat(fn);
+    auto savedTop = top;
+    top = base + fn.size;
+    if (stack.size() < top) stack.resize(max<size_t>(top, 2 * stack.size()));
+
+    auto code = fn.code.data();
+    auto pc = code;
+    auto r = stack.data() + base;
+    // the position of the current instruction for an error
+    auto where = [&]() {
+        auto origin = fn.origins[pc - code];
+        return origin ? origin->GetTextInfo().String() + ": " : string();
+    };
+
+#ifdef COOL_VM_THREADED
+    static const void* labels[] = {
+#define COOL_VM_OP_LABEL(name) &&op##name,
+        COOL_VM_OPS(COOL_VM_OP_LABEL)
+#undef COOL_VM_OP_LABEL
+    };
+#define VM_OP(name) op##name:
+#define VM_DISPATCH() goto *labels[uint8_t(pc->op)]
+    VM_DISPATCH();
+    {
+#else
+#define VM_OP(name) case Op::name:
+#define VM_DISPATCH() continue
+    for (;;) switch (pc->op) {
+#endif
+#define VM_NEXT() { pc++; VM_DISPATCH(); }
+#define VM_JUMP(target) { pc = code + (target); VM_DISPATCH(); }
+
+    VM_OP(Move) r[pc->a] = r[pc->b]; VM_NEXT()
+    VM_OP(LoadInt) r[pc->a] = Value{Value::Kind::Int, int32_t(pc->b)}; VM_NEXT()
+    VM_OP(LoadBool) r[pc->a] = Value{Value::Kind::Bool, int32_t(pc->b)}; VM_NEXT()
+    VM_OP(LoadConst) r[pc->a] = constants[pc->b]; VM_NEXT()
+    VM_OP(LoadVoid) r[pc->a] = Value(); VM_NEXT()
+    VM_OP(GetField) r[pc->a] = r[0].obj->fields[pc->b]; VM_NEXT()
+    VM_OP(SetField) r[0].obj->fields[pc->a] = r[pc->b]; VM_NEXT()
+
+    // Int arithmetic wraps around
+    VM_OP(Add) r[pc->a] = Value{Value::Kind::Int, int32_t(uint32_t(r[pc->b].i) + uint32_t(r[pc->c].i))}; VM_NEXT()
+    VM_OP(Sub) r[pc->a] = Value{Value::Kind::Int, int32_t(uint32_t(r[pc->b].i) - uint32_t(r[pc->c].i))}; VM_NEXT()
+    VM_OP(Mul) r[pc->a] = Value{Value::Kind::Int, int32_t(uint32_t(r[pc->b].i) * uint32_t(r[pc->c].i))}; VM_NEXT()
+    VM_OP(Div) {
+        int32_t left = r[pc->b].i, right = r[pc->c].i;
+        if (right == 0) throw runtime_error(where() + "division by zero");
+        // the only quotient that overflows, it wraps around
+        r[pc->a] = Value{Value::Kind::Int, right == -1 ? int32_t(0u - uint32_t(left)) : left / right};
+        VM_NEXT()
+    }
+    VM_OP(Neg) r[pc->a] = Value{Value::Kind::Int, int32_t(0u - uint32_t(r[pc->b].i))}; VM_NEXT()
+
+    VM_OP(Lt) r[pc->a] = Value{Value::Kind::Bool, r[pc->b].i < r[pc->c].i}; VM_NEXT()
+    VM_OP(Le) r[pc->a] = Value{Value::Kind::Bool, r[pc->b].i <= r[pc->c].i}; VM_NEXT()
+    VM_OP(Eq) {
+        auto& left = r[pc->b];
+        auto& right = r[pc->c];
+        bool equal;
+        if (left.kind == Value::Kind::String && right.kind == Value::Kind::String)
+            equal = left.obj->str == right.obj->str;
+        else if (left.kind == Value::Kind::Int || left.kind == Value::Kind::Bool)
+            equal = left.i == right.i;
+        else
+            equal = left.obj == right.obj;
+        r[pc->a] = Value{Value::Kind::Bool, equal};
+        VM_NEXT()
+    }
+    VM_OP(Not) r[pc->a] = Value{Value::Kind::Bool, r[pc->b].i == 0}; VM_NEXT()
+    VM_OP(IsVoid) r[pc->a] = Value{Value::Kind::Bool, r[pc->b].kind == Value::Kind::Void}; VM_NEXT()
+
+    VM_OP(Jump) VM_JUMP(pc->a)
+    VM_OP(Loop) {
+        if (hot) heat(fn);
+        VM_JUMP(pc->a)
+    }
+    VM_OP(JumpIfFalse) {
+        if (r[pc->a].i == 0) VM_JUMP(pc->b)
+        VM_NEXT()
+    }
+
+    VM_OP(New) {
+        auto value = newObject(pc->b);
+        r = stack.data() + base;
+        r[pc->a] = value;
+        VM_NEXT()
+    }
+    VM_OP(NewSelf) {
+        auto value = newObject(classIndex.at(classOf(r[0])));
+        r = stack.data() + base;
+        r[pc->a] = value;
+        VM_NEXT()
+    }
+
+    VM_OP(Send) {
+        auto& site = sites[pc->c];
+        auto& receiver = r[pc->b];
+        if (receiver.kind == Value::Kind::Void)
+            throw runtime_error(where() + "dispatch to void");
+        auto cls = classOf(receiver);
+        if (cls != site.cls) {
+            auto func = cls->GetFuncFeaturePtr(site.name);
+            if (!func)
+                throw runtime_error(where() + "'" + cls->GetName().Value() + "' has no method '"
+                    + site.name.Str() + "'");
+            site.cls = cls;
+            site.function = methods.at(func);
+        }
+        if (hot) {
+            // the callee was compiled since, call its native code from
+            // now on
+            if (auto entry = natives[site.function].load(memory_order_acquire)) {
+                auto method = functions[site.function].method;
+                site.native = entry;
+                site.args = method->GetArgs().size();
+                site.kind = method->GetType().Sym() == SYM_BOOL ? Value::Kind::Bool : Value::Kind::Int;
+                pc->op = Op::SendNative;
+                VM_DISPATCH();
+            }
+        }
+        // the receiver and the args become the first registers of the
+        // callee
+        auto value = execute(site.function, base + pc->b);
+        r = stack.data() + base;
+        r[pc->a] = value;
+        VM_NEXT()
+    }
+
+    VM_OP(SendNative) {
+        auto& site = sites[pc->c];
+        if (classOf(r[pc->b]) != site.cls) {
+            // another receiver class, or void, dispatch in full again
+            pc->op = Op::Send;
+            VM_DISPATCH();
+        }
+        r[pc->a] = Value{site.kind, callNative(site.native, r + pc->b + 1, site.args)};
+        VM_NEXT()
+    }
+
+    VM_OP(Case) {
+        auto& table = cases[pc->b];
+        auto& value = r[pc->a];
+        if (value.kind == Value::Kind::Void)
+            throw runtime_error(where() + "case on void");
+        auto cls = classOf(value);
+        if (cls != table.cls) {
+            // the branch of the closest ancestor
+            bool found = false;
+            for (auto c = cls; c && !found; c = program->GetClassPtr(c->GetParent().Sym())) {
+                for (auto& branch : table.branches) {
+                    if (branch.first != c) continue;
+                    table.pc = branch.second;
+                    found = true;
+                    break;
+                }
+            }
+            if (!found)
+                throw runtime_error(where() + "no case branch matches '" + cls->GetName().Value() + "'");
+            table.cls = cls;
+        }
+        VM_JUMP(table.pc)
+    }
+
+    // the methods of the builtin classes, see builtin.cpp
+    VM_OP(OutString) out<< r[pc->a].obj->str<< '\n'; VM_NEXT()
+    VM_OP(OutInt) out<< r[pc->a].i<< '\n'; VM_NEXT()
+    // a line without its newline, empty at the end of the input
+    VM_OP(InString) {
+        string line;
+        getline(in, line);
+        auto value = newString(line);
+        r[pc->a] = value;
+        VM_NEXT()
+    }
+    VM_OP(InInt) {
+        string line;
+        getline(in, line);
+        r[pc->a] = Value{Value::Kind::Int, int32_t(strtol(line.c_str(), nullptr, 10))};
+        VM_NEXT()
+    }
+    VM_OP(Length) r[pc->a] = Value{Value::Kind::Int, int32_t(r[pc->b].obj->str.size())}; VM_NEXT()
+    VM_OP(Concat) {
+        auto value = newString(r[pc->b].obj->str + r[pc->c].obj->str);
+        r[pc->a] = value;
+        VM_NEXT()
+    }
+    VM_OP(Substr) {
+        auto& str = r[pc->b].obj->str;
+        int64_t i = r[pc->c].i;
+        int64_t l = r[pc->c + 1].i;
+        if (i < 0 || l < 0 || i + l > int64_t(str.size()))
+            throw runtime_error("substr(" + to_string(i) + ", " + to_string(l)
+                + ") out of range of a String of length " + to_string(str.size()));
+        auto value = newString(str.substr(i, l));
+        r[pc->a] = value;
+        VM_NEXT()
+    }
+    VM_OP(TypeName) {
+        auto value = newString(classOf(r[pc->b])->GetName().Value());
+        r[pc->a] = value;
+        VM_NEXT()
+    }
+    VM_OP(Copy) {
+        // Int, Bool and String values are immutable
+        if (r[pc->b].kind != Value::Kind::Object) {
+            r[pc->a] = r[pc->b];
+            VM_NEXT()
+        }
+        auto obj = alloc(r[pc->b].obj->cls);
+        obj->fields = r[pc->b].obj->fields;
+        r[pc->a] = Value{Value::Kind::Object, 0, obj};
+        VM_NEXT()
+    }
+    VM_OP(Abort)
+        throw runtime_error("abort called from class '" + classOf(r[pc->a])->GetName().Value() + "'");
+    VM_OP(Trap)
+        throw runtime_error("builtin '" + static_cast<repr::LinkBuiltin*>(fn.origins[pc - code])->GetName()
+            + "' is not supported");
+
+    VM_OP(Return) {
+        auto value = r[pc->a];
+        top = savedTop;
+        return value;
+    }
+    }
+
+#undef VM_OP
+#undef VM_DISPATCH
+#undef VM_NEXT
+#undef VM_JUMP
+}
+
+void VM::Run(repr::Program& prog) {
+    program = &prog;
+    compile(prog);
+    auto main = newObject(classIndex.at(prog.GetClassPtr(SYM_MAIN)));
+    auto func = classOf(main)->GetFuncFeaturePtr(SYM_FUNC_MAIN);
+    if (!func) throw runtime_error("no method main in class Main");
+    stack.resize(max<size_t>(stack.size(), 1));
+    stack[0] = main;
+    execute(methods.at(func), 0);
+    out.flush();
+}
+
+void VM::TierUp(uint32_t _threshold, function<void(repr::FuncFeature&)> _hot) {
+    threshold = _threshold;
+    hot = move(_hot);
+}
+
+void VM::Install(const repr::FuncFeature& func, void* entry) {
+    natives.at(methods.at(&func)).store(entry, memory_order_release);
+}
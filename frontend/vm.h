@@ -0,0 +1,220 @@
+//
+// Created by 田地 on 2021/9/3.
+//
+
+#ifndef COOL_VM_H
+#define COOL_VM_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+
+#include "repr.h"
+#include "adt.h"
+#include "symbol.h"
+#include "interp.h"
+
+using namespace std;
+
+namespace cool {
+
+namespace vm {
+
+using interp::Value;
+using interp::Object;
+
+//======================================================================//
+//                              Bytecode                                //
+//======================================================================//
+// X(name), every instruction has the same three operands, a is the
+// destination register unless noted
+#define COOL_VM_OPS(X)\
+    X(Move)         /* r[a] = r[b] */\
+    X(LoadInt)      /* r[a] = Int b */\
+    X(LoadBool)     /* r[a] = Bool b */\
+    X(LoadConst)    /* r[a] = constants[b] */\
+    X(LoadVoid)     /* r[a] = void */\
+    X(GetField)     /* r[a] = self.fields[b] */\
+    X(SetField)     /* self.fields[a] = r[b] */\
+    X(Add)          /* r[a] = r[b] + r[c] */\
+    X(Sub)\
+    X(Mul)\
+    X(Div)\
+    X(Neg)          /* r[a] = ~r[b] */\
+    X(Lt)           /* r[a] = r[b] < r[c] */\
+    X(Le)\
+    X(Eq)\
+    X(Not)          /* r[a] = not r[b] */\
+    X(IsVoid)       /* r[a] = isvoid r[b] */\
+    X(Jump)         /* pc = a */\
+    X(Loop)         /* pc = a, the back-edge of a loop */\
+    X(JumpIfFalse)  /* if not r[a] then pc = b */\
+    X(New)          /* r[a] = new classes[b] */\
+    X(NewSelf)      /* r[a] = new SELF_TYPE */\
+    X(Send)         /* r[a] = r[b].sites[c](r[b+1], ...) */\
+    X(SendNative)   /* a Send patched to the native code of sites[c] */\
+    X(Case)         /* pc = the branch of cases[b] matching r[a] */\
+    X(OutString)    /* print r[a] */\
+    X(OutInt)\
+    X(InString)     /* r[a] = a line read */\
+    X(InInt)\
+    X(Length)       /* r[a] = r[b].length() */\
+    X(Concat)       /* r[a] = r[b].concat(r[c]) */\
+    X(Substr)       /* r[a] = r[b].substr(r[c], r[c+1]) */\
+    X(TypeName)     /* r[a] = r[b].type_name() */\
+    X(Copy)         /* r[a] = r[b].copy() */\
+    X(Abort)        /* throw, r[a].abort() */\
+    X(Trap)         /* throw, the builtin at origin is not supported */\
+    X(Return)       /* return r[a] */
+
+enum class Op : uint8_t {
+#define COOL_VM_OP_ENUM(name) name,
+    COOL_VM_OPS(COOL_VM_OP_ENUM)
+#undef COOL_VM_OP_ENUM
+};
+
+struct Instr {
+    Op op;
+    uint32_t a = 0;
+    uint32_t b = 0;
+    uint32_t c = 0;
+};
+
+// One method, or the field initializers of a class. Register 0 holds
+// self and registers 1..n the args, then come the locals and temporaries.
+struct Function {
+    vector<Instr> code;
+    vector<repr::Expr*> origins; // of every instruction, for errors
+    uint32_t size = 1;           // number of registers
+    repr::FuncFeature* method = nullptr; // nullptr for field initializers
+    uint32_t hotness = 0;        // calls and back-edges taken, see TierUp
+};
+
+//======================================================================//
+//                              VM Class                                //
+//======================================================================//
+// Runs a program that passed SemanticChecking on register bytecode
+// lowered from its AST, a third way beside interp::Interpreter and
+// irgen::LLVMGen. Registers are numbered from the IdAttrs InitSymbolTable
+// left in the symbol table: an arg is 1 + its idx, and the locals of a
+// scope sit above everything live when the scope is entered, at their idx
+// in the scope, NumLocalId of them. Temporaries are taken above those.
+// A call puts the receiver and the args in consecutive registers, which
+// become the first registers of the callee, so nothing is copied.
+// Every call site has an inline cache of the last receiver class and its
+// method. The dispatch loop is threaded with computed goto where the
+// compiler has it, and a switch otherwise.
+// Methods can be tiered up to native code while running, see TierUp. A
+// call site whose callee has native code is patched to call it directly.
+// Objects nothing refers to are freed by a mark-sweep collection whenever
+// the heap has doubled since the last one. The registers of the running
+// functions, the constants and the field defaults are the roots, a value
+// is never held anywhere else while the program runs.
+class VM {
+  private:
+    struct Site {
+        Symbol name;
+        repr::Class* cls = nullptr; // inline cache
+        uint32_t function = 0;
+        // set when patched to SendNative
+        void* native = nullptr;
+        uint32_t args = 0;
+        Value::Kind kind = Value::Kind::Int;
+    };
+
+    struct CaseTable {
+        vector<pair<repr::Class*, uint32_t>> branches; // class, pc
+        repr::Class* cls = nullptr; // inline cache
+        uint32_t pc = 0;
+    };
+
+    struct ClassInfo {
+        repr::Class* cls = nullptr;
+        vector<Value> defaults;  // of every field
+        vector<uint32_t> inits;  // initializer functions, root class first
+    };
+
+    adt::ScopedTableSpecializer<adt::SymbolTable>& stable;
+    ostream& out;
+    istream& in;
+    repr::Program* program = nullptr;
+
+    // set by compile
+    vector<Function> functions;
+    unordered_map<const repr::FuncFeature*, uint32_t> methods;
+    vector<Site> sites;
+    vector<CaseTable> cases;
+    vector<ClassInfo> classes;
+    unordered_map<const repr::Class*, uint32_t> classIndex;
+    vector<Value> constants;
+
+    // the heap is collected before it grows past MinHeap objects
+    static const size_t MinHeap = 1024;
+
+    vector<unique_ptr<Object>> heap;
+    size_t collectAt = MinHeap; // heap size the next collection runs at
+    vector<Value> stack;
+    size_t top = 0; // end of the registers of the running function
+
+    // set by TierUp
+    uint32_t threshold = 0;
+    function<void(repr::FuncFeature&)> hot;
+    vector<atomic<void*>> natives; // entries of the functions, see Install
+
+    void compile(repr::Program& prog);
+
+    Object* alloc(repr::Class* cls);
+    // free the objects the roots don't reach
+    void collect();
+    Value newString(const string& str);
+    Value defaultValue(Symbol type);
+    repr::Class* classOf(const Value& value);
+    Value newObject(uint32_t cls);
+
+    // run function with its registers starting at stack[base], self and
+    // the args already in place
+    Value execute(uint32_t function, size_t base);
+    // count a call or a back-edge of fn
+    void heat(Function& fn);
+    static int32_t callNative(void* entry, const Value* args, uint32_t n);
+
+  public:
+    // the most args a method with native code can take
+    static const uint32_t MaxNativeArgs = 4;
+
+    // out_string and out_int write to _out, in_string and in_int read
+    // from _in
+    explicit VM(adt::ScopedTableSpecializer<adt::SymbolTable>& _stable,
+        ostream& _out = cout, istream& _in = cin);
+    VM(const VM&) = delete;
+    VM& operator=(const VM&) = delete;
+
+    // compile prog and run Main.main, throw runtime_error on an error at
+    // run time, e.g. a dispatch on void
+    void Run(repr::Program& prog);
+    // number of objects on the heap, the unreachable ones not yet freed
+    // included
+    size_t HeapSize() const { return heap.size(); }
+
+    // count the calls and the loop back-edges of every method from now
+    // on, and call _hot with a method once threshold of them were taken.
+    // _hot runs on the thread running the program, between two
+    // instructions of it
+    void TierUp(uint32_t _threshold, function<void(repr::FuncFeature&)> _hot);
+    // calls to func go to entry from now on, rather than to its bytecode.
+    // entry takes self and the args as int32_t and returns the Int or the
+    // Bool, self is always nullptr, so func must not use it. Safe to call
+    // from any thread once func was reported hot
+    void Install(const repr::FuncFeature& func, void* entry);
+};
+
+} // namespace vm
+
+} // namespace cool
+
+#endif //COOL_VM_H
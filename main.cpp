@@ -5,6 +5,7 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <unordered_map>
 
 #include "frontend/diag.h"
 #include "frontend/tokenizer.h"
@@ -13,6 +14,12 @@
 #include "frontend/analysis.h"
 #include "frontend/llvm_gen.h"
 #include "frontend/adt.h"
+#include "frontend/cache.h"
+#include "frontend/profile.h"
+#include "frontend/interp.h"
+#include "frontend/vm.h"
+#include "frontend/tier.h"
+#include "frontend/constant.h"
 
 using namespace std;
 using namespace cool;
@@ -23,11 +30,65 @@ using namespace pass;
 using namespace ana;
 using namespace irgen;
 using namespace adt;
+using namespace cache;
+using namespace profile;
+using namespace interp;
+using namespace vm;
+using namespace tier;
+using namespace constant;
 
-int main() {
-    fstream file;
-    file.open("../main_data", ios::in);
-    assert(file);
+int main(int argc, char* argv[]) {
+    // -O0, -O1, -O2, -O3 or -Os, and -time-passes to report the time
+    // every optimization pass took. -speculate=none, -speculate=profile or
+    // -speculate=guess picks which polymorphic calls get a guarded direct
+    // call, see SpeculateReceivers, profile by default. The output is an
+    // executable linked with the runtime, with -arena the one that never
+    // frees, unless one of
+    //  -S          textual IR, output.ll
+    //  -emit-llvm  bitcode, output.bc
+    //  -c          object file, output.o
+    //  --run       no output, the program is JIT compiled and run
+    //  --interp    no output, the program is interpreted, skipping LLVM
+    //  --vm        no output, the program is run on the bytecode VM
+    //  --tiered    no output, the program is run on the bytecode VM and
+    //              its hot methods are JIT compiled while it runs
+    auto optLevel = LLVMGen::OptLevel::O2;
+    bool timePasses = false;
+    bool arena = false;
+    auto speculation = Speculation::Profile;
+    string emit;
+    const unordered_map<string, Speculation> speculations = {
+        {"-speculate=none", Speculation::None},
+        {"-speculate=profile", Speculation::Profile},
+        {"-speculate=guess", Speculation::Guess},
+    };
+    const unordered_map<string, LLVMGen::OptLevel> optLevels = {
+        {"-O0", LLVMGen::OptLevel::O0},
+        {"-O1", LLVMGen::OptLevel::O1},
+        {"-O2", LLVMGen::OptLevel::O2},
+        {"-O3", LLVMGen::OptLevel::O3},
+        {"-Os", LLVMGen::OptLevel::Os},
+    };
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (optLevels.count(arg)) {
+            optLevel = optLevels.at(arg);
+        } else if (arg == "-time-passes") {
+            timePasses = true;
+        } else if (arg == "-arena") {
+            arena = true;
+        } else if (speculations.count(arg)) {
+            speculation = speculations.at(arg);
+        } else if (arg == "-S" || arg == "-emit-llvm" || arg == "-c" || arg == "--run" || arg == "--interp"
+            || arg == "--vm" || arg == "--tiered") {
+            emit = arg;
+        } else {
+            cerr<< "unknown option "<< arg<< endl;
+            return 1;
+        }
+    }
+
+    auto source = SourceBuffer::Open("../main_data");
 
     Diagnosis diagnosis;
     Tokenizer tokenizer(diagnosis);
@@ -35,13 +96,27 @@ int main() {
         diagnosis.Output(cerr);
         return 0;
     }
-    Parser parser(diagnosis, tokenizer.Tokenize("main_data", file));
+    Parser parser(diagnosis, tokenizer.Tokenize("main_data", *source));
     auto prog = parser.ParseProgram();
     if (!diagnosis.Empty()) {
         diagnosis.Output(cerr);
         return 0;
     }
+    CompileCache compileCache(CACHE_DIR);
     PassContext passContext(diagnosis);
+    // speculate on the receivers from a profile if there is one, cached
+    // classes are keyed on both
+    passContext.Set<Speculation>("speculation", speculation);
+    ifstream profileFile("../main_data" + PROFILE_SUFFIX);
+    if (profileFile) {
+        auto receiverProfile = ReceiverProfile::Read(profileFile);
+        passContext.Set<ReceiverProfile>("receiver_profile", receiverProfile);
+    }
+    // the tiered engine compiles from the checked AST, which classes
+    // reused from the cache skip
+    if (emit != "--tiered")
+        passContext.Set<CompileCache>("compile_cache", compileCache);
+    passContext.EnableParallel();
     PassManager::Refresh();
     PassManager::Register<SemanticChecking>();
     PassManager::Run(prog, passContext);
@@ -49,10 +124,46 @@ int main() {
         diagnosis.Output(cerr);
         return 0;
     }
+    if (emit == "--interp") {
+        Interpreter(*passContext.Get<ScopedTableSpecializer<SymbolTable>>("symbol_table")).Run(*prog);
+        diagnosis.Output(cerr);
+        return 0;
+    }
+    if (emit == "--vm") {
+        VM(*passContext.Get<ScopedTableSpecializer<SymbolTable>>("symbol_table")).Run(*prog);
+        diagnosis.Output(cerr);
+        return 0;
+    }
+    Devirtualize()(prog, passContext);
+    cerr<< "devirtualized "<< passContext.Get<DevirtualizeStats>("devirtualize_stats")->devirtualized
+        << " of "<< passContext.Get<DevirtualizeStats>("devirtualize_stats")->sites<< " call sites"<< endl;
+    if (emit == "--tiered") {
+        TieredEngine engine(*passContext.Get<ScopedTableSpecializer<SymbolTable>>("symbol_table"));
+        engine.Run(*prog);
+        cerr<< "compiled "<< engine.Compiled()<< " methods"<< endl;
+        diagnosis.Output(cerr);
+        return 0;
+    }
+    // speculate on the receivers of the others
+    SpeculateReceivers()(prog, passContext);
+    cerr<< "speculated on "<< passContext.Get<SpeculationStats>("speculation_stats")->speculated
+        << " call sites, "<< passContext.Get<SpeculationStats>("speculation_stats")->profiled<< " from profile"<< endl;
     LLVMGen llvmGen(*passContext.Get<ScopedTableSpecializer<SymbolTable>>("symbol_table"));
+    llvmGen.UseCache(*passContext.Get<CompileCache>("compile_cache"),
+        *passContext.Get<Fingerprints>("fingerprints"),
+        *passContext.Get<CachedClasses>("cached_classes"));
     llvmGen.Visit(*prog);
-    llvmGen.DumpTextualIR("output.ll");
-//    llvmGen.EmitObjectFile("output.o");
+    llvmGen.Optimize(optLevel, timePasses);
+    if (emit == "-S")
+        llvmGen.DumpTextualIR("output.ll");
+    else if (emit == "-emit-llvm")
+        llvmGen.EmitBitcodeFile("output.bc");
+    else if (emit == "-c")
+        llvmGen.EmitObjectFile("output.o");
+    else if (emit == "--run")
+        llvmGen.Run();
+    else
+        llvmGen.EmitExecutable(OUTPUT_EXECUTABLE, arena ? RUNTIME_ARENA_ARCHIVE : RUNTIME_ARCHIVE);
     diagnosis.Output(cerr);
 }
 
@@ -0,0 +1,72 @@
+//
+// Created by 田地 on 2021/9/6.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+
+char* cool_arena_top = NULL;
+char* cool_arena_end = NULL;
+
+// chunks start at a huge page, so that the kernel can back them with some
+#define HUGE_PAGE ((size_t) 2 << 20)
+
+static size_t chunkSize = 0;
+static char* chunkStart = NULL;    // of the current chunk
+static CoolArenaStats stats;        // up to the current chunk, used excluded
+
+static size_t roundUp(size_t size, size_t unit) {
+    return (size + unit - 1) / unit * unit;
+}
+
+static char* newChunk(size_t size) {
+    // over-allocate by a huge page and trim both ends to align
+    size_t mapped = size + HUGE_PAGE;
+    char* ptr = (char*) mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (ptr == MAP_FAILED) {
+        fprintf(stderr, "cool: out of memory allocating a chunk of %zu bytes\n", size);
+        abort();
+    }
+    char* start = (char*) roundUp((size_t) ptr, HUGE_PAGE);
+    if (start > ptr) munmap(ptr, start - ptr);
+    munmap(start + size, ptr + mapped - (start + size));
+#ifdef MADV_HUGEPAGE
+    madvise(start, size, MADV_HUGEPAGE);
+#endif
+    stats.reserved += size;
+    stats.chunks++;
+    return start;
+}
+
+void* cool_arena_alloc(uint64_t size) {
+    if (!chunkSize) {
+        const char* value = getenv("COOL_ARENA_CHUNK");
+        size_t fallback = (size_t) 32 << 20;
+        chunkSize = value ? (size_t) strtoull(value, NULL, 10) : fallback;
+        chunkSize = chunkSize ? roundUp(chunkSize, HUGE_PAGE) : fallback;
+    }
+    if ((size_t) (cool_arena_end - cool_arena_top) >= size) {
+        void* ptr = cool_arena_top;
+        cool_arena_top += size;
+        return ptr;
+    }
+    // the current chunk is kept for the small ones
+    if (size > chunkSize / 4) {
+        stats.used += size;
+        return newChunk(roundUp(size, HUGE_PAGE));
+    }
+    stats.used += cool_arena_top - chunkStart;
+    chunkStart = cool_arena_top = newChunk(chunkSize);
+    cool_arena_end = chunkStart + chunkSize;
+    void* ptr = cool_arena_top;
+    cool_arena_top += size;
+    return ptr;
+}
+
+void cool_arena_stats(CoolArenaStats* out) {
+    *out = stats;
+    out->used += cool_arena_top - chunkStart;
+}
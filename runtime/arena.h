@@ -0,0 +1,45 @@
+//
+// Created by 田地 on 2021/9/6.
+//
+
+#ifndef COOL_ARENA_H
+#define COOL_ARENA_H
+
+#include "stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// An allocator for batch programs that never frees. Objects are carved out
+// of huge page aligned chunks by a pointer bump: generated code bumps
+// cool_arena_top itself as long as it stays below cool_arena_end, and calls
+// mallocool otherwise. Both are NULL while the arena is not in use, so that
+// generated code always ends up in mallocool then.
+//
+// The arena replaces the garbage collector in a runtime built with
+// COOL_ARENA, i.e. the coolrt_arena archive, or once COOL_ALLOC=arena is
+// set in the environment.
+//
+// Environment:
+//  COOL_ARENA_CHUNK  size of a chunk in bytes, 32M by default
+
+extern char* cool_arena_top;
+extern char* cool_arena_end;
+
+typedef struct {
+    uint64_t used;     // bytes handed out
+    uint64_t reserved; // bytes of all chunks
+    uint64_t chunks;
+} CoolArenaStats;
+
+// size bytes of zeroed memory, size is a multiple of 8. Starts a new chunk
+// if the current one is full, objects too large for one get their own.
+void* cool_arena_alloc(uint64_t size);
+void cool_arena_stats(CoolArenaStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COOL_ARENA_H
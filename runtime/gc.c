@@ -0,0 +1,581 @@
+//
+// Created by 田地 on 2021/9/5.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "gc.h"
+#include "runtime.h"
+
+CoolFrame* cool_gc_roots = NULL;
+
+//======================================================================//
+//                               Heap                                   //
+//======================================================================//
+// every object starts with it. Objects are 8 byte aligned, so the size
+// holds the flags in its low 3 bits. A moved object keeps its new address
+// in place of its vtable.
+typedef CoolObjectHeader Header;
+
+enum {
+    MARKED = 1,
+    REMEMBERED = 2, // an old object in the remembered set
+    FORWARDED = 4,  // a nursery object already promoted
+    FLAGS = 7,
+};
+
+typedef struct {
+    void** items;
+    size_t count;
+    size_t capacity;
+} Stack;
+
+static char* nurseryStart = NULL;
+static char* nurseryTop;
+static char* nurseryEnd;
+
+static char* oldStart;
+static char* oldTop;
+static char* oldEnd;
+static char* oldTouched;    // end of what was written since the last major collection
+static size_t nextMajor;    // old space size that triggers a major collection
+static size_t minOldSize;
+
+static Stack remembered;    // old objects that may point into the nursery
+static Stack marking;
+
+// the vtable of every class id, while the old space is moved
+static void*** vtables;
+static size_t vtableCount;
+
+// most threads marking the old space together
+#define MAX_MARK_THREADS 64
+// smaller old spaces are marked by the collecting thread alone
+#define PARALLEL_MARK_MIN ((size_t) 1 << 20)
+
+static CoolGCStats stats;
+
+static size_t align8(size_t size) {
+    return (size + 7) & ~(size_t) 7;
+}
+
+static Header* header(void* obj) {
+    return (Header*) obj;
+}
+
+static void* forwardOf(Header* h) {
+    return (void*) h->vtable;
+}
+
+// bytes the object takes in the heap
+static size_t sizeOf(Header* h) {
+    return h->size & ~(uint32_t) FLAGS;
+}
+
+static int inNursery(void* ptr) {
+    return (char*) ptr >= nurseryStart && (char*) ptr < nurseryEnd;
+}
+
+static int inOld(void* ptr) {
+    return (char*) ptr >= oldStart && (char*) ptr < oldTop;
+}
+
+static size_t sizeFromEnv(const char* name, size_t fallback) {
+    const char* value = getenv(name);
+    if (!value) return fallback;
+    char* end;
+    unsigned long long size = strtoull(value, &end, 10);
+    if (*end == 'K' || *end == 'k') size <<= 10;
+    else if (*end == 'M' || *end == 'm') size <<= 20;
+    else if (*end == 'G' || *end == 'g') size <<= 30;
+    return size ? (size_t) size : fallback;
+}
+
+static char* reserve(size_t size) {
+    // pages are only backed once touched
+    void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+    if (ptr == MAP_FAILED) {
+        fprintf(stderr, "cool: cannot reserve %zu bytes for the heap\n", size);
+        abort();
+    }
+    return (char*) ptr;
+}
+
+static void outOfMemory(size_t size) {
+    fprintf(stderr, "cool: out of memory allocating %zu bytes, %zu bytes live\n",
+        size, (size_t) (oldTop - oldStart));
+    abort();
+}
+
+static unsigned markThreads;
+
+static void init() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    markThreads = (unsigned) sizeFromEnv("COOL_GC_THREADS", cpus > 8 ? 8 : cpus > 0 ? (size_t) cpus : 1);
+    if (markThreads > MAX_MARK_THREADS) markThreads = MAX_MARK_THREADS;
+    size_t nurserySize = align8(sizeFromEnv("COOL_GC_NURSERY", (size_t) 4 << 20));
+    size_t oldSize = align8(sizeFromEnv("COOL_GC_HEAP", (size_t) 4 << 30));
+    nurseryStart = nurseryTop = reserve(nurserySize);
+    nurseryEnd = nurseryStart + nurserySize;
+    oldStart = oldTop = oldTouched = reserve(oldSize);
+    oldEnd = oldStart + oldSize;
+    minOldSize = nextMajor = 4 * nurserySize;
+}
+
+static void push(Stack* stack, void* item) {
+    if (stack->count == stack->capacity) {
+        stack->capacity = stack->capacity ? 2 * stack->capacity : 1024;
+        stack->items = (void**) realloc(stack->items, stack->capacity * sizeof(void*));
+        if (!stack->items) outOfMemory(stack->capacity * sizeof(void*));
+    }
+    stack->items[stack->count++] = item;
+}
+
+// total bytes in the old space, zeroed
+static Header* oldAlloc(size_t total) {
+    if ((size_t) (oldEnd - oldTop) < total) outOfMemory(total);
+    Header* h = (Header*) oldTop;
+    oldTop += total;
+    if (oldTop > oldTouched) oldTouched = oldTop;
+    return h;
+}
+
+static uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// run body on every non-null pointer field of obj, body may replace it.
+// The layout precedes the vtable, an object without one has no fields.
+#define FOR_EACH_FIELD(obj, field, body) FOR_EACH_FIELD_OF(obj, header(obj)->vtable, field, body)
+
+// of an object whose vtable slot holds something else
+#define FOR_EACH_FIELD_OF(obj, vtable, field, body) {\
+    void** vtable_ = (vtable);\
+    const uint32_t* layout_ = vtable_ ? (const uint32_t*) vtable_[-1] : NULL;\
+    if (layout_) {\
+        for (uint32_t i_ = 1; i_ <= layout_[0]; i_++) {\
+            void** field = (void**) ((char*) (obj) + layout_[i_]);\
+            if (*field) body\
+        }\
+    }\
+}
+
+// and on every non-null slot of the shadow stack
+#define FOR_EACH_ROOT(slot, body) {\
+    for (CoolFrame* frame_ = cool_gc_roots; frame_; frame_ = frame_->prev) {\
+        for (uintptr_t i_ = 0; i_ < frame_->count; i_++) {\
+            void** slot = &frame_->roots[i_];\
+            if (*slot) body\
+        }\
+    }\
+}
+
+//======================================================================//
+//                         Minor Collection                             //
+//======================================================================//
+// the address of obj once out of the nursery
+static void* promote(void* obj) {
+    if (!inNursery(obj)) return obj;
+    Header* h = header(obj);
+    if (h->size & FORWARDED) return forwardOf(h);
+    size_t size = sizeOf(h);
+    Header* to = oldAlloc(size);
+    memcpy(to, h, size);
+    h->vtable = (void**) to;
+    h->size |= FORWARDED;
+    stats.promoted += size;
+    return to;
+}
+
+// copy everything reachable in the nursery to the end of the old space,
+// then scan the copies in order like Cheney's algorithm
+static void minor() {
+    size_t used = nurseryTop - nurseryStart;
+    if ((size_t) (oldEnd - oldTop) < used) outOfMemory(used);
+    char* scan = oldTop;
+
+    FOR_EACH_ROOT(slot, { *slot = promote(*slot); })
+    for (size_t i = 0; i < remembered.count; i++) {
+        void* obj = remembered.items[i];
+        header(obj)->size &= ~(uint32_t) REMEMBERED;
+        FOR_EACH_FIELD(obj, field, { *field = promote(*field); })
+    }
+    remembered.count = 0;
+    while (scan < oldTop) {
+        Header* h = (Header*) scan;
+        FOR_EACH_FIELD(h, field, { *field = promote(*field); })
+        scan += sizeOf(h);
+    }
+
+    // allocation hands out zeroed memory without clearing it
+    memset(nurseryStart, 0, used);
+    nurseryTop = nurseryStart;
+    stats.minor++;
+}
+
+//======================================================================//
+//                           Parallel Marking                           //
+//======================================================================//
+// Every marking thread owns a Chase-Lev deque of grey objects, see "Correct
+// and Efficient Work-Stealing for Weak Memory Models", Le et al. The owner
+// pushes and pops at the bottom, the others steal from the top once their
+// own deque ran dry. Marking is over when all of them are idle with every
+// deque empty.
+typedef struct Buffer {
+    int64_t capacity;       // a power of 2
+    struct Buffer* retired; // smaller buffers of the deque, freed after marking
+    _Atomic(void*) items[];
+} Buffer;
+
+typedef struct {
+    _Atomic int64_t top;
+    _Atomic int64_t bottom;
+    _Atomic(Buffer*) buffer;
+    uint64_t steals;
+    unsigned seed;
+} Deque;
+
+// apart, so that the threads do not share cache lines
+typedef struct {
+    Deque deque;
+    char pad[64 - sizeof(Deque) % 64];
+} Marker;
+
+static Marker markers[MAX_MARK_THREADS];
+static unsigned activeMarkers;
+static atomic_uint idleMarkers;
+
+static pthread_t helpers[MAX_MARK_THREADS];
+static unsigned helperCount;
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t poolWake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t poolDone = PTHREAD_COND_INITIALIZER;
+static uint64_t generation; // of marking, bumped to wake the helpers
+static unsigned running;    // helpers still marking
+
+static Buffer* newBuffer(int64_t capacity) {
+    Buffer* buffer = (Buffer*) malloc(sizeof(Buffer) + capacity * sizeof(void*));
+    if (!buffer) outOfMemory(capacity * sizeof(void*));
+    buffer->capacity = capacity;
+    buffer->retired = NULL;
+    return buffer;
+}
+
+static void dequePush(Deque* q, void* obj) {
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&q->top, memory_order_acquire);
+    Buffer* buffer = atomic_load_explicit(&q->buffer, memory_order_relaxed);
+    if (b - t > buffer->capacity - 1) {
+        Buffer* bigger = newBuffer(2 * buffer->capacity);
+        for (int64_t i = t; i < b; i++) {
+            void* item = atomic_load_explicit(&buffer->items[i & (buffer->capacity - 1)], memory_order_relaxed);
+            atomic_store_explicit(&bigger->items[i & (bigger->capacity - 1)], item, memory_order_relaxed);
+        }
+        // a thief may still read the old one
+        bigger->retired = buffer;
+        atomic_store_explicit(&q->buffer, bigger, memory_order_release);
+        buffer = bigger;
+    }
+    atomic_store_explicit(&buffer->items[b & (buffer->capacity - 1)], obj, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+}
+
+static void* dequePop(Deque* q) {
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+    Buffer* buffer = atomic_load_explicit(&q->buffer, memory_order_relaxed);
+    atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t t = atomic_load_explicit(&q->top, memory_order_relaxed);
+    if (t > b) {
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+    void* obj = atomic_load_explicit(&buffer->items[b & (buffer->capacity - 1)], memory_order_relaxed);
+    if (t == b) {
+        // the last one, a thief may be after it too
+        if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+            memory_order_seq_cst, memory_order_relaxed))
+            obj = NULL;
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+    }
+    return obj;
+}
+
+// NULL if q is empty or another thread got there first
+static void* dequeSteal(Deque* q) {
+    int64_t t = atomic_load_explicit(&q->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+    if (t >= b) return NULL;
+    Buffer* buffer = atomic_load_explicit(&q->buffer, memory_order_acquire);
+    void* obj = atomic_load_explicit(&buffer->items[t & (buffer->capacity - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+        memory_order_seq_cst, memory_order_relaxed))
+        return NULL;
+    return obj;
+}
+
+static int dequeEmpty(Deque* q) {
+    return atomic_load_explicit(&q->bottom, memory_order_acquire)
+        <= atomic_load_explicit(&q->top, memory_order_acquire);
+}
+
+static void markShared(Deque* q, void* obj) {
+    if (!inOld(obj)) return;
+    Header* h = header(obj);
+    if (__atomic_load_n(&h->size, __ATOMIC_RELAXED) & MARKED) return;
+    if (__atomic_fetch_or(&h->size, (uint32_t) MARKED, __ATOMIC_RELAXED) & MARKED) return;
+    dequePush(q, obj);
+}
+
+static void* stealFor(Deque* q) {
+    unsigned start = q->seed = q->seed * 1103515245u + 12345u;
+    for (unsigned i = 0; i < activeMarkers; i++) {
+        Deque* victim = &markers[(start + i) % activeMarkers].deque;
+        if (victim == q) continue;
+        void* obj = dequeSteal(victim);
+        if (obj) {
+            q->steals++;
+            return obj;
+        }
+    }
+    return NULL;
+}
+
+// whether every marker is out of work, otherwise there is some to steal
+static int terminate(void) {
+    atomic_fetch_add(&idleMarkers, 1);
+    for (;;) {
+        if (atomic_load(&idleMarkers) == activeMarkers) return 1;
+        for (unsigned i = 0; i < activeMarkers; i++) {
+            if (!dequeEmpty(&markers[i].deque)) {
+                atomic_fetch_sub(&idleMarkers, 1);
+                return 0;
+            }
+        }
+        sched_yield();
+    }
+}
+
+static void drain(Deque* q) {
+    for (;;) {
+        void* obj;
+        while ((obj = dequePop(q)) || (obj = stealFor(q)))
+            FOR_EACH_FIELD(obj, field, { markShared(q, *field); })
+        if (terminate()) return;
+    }
+}
+
+static void* helper(void* arg) {
+    unsigned index = (unsigned) (uintptr_t) arg;
+    uint64_t seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&poolLock);
+        while (generation == seen) pthread_cond_wait(&poolWake, &poolLock);
+        seen = generation;
+        int active = index < activeMarkers;
+        pthread_mutex_unlock(&poolLock);
+        if (!active) continue;
+
+        drain(&markers[index].deque);
+
+        pthread_mutex_lock(&poolLock);
+        if (--running == 0) pthread_cond_signal(&poolDone);
+        pthread_mutex_unlock(&poolLock);
+    }
+    return NULL;
+}
+
+// mark with threads, the collecting one included. Fewer mark if no more
+// helpers could be started.
+static void markParallel(unsigned threads) {
+    while (helperCount + 1 < threads) {
+        unsigned index = helperCount + 1;
+        if (!markers[index].deque.buffer) markers[index].deque.buffer = newBuffer(1024);
+        if (pthread_create(&helpers[helperCount], NULL, helper, (void*) (uintptr_t) index)) break;
+        pthread_detach(helpers[helperCount++]);
+    }
+    if (!markers[0].deque.buffer) markers[0].deque.buffer = newBuffer(1024);
+    unsigned active = threads < helperCount + 1 ? threads : helperCount + 1;
+
+    // the roots are spread over the deques, the rest is left to stealing
+    unsigned next = 0;
+    FOR_EACH_ROOT(slot, { markShared(&markers[next++ % active].deque, *slot); })
+    atomic_store(&idleMarkers, 0);
+
+    // a helper takes part if it is active in the generation it wakes up to
+    pthread_mutex_lock(&poolLock);
+    activeMarkers = active;
+    running = active - 1;
+    generation++;
+    pthread_cond_broadcast(&poolWake);
+    pthread_mutex_unlock(&poolLock);
+
+    drain(&markers[0].deque);
+
+    pthread_mutex_lock(&poolLock);
+    while (running) pthread_cond_wait(&poolDone, &poolLock);
+    pthread_mutex_unlock(&poolLock);
+
+    for (unsigned i = 0; i < activeMarkers; i++) {
+        Deque* q = &markers[i].deque;
+        stats.steals += q->steals;
+        q->steals = 0;
+        Buffer* buffer = atomic_load(&q->buffer);
+        while (buffer->retired) {
+            Buffer* retired = buffer->retired;
+            buffer->retired = retired->retired;
+            free(retired);
+        }
+    }
+}
+
+//======================================================================//
+//                         Major Collection                             //
+//======================================================================//
+static void mark(void* obj) {
+    if (!inOld(obj)) return;
+    Header* h = header(obj);
+    if (h->size & MARKED) return;
+    h->size |= MARKED;
+    push(&marking, obj);
+}
+
+// remember the vtable of the class of h before it is overwritten. All
+// objects of a class share one vtable.
+static void saveVTable(Header* h) {
+    if (h->classId >= vtableCount) {
+        size_t count = vtableCount ? vtableCount : 64;
+        while (count <= h->classId) count *= 2;
+        vtables = (void***) realloc(vtables, count * sizeof(void**));
+        if (!vtables) outOfMemory(count * sizeof(void**));
+        memset(vtables + vtableCount, 0, (count - vtableCount) * sizeof(void**));
+        vtableCount = count;
+    }
+    vtables[h->classId] = h->vtable;
+}
+
+// the address of a marked obj once compacted
+static void* compacted(void* obj) {
+    return inOld(obj) ? forwardOf(header(obj)) : obj;
+}
+
+// Lisp-2 style, with the nursery empty: mark, compute the new address of
+// every marked object, update the pointers to them, then slide them down
+static void major() {
+    uint64_t start = now();
+    if (markThreads > 1 && (size_t) (oldTop - oldStart) >= PARALLEL_MARK_MIN) {
+        markParallel(markThreads);
+    } else {
+        FOR_EACH_ROOT(slot, { mark(*slot); })
+        while (marking.count) {
+            void* obj = marking.items[--marking.count];
+            FOR_EACH_FIELD(obj, field, { mark(*field); })
+        }
+    }
+    stats.markNs += now() - start;
+
+    // no flag but MARKED is set, the remembered set went with the nursery.
+    // The new address of a marked object takes the place of its vtable.
+    char* to = oldStart;
+    for (char* p = oldStart; p < oldTop; p += sizeOf((Header*) p)) {
+        Header* h = (Header*) p;
+        if (!(h->size & MARKED)) continue;
+        saveVTable(h);
+        h->vtable = (void**) to;
+        to += sizeOf(h);
+    }
+
+    FOR_EACH_ROOT(slot, { *slot = compacted(*slot); })
+    for (char* p = oldStart; p < oldTop; p += sizeOf((Header*) p)) {
+        Header* h = (Header*) p;
+        if (h->size & MARKED)
+            FOR_EACH_FIELD_OF(h, vtables[h->classId], field, { *field = compacted(*field); })
+    }
+
+    char* p = oldStart;
+    while (p < oldTop) {
+        Header* h = (Header*) p;
+        size_t size = sizeOf(h);
+        if (h->size & MARKED) {
+            Header* dest = (Header*) forwardOf(h);
+            memmove(dest, h, size);
+            dest->vtable = vtables[dest->classId];
+            dest->size = (uint32_t) size;
+        }
+        p += size;
+    }
+    oldTop = to;
+
+    // everything above oldTop must read as zero again, the whole pages
+    // are given back to the system
+    size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    char* page = oldStart + ((size_t) (oldTop - oldStart) + pageSize - 1) / pageSize * pageSize;
+    if (page > oldTouched) page = oldTouched;
+    memset(oldTop, 0, page - oldTop);
+    if (page < oldTouched) madvise(page, oldTouched - page, MADV_DONTNEED);
+    oldTouched = oldTop;
+
+    size_t live = oldTop - oldStart;
+    nextMajor = 2 * live > minOldSize ? 2 * live : minOldSize;
+    stats.major++;
+}
+
+//======================================================================//
+//                              Interface                               //
+//======================================================================//
+void cool_gc_collect(int full) {
+    if (!nurseryStart) init();
+    uint64_t start = now();
+    minor();
+    if (full || (size_t) (oldTop - oldStart) > nextMajor) major();
+    uint64_t pause = now() - start;
+    stats.pauseNs += pause;
+    if (pause > stats.maxPauseNs) stats.maxPauseNs = pause;
+}
+
+void* cool_gc_alloc(uint64_t size) {
+    if (!nurseryStart) init();
+    size_t total = align8(size);
+    Header* h;
+    if (total > (size_t) (nurseryEnd - nurseryStart) / 4) {
+        // large objects are never copied
+        if ((size_t) (oldTop - oldStart) + total > nextMajor) cool_gc_collect(1);
+        h = oldAlloc(total);
+    } else {
+        if ((size_t) (nurseryEnd - nurseryTop) < total) cool_gc_collect(0);
+        h = (Header*) nurseryTop;
+        nurseryTop += total;
+    }
+    h->size = (uint32_t) total;
+    return h;
+}
+
+void cool_gc_write_barrier(void* obj, void* value) {
+    if (!value || !inNursery(value) || inNursery(obj)) return;
+    Header* h = header(obj);
+    if (h->size & REMEMBERED) return;
+    h->size |= REMEMBERED;
+    push(&remembered, obj);
+}
+
+void cool_gc_set_threads(unsigned threads) {
+    if (!nurseryStart) init();
+    markThreads = threads < 1 ? 1 : threads > MAX_MARK_THREADS ? MAX_MARK_THREADS : threads;
+}
+
+void cool_gc_stats(CoolGCStats* out) {
+    *out = stats;
+    out->oldUsed = nurseryStart ? (uint64_t) (oldTop - oldStart) : 0;
+}
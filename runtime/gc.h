@@ -0,0 +1,77 @@
+//
+// Created by 田地 on 2021/9/5.
+//
+
+#ifndef COOL_GC_H
+#define COOL_GC_H
+
+#include "stddef.h"
+#include "stdint.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A precise generational collector. Objects are allocated by a pointer
+// bump in the nursery, survivors of a minor collection are promoted to the
+// old space all at once, and the old space is collected by mark-compact
+// once it grew to twice what was live after its last collection. Large old
+// spaces are marked by several threads, stealing work from each other.
+//
+// Every object starts with a CoolObjectHeader, see runtime.h. The flags of
+// the collector are kept in the low bits of its size, the address an
+// object moves to in its vtable slot, so all objects of a class id must
+// share one vtable. The vtable of an object is preceded by its layout:
+// layout[0] is the number of pointer fields of the object, layout[1..] are
+// their offsets in bytes. NULL means no pointer fields, e.g. a String.
+// Objects outside the heap, e.g. the names of classes, are left alone.
+//
+// The roots are the slots of the frames on the shadow stack. Pointers
+// stored into objects go through cool_gc_write_barrier, so that the old
+// objects pointing into the nursery are known at a minor collection.
+//
+// Environment:
+//  COOL_GC_NURSERY  size of the nursery in bytes, 4M by default
+//  COOL_GC_HEAP     most bytes the old space may take, 4G by default
+//  COOL_GC_THREADS  threads marking the old space, the number of CPUs up
+//                   to 8 by default
+
+// the frame of a function on the shadow stack, pushed on entry and popped
+// on return. A slot holds a pointer to an object or NULL.
+typedef struct CoolFrame {
+    struct CoolFrame* prev;
+    uintptr_t count; // of roots
+    void* roots[];
+} CoolFrame;
+
+// the innermost frame
+extern CoolFrame* cool_gc_roots;
+
+typedef struct {
+    uint64_t minor;      // collections of the nursery
+    uint64_t major;      // collections of the old space
+    uint64_t promoted;   // bytes moved out of the nursery
+    uint64_t oldUsed;    // bytes taken in the old space
+    uint64_t pauseNs;    // time spent collecting
+    uint64_t maxPauseNs; // of a single collection
+    uint64_t markNs;     // time spent marking the old space
+    uint64_t steals;     // grey objects a marking thread took from another
+} CoolGCStats;
+
+// size bytes of zeroed memory for an object of size bytes, the header
+// included, never NULL, aborts if the heap is full. The size of the header
+// is set, the caller sets the rest before the next allocation.
+void* cool_gc_alloc(uint64_t size);
+// value was just stored into a field of obj
+void cool_gc_write_barrier(void* obj, void* value);
+// collect the nursery, and the old space too if major
+void cool_gc_collect(int major);
+// mark the old space with threads from the next major collection on
+void cool_gc_set_threads(unsigned threads);
+void cool_gc_stats(CoolGCStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //COOL_GC_H
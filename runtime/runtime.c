@@ -4,18 +4,26 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "runtime.h"
+#include "gc.h"
+#include "arena.h"
 
-void start() {
-//    printf("hello cool!");
-    coolmain();
-}
+// whether objects come from the arena rather than the collector
+#ifdef COOL_ARENA
+static int arena = 1;
+#else
+static int arena = -1; // COOL_ALLOC is read on the first allocation
+#endif
 
 void* mallocool(uint64_t size) {
-    void* ptr = malloc(size);
-//    printf("%llu, %p\n", size, ptr);
-    return ptr;
+    if (arena < 0) {
+        const char* alloc = getenv("COOL_ALLOC");
+        arena = alloc && strcmp(alloc, "arena") == 0;
+    }
+    if (arena) return cool_arena_alloc((size + 7) & ~(uint64_t) 7);
+    return cool_gc_alloc(size);
 }
 
 void out_int(int32_t i) {
@@ -27,10 +35,64 @@ void out_string( char* str) {
     printf("%s\n", str);
 }
 
+void cool_case_abort(int64_t classId) {
+    fflush(stdout);
+    if (classId < 0)
+        fprintf(stderr, "case on void\n");
+    else
+        fprintf(stderr, "no case branch matches class id %lld\n", (long long) classId);
+    exit(1);
+}
+
+int32_t in_int(void) {
+    char line[1024];
+    if (!fgets(line, sizeof(line), stdin)) return 0;
+    // the rest of a longer line goes too
+    if (!strchr(line, '\n')) {
+        int c;
+        while ((c = getchar()) != EOF && c != '\n') {}
+    }
+    return (int32_t) strtol(line, NULL, 10);
+}
+
+void cool_abort(void) {
+    fflush(stdout);
+    fprintf(stderr, "abort called\n");
+    exit(1);
+}
+
+void* cool_copy(void* obj) {
+    // obj may move while the copy is allocated
+    void* frame[3] = {cool_gc_roots, (void*) 1, obj};
+    cool_gc_roots = (CoolFrame*) frame;
+    // the collector keeps its flags in the low bits of the size
+    uint32_t size = ((CoolObjectHeader*) obj)->size & ~(uint32_t) 7;
+    CoolObjectHeader* copy = (CoolObjectHeader*) mallocool(size);
+    cool_gc_roots = (CoolFrame*) frame[0];
+    memcpy(copy, frame[2], size);
+    copy->size = size;
+
+    // a large copy starts out old, its fields may point into the nursery
+    const uint32_t* layout = copy->vtable ? (const uint32_t*) copy->vtable[-1] : NULL;
+    if (layout) {
+        for (uint32_t i = 1; i <= layout[0]; i++)
+            cool_gc_write_barrier(copy, *(void**) ((char*) copy + layout[i]));
+    }
+    return copy;
+}
+
 void print_ptr(void* ptr) {
     printf("print_ptr: %p\n", ptr);
 }
 
+// the JIT of the compiler calls coolmain itself, see LLVMGen::Run
+#ifndef COOL_RUNTIME_NO_MAIN
+void start() {
+//    printf("hello cool!");
+    coolmain();
+}
+
 int main() {
     start();
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
@@ -8,25 +8,51 @@
 #include "stddef.h"
 #include "stdint.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void coolmain();
 
 // program entry point
 void start();
 
-// todo: object layout
-//struct Object {
-//    uint32_t gcTag;
-//    uint32_t classTag;
-//    uint32_t size;
-//    void*    data;
-//};
-
+// the header every object starts with, its fields follow it. A String
+// is followed by its length and its chars, an Int or a Bool bound to an
+// object type by its value in a box. The ids of a class and its subclasses
+// are consecutive, the class' own first, so a test against a class is a
+// range check. The collector keeps its state in the header too, see gc.h.
+typedef struct {
+    uint32_t classId;
+    uint32_t size;   // of the object in bytes, the header included, a multiple of 8
+    void**   vtable; // vtable[-1] is the layout of the object, see gc.h, vtable[-2] the name of its class
+} CoolObjectHeader;
+
+// size bytes of zeroed memory for an object from the collector, see gc.h,
+// or from the arena, see arena.h. Generated code bumps the arena on its
+// own until a chunk is full.
 void* mallocool(uint64_t size);
 
 void out_int(int32_t);
 void out_string(char*);
+// the Int on the next line of stdin, 0 if there is none
+int32_t in_int(void);
+
+// Object.abort, never returns
+void cool_abort(void);
+
+// Object.copy, a shallow copy of obj
+void* cool_copy(void* obj);
+
+// no branch of a case matches an object of classId, or the object is
+// void if classId is negative. Never returns.
+void cool_case_abort(int64_t classId);
 
 // for debug use only
 void print_ptr(void*);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif //COOL_RUNTIME_H
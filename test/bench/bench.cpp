@@ -0,0 +1,479 @@
+//
+// Created by 田地 on 2021/8/22.
+//
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#include "bench.h"
+#include "../../frontend/tokenizer.h"
+#include "../../frontend/scan.h"
+#include "../../frontend/visitor.h"
+#include "../../frontend/vtable.h"
+#include "../../frontend/adt.h"
+#include "../../frontend/typead.h"
+#include "../../frontend/parser.h"
+#include "../../frontend/pass.h"
+#include "../../frontend/analysis.h"
+#include "../../frontend/interp.h"
+#include "../../frontend/vm.h"
+#include "../../frontend/tier.h"
+#include "../../frontend/llvm_gen.h"
+#include "../../runtime/runtime.h"
+#include "../../runtime/gc.h"
+
+using namespace cool;
+using namespace tok;
+
+namespace {
+
+// the program every tokenizer benchmark scans
+string benchProgram(int classes) {
+    stringstream ss;
+    for (int i = 0; i < classes; i++) {
+        ss<< "class A" << i << " inherits IO {\n"
+          << "    count : Int <- 0;\n"
+          << "    name : String <- \"class \\\"A\\\"\";\n"
+          << "    -- walk until done\n"
+          << "    step(n : Int, flag : Bool) : Int {\n"
+          << "        if not flag then\n"
+          << "            while count < n loop count <- count + 1 pool\n"
+          << "        else\n"
+          << "            let tmp : Int <- n * 2 in { count <- tmp / 2; isvoid self; }\n"
+          << "        fi\n"
+          << "    };\n"
+          << "    kind(o : Object) : String {\n"
+          << "        case o of i : Int => \"int\"; s : String => \"str\"; esac\n"
+          << "    };\n"
+          << "};\n";
+    }
+    return ss.str();
+}
+
+// identifier lexemes of the bench program, keywords included
+vector<string> benchLexemes() {
+    auto src = benchProgram(16);
+    SourceBuffer buf(src);
+    diag::Diagnosis diag;
+    Tokenizer tokenizer(diag);
+    vector<string> lexemes;
+    for (auto& v : tokenizer.Scan("", buf)) {
+        if (v.length > 0 && (isalpha(src[v.offset]) || src[v.offset] == '_'))
+            lexemes.emplace_back(buf.Slice(v.offset, v.length));
+    }
+    return lexemes;
+}
+
+// the hash maps the tokenizer used to look keywords and operators up with
+unordered_map<string, Token::Type> mapKeywords = {
+    {"class", Token::kClass}, {"if", Token::kIf}, {"then", Token::kThen},
+    {"else", Token::kElse}, {"fi", Token::kFi}, {"in", Token::kIn},
+    {"inherits", Token::kInheirits}, {"isvoid", Token::kIsvoid}, {"let", Token::kLet},
+    {"loop", Token::kLoop}, {"pool", Token::kPool}, {"while", Token::kWhile},
+    {"case", Token::kCase}, {"esac", Token::kEsac}, {"new", Token::kNew},
+    {"of", Token::kOf}, {"not", Token::kNot}, {"true", Token::kTrue},
+    {"false", Token::kFalse},
+};
+
+unordered_map<char, Token::Type> mapSpecials = {
+    {':', Token::kColon}, {';', Token::kSemiColon}, {',', Token::kComma},
+    {'.', Token::kDot}, {'~', Token::kNegate}, {'*', Token::kMultiply},
+    {'+', Token::kAdd}, {'-', Token::kMinus}, {'/', Token::kDivide},
+    {'(', Token::kOpenParen}, {')', Token::kCloseParen}, {'{', Token::kOpenBrace},
+    {'}', Token::kCloseBrace},
+};
+
+// the visitor dispatch ExprVisitor used before node kinds: the vtable
+// is rebuilt and copied on every visit and looked up by type_index
+template<typename R>
+class LegacyExprVisitor {
+  private:
+    using Self = LegacyExprVisitor;
+    using VTable = VirtualTable<R, repr::Expr, Self&>;
+
+  public:
+    virtual ~LegacyExprVisitor() = default;
+
+    R Visit(repr::Expr& expr) {
+        VTable vtable = GetVTable();
+        return vtable(expr, *this);
+    }
+
+    virtual R Visit_(repr::Add& expr) = 0;
+    virtual R Visit_(repr::Negate& expr) = 0;
+    virtual R Visit_(repr::Integer& expr) = 0;
+    template<class T>
+    R Visit_(T& expr) { throw runtime_error("unexpected node"); }
+
+  private:
+    #define LEGACY_DISPATCH(Class)\
+        vtable.template SetDispatch<Class>([](repr::Expr& expr, Self& self){\
+            return self.Visit_(static_cast<Class&>(expr));\
+        })
+
+    static VTable GetVTable() {
+        static VTable vtable;
+        LEGACY_DISPATCH(repr::LinkBuiltin);
+        LEGACY_DISPATCH(repr::Assign);
+        LEGACY_DISPATCH(repr::Add);
+        LEGACY_DISPATCH(repr::Block);
+        LEGACY_DISPATCH(repr::Case);
+        LEGACY_DISPATCH(repr::Call);
+        LEGACY_DISPATCH(repr::Divide);
+        LEGACY_DISPATCH(repr::Equal);
+        LEGACY_DISPATCH(repr::False);
+        LEGACY_DISPATCH(repr::ID);
+        LEGACY_DISPATCH(repr::IsVoid);
+        LEGACY_DISPATCH(repr::Integer);
+        LEGACY_DISPATCH(repr::If);
+        LEGACY_DISPATCH(repr::LessThanOrEqual);
+        LEGACY_DISPATCH(repr::LessThan);
+        LEGACY_DISPATCH(repr::Let);
+        LEGACY_DISPATCH(repr::MethodCall);
+        LEGACY_DISPATCH(repr::Multiply);
+        LEGACY_DISPATCH(repr::Minus);
+        LEGACY_DISPATCH(repr::Negate);
+        LEGACY_DISPATCH(repr::New);
+        LEGACY_DISPATCH(repr::Not);
+        LEGACY_DISPATCH(repr::String);
+        LEGACY_DISPATCH(repr::True);
+        LEGACY_DISPATCH(repr::While);
+        return vtable;
+    }
+
+    #undef LEGACY_DISPATCH
+};
+
+// a balanced expression tree of 2^depth leaves
+repr::Expr* benchExpr(repr::AstArena& arena, int depth) {
+    if (depth == 0) return arena.New<repr::Integer>(repr::IntAttr(1));
+    auto expr = arena.New<repr::Add>(benchExpr(arena, depth - 1), benchExpr(arena, depth - 1));
+    if (depth % 3 == 0) return arena.New<repr::Negate>(expr);
+    return expr;
+}
+
+// 2^depth calls deep, straight-line arithmetic and calls only
+string callTreeProgram(int depth) {
+    stringstream ss;
+    ss<< "class Tree {\n";
+    for (int i = 0; i < depth; i++)
+        ss<< "    f" << i << "(x : Int) : Int { f" << i + 1 << "(x + 1) + f" << i + 1 << "(x + 2) };\n";
+    ss<< "    f" << depth << "(x : Int) : Int { x };\n"
+      << "};\n"
+      << "class Main inherits IO {\n"
+      << "    main() : Object { out_int(new Tree.f0(1)) };\n"
+      << "};\n";
+    return ss.str();
+}
+
+// the total number of Collatz steps of 1..n-1, loops and branches
+string collatzProgram(int n) {
+    stringstream ss;
+    ss<< "class Main inherits IO {\n"
+      << "    main() : Object {\n"
+      << "        let i : Int <- 1, x : Int, steps : Int in {\n"
+      << "            while i < " << n << " loop {\n"
+      << "                x <- i;\n"
+      << "                while 1 < x loop {\n"
+      << "                    if x / 2 + x / 2 = x then x <- x / 2 else x <- x + x + x + 1 fi;\n"
+      << "                    steps <- steps + 1;\n"
+      << "                } pool;\n"
+      << "                i <- i + 1;\n"
+      << "            } pool;\n"
+      << "            out_int(steps);\n"
+      << "        }\n"
+      << "    };\n"
+      << "};\n";
+    return ss.str();
+}
+
+// time every engine from the checked AST of src to the end of the run,
+// the JIT prints the result of every iteration to stdout
+void benchEngines(const string& name, const string& src, int iters, bool jit) {
+    stringstream source(src);
+    diag::Diagnosis diag;
+    Tokenizer tokenizer(diag);
+    parser::Parser parser(diag, tokenizer.Tokenize("", source));
+    auto prog = parser.ParseProgram();
+    pass::PassContext ctx(diag);
+    ctx.EnableParallel();
+    pass::PassManager::Refresh();
+    pass::PassManager::Register<ana::SemanticChecking>();
+    pass::PassManager::Run(prog, ctx);
+    assert(diag.Empty());
+    // what the driver does before LLVMGen, the others do not look at it
+    ana::Devirtualize()(prog, ctx);
+    auto& stable = *ctx.Get<adt::ScopedTableSpecializer<adt::SymbolTable>>("symbol_table");
+
+    stringstream interpOut, vmOut;
+    double interpNs = Measure(name + "/interpreter", iters, [&]() {
+        interpOut.str("");
+        interp::Interpreter(stable, interpOut).Run(*prog);
+    });
+    double vmNs = Measure(name + "/bytecode vm", iters, [&]() {
+        vmOut.str("");
+        vm::VM(stable, vmOut).Run(*prog);
+    });
+    assert(interpOut.str() == vmOut.str());
+    cout<< name << " vm speedup: " << interpNs / vmNs << "x over the interpreter" <<endl;
+
+    // compiles in the background while the vm runs, every iteration anew
+    stringstream tieredOut;
+    double tieredNs = Measure(name + "/tiered", iters, [&]() {
+        tieredOut.str("");
+        tier::TieredEngine(stable, tieredOut).Run(*prog);
+    });
+    assert(vmOut.str() == tieredOut.str());
+    cout<< name << " tiered speedup: " << vmNs / tieredNs << "x over the vm" <<endl;
+    if (!jit) return;
+
+    double jitNs = Measure(name + "/llvm jit -O2", iters, [&]() {
+        irgen::LLVMGen llvmGen(stable);
+        llvmGen.Visit(*prog);
+        llvmGen.Optimize(irgen::LLVMGen::OptLevel::O2);
+        llvmGen.Run();
+    });
+    cout<< name << " vm time: " << vmNs / jitNs << "x the jit's" <<endl;
+}
+
+} // namespace
+
+void BenchKeywordLookup() {
+    auto lexemes = benchLexemes();
+    int iters = 200;
+
+    double mapNs = Measure("keyword/unordered_map", iters, [&]() {
+        int n = 0;
+        for (auto& lexeme : lexemes) {
+            string lowerStr = lexeme;
+            transform(lowerStr.begin(), lowerStr.end(), lowerStr.begin(), ::tolower);
+            n += mapKeywords.find(lowerStr) != mapKeywords.end();
+        }
+        DoNotOptimize(n);
+    });
+    double hashNs = Measure("keyword/perfect hash", iters, [&]() {
+        int n = 0;
+        for (auto& lexeme : lexemes)
+            n += LookupKeyword(lexeme.data(), lexeme.size()) != Token::END;
+        DoNotOptimize(n);
+    });
+    cout<< "keyword speedup: " << mapNs / hashNs << "x over " << lexemes.size() << " lexemes" <<endl;
+}
+
+void BenchSpecialLookup() {
+    string chars = ":;,.~*+-/(){}<=@";
+    string input;
+    for (int i = 0; i < 4096; i++) input += chars[i % chars.size()];
+    int iters = 200;
+
+    double mapNs = Measure("special/unordered_map", iters, [&]() {
+        int n = 0;
+        for (char c : input) n += mapSpecials.find(c) != mapSpecials.end();
+        DoNotOptimize(n);
+    });
+    double tableNs = Measure("special/char table", iters, [&]() {
+        int n = 0;
+        for (char c : input) n += LookupSpecial(c) != Token::SKIP;
+        DoNotOptimize(n);
+    });
+    cout<< "special speedup: " << mapNs / tableNs << "x" <<endl;
+}
+
+void BenchScan() {
+    SourceBuffer buf(benchProgram(1000));
+    diag::Diagnosis diag;
+    double ns = Measure("scan", 20, [&]() {
+        Tokenizer tokenizer(diag);
+        DoNotOptimize(tokenizer.Scan("", buf));
+    });
+    cout<< "scan throughput: " << buf.Size() / ns * 1000 << " MB/s" <<endl;
+}
+
+void BenchScanKernels() {
+    // indentation and long comment blocks, the input the kernels are for
+    stringstream ss;
+    for (int i = 0; i < 2000; i++) {
+        ss<< "*" << string(200, '=') << "\n"
+          << " documentation for method_number_" << i << " goes here\n"
+          << string(200, '=') << "*\n"
+          << string(32, ' ') << "-- " << string(120, '-') << "\n"
+          << string(32, ' ') << "a_rather_long_identifier_name_" << i << " <- 1;\n";
+    }
+    SourceBuffer buf(ss.str());
+    diag::Diagnosis diag;
+    auto best = scan::Active();
+
+    scan::Use(scan::Kernel::Scalar);
+    double scalarNs = Measure("scan/scalar kernels", 20, [&]() {
+        Tokenizer tokenizer(diag);
+        DoNotOptimize(tokenizer.Scan("", buf));
+    });
+    scan::Use(best);
+    double simdNs = Measure(best == scan::Kernel::AVX2 ? "scan/avx2 kernels" : "scan/sse2 kernels", 20, [&]() {
+        Tokenizer tokenizer(diag);
+        DoNotOptimize(tokenizer.Scan("", buf));
+    });
+    cout<< "kernel speedup: " << scalarNs / simdNs << "x" <<endl;
+}
+
+void BenchExprVisitor() {
+    class Legacy : public LegacyExprVisitor<int> {
+      public:
+        int Visit_(repr::Add& expr) final { return Visit(*expr.GetLeft()) + Visit(*expr.GetRight()); }
+        int Visit_(repr::Negate& expr) final { return -Visit(*expr.GetExpr()); }
+        int Visit_(repr::Integer& expr) final { return expr.GetValue().Value(); }
+    };
+    class Kind : public visitor::ExprVisitor<int> {
+      public:
+        int Visit_(repr::Add& expr) final { return Visit(*expr.GetLeft()) + Visit(*expr.GetRight()); }
+        int Visit_(repr::Negate& expr) final { return -Visit(*expr.GetExpr()); }
+        int Visit_(repr::Integer& expr) final { return expr.GetValue().Value(); }
+    };
+
+    repr::AstArena arena;
+    auto expr = benchExpr(arena, 16);
+    Legacy legacy;
+    Kind kind;
+    assert(legacy.Visit(*expr) == kind.Visit(*expr));
+
+    double legacyNs = Measure("visit/typeid vtable", 3, [&]() { DoNotOptimize(legacy.Visit(*expr)); });
+    double kindNs = Measure("visit/kind switch", 3, [&]() { DoNotOptimize(kind.Visit(*expr)); });
+    cout<< "visitor speedup: " << legacyNs / kindNs << "x" <<endl;
+}
+
+void BenchSymbolLookup() {
+    // a method body nested a few scopes deep, looking up fields of its class
+    const int depth = 8, width = 16;
+    vector<string> names;
+    for (int i = 0; i < depth * width; i++) names.emplace_back("identifier_name_" + to_string(i));
+
+    vector<unordered_map<string, shared_ptr<attr::IdAttr>>> legacy(depth);
+    adt::ScopedTableSpecializer<adt::SymbolTable> stable;
+    for (int d = 0; d < depth; d++) {
+        stable.NewScope(nullptr);
+        for (int i = d * width; i < (d + 1) * width; i++) {
+            attr::IdAttr attr{attr::IdAttr::Field, i, names.at(i), "Int"};
+            legacy.at(d).insert({names.at(i), make_shared<attr::IdAttr>(attr)});
+            stable.Insert(attr);
+        }
+    }
+    vector<Symbol> syms(names.begin(), names.end());
+
+    auto legacyLookup = [&](const string& name) -> shared_ptr<attr::IdAttr> {
+        for (int d = depth - 1; d >= 0; d--) {
+            auto it = legacy.at(d).find(name);
+            if (it != legacy.at(d).end()) return it->second;
+        }
+        return nullptr;
+    };
+
+    double legacyNs = Measure("lookup/scope maps", 100000, [&]() {
+        for (auto& name : names) DoNotOptimize(legacyLookup(name));
+    });
+    double symNs = Measure("lookup/flat table", 100000, [&]() {
+        for (auto sym : syms) DoNotOptimize(stable.GetIdAttr(sym));
+    });
+    cout<< "lookup speedup: " << legacyNs / symNs << "x" <<endl;
+}
+
+void BenchTypeAdvisor() {
+    // a 500 deep chain, the worst case for walking parent pointers
+    const int depth = 500;
+    type::TypeAdvisor typeAd(new repr::Class({"Object"}, {""}, {}, {}));
+    vector<Symbol> chain = {"Object"};
+    for (int i = 0; i < depth; i++) {
+        chain.emplace_back("Chain" + to_string(i));
+        typeAd.AddType(new repr::Class({chain.back().Str()}, {chain.at(i).Str()}, {}, {}));
+    }
+    typeAd.BuildIndex();
+
+    // what Conforms used to do: walk up from the left type
+    auto walk = [&](Symbol left, Symbol right) {
+        bool found = false;
+        typeAd.BottomUpVisit(left, [&](repr::Class* cls) { return found = cls->GetName().Sym() == right; });
+        return found;
+    };
+    assert(walk(chain.back(), chain.at(1)) && typeAd.Conforms(chain.back(), chain.at(1), chain.back()));
+
+    double walkNs = Measure("conforms/parent walk", 10000, [&]() {
+        DoNotOptimize(walk(chain.back(), chain.at(1)));
+    });
+    double indexNs = Measure("conforms/pre-post", 10000, [&]() {
+        DoNotOptimize(typeAd.Conforms(chain.back(), chain.at(1), chain.back()));
+    });
+    Measure("lca/sparse table", 10000, [&]() {
+        DoNotOptimize(typeAd.LeastCommonAncestor(chain.back(), chain.at(depth / 2)));
+    });
+    cout<< "conforms speedup: " << walkNs / indexNs << "x" <<endl;
+}
+
+void BenchEngines() {
+    benchEngines("call tree", callTreeProgram(22), 3, true);
+    benchEngines("collatz", collatzProgram(30000), 3, true);
+}
+
+void BenchParallelMark() {
+    struct Node {
+        CoolObjectHeader header;
+        Node* left;
+        Node* right;
+        int64_t key;
+    };
+    static const uint32_t layout[] = {2, offsetof(Node, left), offsetof(Node, right)};
+    static void* vtable[] = {(void*) layout};
+
+    // a search tree of 1M random keys, some 48M bytes of old space
+    void* frame[4] = {cool_gc_roots, reinterpret_cast<void*>(2), nullptr, nullptr};
+    cool_gc_roots = reinterpret_cast<CoolFrame*>(frame);
+    auto& tree = reinterpret_cast<Node*&>(frame[2]);
+    auto& fresh = reinterpret_cast<Node*&>(frame[3]);
+    uint64_t seed = 42;
+    for (int i = 0; i < 1 << 20; i++) {
+        fresh = static_cast<Node*>(cool_gc_alloc(sizeof(Node)));
+        fresh->header.vtable = vtable + 1;
+        seed = seed * 6364136223846793005u + 1442695040888963407u;
+        fresh->key = int64_t(seed >> 40);
+        Node** link = &tree;
+        Node* parent = nullptr;
+        while (*link) {
+            parent = *link;
+            link = fresh->key < parent->key ? &parent->left : &parent->right;
+        }
+        *link = fresh;
+        if (parent) cool_gc_write_barrier(parent, fresh);
+    }
+    fresh = nullptr;
+    cool_gc_collect(1);
+
+    double serialNs = 0;
+    for (unsigned threads : {1, 2, 4, 8, 16}) {
+        cool_gc_set_threads(threads);
+        CoolGCStats before, after;
+        cool_gc_stats(&before);
+        Measure("major gc/" + to_string(threads) + " threads", 5, [&]() { cool_gc_collect(1); });
+        cool_gc_stats(&after);
+        double markNs = double(after.markNs - before.markNs) / 5;
+        if (threads == 1) serialNs = markNs;
+        cout<< "mark with " << threads << " threads: " << markNs << " ns, " << serialNs / markNs
+            << "x the serial speed, " << (after.steals - before.steals) / 5 << " steals" <<endl;
+    }
+
+    cool_gc_roots = static_cast<CoolFrame*>(frame[0]);
+    cool_gc_collect(1);
+}
+
+int main() {
+    BenchKeywordLookup();
+    BenchSpecialLookup();
+    BenchScan();
+    BenchScanKernels();
+    BenchExprVisitor();
+    BenchSymbolLookup();
+    BenchTypeAdvisor();
+    BenchEngines();
+    BenchParallelMark();
+}
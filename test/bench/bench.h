@@ -0,0 +1,41 @@
+//
+// Created by 田地 on 2021/8/22.
+//
+
+#ifndef COOL_BENCH_H
+#define COOL_BENCH_H
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// run f iters times and print the average time per iteration
+template<class F>
+double Measure(const string& name, int iters, F f) {
+    auto st = chrono::steady_clock::now();
+    for (int i = 0; i < iters; i++) f();
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - st;
+    double perIter = elapsed.count() / iters;
+    cout<< name << ": " << perIter << " ns/iter" <<endl;
+    return perIter;
+}
+
+// keep the optimizer from dropping a benchmarked result
+template<class T>
+void DoNotOptimize(const T& val) {
+    asm volatile("" : : "g"(&val) : "memory");
+}
+
+void BenchKeywordLookup();
+void BenchSpecialLookup();
+void BenchScan();
+void BenchScanKernels();
+void BenchExprVisitor();
+void BenchSymbolLookup();
+void BenchTypeAdvisor();
+void BenchEngines();
+void BenchParallelMark();
+
+#endif //COOL_BENCH_H
@@ -4,13 +4,34 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <tuple>
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
 
 #include "unit.h"
 #include "../frontend/parser.h"
 #include "../frontend/tokenizer.h"
+#include "../frontend/scan.h"
 #include "../frontend/pass.h"
 #include "../frontend/analysis.h"
 #include "../frontend/builtin.h"
+#include "../frontend/typead.h"
+#include "../frontend/adt.h"
+#include "../frontend/cache.h"
+#include "../frontend/parallel.h"
+#include "../frontend/profile.h"
+#include "../frontend/interp.h"
+#include "../frontend/vm.h"
+#include "../frontend/tier.h"
+#include "../frontend/llvm_gen.h"
+#include "../frontend/constant.h"
+#include "../runtime/runtime.h"
+#include "../runtime/gc.h"
+#include "../runtime/arena.h"
 
 using namespace std;
 
@@ -37,6 +58,51 @@ void TestProgram() {
     assert(!prog.GetClassPtr(cls1.GetName().Value()));
 }
 
+void TestAstArena() {
+    auto arena = make_shared<AstArena>();
+    auto cls = arena->New<Class>(StringAttr("A"), StringAttr("Object"),
+        vector<FuncFeature*>{arena->New<FuncFeature>(StringAttr("f"), StringAttr("Int"),
+            arena->New<Add>(arena->New<Integer>(IntAttr(1)), arena->New<Integer>(IntAttr(2))))},
+        vector<FieldFeature*>{});
+    auto prog = new Program(arena, {}, {cls});
+    size_t parsed = arena->Allocated();
+    assert(parsed > 0);
+
+    // nodes keep their lists in the arena and need no finalizer, only a
+    // class still owns heap memory
+    assert(is_trivially_destructible<Call>::value && is_trivially_destructible<Block>::value);
+    assert(is_trivially_destructible<Let>::value && is_trivially_destructible<Case>::value);
+    assert(is_trivially_destructible<FuncFeature>::value && is_trivially_destructible<LinkBuiltin>::value);
+    assert(!is_trivially_destructible<Class>::value);
+    auto one = arena->New<Integer>(IntAttr(1));
+    size_t before = arena->Allocated();
+    auto block = arena->New<Block>(diag::TextInfo{}, vector<Expr*>{one, one});
+    assert(block->GetExprs().size() == 2 && block->GetExprs().at(1) == one);
+    assert(arena->Allocated() >= before + sizeof(Block) + 2 * sizeof(Expr*));
+    parsed = arena->Allocated();
+
+    // clones are allocated from the current arena
+    {
+        AstArena::Scope scope(prog->GetArena());
+        auto func = cls->GetFuncFeaturePtr("f")->Clone();
+        assert(func != cls->GetFuncFeaturePtr("f"));
+        assert(dynamic_cast<Add*>(func->GetExpr()));
+        assert(arena->Allocated() > parsed);
+    }
+
+    // a cloned program shares the arena, which lives until both are gone
+    auto clone = prog->Clone();
+    assert(&clone->GetArena() == arena.get());
+    assert(clone->GetClassPtr("A") && clone->GetClassPtr("A") != cls);
+    delete prog;
+    assert(clone->GetClassPtr("A")->GetFuncFeaturePtr("f"));
+    delete clone;
+    assert(arena.use_count() == 1);
+
+    arena->Release();
+    assert(arena->Allocated() == 0);
+}
+
 void TestMatchMultiple() {
     Parser parser(testDiag, {
         {Token::ID, "test", "test", 0, 0},
@@ -400,6 +466,8 @@ void TestTokDigit() {
         Tokenizer tokenizer(testDiag);
         auto tok = tokenizer.TokDigit(sstream);
         assert(tok.type == c.tok.type && tok.str == c.tok.str && tok.val == c.tok.val);
+        // the stream is left right after the token
+        assert(string(istreambuf_iterator<char>(sstream), {}) == c.str.substr(tok.str.size()));
     }
 }
 
@@ -537,6 +605,75 @@ void TestTokenizer() {
     }
 }
 
+void TestScan() {
+    string src = "class Main {\n"
+                 "  -- line comment\n"
+                 "  * block\ncomment *\n"
+                 "  s : String <- \"a\\\"b\";\n"
+                 "};";
+    SourceBuffer buf(src);
+    Tokenizer tokenizer(testDiag);
+    auto views = tokenizer.Scan("", buf);
+    assert(views.size() == 11);
+    // views point into the buffer instead of owning a copy
+    assert(views[1].type == Token::TypeID && buf.Slice(views[1].offset, views[1].length) == "Main");
+    // newlines inside comments still advance the line
+    assert(views[3].type == Token::ID && views[3].textInfo.line == 5 && views[3].textInfo.pos == 3);
+    // strings are unescaped on materialization only
+    assert(views[7].type == Token::String && buf.Slice(views[7].offset, views[7].length) == "a\\\"b");
+    assert(Materialize(buf, views[7]).str == "a\"b");
+
+    stringstream sstream(src);
+    Tokenizer streamTokenizer(testDiag);
+    auto toks = streamTokenizer.Tokenize("", sstream);
+    assert(toks.size() == views.size());
+    for (int i = 0; i < toks.size(); i++) {
+        auto tok = Materialize(buf, views[i]);
+        assert(tok.type == toks[i].type && tok.str == toks[i].str && tok.val == toks[i].val);
+    }
+}
+
+void TestScanKernels() {
+    string src;
+    for (int i = 0; i < 300; i++) {
+        src += string(i % 37, ' ') + "\t\n";
+        src += "ident_" + to_string(i) + string(i % 41, 'x');
+        src += "*" + string(i % 53, '-') + "\n*";
+    }
+    auto expect = [&](const char* p) {
+        return make_tuple(scan::SkipSpace(p, src.data() + src.size()),
+                          scan::SkipIdent(p, src.data() + src.size()),
+                          scan::FindByte(p, src.data() + src.size(), '*'),
+                          scan::CountByte(p, src.data() + src.size(), '\n'));
+    };
+
+    auto best = scan::Active();
+    assert(scan::Use(scan::Kernel::Scalar));
+    vector<tuple<const char*, const char*, const char*, size_t>> scalar;
+    for (size_t i = 0; i < src.size(); i++)
+        scalar.emplace_back(expect(src.data() + i));
+    SourceBuffer buf(src);
+    Tokenizer scalarTokenizer(testDiag);
+    auto scalarViews = scalarTokenizer.Scan("", buf);
+
+    for (auto k : {scan::Kernel::SSE2, scan::Kernel::AVX2}) {
+        if (!scan::Use(k)) continue;
+        for (size_t i = 0; i < src.size(); i++)
+            assert(expect(src.data() + i) == scalar[i]);
+        Tokenizer tokenizer(testDiag);
+        auto views = tokenizer.Scan("", buf);
+        assert(views.size() == scalarViews.size());
+        for (int i = 0; i < views.size(); i++) {
+            assert(views[i].type == scalarViews[i].type
+            && views[i].offset == scalarViews[i].offset
+            && views[i].length == scalarViews[i].length
+            && views[i].textInfo.line == scalarViews[i].textInfo.line
+            && views[i].textInfo.pos == scalarViews[i].textInfo.pos);
+        }
+    }
+    scan::Use(best);
+}
+
 void TestRegisterPass() {
     PassManager::Refresh();
     class TestPass : public ProgramPass {
@@ -648,6 +785,982 @@ void TestVirtualTable() {
     }
 }
 
+void TestExprVisitor() {
+    class Visitor : public ExprVisitor<int, int> {
+      public:
+        int Visit_(Add& expr, int depth) final {
+            return max(Visit(*expr.GetLeft(), depth + 1), Visit(*expr.GetRight(), depth + 1));
+        }
+        int Visit_(Negate& expr, int depth) final { return Visit(*expr.GetExpr(), depth + 1); }
+        int Visit_(Integer& expr, int depth) final { return depth; }
+    };
+
+    auto expr = new Add(new Integer(IntAttr(1)), new Negate(new Add(new Integer(IntAttr(2)), new Integer(IntAttr(3)))));
+    assert(expr->GetKind() == Repr::Kind::Add);
+    assert(expr->GetRight()->GetKind() == Repr::Kind::Negate);
+
+    Visitor visitor;
+    assert(visitor.Visit(*expr, 0) == 3);
+}
+
+void TestSymbol() {
+    Symbol empty;
+    assert(empty.Empty() && empty.Id() == 0 && empty.Str().empty());
+    assert(Symbol("") == empty);
+
+    Symbol a = "symbol_a", b = string("symbol_b");
+    auto size = Symbol::PoolSize();
+    assert(Symbol("symbol_a") == a && Symbol(string("symbol_b")) == b);
+    assert(a != b && Symbol::PoolSize() == size);
+    assert(a.Str() == "symbol_a" && b.Str() == "symbol_b");
+
+    // strings stay put while the pool grows past a chunk
+    auto& str = a.Str();
+    for (int i = 0; i < 5000; i++) Symbol("symbol_" + to_string(i));
+    assert(&str == &a.Str() && Symbol("symbol_4999").Str() == "symbol_4999");
+
+    StringAttr attr("symbol_a");
+    assert(attr.Sym() == a && attr.Value() == "symbol_a");
+
+    Class cls = {{"A"}, {"Object"}, {new FuncFeature({"symbol_a"}, {"Int"}, new Integer(IntAttr(1)))}, {}};
+    assert(cls.GetFuncFeaturePtr(a) && !cls.GetFuncFeaturePtr(b));
+}
+
+void TestTypeAdvisor() {
+    // Object
+    // ├── A ── B ── ... (a chain 300 deep)
+    // └── C ── D
+    //     └── E
+    auto newClass = [](const string& name, const string& parent) {
+        return new Class({name}, {parent}, {}, {});
+    };
+    type::TypeAdvisor typeAd(newClass("Object", ""));
+    string parent = "Object";
+    for (int i = 0; i < 300; i++) {
+        string name = "Chain" + to_string(i);
+        typeAd.AddType(newClass(name, parent));
+        parent = name;
+    }
+    typeAd.AddType(newClass("C", "Object"));
+    typeAd.AddType(newClass("D", "C"));
+    typeAd.AddType(newClass("E", "C"));
+    typeAd.BuildIndex();
+
+    assert(typeAd.Conforms("Chain299", "Chain0", "Object"));
+    assert(typeAd.Conforms("Chain299", "Object", "Object"));
+    assert(!typeAd.Conforms("Chain0", "Chain299", "Object"));
+    assert(typeAd.Conforms("D", "D", "Object"));
+    assert(!typeAd.Conforms("D", "E", "Object"));
+    assert(!typeAd.Conforms("D", "Unknown", "Object"));
+    assert(typeAd.Conforms("SELF_TYPE", "C", "D"));
+    assert(!typeAd.Conforms("D", "SELF_TYPE", "D"));
+
+    assert(typeAd.LeastCommonAncestor("D", "E") == Symbol("C"));
+    assert(typeAd.LeastCommonAncestor("E", "C") == Symbol("C"));
+    assert(typeAd.LeastCommonAncestor("Chain299", "Chain150") == Symbol("Chain150"));
+    assert(typeAd.LeastCommonAncestor("Chain299", "D") == Symbol("Object"));
+    assert(typeAd.LeastCommonAncestor("Chain1", "Unknown").Empty());
+
+    // adding a type after the index was built is still seen by queries
+    typeAd.AddType(newClass("F", "D"));
+    assert(typeAd.Conforms("F", "C", "Object"));
+    assert(typeAd.LeastCommonAncestor("F", "E") == Symbol("C"));
+}
+
+void TestSymbolTable() {
+    using namespace adt;
+    ScopedTableSpecializer<SymbolTable> stable;
+
+    // class { x : Int; f(y : Int) { let x : Bool, y : String in ... } }
+    stable.NewScope(nullptr);
+    stable.Insert({IdAttr::Field, 0, "x", "Int"});
+    stable.NewScope(nullptr);
+    stable.Insert({IdAttr::Arg, 0, "y", "Int"});
+    stable.NewScope(nullptr);
+    stable.Insert({IdAttr::Local, stable.Current().NextLocalIdIdx(), "x", "Bool"});
+    stable.Insert({IdAttr::Local, stable.Current().NextLocalIdIdx(), "y", "String"});
+    stable.Insert({IdAttr::Local, stable.Current().NextLocalIdIdx(), "y", "Int"});
+    assert(stable.GetIdAttr("x")->type == Symbol("Bool"));
+    assert(stable.GetIdAttr("y")->type == Symbol("String"));
+    assert(stable.Current().NumLocalId() == 2);
+    assert(!stable.GetIdAttr("z"));
+    stable.FinishScope();
+    assert(stable.GetIdAttr("x")->storageClass == IdAttr::Field);
+    assert(stable.GetIdAttr("y")->storageClass == IdAttr::Arg);
+    stable.FinishScope();
+    assert(!stable.GetIdAttr("y"));
+    stable.FinishScope();
+    assert(!stable.GetIdAttr("x"));
+    assert(stable.NumIdAttr() == 4);
+
+    // later passes replay the same scopes
+    stable.InitTraverse();
+    stable.EnterScope();
+    stable.EnterScope();
+    stable.EnterScope();
+    int inner = stable.IndexOf("x");
+    assert(stable.IdAttrAt(inner).type == Symbol("Bool"));
+    stable.LeaveScope();
+    assert(stable.IndexOf("x") != inner && stable.GetIdAttr("x")->type == Symbol("Int"));
+    stable.InitTraverse();
+    assert(stable.IndexOf("x") == -1);
+}
+
+void TestFingerprint() {
+    using namespace cache;
+    auto parse = [](const string& src) {
+        stringstream sstream(src);
+        Tokenizer tokenizer(testDiag);
+        Parser parser(testDiag, tokenizer.Tokenize("", sstream));
+        auto prog = parser.ParseProgram();
+        assert(testDiag.Empty());
+        return prog;
+    };
+    string a = "class A { x : Int <- 1; f(y : Int) : Int { x + y }; };\n";
+    string b = "class B inherits A { g() : Int { f(2) }; };\n";
+
+    // stable across parses and declaration order
+    auto prog = parse(a + b);
+    auto reordered = parse(b + a);
+    assert(HashClass(*prog->GetClassPtr("A")) == HashClass(*reordered->GetClassPtr("A")));
+    assert(HashClass(*prog->GetClassPtr("B")) == HashClass(*reordered->GetClassPtr("B")));
+    assert(HashClass(*prog->GetClassPtr("A")) != HashClass(*prog->GetClassPtr("B")));
+    assert(HashInterfaces(*prog) == HashInterfaces(*reordered));
+
+    // editing a body only changes its own class
+    auto edited = parse("class A { x : Int <- 1; f(y : Int) : Int { y + x }; };\n" + b);
+    assert(HashClass(*prog->GetClassPtr("A")) != HashClass(*edited->GetClassPtr("A")));
+    assert(HashClass(*prog->GetClassPtr("B")) == HashClass(*edited->GetClassPtr("B")));
+    assert(HashInterfaces(*prog) == HashInterfaces(*edited));
+
+    // editing a signature changes every key
+    auto resigned = parse("class A { x : Int <- 1; f(y : Bool) : Int { x + y }; };\n" + b);
+    assert(HashInterfaces(*prog) != HashInterfaces(*resigned));
+    assert(CompileCache::Key(1, HashInterfaces(*prog)) != CompileCache::Key(1, HashInterfaces(*resigned)));
+
+    // the speculation mode and the receiver profile are part of every key
+    auto fingerprint = [&](profile::Speculation* mode, const string& profileSource) {
+        char cacheDir[] = "/tmp/coolcacheXXXXXX";
+        assert(mkdtemp(cacheDir));
+        CompileCache compileCache(cacheDir);
+        PassContext ctx(testDiag);
+        ctx.Set<CompileCache>("compile_cache", compileCache);
+        if (mode) ctx.Set<profile::Speculation>("speculation", *mode);
+        if (!profileSource.empty()) {
+            stringstream profileStream(profileSource);
+            auto receiverProfile = profile::ReceiverProfile::Read(profileStream);
+            ctx.Set<profile::ReceiverProfile>("receiver_profile", receiverProfile);
+        }
+        FingerprintClasses()(prog, ctx);
+        assert(rmdir(cacheDir) == 0);
+        return ctx.Get<Fingerprints>("fingerprints")->at("A");
+    };
+    auto profileMode = profile::Speculation::Profile, noneMode = profile::Speculation::None;
+    assert(fingerprint(nullptr, "") == fingerprint(&profileMode, ""));
+    assert(fingerprint(nullptr, "") != fingerprint(&noneMode, ""));
+    assert(fingerprint(nullptr, "1:2 A 3\n") != fingerprint(nullptr, ""));
+    assert(fingerprint(nullptr, "1:2 A 3\n") != fingerprint(nullptr, "1:2 A 4\n"));
+    assert(fingerprint(nullptr, "1:2 A 3\n4:5 B 6\n") == fingerprint(nullptr, "4:5 B 6\n1:2 A 3\n"));
+    assert(fingerprint(&noneMode, "1:2 A 3\n") == fingerprint(&noneMode, ""));
+
+    // entries round trip through the disk
+    char dir[] = "/tmp/coolcacheXXXXXX";
+    assert(mkdtemp(dir));
+    {
+        CompileCache compileCache(dir);
+        string blob;
+        assert(!compileCache.Load(1, blob));
+        compileCache.Store(1, string("BC\0\xff", 4));
+        compileCache.Store(1, string("BC\0\xde", 4));
+        assert(compileCache.Load(1, blob) && blob == string("BC\0\xde", 4));
+    }
+    assert(remove((string(dir) + "/0000000000000001.bc").c_str()) == 0);
+    assert(rmdir(dir) == 0);
+
+    // a cached class skips its scope and everything nested in it
+    adt::ScopedTableSpecializer<adt::SymbolTable> stable;
+    stable.NewScope(nullptr);
+    stable.NewScope(nullptr);
+    stable.NewScope(nullptr);
+    stable.FinishScope();
+    stable.FinishScope();
+    stable.NewScope(nullptr);
+    stable.Insert({IdAttr::Field, 0, "z", "Int"});
+    stable.FinishScope();
+    stable.FinishScope();
+    stable.InitTraverse();
+    stable.EnterScope();
+    stable.SkipScope();
+    stable.EnterScope();
+    assert(stable.GetIdAttr("z"));
+    stable.LeaveScope();
+    stable.LeaveScope();
+}
+
+void TestParallelPasses() {
+    {
+        parallel::ThreadPool pool(4);
+        vector<atomic<int>> hits(1000);
+        for (auto& h : hits) h.store(0);
+        pool.ParallelFor(hits.size(), [&](size_t i, size_t worker) {
+            assert(worker < pool.Size());
+            hits[i]++;
+        });
+        for (auto& h : hits) assert(h.load() == 1);
+        bool thrown = false;
+        try {
+            pool.ParallelFor(100, [](size_t i, size_t) {
+                if (i == 42) throw runtime_error("42");
+            });
+        } catch (runtime_error& e) {
+            thrown = string(e.what()) == "42";
+        }
+        assert(thrown);
+    }
+
+    // children declared before their parents, errors in several classes
+    string src =
+        "class C inherits B { c() : Int { b() + true }; x : Int; };\n"
+        "class B inherits A { b() : Int { a() }; d() : Bool { 1 }; };\n"
+        "class A { x : Int <- true; a() : Int { x + \"s\" }; };\n"
+        "class D inherits A { e(y : Int) : Int { let z : Bool <- y in z }; };\n";
+    auto run = [&](size_t jobs) {
+        stringstream sstream(src);
+        Diagnosis diag;
+        Tokenizer tokenizer(diag);
+        Parser parser(diag, tokenizer.Tokenize("", sstream));
+        auto prog = parser.ParseProgram();
+        PassContext ctx(diag);
+        if (jobs) ctx.EnableParallel(jobs);
+        PassManager::Refresh();
+        PassManager::Register<ana::SemanticChecking>();
+        PassManager::Run(prog, ctx);
+        // inherited members are added in the same order either way, Object's
+        // abort, type_name and copy last
+        auto c = prog->GetClassPtr("C");
+        assert(c->GetFuncFeatures().size() == 7 && c->GetFuncFeatures().at(3)->GetName().Value() == "a");
+        assert(c->GetFuncFeatures().back()->GetName().Value() == "copy");
+        stringstream out;
+        diag.Output(out);
+        return out.str();
+    };
+    // the same diagnoses in the same order
+    auto serial = run(0);
+    auto parallel = run(4);
+    assert(!serial.empty());
+    assert(serial == parallel);
+    assert(parallel == run(3) && parallel == run(1));
+}
+
+void TestInheritedFeatures() {
+    string src =
+        "class C inherits B { c() : Int { 3 }; };\n"
+        "class B inherits A { y : Int <- 2; b() : Int { a() }; };\n"
+        "class A { x : Int <- 1; a() : Int { x }; };\n";
+    stringstream sstream(src);
+    Diagnosis diag;
+    Tokenizer tokenizer(diag);
+    Parser parser(diag, tokenizer.Tokenize("", sstream));
+    auto prog = parser.ParseProgram();
+    PassContext ctx(diag);
+    PassManager::Refresh();
+    PassManager::Register<ana::SemanticChecking>();
+    PassManager::Run(prog, ctx);
+    assert(diag.Empty());
+
+    auto a = prog->GetClassPtr("A"), b = prog->GetClassPtr("B"), c = prog->GetClassPtr("C");
+    // inherited features are the ancestor's, not copies
+    assert(c->GetFuncFeaturePtr("a") == a->GetFuncFeaturePtr("a"));
+    assert(c->GetFuncFeaturePtr("b") == b->GetFuncFeaturePtr("b"));
+    assert(c->GetFieldFeaturePtr("x") == a->GetFieldFeaturePtr("x"));
+    assert(c->IsInherited(c->GetFuncFeaturePtr("a")) && !a->IsInherited(a->GetFuncFeaturePtr("a")));
+    assert(c->GetFuncFeaturePtr("b")->GetOwner() == b);
+    assert(c->GetOwnFuncFeatures().size() == 1 && c->GetOwnFieldFeatures().empty());
+    // the parent's layout is a prefix
+    assert(c->GetFieldFeatures().size() == 2 && c->GetFieldFeatures().at(0)->GetName().Value() == "x");
+
+    // a clone only has the class' own features
+    auto clone = c->Clone();
+    assert(clone->GetFuncFeatures().size() == 1 && clone->GetFieldFeatures().empty());
+}
+
+void TestDevirtualize() {
+    string src =
+        "class B inherits A { f() : Int { 3 }; h(a : A, b : B) : Int { a.f() + a.g() + b.f() + f() }; };\n"
+        "class A { f() : Int { 1 }; g() : Int { 2 }; };\n";
+    stringstream sstream(src);
+    Diagnosis diag;
+    Tokenizer tokenizer(diag);
+    Parser parser(diag, tokenizer.Tokenize("", sstream));
+    auto prog = parser.ParseProgram();
+    PassContext ctx(diag);
+    PassManager::Refresh();
+    PassManager::Register<ana::SemanticChecking>();
+    PassManager::Register<ana::Devirtualize>();
+    PassManager::Required<ana::Devirtualize, ana::SemanticChecking>();
+    PassManager::Run(prog, ctx);
+    assert(diag.Empty());
+
+    // only a.f() may reach B's override
+    auto stats = ctx.Get<ana::DevirtualizeStats>("devirtualize_stats");
+    assert(stats->sites == 4);
+    assert(stats->devirtualized == 3);
+}
+
+void TestSpeculateReceivers() {
+    string src =
+        "class A { f() : Int { 1 }; };\n"
+        "class B inherits A { f() : Int { 2 }; };\n"
+        "class C inherits A { f() : Int { 3 }; };\n"
+        "class M { b : A <- new B; c : A <- new B;\n"
+        "g(x : A) : Int { let a : A <- new C in a.f() + x.f() + x.f() }; };\n";
+    stringstream sstream(src);
+    Diagnosis diag;
+    Tokenizer tokenizer(diag);
+    Parser parser(diag, tokenizer.Tokenize("", sstream));
+    auto prog = parser.ParseProgram();
+    // the last call mostly receives a C, and never an Int
+    stringstream profileSource("# line:pos class count\n5:58 C 90\n5:58 B 10\n\n5:58 Int 1000\n");
+    auto receiverProfile = profile::ReceiverProfile::Read(profileSource);
+    PassContext ctx(diag);
+    ctx.Set<profile::ReceiverProfile>("receiver_profile", receiverProfile);
+    PassManager::Refresh();
+    PassManager::Register<ana::SemanticChecking>();
+    PassManager::Register<ana::Devirtualize>();
+    PassManager::Required<ana::Devirtualize, ana::SemanticChecking>();
+    PassManager::Run(prog, ctx);
+    assert(diag.Empty());
+
+    auto body = static_cast<repr::Let*>(prog->GetClassPtr("M")->GetFuncFeaturePtr("g")->GetExpr());
+    auto sum = static_cast<repr::Add*>(body->GetExpr());
+    auto left = static_cast<repr::Add*>(sum->GetLeft());
+    auto speculate = [&](profile::Speculation mode) {
+        for (auto call : {left->GetLeft(), left->GetRight(), sum->GetRight()})
+            static_cast<repr::Call*>(static_cast<repr::MethodCall*>(call)->GetRight())->SetSpeculation(Symbol());
+        ctx.map.erase("speculation");
+        ctx.map.erase("speculation_stats");
+        ctx.Set<profile::Speculation>("speculation", mode);
+        profile::SpeculateReceivers()(prog, ctx);
+        vector<string> guesses;
+        for (auto call : {left->GetLeft(), left->GetRight(), sum->GetRight()})
+            guesses.emplace_back(static_cast<repr::Call*>(static_cast<repr::MethodCall*>(call)->GetRight())->GetSpeculation().Str());
+        return guesses;
+    };
+
+    // by default only the site the profile has
+    assert((speculate(profile::Speculation::Profile) == vector<string>{"", "", "C"}));
+    auto stats = ctx.Get<profile::SpeculationStats>("speculation_stats");
+    assert(stats->speculated == 1 && stats->profiled == 1);
+
+    // a is bound to a C, x is most likely a B since it's allocated the most
+    assert((speculate(profile::Speculation::Guess) == vector<string>{"C", "B", "C"}));
+    stats = ctx.Get<profile::SpeculationStats>("speculation_stats");
+    assert(stats->speculated == 3 && stats->profiled == 1);
+
+    assert((speculate(profile::Speculation::None) == vector<string>{"", "", ""}));
+    assert(ctx.Get<profile::SpeculationStats>("speculation_stats")->speculated == 0);
+
+    bool thrown = false;
+    try {
+        stringstream malformed("5:58 C\n");
+        profile::ReceiverProfile::Read(malformed);
+    } catch (runtime_error& e) {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void TestInterpreter() {
+    string src =
+        "class A { x : Int <- 1; get() : Int { x }; name() : String { \"a\" }; };\n"
+        "class B inherits A { y : Int <- x + 1; get() : Int { y }; name() : String { \"b\" }; };\n"
+        "class Main inherits IO {\n"
+        "    main() : Object {\n"
+        "        let a : A <- new B, i : Int <- 0, s : Int in {\n"
+        "            while i < 5 loop { s <- s + i; i <- i + 1; } pool;\n"
+        "            out_int(s);\n"
+        "            out_int(a.get());\n"
+        "            out_string(a.name());\n"
+        "            case a of o : Object => 0; x : A => out_string(x.name()); esac;\n"
+        "            if isvoid new A then out_int(0) else out_int(a.get() / 2) fi;\n"
+        "            out_int(~3);\n"
+        "        }\n"
+        "    };\n"
+        "};\n";
+    stringstream sstream(src);
+    Diagnosis diag;
+    Tokenizer tokenizer(diag);
+    Parser parser(diag, tokenizer.Tokenize("", sstream));
+    auto prog = parser.ParseProgram();
+    PassContext ctx(diag);
+    PassManager::Refresh();
+    PassManager::Register<ana::SemanticChecking>();
+    PassManager::Run(prog, ctx);
+    assert(diag.Empty());
+
+    stringstream out;
+    interp::Interpreter(*ctx.Get<adt::ScopedTableSpecializer<adt::SymbolTable>>("symbol_table"), out).Run(*prog);
+    assert(out.str() == "10\n2\nb\nb\n1\n-3\n");
+}
+
+void TestVM() {
+    string src =
+        "class A { x : Int <- 1; get() : Int { x }; name() : String { \"a\" }; };\n"
+        "class B inherits A { y : Int <- x + 1; get() : Int { y }; name() : String { \"b\" }; };\n"
+        "class Main inherits IO {\n"
+        "    main() : Object {\n"
+        "        let a : A <- new B, i : Int <- 0, s : Int in {\n"
+        "            while i < 5 loop { s <- s + i; i <- i + 1; } pool;\n"
+        "            out_int(s);\n"
+        "            s <- { 5; s + 1; };\n"
+        "            out_int(s);\n"
+        "            i <- 0;\n"
+        "            while i < 3 loop { out_string(a.name()); a <- new A; i <- i + 1; } pool;\n"
+        "            case a of o : Object => 0; x : A => out_string(x.name()); esac;\n"
+        "            out_int(fib(10));\n"
+        "        }\n"
+        "    };\n"
+        "    fib(n : Int) : Int { if n < 2 then n else fib(n + ~1) + fib(n + ~2) fi };\n"
+        "};\n";
+    stringstream sstream(src);
+    Diagnosis diag;
+    Tokenizer tokenizer(diag);
+    Parser parser(diag, tokenizer.Tokenize("", sstream));
+    auto prog = parser.ParseProgram();
+    PassContext ctx(diag);
+    PassManager::Refresh();
+    PassManager::Register<ana::SemanticChecking>();
+    PassManager::Run(prog, ctx);
+    assert(diag.Empty());
+
+    // the same output as the interpreter, the send in the loop sees a B
+    // then an A
+    auto& stable = *ctx.Get<adt::ScopedTableSpecializer<adt::SymbolTable>>("symbol_table");
+    stringstream out, expected;
+    vm::VM(stable, out).Run(*prog);
+    interp::Interpreter(stable, expected).Run(*prog);
+    assert(out.str() == "10\n11\nb\na\na\na\n55\n");
+    assert(out.str() == expected.str());
+
+    // garbage is freed while the program runs, a list still reachable
+    // is not
+    string listSrc =
+        "class Node {\n"
+        "    next : Node; v : Int;\n"
+        "    init(n : Node, x : Int) : Int { { next <- n; v <- x; } };\n"
+        "    sum() : Int { if isvoid next then v else v + next.sum() fi };\n"
+        "};\n"
+        "class Main inherits IO {\n"
+        "    main() : Object {\n"
+        "        let l : Node, i : Int <- 0 in {\n"
+        "            while i < 2000 loop { let n : Node <- new Node in { n.init(l, i); l <- n; }; i <- i + 1; } pool;\n"
+        "            i <- 0;\n"
+        "            while i < 100000 loop { new Node; i <- i + 1; } pool;\n"
+        "            out_int(l.sum());\n"
+        "        }\n"
+        "    };\n"
+        "};\n";
+    stringstream listStream(listSrc);
+    Parser listParser(diag, tokenizer.Tokenize("", listStream));
+    auto listProg = listParser.ParseProgram();
+    PassContext listCtx(diag);
+    PassManager::Run(listProg, listCtx);
+    assert(diag.Empty());
+    stringstream listOut;
+    vm::VM machine(*listCtx.Get<adt::ScopedTableSpecializer<adt::SymbolTable>>("symbol_table"), listOut);
+    machine.Run(*listProg);
+    assert(listOut.str() == "1999000\n");
+    assert(machine.HeapSize() < 10000);
+}
+
+void TestBuiltins() {
+    string src =
+        "class A { x : Int <- 7; set(v : Int) : Int { x <- v }; get() : Int { x }; };\n"
+        "class Main inherits IO {\n"
+        "    main() : Object {\n"
+        "        let a : A <- new A, b : A <- a.copy(), s : String <- \"hello\" in {\n"
+        "            b.set(9);\n"
+        "            out_int(a.get());\n"
+        "            out_int(b.get());\n"
+        "            out_string(b.type_name());\n"
+        "            out_string(5.type_name());\n"
+        "            s <- s.concat(\" world\");\n"
+        "            out_string(s.substr(4, 3));\n"
+        "            out_int(s.length());\n"
+        "            out_int(in_int() + 1);\n"
+        "            out_string(in_string().concat(\"!\"));\n"
+        "            out_int(in_int());\n"
+        "            s.substr(3, 10);\n"
+        "        }\n"
+        "    };\n"
+        "};\n";
+    stringstream sstream(src);
+    Diagnosis diag;
+    Tokenizer tokenizer(diag);
+    Parser parser(diag, tokenizer.Tokenize("", sstream));
+    auto prog = parser.ParseProgram();
+    PassContext ctx(diag);
+    PassManager::Refresh();
+    PassManager::Register<ana::SemanticChecking>();
+    PassManager::Run(prog, ctx);
+    assert(diag.Empty());
+
+    // the same output from both, up to the substr out of range. in_int
+    // is 0 at the end of the input
+    auto& stable = *ctx.Get<adt::ScopedTableSpecializer<adt::SymbolTable>>("symbol_table");
+    auto run = [&](bool onVM) {
+        stringstream in(" 41\nabc\n"), out;
+        try {
+            if (onVM) vm::VM(stable, out, in).Run(*prog);
+            else interp::Interpreter(stable, out, in).Run(*prog);
+        } catch (runtime_error& e) {
+            out<< e.what();
+        }
+        return out.str();
+    };
+    string expected = "7\n9\nA\nInt\no w\n11\n42\nabc!\n0\nsubstr(3, 10) out of range of a String of length 11";
+    assert(run(false) == expected);
+    assert(run(true) == expected);
+
+    // the names the interpreter resolved are kept on the nodes
+    auto main = prog->GetClassPtr("Main")->GetFuncFeaturePtr(Symbol("main"));
+    auto let = static_cast<repr::Let*>(main->GetExpr());
+    for (uint32_t i = 0; i < let->GetDecls().size(); i++) {
+        auto slot = let->GetDecls().at(i)->GetSlot();
+        assert(slot.kind == repr::Slot::Frame && slot.idx == i);
+    }
+    assert(main->GetFrameSize() == 3);
+}
+
+void TestTieredEngine() {
+    string src =
+        "class Main inherits IO {\n"
+        "    main() : Object {\n"
+        "        let i : Int <- 0, s : Int in {\n"
+        "            while i < 3000 loop { s <- add(s, i); i <- i + 1; } pool;\n"
+        "            out_int(s);\n"
+        "            out_int(fib(20));\n"
+        "        }\n"
+        "    };\n"
+        "    add(a : Int, b : Int) : Int { a + b };\n"
+        "    fib(n : Int) : Int { if n < 2 then n else fib(n + ~1) + fib(n + ~2) fi };\n"
+        "};\n";
+    stringstream sstream(src);
+    Diagnosis diag;
+    Tokenizer tokenizer(diag);
+    Parser parser(diag, tokenizer.Tokenize("", sstream));
+    auto prog = parser.ParseProgram();
+    PassContext ctx(diag);
+    PassManager::Refresh();
+    PassManager::Register<ana::SemanticChecking>();
+    PassManager::Run(prog, ctx);
+    assert(diag.Empty());
+    ana::Devirtualize()(prog, ctx);
+
+    // the same output whenever the hot methods switch to native code
+    auto& stable = *ctx.Get<adt::ScopedTableSpecializer<adt::SymbolTable>>("symbol_table");
+    stringstream hot;
+    tier::TieredEngine hotEngine(stable, hot, 100);
+    hotEngine.Run(*prog);
+    assert(hot.str() == "4498500\n6765\n");
+    assert(hotEngine.Compiled() <= 2);
+
+    // nothing gets hot, nothing is compiled
+    stringstream cold;
+    tier::TieredEngine coldEngine(stable, cold, 1000000);
+    coldEngine.Run(*prog);
+    assert(cold.str() == hot.str());
+    assert(coldEngine.Compiled() == 0);
+
+    // a method with a loop, locals and an assigned arg is compiled too
+    string loopSrc =
+        "class Main inherits IO {\n"
+        "    main() : Object {\n"
+        "        let i : Int <- 0, s : Int in {\n"
+        "            while i < 200 loop { s <- s + sum(i); i <- i + 1; } pool;\n"
+        "            out_int(s);\n"
+        "        }\n"
+        "    };\n"
+        "    sum(n : Int) : Int {\n"
+        "        let s : Int, i : Int <- 0 in { while i < n loop { i <- i + 1; s <- s + i; } pool; n <- s; n; }\n"
+        "    };\n"
+        "};\n";
+    stringstream loopStream(loopSrc);
+    Parser loopParser(diag, tokenizer.Tokenize("", loopStream));
+    auto loopProg = loopParser.ParseProgram();
+    PassContext loopCtx(diag);
+    PassManager::Run(loopProg, loopCtx);
+    assert(diag.Empty());
+    ana::Devirtualize()(loopProg, loopCtx);
+    auto& loopStable = *loopCtx.Get<adt::ScopedTableSpecializer<adt::SymbolTable>>("symbol_table");
+    stringstream loop;
+    tier::TieredEngine loopEngine(loopStable, loop, 100, false);
+    loopEngine.Run(*loopProg);
+    assert(loop.str() == "1333300\n");
+    assert(loopEngine.Compiled() > 0);
+}
+
+void TestGarbageCollector() {
+    struct Cell {
+        CoolObjectHeader header;
+        Cell* next;
+        int64_t value;
+    };
+    // the collector finds the layout before the slots of the vtable
+    static const uint32_t layout[] = {1, offsetof(Cell, next)};
+    static void* vtable[] = {(void*) layout};
+    auto newCell = []() {
+        auto cell = static_cast<Cell*>(cool_gc_alloc(sizeof(Cell)));
+        cell->header.vtable = vtable + 1;
+        return cell;
+    };
+    auto walk = [](Cell* cell) {
+        vector<int64_t> values;
+        for (; cell; cell = cell->next) values.emplace_back(cell->value);
+        return values;
+    };
+
+    // a frame with a single root, as generated code pushes it
+    void* frame[3] = {cool_gc_roots, reinterpret_cast<void*>(1), nullptr};
+    cool_gc_roots = reinterpret_cast<CoolFrame*>(frame);
+    auto& list = reinterpret_cast<Cell*&>(frame[2]);
+
+    // garbage in between the cells, the list moves as it grows
+    for (int64_t i = 0; i < 1000; i++) {
+        cool_gc_alloc(64);
+        auto cell = newCell();
+        cell->value = i;
+        cell->next = list;
+        cool_gc_write_barrier(cell, list);
+        list = cell;
+        if (i % 100 == 0) cool_gc_collect(0);
+    }
+    auto values = walk(list);
+    assert(values.size() == 1000 && values.front() == 999 && values.back() == 0);
+
+    // only an old object points to a young one
+    cool_gc_collect(0);
+    auto young = newCell();
+    young->value = -1;
+    young->next = list->next;
+    list->next = young;
+    cool_gc_write_barrier(list, young);
+    cool_gc_collect(0);
+    assert(list->next->value == -1 && list->next->next->value == 998);
+
+    // cut the list after 500, compaction gives the rest back
+    CoolGCStats before, after;
+    cool_gc_stats(&before);
+    Cell* cell = list;
+    while (cell->value != 500) cell = cell->next;
+    cell->next = nullptr;
+    cool_gc_collect(1);
+    cool_gc_stats(&after);
+    values = walk(list);
+    assert(values.size() == 501 && values.at(1) == -1 && values.back() == 500);
+    // the moved cells got their vtable back and no flag is left set
+    assert(list->header.vtable == vtable + 1 && list->header.size == sizeof(Cell));
+    assert(after.oldUsed < before.oldUsed && after.oldUsed >= values.size() * sizeof(Cell));
+    assert(after.minor >= 12 && after.major >= 1 && after.maxPauseNs <= after.pauseNs);
+
+    // nothing is reachable once the frame is popped
+    cool_gc_roots = static_cast<CoolFrame*>(frame[0]);
+    cool_gc_collect(1);
+    cool_gc_stats(&after);
+    assert(after.oldUsed == 0);
+}
+
+void TestParallelMark() {
+    struct Node {
+        CoolObjectHeader header;
+        Node* left;
+        Node* right;
+        int64_t key;
+    };
+    static const uint32_t layout[] = {2, offsetof(Node, left), offsetof(Node, right)};
+    static void* vtable[] = {(void*) layout};
+    function<int64_t(Node*)> sum = [&](Node* node) -> int64_t {
+        return node ? node->key + sum(node->left) + sum(node->right) : 0;
+    };
+
+    void* frame[4] = {cool_gc_roots, reinterpret_cast<void*>(2), nullptr, nullptr};
+    cool_gc_roots = reinterpret_cast<CoolFrame*>(frame);
+    auto& tree = reinterpret_cast<Node*&>(frame[2]);
+    auto& fresh = reinterpret_cast<Node*&>(frame[3]);
+
+    // a search tree of random keys, some 2M bytes in the old space, so
+    // that it is marked in parallel. Nothing moves while a node is linked.
+    uint64_t seed = 42;
+    int64_t expected = 0;
+    for (int i = 0; i < 50000; i++) {
+        fresh = static_cast<Node*>(cool_gc_alloc(sizeof(Node)));
+        fresh->header.vtable = vtable + 1;
+        cool_gc_alloc(32);
+        seed = seed * 6364136223846793005u + 1442695040888963407u;
+        fresh->key = int64_t(seed >> 40);
+        expected += fresh->key;
+        Node** link = &tree;
+        Node* parent = nullptr;
+        while (*link) {
+            parent = *link;
+            link = fresh->key < parent->key ? &parent->left : &parent->right;
+        }
+        *link = fresh;
+        if (parent) cool_gc_write_barrier(parent, fresh);
+    }
+    fresh = nullptr;
+
+    // the same objects survive however many threads mark
+    cool_gc_set_threads(1);
+    cool_gc_collect(1);
+    CoolGCStats serial, parallel;
+    cool_gc_stats(&serial);
+    assert(sum(tree) == expected);
+    for (unsigned threads : {2, 4, 8}) {
+        cool_gc_set_threads(threads);
+        cool_gc_collect(1);
+        cool_gc_stats(&parallel);
+        assert(parallel.oldUsed == serial.oldUsed);
+        assert(sum(tree) == expected);
+    }
+    assert(parallel.major == serial.major + 3 && parallel.markNs > serial.markNs);
+
+    cool_gc_roots = static_cast<CoolFrame*>(frame[0]);
+    cool_gc_collect(1);
+    cool_gc_stats(&parallel);
+    assert(parallel.oldUsed == 0);
+}
+
+void TestArena() {
+    // the first chunk starts at a huge page
+    auto first = static_cast<char*>(cool_arena_alloc(24));
+    assert(reinterpret_cast<uintptr_t>(first) % (2 << 20) == 0);
+    assert(cool_arena_top == first + 24 && cool_arena_end > cool_arena_top);
+
+    // what generated code bumps on its own follows on
+    auto second = static_cast<char*>(cool_arena_alloc(16));
+    assert(second == first + 24);
+    assert(all_of(second, second + 16, [](char c) { return c == 0; }));
+
+    // a large object leaves the current chunk alone
+    CoolArenaStats before, after;
+    cool_arena_stats(&before);
+    auto large = static_cast<char*>(cool_arena_alloc(before.reserved));
+    assert(reinterpret_cast<uintptr_t>(large) % (2 << 20) == 0);
+    assert(cool_arena_top == second + 16);
+    large[before.reserved - 1] = 1;
+    cool_arena_stats(&after);
+    assert(after.chunks == before.chunks + 1 && after.used == before.used + before.reserved);
+
+    // a full chunk is dropped for a new one
+    auto rest = uint64_t(cool_arena_end - cool_arena_top);
+    cool_arena_alloc(rest - 8);
+    auto next = static_cast<char*>(cool_arena_alloc(16));
+    assert(reinterpret_cast<uintptr_t>(next) % (2 << 20) == 0 && cool_arena_top == next + 16);
+    cool_arena_stats(&after);
+    assert(after.chunks == before.chunks + 2);
+}
+
+void TestVTableLayout() {
+    string src =
+        "class A { f() : Int { 1 }; g() : Int { 2 }; };\n"
+        "class B inherits A { h() : Int { 30 }; g() : Int { 20 }; };\n"
+        "class Main inherits IO {\n"
+        "    call(a : A) : Int { a.g() };\n"
+        "    test() : Int { call(new B) + call(new A) };\n"
+        "    main() : Object { out_int(test()) };\n"
+        "};\n";
+    stringstream sstream(src);
+    Diagnosis diag;
+    Tokenizer tokenizer(diag);
+    Parser parser(diag, tokenizer.Tokenize("", sstream));
+    auto prog = parser.ParseProgram();
+    PassContext ctx(diag);
+    PassManager::Refresh();
+    PassManager::Register<ana::SemanticChecking>();
+    PassManager::Run(prog, ctx);
+    assert(diag.Empty());
+    ana::Devirtualize()(prog, ctx);
+
+    irgen::LLVMGen gen(*ctx.Get<adt::ScopedTableSpecializer<adt::SymbolTable>>("symbol_table"));
+    gen.Visit(*prog);
+    gen.Optimize(irgen::LLVMGen::OptLevel::O2);
+    vector<string> names = {
+        gen.FunctionName(Symbol("f"), Symbol("A")),
+        gen.FunctionName(Symbol("g"), Symbol("A")),
+        gen.FunctionName(Symbol("g"), Symbol("B")),
+        gen.FunctionName(Symbol("h"), Symbol("B")),
+        gen.FunctionName(Symbol("test"), Symbol("Main")),
+    };
+    auto jit = irgen::LLVMGen::CreateJIT();
+    gen.AddTo(*jit);
+    vector<void*> functions;
+    for (auto& name : names) functions.emplace_back(irgen::LLVMGen::Lookup(*jit, name));
+
+    // the parent's slots come first, an override takes over the slot of
+    // the method it overrides, new methods are appended. They follow the
+    // name of the class and the layout of its objects. Object's abort,
+    // type_name and copy take the first three.
+    auto a = static_cast<void**>(irgen::LLVMGen::Lookup(*jit, "A" + constant::CG_VTABLE_SUFFIX)) + 5;
+    auto b = static_cast<void**>(irgen::LLVMGen::Lookup(*jit, "B" + constant::CG_VTABLE_SUFFIX)) + 5;
+    assert(a[0] == functions[0] && a[1] == functions[1]);
+    assert(b[0] == functions[0] && b[1] == functions[2] && b[2] == functions[3]);
+
+    // a call on an A dispatches to the override of a B
+    auto test = reinterpret_cast<int32_t (*)(void*)>(functions[4]);
+    assert(test(nullptr) == 20 + 2);
+}
+
+void TestObjectHeader() {
+    string src =
+        "class A { next : A; };\n"
+        "class B inherits A { n : Int; };\n"
+        "class C inherits B { };\n"
+        "class D inherits A { };\n"
+        "class Main inherits IO {\n"
+        "    hi() : String { \"hi\" };\n"
+        "    boxed() : Object { 7 };\n"
+        "    twin(a : A) : A { a.copy() };\n"
+        "    name(a : A) : String { a.type_name() };\n"
+        "    main() : Object { out_int(1) };\n"
+        "};\n";
+    stringstream sstream(src);
+    Diagnosis diag;
+    Tokenizer tokenizer(diag);
+    Parser parser(diag, tokenizer.Tokenize("", sstream));
+    auto prog = parser.ParseProgram();
+    PassContext ctx(diag);
+    PassManager::Refresh();
+    PassManager::Register<ana::SemanticChecking>();
+    PassManager::Run(prog, ctx);
+    assert(diag.Empty());
+
+    // pre-order from Object, children by name, a subtree is a range
+    irgen::LLVMGen gen(*ctx.Get<adt::ScopedTableSpecializer<adt::SymbolTable>>("symbol_table"));
+    gen.Visit(*prog);
+    using Range = pair<uint32_t, uint32_t>;
+    assert(gen.ClassIdRange(Symbol("Object")) == Range(0, 9));
+    assert(gen.ClassIdRange(Symbol("A")) == Range(1, 4));
+    assert(gen.ClassIdRange(Symbol("B")) == Range(2, 3));
+    assert(gen.ClassIdRange(Symbol("C")) == Range(3, 3));
+    assert(gen.ClassIdRange(Symbol("D")) == Range(4, 4));
+    assert(gen.ClassIdRange(Symbol("Bool")) == Range(5, 5));
+    assert(gen.ClassIdRange(Symbol("IO")) == Range(6, 7));
+    assert(gen.ClassIdRange(Symbol("Main")) == Range(7, 7));
+    assert(gen.ClassIdRange(Symbol("Int")) == Range(8, 8));
+    assert(gen.ClassIdRange(Symbol("String")) == Range(9, 9));
+
+    auto hiName = gen.FunctionName(Symbol("hi"), Symbol("Main"));
+    auto boxedName = gen.FunctionName(Symbol("boxed"), Symbol("Main"));
+    auto twinName = gen.FunctionName(Symbol("twin"), Symbol("Main"));
+    auto nameName = gen.FunctionName(Symbol("name"), Symbol("Main"));
+    auto jit = irgen::LLVMGen::CreateJIT();
+    gen.AddTo(*jit);
+    auto vtableOf = [&](const string& cls) {
+        return static_cast<void**>(irgen::LLVMGen::Lookup(*jit, cls + constant::CG_VTABLE_SUFFIX)) + 2;
+    };
+
+    // the layout of an object precedes the slots its vtable points to,
+    // and no flag of the collector is set in its size
+    auto b = reinterpret_cast<CoolObjectHeader* (*)()>(irgen::LLVMGen::Lookup(*jit, "B"))();
+    assert(sizeof(CoolObjectHeader) == 16);
+    assert(b->classId == 2 && b->size == sizeof(CoolObjectHeader) + 16);
+    assert(b->vtable == vtableOf("B"));
+    auto layout = static_cast<const uint32_t*>(b->vtable[-1]);
+    assert(layout[0] == 1 && layout[1] == sizeof(CoolObjectHeader));
+
+    // a String and a boxed Int have the header too, their values follow
+    auto hi = reinterpret_cast<CoolObjectHeader* (*)(void*)>(irgen::LLVMGen::Lookup(*jit, hiName))(nullptr);
+    auto chars = reinterpret_cast<char*>(hi + 1);
+    assert(hi->classId == 9 && hi->vtable == vtableOf("String"));
+    assert(*reinterpret_cast<int32_t*>(chars) == 2 && string(chars + 4) == "hi");
+    assert(hi->size == (sizeof(CoolObjectHeader) + 4 + 3 + 7) / 8 * 8);
+    auto boxed = reinterpret_cast<CoolObjectHeader* (*)(void*)>(irgen::LLVMGen::Lookup(*jit, boxedName))(nullptr);
+    assert(boxed->classId == 8 && boxed->vtable == vtableOf("Int"));
+    assert(*reinterpret_cast<int32_t*>(boxed + 1) == 7);
+    assert(static_cast<const uint32_t*>(boxed->vtable[-1])[0] == 0);
+
+    // type_name is the String before the layout, copy a new object of the
+    // same size with the fields of the original
+    auto name = reinterpret_cast<CoolObjectHeader* (*)(void*, void*)>(irgen::LLVMGen::Lookup(*jit, nameName))(nullptr, b);
+    assert(name == b->vtable[-2] && name->classId == 9 && name->vtable == vtableOf("String"));
+    assert(string(reinterpret_cast<char*>(name + 1) + 4) == "B");
+    reinterpret_cast<void**>(b + 1)[0] = b;
+    auto twin = reinterpret_cast<CoolObjectHeader* (*)(void*, void*)>(irgen::LLVMGen::Lookup(*jit, twinName))(nullptr, b);
+    assert(twin != b && twin->classId == 2 && twin->size == b->size && twin->vtable == b->vtable);
+    assert(reinterpret_cast<void**>(twin + 1)[0] == b);
+}
+
+void TestCaseDispatch() {
+    string src =
+        "class A { id() : Int { 1 }; };\n"
+        "class B inherits A { id() : Int { 2 }; };\n"
+        "class C inherits B { id() : Int { 3 }; };\n"
+        "class D inherits A { id() : Int { 4 }; };\n"
+        "class Main inherits IO {\n"
+        "    pick(o : Object) : Int {\n"
+        "        case o of x : Object => 0; y : A => 10 + y.id(); z : C => 100 + z.id(); w : D => 1000; esac\n"
+        "    };\n"
+        "    test() : Int {\n"
+        "        pick(new Main) + pick(new A) + pick(new B) + pick(new C) + pick(new D)\n"
+        "    };\n"
+        "    kind(o : Object) : Int {\n"
+        "        case o of x : Object => 0; s : String => 20000; i : Int => 30000 + i;\n"
+        "            b : Bool => if b then 40000 else 50000 fi; esac\n"
+        "    };\n"
+        "    five() : Object { case 5 of x : Object => x; esac };\n"
+        "    values() : Int {\n"
+        "        let o : Object <- true in\n"
+        "            kind(\"hi\") + kind(1) + kind(o) + kind(new Main) + kind(five())\n"
+        "    };\n"
+        "    main() : Object { out_int(test()) };\n"
+        "};\n";
+    stringstream sstream(src);
+    Diagnosis diag;
+    Tokenizer tokenizer(diag);
+    Parser parser(diag, tokenizer.Tokenize("", sstream));
+    auto prog = parser.ParseProgram();
+    PassContext ctx(diag);
+    PassManager::Refresh();
+    PassManager::Register<ana::SemanticChecking>();
+    PassManager::Run(prog, ctx);
+    assert(diag.Empty());
+    ana::Devirtualize()(prog, ctx);
+
+    // every object takes the branch of its closest ancestor, test calls
+    // nothing on its self
+    irgen::LLVMGen gen(*ctx.Get<adt::ScopedTableSpecializer<adt::SymbolTable>>("symbol_table"));
+    gen.Visit(*prog);
+    gen.Optimize(irgen::LLVMGen::OptLevel::O2);
+    auto name = gen.FunctionName(Symbol("test"), Symbol("Main"));
+    auto jit = irgen::LLVMGen::CreateJIT();
+    gen.AddTo(*jit);
+    auto test = reinterpret_cast<int32_t (*)(void*)>(irgen::LLVMGen::Lookup(*jit, name));
+    assert(test(nullptr) == 0 + 11 + 12 + 103 + 1000);
+
+    // a String has a header too, an Int or a Bool is boxed when bound to
+    // an Object and unboxed when its branch matches
+    auto values = reinterpret_cast<int32_t (*)(void*)>(
+        irgen::LLVMGen::Lookup(*jit, gen.FunctionName(Symbol("values"), Symbol("Main"))));
+    assert(values(nullptr) == 20000 + 30001 + 40000 + 0 + 30005);
+
+    // the types of branches must differ, not their values
+    stringstream duplicate(
+        "class Main inherits IO {\n"
+        "    pick(o : Object) : Int { case o of x : Main => 1; y : Main => 2; esac };\n"
+        "    main() : Object { out_int(pick(new Main)) };\n"
+        "};\n");
+    Diagnosis dupDiag;
+    Tokenizer dupTokenizer(dupDiag);
+    Parser dupParser(dupDiag, dupTokenizer.Tokenize("", duplicate));
+    auto dupProg = dupParser.ParseProgram();
+    PassContext dupCtx(dupDiag);
+    PassManager::Refresh();
+    PassManager::Register<ana::SemanticChecking>();
+    PassManager::Run(dupProg, dupCtx);
+    assert(!dupDiag.Empty());
+}
+
 void TestFrontEnd() {
     string filename = "../test/data/test_program";
     fstream file;
@@ -669,6 +1782,7 @@ void TestFrontEnd() {
 
 int main() {
     TestProgram();
+    TestAstArena();
 
     TestMatchMultiple();
 
@@ -695,11 +1809,33 @@ int main() {
     TestTokSpecial();
     TestTokenizer();
     TestTokComment();
+    TestScan();
+    TestScanKernels();
 
     TestRegisterPass();
     TestRequiredPass();
     TestPassManager();
     TestVirtualTable();
+    TestExprVisitor();
+
+    TestSymbol();
+    TestTypeAdvisor();
+    TestSymbolTable();
+    TestFingerprint();
+    TestParallelPasses();
+    TestInheritedFeatures();
+    TestDevirtualize();
+    TestSpeculateReceivers();
+    TestInterpreter();
+    TestVM();
+    TestBuiltins();
+    TestTieredEngine();
+    TestGarbageCollector();
+    TestParallelMark();
+    TestArena();
+    TestVTableLayout();
+    TestObjectHeader();
+    TestCaseDispatch();
 
 //    TestFrontEnd();
 }
\ No newline at end of file
@@ -110,6 +110,7 @@ struct ParserTestCase {
 };
 
 void TestProgram();
+void TestAstArena();
 
 void TestParseID();
 void TestParseNew();
@@ -146,12 +147,36 @@ struct TokenizerTestCase {
 
 void TestTokenizer();
 
+void TestScan();
+void TestScanKernels();
+
 void TestRegisterPass();
 void TestRequiredPass();
 void TestPassManager();
 
 void TestVirtualTable();
 
+void TestExprVisitor();
+
+void TestSymbol();
+void TestTypeAdvisor();
+void TestSymbolTable();
+void TestFingerprint();
+void TestParallelPasses();
+void TestInheritedFeatures();
+void TestDevirtualize();
+void TestSpeculateReceivers();
+void TestInterpreter();
+void TestVM();
+void TestBuiltins();
+void TestTieredEngine();
+void TestGarbageCollector();
+void TestParallelMark();
+void TestArena();
+void TestVTableLayout();
+void TestObjectHeader();
+void TestCaseDispatch();
+
 void TestSemanticCheckingPasses();
 
 void TestFrontEnd();